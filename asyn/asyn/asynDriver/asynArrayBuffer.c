@@ -0,0 +1,125 @@
+/* asynArrayBuffer.c */
+/***********************************************************************
+* Copyright (c) 2002 The University of Chicago, as Operator of Argonne
+* National Laboratory, and the Regents of the University of
+* California, as Operator of Los Alamos National Laboratory, and
+* Berliner Elektronenspeicherring-Gesellschaft m.b.H. (BESSY).
+* asynDriver is distributed subject to a Software License Agreement
+* found in file LICENSE that is included with this distribution.
+***********************************************************************/
+
+#include <stdlib.h>
+
+#include <cantProceed.h>
+#include <epicsAssert.h>
+#include <epicsMutex.h>
+#include <epicsThread.h>
+
+#include "asynArrayBuffer.h"
+
+struct asynArrayBuffer {
+    void                *pData;
+    size_t              nBytes;
+    int                 refCount;
+    asynArrayBufferFree freeFunc;
+    void                *freePvt;
+};
+
+/* Ensure the data after the header is aligned for any type */
+#define BUFFER_HEADER_SIZE (((sizeof(asynArrayBuffer)+15)/16)*16)
+
+static epicsThreadOnceId onceId = EPICS_THREAD_ONCE_INIT;
+static epicsMutexId refCountLock;
+static epicsThreadPrivateId postedId;
+
+static void arrayBufferInit(void *arg)
+{
+    refCountLock = epicsMutexMustCreate();
+    postedId = epicsThreadPrivateCreate();
+}
+
+asynArrayBuffer *asynArrayBufferAlloc(size_t nBytes)
+{
+    asynArrayBuffer *pBuffer;
+
+    epicsThreadOnce(&onceId, arrayBufferInit, 0);
+    pBuffer = mallocMustSucceed(BUFFER_HEADER_SIZE + nBytes, "asynArrayBufferAlloc");
+    pBuffer->pData = (char *)pBuffer + BUFFER_HEADER_SIZE;
+    pBuffer->nBytes = nBytes;
+    pBuffer->refCount = 1;
+    pBuffer->freeFunc = 0;
+    pBuffer->freePvt = 0;
+    return pBuffer;
+}
+
+asynArrayBuffer *asynArrayBufferWrap(void *pData, size_t nBytes,
+                                     asynArrayBufferFree freeFunc, void *freePvt)
+{
+    asynArrayBuffer *pBuffer;
+
+    epicsThreadOnce(&onceId, arrayBufferInit, 0);
+    pBuffer = mallocMustSucceed(sizeof(asynArrayBuffer), "asynArrayBufferWrap");
+    pBuffer->pData = pData;
+    pBuffer->nBytes = nBytes;
+    pBuffer->refCount = 1;
+    pBuffer->freeFunc = freeFunc;
+    pBuffer->freePvt = freePvt;
+    return pBuffer;
+}
+
+void *asynArrayBufferData(asynArrayBuffer *pBuffer)
+{
+    return pBuffer->pData;
+}
+
+size_t asynArrayBufferSize(asynArrayBuffer *pBuffer)
+{
+    return pBuffer->nBytes;
+}
+
+void asynArrayBufferReserve(asynArrayBuffer *pBuffer)
+{
+    epicsMutexMustLock(refCountLock);
+    assert(pBuffer->refCount > 0);
+    pBuffer->refCount++;
+    epicsMutexUnlock(refCountLock);
+}
+
+void asynArrayBufferRelease(asynArrayBuffer *pBuffer)
+{
+    int refCount;
+
+    epicsMutexMustLock(refCountLock);
+    assert(pBuffer->refCount > 0);
+    refCount = --pBuffer->refCount;
+    epicsMutexUnlock(refCountLock);
+    if (refCount > 0) return;
+    if (pBuffer->freeFunc) pBuffer->freeFunc(pBuffer->freePvt, pBuffer->pData);
+    free(pBuffer);
+}
+
+asynArrayBuffer *asynArrayBufferSetPosted(asynArrayBuffer *pBuffer)
+{
+    asynArrayBuffer *pPrevious;
+
+    epicsThreadOnce(&onceId, arrayBufferInit, 0);
+    pPrevious = epicsThreadPrivateGet(postedId);
+    epicsThreadPrivateSet(postedId, pBuffer);
+    return pPrevious;
+}
+
+asynArrayBuffer *asynArrayBufferReservePosted(const void *pData)
+{
+    asynArrayBuffer *pBuffer;
+    const char *pStart;
+
+    /* No buffer has ever been created, so none can be posted */
+    if (!postedId) return 0;
+    pBuffer = epicsThreadPrivateGet(postedId);
+    if (!pBuffer) return 0;
+    pStart = pBuffer->pData;
+    if ((const char *)pData < pStart || (const char *)pData >= pStart + pBuffer->nBytes)
+        return 0;
+    asynArrayBufferReserve(pBuffer);
+    return pBuffer;
+}
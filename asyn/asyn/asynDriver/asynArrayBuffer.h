@@ -0,0 +1,66 @@
+/*asynArrayBuffer.h*/
+/***********************************************************************
+* Copyright (c) 2002 The University of Chicago, as Operator of Argonne
+* National Laboratory, and the Regents of the University of
+* California, as Operator of Los Alamos National Laboratory, and
+* Berliner Elektronenspeicherring-Gesellschaft m.b.H. (BESSY).
+* asynDriver is distributed subject to a Software License Agreement
+* found in file LICENSE that is included with this distribution.
+***********************************************************************/
+
+#ifndef asynArrayBufferH
+#define asynArrayBufferH
+
+#include <stddef.h>
+#include "asynAPI.h"
+
+/*
+ * Reference counted array buffers, so that array interrupt callbacks can
+ * share the data of a large array instead of copying it.
+ *
+ * The standard array interrupt callbacks still receive a plain pointer.
+ * A driver that wants its data to be shared puts it in an asynArrayBuffer,
+ * marks the buffer as posted while it calls the interrupt callbacks, and
+ * does not change the data afterwards. A client that wants to keep the
+ * data after its callback returns calls asynArrayBufferReservePosted with
+ * the pointer it was given. If that pointer is in the posted buffer the
+ * client gets a reference and must call asynArrayBufferRelease when done.
+ * Otherwise it must copy the data as before.
+ *
+ * Example, in a driver:
+ *     asynArrayBuffer *pBuffer = asynArrayBufferAlloc(n*sizeof(epicsInt16));
+ *     readCamera((epicsInt16 *)asynArrayBufferData(pBuffer), n);
+ *     pPrevious = asynArrayBufferSetPosted(pBuffer);
+ *     pasynInt16ArrayCallbacks...(data, n) for each client
+ *     asynArrayBufferSetPosted(pPrevious);
+ *     asynArrayBufferRelease(pBuffer);
+ * asynPortDriver::doCallbacksArrayBuffer does the middle part.
+ */
+
+typedef struct asynArrayBuffer asynArrayBuffer;
+typedef void (*asynArrayBufferFree)(void *freePvt, void *pData);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Both return a buffer with one reference, held by the caller */
+ASYN_API asynArrayBuffer *asynArrayBufferAlloc(size_t nBytes);
+/* freeFunc is called with freePvt and pData when the last reference is released */
+ASYN_API asynArrayBuffer *asynArrayBufferWrap(void *pData, size_t nBytes,
+                                              asynArrayBufferFree freeFunc, void *freePvt);
+ASYN_API void   *asynArrayBufferData(asynArrayBuffer *pBuffer);
+ASYN_API size_t asynArrayBufferSize(asynArrayBuffer *pBuffer);
+ASYN_API void   asynArrayBufferReserve(asynArrayBuffer *pBuffer);
+ASYN_API void   asynArrayBufferRelease(asynArrayBuffer *pBuffer);
+/* Sets the buffer posted by the calling thread and returns the previous one */
+ASYN_API asynArrayBuffer *asynArrayBufferSetPosted(asynArrayBuffer *pBuffer);
+/* Returns the buffer posted by the calling thread with a new reference,
+ * or NULL if pData is not in it */
+ASYN_API asynArrayBuffer *asynArrayBufferReservePosted(const void *pData);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* asynArrayBufferH */
@@ -0,0 +1,363 @@
+/* asynArrayConvert.c */
+/***********************************************************************
+* Copyright (c) 2002 The University of Chicago, as Operator of Argonne
+* National Laboratory, and the Regents of the University of
+* California, as Operator of Los Alamos National Laboratory, and
+* Berliner Elektronenspeicherring-Gesellschaft m.b.H. (BESSY).
+* asynDriver is distributed subject to a Software License Agreement
+* found in file LICENSE that is included with this distribution.
+***********************************************************************/
+
+#include <string.h>
+
+#include <epicsTypes.h>
+#include <epicsThread.h>
+
+#include "asynDriver.h"
+#include "asynArrayConvert.h"
+
+/* SSE2 is part of the x86_64 instruction set, so it is used whenever the compiler has it.
+ * AVX2 is only used if the CPU reports it, so it needs a compiler that can build
+ * individual functions for it. */
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ARRAY_CONVERT_SSE2
+#include <emmintrin.h>
+#define SSE2_FUNC static
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#define ARRAY_CONVERT_AVX2
+#include <immintrin.h>
+#define AVX2_FUNC static __attribute__((target("avx2")))
+#endif
+
+#define ARRAY_CONVERT_SRC_TYPES(M) \
+    M(Int8, epicsInt8) M(UInt8, epicsUInt8) M(Int16, epicsInt16) M(UInt16, epicsUInt16) \
+    M(Int32, epicsInt32) M(UInt32, epicsUInt32) M(Int64, epicsInt64) M(UInt64, epicsUInt64) \
+    M(Float32, epicsFloat32) M(Float64, epicsFloat64)
+
+#define ARRAY_CONVERT_DST_TYPES(M, SN, ST) \
+    M(SN, ST, Int8, epicsInt8) M(SN, ST, UInt8, epicsUInt8) \
+    M(SN, ST, Int16, epicsInt16) M(SN, ST, UInt16, epicsUInt16) \
+    M(SN, ST, Int32, epicsInt32) M(SN, ST, UInt32, epicsUInt32) \
+    M(SN, ST, Int64, epicsInt64) M(SN, ST, UInt64, epicsUInt64) \
+    M(SN, ST, Float32, epicsFloat32) M(SN, ST, Float64, epicsFloat64)
+
+/* Scalar conversions for every pair of types */
+#define SCALAR_FUNC(SN, ST, DN, DT) \
+static void convert##SN##To##DN(const void *src, void *dst, size_t nElements) \
+{ \
+    const ST *s = (const ST *)src; \
+    DT *d = (DT *)dst; \
+    size_t i; \
+    for (i=0; i<nElements; i++) d[i] = (DT)s[i]; \
+}
+#define SCALAR_FUNCS(SN, ST) ARRAY_CONVERT_DST_TYPES(SCALAR_FUNC, SN, ST)
+ARRAY_CONVERT_SRC_TYPES(SCALAR_FUNCS)
+
+#define SCALAR_ENTRY(SN, ST, DN, DT) convert##SN##To##DN,
+#define SCALAR_ROW(SN, ST) { ARRAY_CONVERT_DST_TYPES(SCALAR_ENTRY, SN, ST) },
+static const asynArrayConvertFunc scalarTable[asynArrayNumTypes][asynArrayNumTypes] = {
+    ARRAY_CONVERT_SRC_TYPES(SCALAR_ROW)
+};
+
+/* Conversions between types of the same size, including signed to unsigned, copy the bits */
+static void copy1(const void *src, void *dst, size_t nElements) { memcpy(dst, src, nElements); }
+static void copy2(const void *src, void *dst, size_t nElements) { memcpy(dst, src, nElements*2); }
+static void copy4(const void *src, void *dst, size_t nElements) { memcpy(dst, src, nElements*4); }
+static void copy8(const void *src, void *dst, size_t nElements) { memcpy(dst, src, nElements*8); }
+
+typedef struct convertEntry {
+    asynArrayType        srcType;
+    asynArrayType        dstType;
+    asynArrayConvertFunc func;
+} convertEntry;
+
+static const convertEntry copyEntries[] = {
+    {asynArrayInt8,    asynArrayInt8,    copy1}, {asynArrayInt8,    asynArrayUInt8,   copy1},
+    {asynArrayUInt8,   asynArrayInt8,    copy1}, {asynArrayUInt8,   asynArrayUInt8,   copy1},
+    {asynArrayInt16,   asynArrayInt16,   copy2}, {asynArrayInt16,   asynArrayUInt16,  copy2},
+    {asynArrayUInt16,  asynArrayInt16,   copy2}, {asynArrayUInt16,  asynArrayUInt16,  copy2},
+    {asynArrayInt32,   asynArrayInt32,   copy4}, {asynArrayInt32,   asynArrayUInt32,  copy4},
+    {asynArrayUInt32,  asynArrayInt32,   copy4}, {asynArrayUInt32,  asynArrayUInt32,  copy4},
+    {asynArrayInt64,   asynArrayInt64,   copy8}, {asynArrayInt64,   asynArrayUInt64,  copy8},
+    {asynArrayUInt64,  asynArrayInt64,   copy8}, {asynArrayUInt64,  asynArrayUInt64,  copy8},
+    {asynArrayFloat32, asynArrayFloat32, copy4}, {asynArrayFloat64, asynArrayFloat64, copy8}
+};
+
+/* The vector kernels convert 16 elements per loop and do the remainder with a scalar loop.
+ * Integer sources are first widened to 32-bit integers, which are exact in epicsFloat64
+ * and rounded to nearest in epicsFloat32, the same as the C conversion. */
+#define VECTOR_FUNC(FUNC, ISA, SN, ST, DN, DT) \
+FUNC void ISA##SN##To##DN(const void *src, void *dst, size_t nElements) \
+{ \
+    const ST *s = (const ST *)src; \
+    DT *d = (DT *)dst; \
+    size_t i; \
+    for (i=0; i+16<=nElements; i+=16) ISA##Convert16##SN##To##DN(s+i, d+i); \
+    for (; i<nElements; i++) d[i] = (DT)s[i]; \
+}
+
+#ifdef ARRAY_CONVERT_SSE2
+
+/* Load 16 elements as four vectors of 4 epicsInt32 */
+static void sse2LoadInt8(const epicsInt8 *s, __m128i x[4])
+{
+    __m128i v = _mm_loadu_si128((const __m128i *)s);
+    __m128i lo = _mm_unpacklo_epi8(v, v), hi = _mm_unpackhi_epi8(v, v);
+    x[0] = _mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 24);
+    x[1] = _mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 24);
+    x[2] = _mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 24);
+    x[3] = _mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 24);
+}
+
+static void sse2LoadUInt8(const epicsUInt8 *s, __m128i x[4])
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i v = _mm_loadu_si128((const __m128i *)s);
+    __m128i lo = _mm_unpacklo_epi8(v, zero), hi = _mm_unpackhi_epi8(v, zero);
+    x[0] = _mm_unpacklo_epi16(lo, zero);
+    x[1] = _mm_unpackhi_epi16(lo, zero);
+    x[2] = _mm_unpacklo_epi16(hi, zero);
+    x[3] = _mm_unpackhi_epi16(hi, zero);
+}
+
+static void sse2LoadInt16(const epicsInt16 *s, __m128i x[4])
+{
+    __m128i v0 = _mm_loadu_si128((const __m128i *)s);
+    __m128i v1 = _mm_loadu_si128((const __m128i *)(s+8));
+    x[0] = _mm_srai_epi32(_mm_unpacklo_epi16(v0, v0), 16);
+    x[1] = _mm_srai_epi32(_mm_unpackhi_epi16(v0, v0), 16);
+    x[2] = _mm_srai_epi32(_mm_unpacklo_epi16(v1, v1), 16);
+    x[3] = _mm_srai_epi32(_mm_unpackhi_epi16(v1, v1), 16);
+}
+
+static void sse2LoadUInt16(const epicsUInt16 *s, __m128i x[4])
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i v0 = _mm_loadu_si128((const __m128i *)s);
+    __m128i v1 = _mm_loadu_si128((const __m128i *)(s+8));
+    x[0] = _mm_unpacklo_epi16(v0, zero);
+    x[1] = _mm_unpackhi_epi16(v0, zero);
+    x[2] = _mm_unpacklo_epi16(v1, zero);
+    x[3] = _mm_unpackhi_epi16(v1, zero);
+}
+
+static void sse2LoadInt32(const epicsInt32 *s, __m128i x[4])
+{
+    int j;
+    for (j=0; j<4; j++) x[j] = _mm_loadu_si128((const __m128i *)(s+4*j));
+}
+
+#define SSE2_FROM_INT32(SN, ST) \
+static void sse2Convert16##SN##ToFloat32(const ST *s, epicsFloat32 *d) \
+{ \
+    __m128i x[4]; \
+    int j; \
+    sse2Load##SN(s, x); \
+    for (j=0; j<4; j++) _mm_storeu_ps(d+4*j, _mm_cvtepi32_ps(x[j])); \
+} \
+static void sse2Convert16##SN##ToFloat64(const ST *s, epicsFloat64 *d) \
+{ \
+    __m128i x[4]; \
+    int j; \
+    sse2Load##SN(s, x); \
+    for (j=0; j<4; j++) { \
+        _mm_storeu_pd(d+4*j,   _mm_cvtepi32_pd(x[j])); \
+        _mm_storeu_pd(d+4*j+2, _mm_cvtepi32_pd(_mm_unpackhi_epi64(x[j], x[j]))); \
+    } \
+} \
+VECTOR_FUNC(SSE2_FUNC, sse2, SN, ST, Float32, epicsFloat32) \
+VECTOR_FUNC(SSE2_FUNC, sse2, SN, ST, Float64, epicsFloat64)
+
+SSE2_FROM_INT32(Int8, epicsInt8)
+SSE2_FROM_INT32(UInt8, epicsUInt8)
+SSE2_FROM_INT32(Int16, epicsInt16)
+SSE2_FROM_INT32(UInt16, epicsUInt16)
+SSE2_FROM_INT32(Int32, epicsInt32)
+
+static void sse2Convert16Float32ToFloat64(const epicsFloat32 *s, epicsFloat64 *d)
+{
+    int j;
+    for (j=0; j<4; j++) {
+        __m128 v = _mm_loadu_ps(s+4*j);
+        _mm_storeu_pd(d+4*j,   _mm_cvtps_pd(v));
+        _mm_storeu_pd(d+4*j+2, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+    }
+}
+VECTOR_FUNC(SSE2_FUNC, sse2, Float32, epicsFloat32, Float64, epicsFloat64)
+
+static void sse2Convert16Float64ToFloat32(const epicsFloat64 *s, epicsFloat32 *d)
+{
+    int j;
+    for (j=0; j<4; j++) {
+        __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(s+4*j));
+        __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(s+4*j+2));
+        _mm_storeu_ps(d+4*j, _mm_movelh_ps(lo, hi));
+    }
+}
+VECTOR_FUNC(SSE2_FUNC, sse2, Float64, epicsFloat64, Float32, epicsFloat32)
+
+static const convertEntry sse2Entries[] = {
+    {asynArrayInt8,    asynArrayFloat32, sse2Int8ToFloat32},
+    {asynArrayInt8,    asynArrayFloat64, sse2Int8ToFloat64},
+    {asynArrayUInt8,   asynArrayFloat32, sse2UInt8ToFloat32},
+    {asynArrayUInt8,   asynArrayFloat64, sse2UInt8ToFloat64},
+    {asynArrayInt16,   asynArrayFloat32, sse2Int16ToFloat32},
+    {asynArrayInt16,   asynArrayFloat64, sse2Int16ToFloat64},
+    {asynArrayUInt16,  asynArrayFloat32, sse2UInt16ToFloat32},
+    {asynArrayUInt16,  asynArrayFloat64, sse2UInt16ToFloat64},
+    {asynArrayInt32,   asynArrayFloat32, sse2Int32ToFloat32},
+    {asynArrayInt32,   asynArrayFloat64, sse2Int32ToFloat64},
+    {asynArrayFloat32, asynArrayFloat64, sse2Float32ToFloat64},
+    {asynArrayFloat64, asynArrayFloat32, sse2Float64ToFloat32}
+};
+
+#endif /* ARRAY_CONVERT_SSE2 */
+
+#ifdef ARRAY_CONVERT_AVX2
+
+/* Load 16 elements as two vectors of 8 epicsInt32 */
+AVX2_FUNC void avx2LoadInt8(const epicsInt8 *s, __m256i x[2])
+{
+    x[0] = _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *)s));
+    x[1] = _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *)(s+8)));
+}
+
+AVX2_FUNC void avx2LoadUInt8(const epicsUInt8 *s, __m256i x[2])
+{
+    x[0] = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)s));
+    x[1] = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(s+8)));
+}
+
+AVX2_FUNC void avx2LoadInt16(const epicsInt16 *s, __m256i x[2])
+{
+    x[0] = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)s));
+    x[1] = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(s+8)));
+}
+
+AVX2_FUNC void avx2LoadUInt16(const epicsUInt16 *s, __m256i x[2])
+{
+    x[0] = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)s));
+    x[1] = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(s+8)));
+}
+
+AVX2_FUNC void avx2LoadInt32(const epicsInt32 *s, __m256i x[2])
+{
+    x[0] = _mm256_loadu_si256((const __m256i *)s);
+    x[1] = _mm256_loadu_si256((const __m256i *)(s+8));
+}
+
+#define AVX2_FROM_INT32(SN, ST) \
+AVX2_FUNC void avx2Convert16##SN##ToFloat32(const ST *s, epicsFloat32 *d) \
+{ \
+    __m256i x[2]; \
+    avx2Load##SN(s, x); \
+    _mm256_storeu_ps(d,   _mm256_cvtepi32_ps(x[0])); \
+    _mm256_storeu_ps(d+8, _mm256_cvtepi32_ps(x[1])); \
+} \
+AVX2_FUNC void avx2Convert16##SN##ToFloat64(const ST *s, epicsFloat64 *d) \
+{ \
+    __m256i x[2]; \
+    int j; \
+    avx2Load##SN(s, x); \
+    for (j=0; j<2; j++) { \
+        _mm256_storeu_pd(d+8*j,   _mm256_cvtepi32_pd(_mm256_castsi256_si128(x[j]))); \
+        _mm256_storeu_pd(d+8*j+4, _mm256_cvtepi32_pd(_mm256_extracti128_si256(x[j], 1))); \
+    } \
+} \
+VECTOR_FUNC(AVX2_FUNC, avx2, SN, ST, Float32, epicsFloat32) \
+VECTOR_FUNC(AVX2_FUNC, avx2, SN, ST, Float64, epicsFloat64)
+
+AVX2_FROM_INT32(Int8, epicsInt8)
+AVX2_FROM_INT32(UInt8, epicsUInt8)
+AVX2_FROM_INT32(Int16, epicsInt16)
+AVX2_FROM_INT32(UInt16, epicsUInt16)
+AVX2_FROM_INT32(Int32, epicsInt32)
+
+AVX2_FUNC void avx2Convert16Float32ToFloat64(const epicsFloat32 *s, epicsFloat64 *d)
+{
+    int j;
+    for (j=0; j<4; j++) _mm256_storeu_pd(d+4*j, _mm256_cvtps_pd(_mm_loadu_ps(s+4*j)));
+}
+VECTOR_FUNC(AVX2_FUNC, avx2, Float32, epicsFloat32, Float64, epicsFloat64)
+
+AVX2_FUNC void avx2Convert16Float64ToFloat32(const epicsFloat64 *s, epicsFloat32 *d)
+{
+    int j;
+    for (j=0; j<4; j++) _mm_storeu_ps(d+4*j, _mm256_cvtpd_ps(_mm256_loadu_pd(s+4*j)));
+}
+VECTOR_FUNC(AVX2_FUNC, avx2, Float64, epicsFloat64, Float32, epicsFloat32)
+
+static const convertEntry avx2Entries[] = {
+    {asynArrayInt8,    asynArrayFloat32, avx2Int8ToFloat32},
+    {asynArrayInt8,    asynArrayFloat64, avx2Int8ToFloat64},
+    {asynArrayUInt8,   asynArrayFloat32, avx2UInt8ToFloat32},
+    {asynArrayUInt8,   asynArrayFloat64, avx2UInt8ToFloat64},
+    {asynArrayInt16,   asynArrayFloat32, avx2Int16ToFloat32},
+    {asynArrayInt16,   asynArrayFloat64, avx2Int16ToFloat64},
+    {asynArrayUInt16,  asynArrayFloat32, avx2UInt16ToFloat32},
+    {asynArrayUInt16,  asynArrayFloat64, avx2UInt16ToFloat64},
+    {asynArrayInt32,   asynArrayFloat32, avx2Int32ToFloat32},
+    {asynArrayInt32,   asynArrayFloat64, avx2Int32ToFloat64},
+    {asynArrayFloat32, asynArrayFloat64, avx2Float32ToFloat64},
+    {asynArrayFloat64, asynArrayFloat32, avx2Float64ToFloat32}
+};
+
+#endif /* ARRAY_CONVERT_AVX2 */
+
+static epicsThreadOnceId convertOnceId = EPICS_THREAD_ONCE_INIT;
+static asynArrayConvertFunc convertTable[asynArrayNumTypes][asynArrayNumTypes];
+static const char *convertKernels = "scalar";
+
+static void addEntries(const convertEntry *pentry, size_t nEntries)
+{
+    size_t i;
+    for (i=0; i<nEntries; i++, pentry++)
+        convertTable[pentry->srcType][pentry->dstType] = pentry->func;
+}
+
+static void convertInit(void *arg)
+{
+    memcpy(convertTable, scalarTable, sizeof(convertTable));
+    addEntries(copyEntries, sizeof(copyEntries)/sizeof(copyEntries[0]));
+#ifdef ARRAY_CONVERT_SSE2
+    addEntries(sse2Entries, sizeof(sse2Entries)/sizeof(sse2Entries[0]));
+    convertKernels = "SSE2";
+#endif
+#ifdef ARRAY_CONVERT_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        addEntries(avx2Entries, sizeof(avx2Entries)/sizeof(avx2Entries[0]));
+        convertKernels = "AVX2";
+    }
+#endif
+}
+
+asynArrayConvertFunc asynArrayConverter(asynArrayType srcType, asynArrayType dstType)
+{
+    if ((unsigned)srcType >= asynArrayNumTypes || (unsigned)dstType >= asynArrayNumTypes)
+        return 0;
+    epicsThreadOnce(&convertOnceId, convertInit, 0);
+    return convertTable[srcType][dstType];
+}
+
+asynArrayConvertFunc asynArrayConverterScalar(asynArrayType srcType, asynArrayType dstType)
+{
+    if ((unsigned)srcType >= asynArrayNumTypes || (unsigned)dstType >= asynArrayNumTypes)
+        return 0;
+    return scalarTable[srcType][dstType];
+}
+
+void asynArrayConvert(const void *src, asynArrayType srcType,
+                      void *dst, asynArrayType dstType, size_t nElements)
+{
+    asynArrayConvertFunc func = asynArrayConverter(srcType, dstType);
+    if (func) func(src, dst, nElements);
+}
+
+const char *asynArrayConvertKernels(void)
+{
+    epicsThreadOnce(&convertOnceId, convertInit, 0);
+    return convertKernels;
+}
@@ -0,0 +1,58 @@
+/*asynArrayConvert.h*/
+/***********************************************************************
+* Copyright (c) 2002 The University of Chicago, as Operator of Argonne
+* National Laboratory, and the Regents of the University of
+* California, as Operator of Los Alamos National Laboratory, and
+* Berliner Elektronenspeicherring-Gesellschaft m.b.H. (BESSY).
+* asynDriver is distributed subject to a Software License Agreement
+* found in file LICENSE that is included with this distribution.
+***********************************************************************/
+
+#ifndef asynArrayConvertH
+#define asynArrayConvertH
+
+#include <stddef.h>
+#include "asynAPI.h"
+
+/*
+ * Element type conversion of numeric arrays, as done by a C cast of each element.
+ * The common conversions, from the integer types and epicsFloat32 to the floating
+ * point types and between epicsFloat32 and epicsFloat64, use SSE2 or AVX2 on x86
+ * when the CPU supports them. All other conversions use a loop over the elements.
+ * Source and destination must not overlap.
+ */
+
+typedef enum {
+    asynArrayInt8,
+    asynArrayUInt8,
+    asynArrayInt16,
+    asynArrayUInt16,
+    asynArrayInt32,
+    asynArrayUInt32,
+    asynArrayInt64,
+    asynArrayUInt64,
+    asynArrayFloat32,
+    asynArrayFloat64,
+    asynArrayNumTypes
+} asynArrayType;
+
+typedef void (*asynArrayConvertFunc)(const void *src, void *dst, size_t nElements);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Returns the fastest conversion function, or NULL if a type is invalid */
+ASYN_API asynArrayConvertFunc asynArrayConverter(asynArrayType srcType, asynArrayType dstType);
+/* Returns the conversion function that loops over the elements, for comparison */
+ASYN_API asynArrayConvertFunc asynArrayConverterScalar(asynArrayType srcType, asynArrayType dstType);
+ASYN_API void asynArrayConvert(const void *src, asynArrayType srcType,
+                               void *dst, asynArrayType dstType, size_t nElements);
+/* Returns "AVX2", "SSE2" or "scalar" */
+ASYN_API const char *asynArrayConvertKernels(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* asynArrayConvertH */
@@ -93,6 +93,9 @@ typedef struct asynInterface{
 /*registerPort attributes*/
 #define ASYN_MULTIDEVICE  0x0001
 #define ASYN_CANBLOCK     0x0002
+/*With ASYN_CANBLOCK: the queued requests are called by the shared threads of
+ *asynManager, see setSharedThreads, instead of a thread for the port*/
+#define ASYN_SHAREDTHREAD 0x0004
 
 /*standard values for asynUser.reason*/
 #define ASYN_REASON_SIGNAL -1
@@ -102,14 +105,33 @@ typedef struct asynInterface{
 
 #define ASYN_REASON_QUEUE_EVEN_IF_NOT_CONNECTED ASYN_REASON_RESERVED_LOW
 
+/*Queue statistics for ports with ASYN_CANBLOCK, see getQueueStats
+ *bins[0] counts times < 1 us, bins[n] times >= 2^(n-1) us and < 2^n us,
+ *and the last bin all longer times*/
+#define ASYN_QUEUE_HISTOGRAM_BINS 24
+typedef struct asynQueueHistogram {
+    unsigned long count;
+    double        total;  /*seconds*/
+    double        max;    /*seconds*/
+    unsigned long bins[ASYN_QUEUE_HISTOGRAM_BINS];
+}asynQueueHistogram;
+
+typedef struct asynQueueStats {
+    asynQueueHistogram latency; /*from queueRequest until the callback is called*/
+    asynQueueHistogram service; /*time taken by the callback*/
+}asynQueueStats;
+
 typedef void (*userCallback)(asynUser *pasynUser);
 typedef void (*exceptionCallback)(asynUser *pasynUser,asynException exception);
 typedef void (*timeStampCallback)(void *userPvt, epicsTimeStamp *pTimeStamp);
+typedef void (*coalesceCallback)(asynUser *pasynUser, asynUser *pasynUserRead);
 
 typedef struct interruptNode{
     ELLNODE node;
     void    *drvPvt;
 }interruptNode;
+/*added is 1 when pnode was added to the interrupt list, 0 when it was removed*/
+typedef void (*interruptListCallback)(void *userPvt,interruptNode *pnode,int added);
 
 typedef struct asynManager {
     void      (*report)(FILE *fp,int details,const char*portName);
@@ -183,6 +205,34 @@ typedef struct asynManager {
     asynStatus (*setTimeStamp)(asynUser *pasynUser, const epicsTimeStamp *pTimeStamp);
 
     const char *(*strStatus)(asynStatus status);
+    /* Changes each time a user is added to or removed from the interrupt list.
+     * Must be called between interruptStart and interruptEnd */
+    asynStatus (*getInterruptListVersion)(void *pasynPvt,unsigned long *version);
+    /* Queue several requests for one ASYN_CANBLOCK port with one lock and one
+     * wakeup of the port thread. Either all or none of the requests are queued */
+    asynStatus (*queueRequests)(asynUser **ppasynUser,int nUsers,
+                   asynQueuePriority priority,double timeout);
+    /* Merge queued read requests with the same interfaceType, reason and address.
+     * callback is called instead of the process callback for the merged requests */
+    asynStatus (*registerCoalesceCallback)(asynUser *pasynUser,
+                   const char *interfaceType,coalesceCallback callback);
+    asynStatus (*getQueueStats)(asynUser *pasynUser,
+                   asynQueuePriority priority,asynQueueStats *pstats);
+    asynStatus (*resetQueueStats)(asynUser *pasynUser);
+    /* Number of shared threads for the ports registered with ASYN_SHAREDTHREAD.
+     * They are started when the first such port is registered, so this must be
+     * called before. The default is 2 per CPU, and at least 4 */
+    asynStatus (*setSharedThreads)(int numThreads);
+    /* Number of requests queued for the port, including those for its devices */
+    asynStatus (*getQueueDepth)(asynUser *pasynUser,int *nQueued);
+    /* Called with yesNo=1 before and yesNo=0 after a wait in a request of an
+     * ASYN_SHAREDTHREAD port, so the other ports get another shared thread meanwhile */
+    asynStatus (*sharedThreadBlock)(int yesNo);
+    /* callback is called each time a user is added to or removed from the
+     * interrupt list, with the asynManager lock of the port held, so it must
+     * not wait for anything that may need that lock. callback=0 removes it */
+    asynStatus (*registerInterruptListCallback)(void *pasynPvt,
+                   interruptListCallback callback,void *userPvt);
 }asynManager;
 ASYN_API extern asynManager *pasynManager;
 
@@ -272,6 +322,10 @@ typedef struct asynTrace {
     int        (*vprintIOSource)(asynUser *pasynUser,int reason,
                     const char *buffer, size_t len,const char *file, int line, const char *pformat, va_list pvar) EPICS_PRINTF_STYLE(7,0);
 #endif
+    /* Messages for a port with a trace ring are queued by the caller and */
+    /* written by a background thread. size 0 writes them directly again */
+    asynStatus (*setTraceRingSize)(asynUser *pasynUser,size_t size);
+    size_t     (*getTraceRingSize)(asynUser *pasynUser);
 }asynTrace;
 ASYN_API extern asynTrace *pasynTrace;
 
@@ -33,6 +33,15 @@
 #include <epicsExport.h>
 #include "asynDriver.h"
 
+/* The trace ring needs epicsAtomic, which is not available before 3.15 */
+#if EPICS_VERSION_INT >= VERSION_INT(3,15,0,0)
+#include <epicsAtomic.h>
+#include <epicsExit.h>
+#define ASYN_TRACE_RING
+/* The free list caches of the threads are flushed by epicsAtThreadExit */
+#define ASYN_FREELIST_CACHE
+#endif
+
 #define BOOL int
 #ifndef TRUE
 #define TRUE 1
@@ -47,6 +56,14 @@
 #define DEFAULT_SECONDS_BETWEEN_PORT_CONNECT 20
 #define DEFAULT_AUTOCONNECT_TIMEOUT 0.5
 #define DEFAULT_QUEUE_LOCK_PORT_TIMEOUT 2.0
+#define DEFAULT_SHARED_THREADS_PER_CPU 2
+#define MIN_SHARED_THREADS 4
+/* Seconds an extra shared thread, see sharedThreadBlock, waits for work before it exits */
+#define SHARED_EXTRA_IDLE_TIME 10.0
+#define TRACE_RING_MIN_SIZE 16
+#define TRACE_RING_DATA_SIZE 256
+#define TRACE_RING_THREAD_NAME_SIZE 32
+#define TRACE_RING_FLUSH_PERIOD 0.5
 
 /* This is taken from dbDefs.h, which we don't want to include */
 /* Subtract member byte offset, returning pointer to parent object */
@@ -63,6 +80,7 @@
 #endif
 
 typedef struct tracePvt tracePvt;
+typedef struct traceRing traceRing;
 typedef struct userPvt userPvt;
 typedef struct port port;
 typedef struct device device;
@@ -82,6 +100,47 @@ struct tracePvt {
     char          *traceBuffer;
 };
 
+/* A trace message waiting in a traceRing to be written by traceRingThread.
+ * The message is formatted by the caller, since the arguments may not
+ * outlive the call. For printIO the I/O bytes follow the message in data.
+ */
+typedef struct traceRecord {
+    size_t         sequence; /*see traceRingWrite and traceRingDrain*/
+    tracePvt       *ptracePvt;
+    int            traceInfoMask;
+    int            traceIOMask;
+    size_t         traceTruncateSize;
+    BOOL           isIO;
+    epicsTimeStamp time;
+    int            addr;
+    int            reason;
+    const char     *file;
+    int            line;
+    char           threadName[TRACE_RING_THREAD_NAME_SIZE];
+    epicsThreadId  threadId;
+    unsigned int   threadPriority;
+    size_t         messageLength;
+    BOOL           messageTruncated;
+    size_t         ioLength;
+    char           data[TRACE_RING_DATA_SIZE];
+}traceRecord;
+
+/* Bounded multi-producer ring of traceRecords for one port.
+ * Callers claim a record by advancing head with compare and swap, so
+ * asynPrint never blocks and never waits for a file or errlog.
+ * traceRingThread is the only consumer.
+ */
+struct traceRing {
+    ELLNODE     node; /*For asynBase.traceRingList*/
+    port        *pport;
+    size_t      size; /*number of records, a power of 2*/
+    size_t      head; /*next sequence number to claim*/
+    size_t      tail; /*next sequence number to write*/
+    size_t      dropped;
+    size_t      droppedReported;
+    traceRecord *records;
+};
+
 #define nMemList 9
 static size_t memListSize[nMemList] =
     {16,32,64,128,256,512,1024,2048,4096};
@@ -95,6 +154,21 @@ typedef struct memNode {
  */
 #define NODESIZE (((sizeof(memNode)+15)/16)*16)
 
+/*
+ * Each thread keeps a few free asynUsers and memory blocks of each size,
+ * so that createAsynUser/freeAsynUser and memMalloc/memFree normally do
+ * not take pasynBase->lock. The caches are refilled from and flushed to
+ * the global lists FREELIST_CACHE_BATCH nodes at a time, and returned to
+ * the global lists when the thread exits. Without ASYN_FREELIST_CACHE all
+ * threads use the global lists.
+ */
+#define FREELIST_CACHE_MAX 16
+#define FREELIST_CACHE_BATCH 8
+typedef struct freeListCache {
+    ELLLIST asynUserList;
+    ELLLIST memList[nMemList];
+}freeListCache;
+
 typedef struct asynBase {
     ELLLIST           asynPortList;
     ELLLIST           asynUserFreeList;
@@ -103,10 +177,27 @@ typedef struct asynBase {
     epicsMutexId      lock;
     epicsMutexId      lockTrace;
     tracePvt          trace;
+    /* following for trace rings */
+    ELLLIST           traceRingList;
+    epicsMutexId      lockTraceRing;
+    epicsEventId      traceRingEvent;
+    epicsThreadId     traceRingThread;
     ELLLIST           memList[nMemList];
+    epicsThreadPrivateId freeListCacheId;
     /* following for connectPort */
     epicsTimerQueueId connectPortTimerQueue;
     double            autoConnectTimeout;
+    /* The following are for ASYN_SHAREDTHREAD ports, see notifyPort */
+    epicsMutexId      sharedLock;
+    epicsEventId      sharedNotify;
+    ELLLIST           sharedReadyList; /*ports waiting for a shared thread*/
+    int               numSharedThreads; /*shared threads that are not blocked*/
+    BOOL              sharedThreadsStarted;
+    int               numSharedRunning; /*shared threads, including the extra ones*/
+    int               numSharedBlocked; /*shared threads in sharedThreadBlock*/
+    int               maxSharedRunning;
+    unsigned long     numSharedExtra;   /*extra threads started*/
+    epicsThreadPrivateId sharedThreadId;
 }asynBase;
 static asynBase *pasynBase = 0;
 
@@ -115,6 +206,9 @@ typedef struct interruptBase {
     ELLLIST      addRemoveList;
     BOOL         callbackActive;
     BOOL         listModified;
+    unsigned long listVersion; /*incremented each time callbackList changes*/
+    interruptListCallback listCallback; /*called each time callbackList changes*/
+    void         *listCallbackPvt;
     port         *pport;
     asynInterface *pasynInterface;
 }interruptBase;
@@ -134,6 +228,12 @@ typedef struct interfaceNode {
     interruptBase *pinterruptBase;
 }interfaceNode;
 
+typedef struct readyNode { /*For port.readyList*/
+    ELLNODE         node;
+    BOOL            isReady;
+    struct dpCommon *pdpCommon;
+}readyNode;
+
 typedef struct dpCommon { /*device/port common fields*/
     BOOL           enabled;
     BOOL           connected;
@@ -149,6 +249,9 @@ typedef struct dpCommon { /*device/port common fields*/
     tracePvt       trace;
     port           *pport;
     device         *pdevice; /* 0 if port.dpc*/
+    /*The following are only used if port.attributes&ASYN_CANBLOCK*/
+    ELLLIST        queueList[asynQueuePriorityConnect]; /*queued requests*/
+    readyNode      ready[asynQueuePriorityConnect];
 }dpCommon;
 
 typedef struct exceptionUser {
@@ -161,7 +264,7 @@ typedef struct exceptionUser {
 
 typedef enum {callbackIdle,callbackActive,callbackCanceled}callbackState;
 struct userPvt {
-    ELLNODE       node;        /*For asynPort.queueList*/
+    ELLNODE       node;        /*For dpCommon.queueList or port.connectQueue*/
     /* timer,...,state are for queueRequest callbacks*/
     epicsTimerId  timer;
     epicsEventId  callbackDone;
@@ -177,6 +280,13 @@ struct userPvt {
     exceptionUser *pexceptionUser;
     BOOL          freeAfterCallback;
     BOOL          isQueued;
+    asynQueuePriority priority; /*of the queued request*/
+    /* The following are for registerCoalesceCallback */
+    const char    *coalesceType;
+    coalesceCallback coalesceUser;
+    userPvt       *pcoalesceLeader; /*queued request this one is merged with*/
+    ELLLIST       coalescedList;    /*requests merged with this one*/
+    double        queueTime;        /*when queued, see queueStatsTime*/
     asynUser      user;
 };
 
@@ -186,6 +296,8 @@ struct device {
     int       addr;
 };
 
+typedef enum {sharedIdle,sharedReady,sharedRunning,sharedRunningNotified}sharedState;
+
 typedef enum portConnectStatus {
     portConnectSuccess,
     portConnectDevice,
@@ -210,11 +322,19 @@ struct port {
     asynLockPortNotify *pasynLockPortNotify;
     void          *lockPortNotifyPvt;
     /*The following are only initialized/used if attributes&ASYN_CANBLOCK*/
-    ELLLIST       queueList[NUMBER_QUEUE_PRIORITIES];
+    ELLLIST       connectQueue; /*asynQueuePriorityConnect requests*/
+    /*dpCommons with queued requests of each priority, see findQueuedRequest*/
+    ELLLIST       readyList[asynQueuePriorityConnect];
     BOOL          queueStateChange;
     epicsEventId  notifyPortThread;
     epicsThreadId threadid;
+    /*The following are for ASYN_SHAREDTHREAD, protected by asynBase.sharedLock*/
+    ELLNODE       sharedNode; /*For asynBase.sharedReadyList*/
+    sharedState   sharedState;
     userPvt       *pblockProcessHolder;
+    unsigned long numberCoalesced;
+    /*Only changed with asynManagerLock held, mostly by portThread*/
+    asynQueueStats queueStats[asynQueuePriorityConnect+1];
     /* following are for portConnect */
     asynUser      *pconnectUser;
     asynInterface *pcommonInterface;
@@ -225,6 +345,9 @@ struct port {
     epicsTimeStamp timeStamp;
     timeStampCallback timeStampSource;
     void          *timeStampPvt;
+    /* The following are for the trace ring, see traceRingWrite */
+    traceRing     *ptraceRing;
+    int           traceRingUsers;
 };
 
 typedef struct queueLockPortPvt {
@@ -247,6 +370,14 @@ typedef struct queueLockPortPvt {
 /* internal methods */
 static void tracePvtInit(tracePvt *ptracePvt);
 static void tracePvtFree(tracePvt *ptracePvt);
+static void traceRingDrainAll(void);
+static freeListCache *findFreeListCache(void);
+#ifdef ASYN_FREELIST_CACHE
+static void freeListCacheFlush(void *arg);
+#endif
+static ELLNODE *freeListGet(ELLLIST *pcacheList,ELLLIST *pglobalList);
+static void freeListPut(ELLLIST *pcacheList,ELLLIST *pglobalList,ELLNODE *pnode);
+static void asynUserFreeListPut(userPvt *puserPvt);
 static void asynInit(void);
 static void dpCommonInit(port *pport,device *pdevice,BOOL autoConnect);
 static void dpCommonFree(dpCommon *pdpCommon);
@@ -260,8 +391,24 @@ static void exceptionOccurred(asynUser *pasynUser,asynException exception);
 static void queueTimeoutCallback(void *pvt);
 /*autoConnectDevice must be called with asynManagerLock held*/
 static BOOL autoConnectDevice(port *pport,device *pdevice);
+static void addToQueue(userPvt *puserPvt,asynQueuePriority priority,double timeout);
+static void readyDpCommon(dpCommon *pdpCommon,int priority);
+static void readyDpCommonAll(dpCommon *pdpCommon);
+static void unreadyDpCommon(dpCommon *pdpCommon,int priority);
+static void dequeueRequest(userPvt *puserPvt);
+static userPvt *findCoalesceLeader(userPvt *puserPvt,ELLLIST *pqueueList);
+static void replaceCoalesceLeader(userPvt *pleader);
+static userPvt *findQueuedRequest(port *pport);
+static double queueStatsTime(void);
+static void queueHistogramAdd(asynQueueHistogram *phistogram,double seconds);
 static void connectAttempt(dpCommon *pdpCommon);
+static void notifyPort(port *pport);
+static void callQueuedRequests(port *pport);
 static void portThread(port *pport);
+static void sharedPortThread(void *arg);
+static BOOL startSharedThread(void);
+static void startSharedThreads(void);
+static void lockSynchronous(port *pport);
 /* functions for portConnect */
 static void initPortConnect(port *ppport);
 static void portConnectTimerCallback(void *pvt);
@@ -287,6 +434,8 @@ static asynInterface *findInterface(asynUser *pasynUser,
     const char *interfaceType,int interposeInterfaceOK);
 static asynStatus queueRequest(asynUser *pasynUser,
     asynQueuePriority priority,double timeout);
+static asynStatus queueRequests(asynUser **ppasynUser,int nUsers,
+    asynQueuePriority priority,double timeout);
 static asynStatus cancelRequest(asynUser *pasynUser,int *wasQueued);
 static asynStatus blockProcessCallback(asynUser *pasynUser, int allDevices);
 static asynStatus unblockProcessCallback(asynUser *pasynUser, int allDevices);
@@ -326,6 +475,18 @@ static asynStatus removeInterruptUser(asynUser *pasynUser,
                                    interruptNode*pinterruptNode);
 static asynStatus interruptStart(void *pasynPvt,ELLLIST **plist);
 static asynStatus interruptEnd(void *pasynPvt);
+static asynStatus getInterruptListVersion(void *pasynPvt,
+    unsigned long *version);
+static asynStatus registerCoalesceCallback(asynUser *pasynUser,
+    const char *interfaceType,coalesceCallback callback);
+static asynStatus getQueueStats(asynUser *pasynUser,
+    asynQueuePriority priority,asynQueueStats *pstats);
+static asynStatus resetQueueStats(asynUser *pasynUser);
+static asynStatus setSharedThreads(int numThreads);
+static asynStatus sharedThreadBlock(int yesNo);
+static asynStatus getQueueDepth(asynUser *pasynUser,int *nQueued);
+static asynStatus registerInterruptListCallback(void *pasynPvt,
+    interruptListCallback callback,void *userPvt);
 static void defaultTimeStampSource(void *userPvt, epicsTimeStamp *pTimeStamp);
 static asynStatus registerTimeStampSource(asynUser *pasynUser, void *userPvt, timeStampCallback callback);
 static asynStatus unregisterTimeStampSource(asynUser *pasynUser);
@@ -384,7 +545,16 @@ static asynManager manager = {
     updateTimeStamp,
     getTimeStamp,
     setTimeStamp,
-    strStatus
+    strStatus,
+    getInterruptListVersion,
+    queueRequests,
+    registerCoalesceCallback,
+    getQueueStats,
+    resetQueueStats,
+    setSharedThreads,
+    getQueueDepth,
+    sharedThreadBlock,
+    registerInterruptListCallback
 };
 asynManager *pasynManager = &manager;
 
@@ -417,6 +587,8 @@ static int        traceVprintIO(asynUser *pasynUser,int reason,
                       const char *buffer, size_t len,const char *pformat, va_list pvar);
 static int        traceVprintIOSource(asynUser *pasynUser,int reason,
                       const char *buffer, size_t len, const char *file, int line, const char *pformat, va_list pvar);
+static asynStatus setTraceRingSize(asynUser *pasynUser,size_t size);
+static size_t     getTraceRingSize(asynUser *pasynUser);
 static asynTrace asynTraceManager = {
     traceLock,
     traceUnlock,
@@ -437,7 +609,9 @@ static asynTrace asynTraceManager = {
     tracePrintIO,
     tracePrintIOSource,
     traceVprintIO,
-    traceVprintIOSource
+    traceVprintIOSource,
+    setTraceRingSize,
+    getTraceRingSize
 };
 asynTrace *pasynTrace = &asynTraceManager;
 
@@ -497,15 +671,23 @@ static void asynInit(void)
     pasynBase->lock = epicsMutexMustCreate();
     pasynBase->lockTrace = epicsMutexMustCreate();
     tracePvtInit(&pasynBase->trace);
+    ellInit(&pasynBase->traceRingList);
+    pasynBase->lockTraceRing = epicsMutexMustCreate();
     for(i=0; i<nMemList; i++) ellInit(&pasynBase->memList[i]);
+    pasynBase->freeListCacheId = epicsThreadPrivateCreate();
     pasynBase->connectPortTimerQueue = epicsTimerQueueAllocate(
         0,epicsThreadPriorityScanLow);
     pasynBase->autoConnectTimeout = DEFAULT_AUTOCONNECT_TIMEOUT;
+    pasynBase->sharedLock = epicsMutexMustCreate();
+    pasynBase->sharedNotify = epicsEventMustCreate(epicsEventEmpty);
+    ellInit(&pasynBase->sharedReadyList);
+    pasynBase->sharedThreadId = epicsThreadPrivateCreate();
 }
 
 static void dpCommonInit(port *pport,device *pdevice,BOOL autoConnect)
 {
     dpCommon *pdpCommon;
+    int      i;
 
     if(pdevice) {
         pdpCommon = &pdevice->dpc;
@@ -520,6 +702,10 @@ static void dpCommonInit(port *pport,device *pdevice,BOOL autoConnect)
     ellInit(&pdpCommon->exceptionNotifyList);
     pdpCommon->pport = pport;
     pdpCommon->pdevice = pdevice;
+    for(i=0; i<asynQueuePriorityConnect; i++) {
+        ellInit(&pdpCommon->queueList[i]);
+        pdpCommon->ready[i].pdpCommon = pdpCommon;
+    }
     tracePvtInit(&pdpCommon->trace);
 }
 
@@ -625,10 +811,12 @@ static void announceExceptionOccurred(port *pport, device *pdevice, asynExceptio
         ellDelete(&pdpCommon->exceptionNotifyList,&pexceptionUser->notifyNode);
     }
     pdpCommon->exceptionActive = FALSE;
+    /*enable or connect may let queued requests run*/
+    readyDpCommonAll(pdpCommon);
     pport->queueStateChange = TRUE;
     epicsMutexUnlock(pport->asynManagerLock);
     if(pport->attributes&ASYN_CANBLOCK)
-        epicsEventSignal(pport->notifyPortThread);
+        notifyPort(pport);
 }
 static void exceptionOccurred(asynUser *pasynUser,asynException exception)
 {
@@ -644,7 +832,6 @@ static void queueTimeoutCallback(void *pvt)
     userPvt  *puserPvt = (userPvt *)pvt;
     asynUser *pasynUser = &puserPvt->user;
     port     *pport = puserPvt->pport;
-    int      i;
 
     epicsMutexMustLock(pport->asynManagerLock);
     if(!puserPvt->isQueued) {
@@ -654,27 +841,9 @@ static void queueTimeoutCallback(void *pvt)
             pport->portName );
         return;
     }
-    for(i=asynQueuePriorityConnect; i>=asynQueuePriorityLow; i--) {
-        puserPvt = (userPvt *)ellFirst(&pport->queueList[i]);
-        while(puserPvt) {
-            if(pasynUser == &puserPvt->user) {
-                ellDelete(&pport->queueList[i],&puserPvt->node);
-                break;
-            }
-            puserPvt = (userPvt *)ellNext(&puserPvt->node);
-        }
-        if (puserPvt) break;
-    }
-    if(!puserPvt) {
-        epicsMutexUnlock(pport->asynManagerLock);
-        asynPrint(pasynUser,ASYN_TRACE_ERROR,
-            "%s asynManager:queueTimeoutCallback LOGIC ERROR\n",
-            pport->portName);
-        return;
-    }
+    dequeueRequest(puserPvt);
     asynPrint(pasynUser,ASYN_TRACE_FLOW,
         "%s asynManager:queueTimeoutCallback\n", pport->portName);
-    puserPvt->isQueued = FALSE;
     pport->queueStateChange = TRUE;
     if(puserPvt->timeoutUser) {
         puserPvt->state = callbackActive;
@@ -686,13 +855,167 @@ static void queueTimeoutCallback(void *pvt)
         puserPvt->state = callbackIdle;
         if(puserPvt->freeAfterCallback) {
             puserPvt->freeAfterCallback = FALSE;
-            epicsMutexMustLock(pasynBase->lock);
-            ellAdd(&pasynBase->asynUserFreeList,&puserPvt->node);
-            epicsMutexUnlock(pasynBase->lock);
+            asynUserFreeListPut(puserPvt);
         }
     }
     epicsMutexUnlock(pport->asynManagerLock);
-    epicsEventSignal(pport->notifyPortThread);
+    notifyPort(pport);
+}
+
+/* Queued requests are kept on a queue per device (per port for the port
+ * itself and for single device ports) and priority.  port.readyList has,
+ * for each priority, the dpCommons with requests that may be runnable, so
+ * portThread does not have to step over the requests for devices that
+ * are disabled or blocked by another asynUser.  A dpCommon that can not
+ * run is taken off readyList by findQueuedRequest and put back by
+ * readyDpCommon when a request is queued or its state changes.
+ * All of the following must be called with asynManagerLock held.
+ */
+static void readyDpCommon(dpCommon *pdpCommon,int priority)
+{
+    readyNode *pready = &pdpCommon->ready[priority];
+
+    if(pready->isReady || ellCount(&pdpCommon->queueList[priority])==0) return;
+    ellAdd(&pdpCommon->pport->readyList[priority],&pready->node);
+    pready->isReady = TRUE;
+}
+
+static void readyDpCommonAll(dpCommon *pdpCommon)
+{
+    int i;
+
+    for(i=asynQueuePriorityLow; i<asynQueuePriorityConnect; i++)
+        readyDpCommon(pdpCommon,i);
+}
+
+static void unreadyDpCommon(dpCommon *pdpCommon,int priority)
+{
+    readyNode *pready = &pdpCommon->ready[priority];
+
+    if(!pready->isReady) return;
+    ellDelete(&pdpCommon->pport->readyList[priority],&pready->node);
+    pready->isReady = FALSE;
+}
+
+static void dequeueRequest(userPvt *puserPvt)
+{
+    port *pport = puserPvt->pport;
+
+    assert(puserPvt->isQueued);
+    if(puserPvt->pcoalesceLeader) {
+        ellDelete(&puserPvt->pcoalesceLeader->coalescedList,&puserPvt->node);
+        puserPvt->pcoalesceLeader = 0;
+    } else if(puserPvt->priority==asynQueuePriorityConnect) {
+        ellDelete(&pport->connectQueue,&puserPvt->node);
+    } else {
+        dpCommon *pdpCommon = findDpCommon(puserPvt);
+
+        ellDelete(&pdpCommon->queueList[puserPvt->priority],&puserPvt->node);
+        if(ellCount(&pdpCommon->queueList[puserPvt->priority])==0)
+            unreadyDpCommon(pdpCommon,puserPvt->priority);
+    }
+    puserPvt->isQueued = FALSE;
+}
+
+/*Returns a queued request that puserPvt can be merged with, or 0*/
+static userPvt *findCoalesceLeader(userPvt *puserPvt,ELLLIST *pqueueList)
+{
+    asynUser *pasynUser = userPvtToAsynUser(puserPvt);
+    userPvt  *pleader;
+
+    for(pleader = (userPvt *)ellFirst(pqueueList); pleader;
+    pleader = (userPvt *)ellNext(&pleader->node)) {
+        asynUser *pasynUserLeader = userPvtToAsynUser(pleader);
+
+        if(pleader->coalesceUser==puserPvt->coalesceUser
+        && pleader->timeout==0.0
+        && pleader->blockPortCount==0 && pleader->blockDeviceCount==0
+        && pasynUserLeader->reason==pasynUser->reason
+        && pasynUserLeader->drvUser==pasynUser->drvUser
+        && strcmp(pleader->coalesceType,puserPvt->coalesceType)==0) return pleader;
+    }
+    return 0;
+}
+
+/*Put the first request merged with pleader in its place in the queue*/
+static void replaceCoalesceLeader(userPvt *pleader)
+{
+    userPvt  *pnew = (userPvt *)ellGet(&pleader->coalescedList);
+    userPvt  *pfollower;
+    dpCommon *pdpCommon = findDpCommon(pleader);
+
+    pnew->pcoalesceLeader = 0;
+    ellInsert(&pdpCommon->queueList[pleader->priority],&pleader->node,&pnew->node);
+    ellConcat(&pnew->coalescedList,&pleader->coalescedList);
+    for(pfollower = (userPvt *)ellFirst(&pnew->coalescedList); pfollower;
+    pfollower = (userPvt *)ellNext(&pfollower->node))
+        pfollower->pcoalesceLeader = pnew;
+}
+
+/*Returns the next request that portThread can call, without dequeueing it*/
+static userPvt *findQueuedRequest(port *pport)
+{
+    userPvt  *puserPvt = pport->pblockProcessHolder;
+    dpCommon *pdpCommon;
+    readyNode *pready;
+    int      i;
+
+    if(puserPvt) {
+        /*Only the asynUser that blocked the port can run*/
+        if(!puserPvt->isQueued
+        || puserPvt->priority==asynQueuePriorityConnect) return 0;
+        pdpCommon = findDpCommon(puserPvt);
+        if(!pdpCommon->enabled) return 0;
+        if(pdpCommon->pblockProcessHolder
+        && pdpCommon->pblockProcessHolder!=puserPvt) return 0;
+        return puserPvt;
+    }
+    for(i=asynQueuePriorityHigh; i>=asynQueuePriorityLow; i--) {
+        while((pready = (readyNode *)ellFirst(&pport->readyList[i]))) {
+            pdpCommon = pready->pdpCommon;
+            if(pdpCommon->enabled) {
+                puserPvt = pdpCommon->pblockProcessHolder;
+                if(!puserPvt)
+                    return (userPvt *)ellFirst(&pdpCommon->queueList[i]);
+                if(puserPvt->isQueued && puserPvt->priority==i)
+                    return puserPvt;
+            }
+            /*Disabled or blocked by another asynUser*/
+            unreadyDpCommon(pdpCommon,i);
+        }
+    }
+    return 0;
+}
+
+/*Seconds from an arbitrary origin, only used for differences*/
+static double queueStatsTime(void)
+{
+#if EPICS_VERSION_INT >= VERSION_INT(7,0,0,0)
+    return epicsMonotonicGet()*1e-9;
+#else
+    epicsTimeStamp now;
+
+    epicsTimeGetCurrent(&now);
+    return now.secPastEpoch + now.nsec*1e-9;
+#endif
+}
+
+/*queueHistogramAdd must be called with asynManagerLock held*/
+static void queueHistogramAdd(asynQueueHistogram *phistogram,double seconds)
+{
+    unsigned long usec;
+    int           bin = 0;
+
+    if(seconds<0.0) seconds = 0.0;
+    phistogram->count++;
+    phistogram->total += seconds;
+    if(seconds>phistogram->max) phistogram->max = seconds;
+    if(seconds>=(1ul<<(ASYN_QUEUE_HISTOGRAM_BINS-2))*1e-6) {
+        bin = ASYN_QUEUE_HISTOGRAM_BINS-1;
+    } else {
+        for(usec = (unsigned long)(seconds*1e6); usec; usec >>= 1) bin++;
+    }
+    phistogram->bins[bin]++;
 }
 
 /*autoConnectDevice must be called with asynManagerLock held*/
@@ -708,7 +1031,9 @@ static BOOL autoConnectDevice(port *pport,device *pdevice)
              &now,&pport->dpc.lastConnectDisconnect) < 2.0) return FALSE;
         pport->dpc.autoConnectActive = TRUE;
         epicsMutexUnlock(pport->asynManagerLock);
+        sharedThreadBlock(1);
         connectAttempt(&pport->dpc);
+        sharedThreadBlock(0);
         epicsMutexMustLock(pport->asynManagerLock);
         epicsTimeGetCurrent(&pport->dpc.lastConnectDisconnect);
         pport->dpc.autoConnectActive = FALSE;
@@ -725,7 +1050,9 @@ static BOOL autoConnectDevice(port *pport,device *pdevice)
             &now,&pdevice->dpc.lastConnectDisconnect) < 2.0) return FALSE;
         pdevice->dpc.autoConnectActive = TRUE;
         epicsMutexUnlock(pport->asynManagerLock);
+        sharedThreadBlock(1);
         connectAttempt(&pdevice->dpc);
+        sharedThreadBlock(0);
         epicsMutexMustLock(pport->asynManagerLock);
         epicsTimeGetCurrent(&pdevice->dpc.lastConnectDisconnect);
         pdevice->dpc.autoConnectActive = FALSE;
@@ -787,158 +1114,335 @@ disconnect:
     }
 }
 
-static void portThread(port *pport)
+/*Calls the queued requests of an ASYN_CANBLOCK port until none of them can run*/
+static void callQueuedRequests(port *pport)
 {
     userPvt  *puserPvt;
+    userPvt  *pfollower;
     asynUser *pasynUser;
     double   timeout;
     BOOL     callTimeoutUser = FALSE;
+    BOOL     connected;
+    ELLLIST  coalescedList;
+    double   startTime,serviceTime,endTime = 0.0;
 
-    taskwdInsert(epicsThreadGetIdSelf(),0,0);
-    while(1) {
-        epicsEventMustWait(pport->notifyPortThread);
+    ellInit(&coalescedList);
+    epicsMutexMustLock(pport->asynManagerLock);
+    if(!pport->dpc.enabled) {
+        epicsMutexUnlock(pport->asynManagerLock);
+        return;
+    }
+    /*Process ALL connect/disconnect requests first*/
+    while((puserPvt = (userPvt *)ellFirst(&pport->connectQueue))) {
+        asynStatus status = asynSuccess;
+
+        dequeueRequest(puserPvt);
+        startTime = queueStatsTime();
+        queueHistogramAdd(&pport->queueStats[asynQueuePriorityConnect].latency,
+            startTime - puserPvt->queueTime);
+        pasynUser = userPvtToAsynUser(puserPvt);
+        pasynUser->errorMessage[0] = '\0';
+        asynPrint(pasynUser,ASYN_TRACE_FLOW,
+            "asynManager connect queueCallback port:%s\n",
+             pport->portName);
+        puserPvt->state = callbackActive;
+        timeout = puserPvt->timeout;
+        epicsMutexUnlock(pport->asynManagerLock);
+        if(puserPvt->timer && timeout>0.0) epicsTimerCancel(puserPvt->timer);
+        lockSynchronous(pport);
+        if(pport->pasynLockPortNotify) {
+            status = pport->pasynLockPortNotify->lock(
+               pport->lockPortNotifyPvt,pasynUser);
+            if(status!=asynSuccess) asynPrint(pasynUser,ASYN_TRACE_ERROR,
+                    "%s queueCallback pasynLockPortNotify:lock error %s\n",
+                     pport->portName,pasynUser->errorMessage);
+        }
+        puserPvt->processUser(pasynUser);
+        if(pport->pasynLockPortNotify) {
+            status = pport->pasynLockPortNotify->unlock(
+               pport->lockPortNotifyPvt,pasynUser);
+            if(status!=asynSuccess) asynPrint(pasynUser,ASYN_TRACE_ERROR,
+                    "%s queueCallback pasynLockPortNotify:lock error %s\n",
+                     pport->portName,pasynUser->errorMessage);
+        }
+        epicsMutexUnlock(pport->synchronousLock);
         epicsMutexMustLock(pport->asynManagerLock);
-        if(!pport->dpc.enabled) {
-            epicsMutexUnlock(pport->asynManagerLock);
-            continue;
-        }
-        /*Process ALL connect/disconnect requests first*/
-        while((puserPvt = (userPvt *)ellFirst(
-        &pport->queueList[asynQueuePriorityConnect]))) {
-            asynStatus status = asynSuccess;
-
-            assert(puserPvt->isQueued);
-            ellDelete(&pport->queueList[asynQueuePriorityConnect],
-               &puserPvt->node);
-            puserPvt->isQueued = FALSE;
-            pasynUser = userPvtToAsynUser(puserPvt);
-            pasynUser->errorMessage[0] = '\0';
-            asynPrint(pasynUser,ASYN_TRACE_FLOW,
-                "asynManager connect queueCallback port:%s\n",
-                 pport->portName);
-            puserPvt->state = callbackActive;
-            timeout = puserPvt->timeout;
+        queueHistogramAdd(&pport->queueStats[asynQueuePriorityConnect].service,
+            queueStatsTime() - startTime);
+        if (puserPvt->state==callbackCanceled)
+            epicsEventSignal(puserPvt->callbackDone);
+        puserPvt->state = callbackIdle;
+        if(puserPvt->freeAfterCallback) {
+            puserPvt->freeAfterCallback = FALSE;
+            asynUserFreeListPut(puserPvt);
+        }
+    }
+    if(!pport->dpc.connected) {
+        if(!autoConnectDevice(pport,0)) {
             epicsMutexUnlock(pport->asynManagerLock);
-            if(puserPvt->timer && timeout>0.0) epicsTimerCancel(puserPvt->timer);
-            epicsMutexMustLock(pport->synchronousLock);
-            if(pport->pasynLockPortNotify) {
-                status = pport->pasynLockPortNotify->lock(
-                   pport->lockPortNotifyPvt,pasynUser);
-                if(status!=asynSuccess) asynPrint(pasynUser,ASYN_TRACE_ERROR,
-                        "%s queueCallback pasynLockPortNotify:lock error %s\n",
-                         pport->portName,pasynUser->errorMessage);
-            }
+            return;
+        }
+    }
+    /*The time a callback finishes is used as the start time of the next
+     *callback, unless the lock was released in between*/
+    endTime = 0.0;
+    while(1) {
+        int i;
+        dpCommon *pdpCommon = 0;
+        asynStatus status = asynSuccess;
+
+        pport->queueStateChange = FALSE;
+        puserPvt = findQueuedRequest(pport);
+        if(!puserPvt) break; /*while(1)*/
+        pdpCommon = findDpCommon(puserPvt);
+        assert(pdpCommon);
+        if(!pdpCommon->connected) {
+            autoConnectDevice(pdpCommon->pport,pdpCommon->pdevice);
+            endTime = 0.0;
+            if(pport->queueStateChange) break; /*while(1)*/
+        }
+        callTimeoutUser = (!pdpCommon->connected && puserPvt->timeoutUser!=0);
+        connected = pdpCommon->connected;
+        i = puserPvt->priority;
+        dequeueRequest(puserPvt);
+        startTime = (endTime>0.0 ? endTime : queueStatsTime());
+        queueHistogramAdd(&pport->queueStats[i].latency,
+            startTime - puserPvt->queueTime);
+        /*The requests merged with this one are called after it*/
+        ellConcat(&coalescedList,&puserPvt->coalescedList);
+        for(pfollower = (userPvt *)ellFirst(&coalescedList); pfollower;
+        pfollower = (userPvt *)ellNext(&pfollower->node)) {
+            queueHistogramAdd(&pport->queueStats[i].latency,
+                startTime - pfollower->queueTime);
+            pfollower->isQueued = FALSE;
+            pfollower->pcoalesceLeader = 0;
+            pfollower->state = callbackActive;
+            userPvtToAsynUser(pfollower)->errorMessage[0] = '\0';
+            pport->numberCoalesced++;
+        }
+        if(pdpCommon->ready[i].isReady) {
+            /*Other devices with requests of this priority go first*/
+            ellDelete(&pport->readyList[i],&pdpCommon->ready[i].node);
+            ellAdd(&pport->readyList[i],&pdpCommon->ready[i].node);
+        }
+        pasynUser = userPvtToAsynUser(puserPvt);
+        pasynUser->errorMessage[0] = '\0';
+        asynPrint(pasynUser,ASYN_TRACE_FLOW,"asynManager::portThread port=%s callback\n",pport->portName);
+        puserPvt->state = callbackActive;
+        timeout = puserPvt->timeout;
+        epicsMutexUnlock(pport->asynManagerLock);
+        if(puserPvt->timer && timeout>0.0) epicsTimerCancel(puserPvt->timer);
+        lockSynchronous(pport);
+        if(pport->pasynLockPortNotify) {
+            status = pport->pasynLockPortNotify->lock(
+               pport->lockPortNotifyPvt,pasynUser);
+            if(status!=asynSuccess) asynPrint(pasynUser,ASYN_TRACE_ERROR,
+                    "%s queueCallback pasynLockPortNotify:lock error %s\n",
+                     pport->portName,pasynUser->errorMessage);
+        }
+        if(callTimeoutUser) {
+            puserPvt->timeoutUser(pasynUser);
+        } else {
             puserPvt->processUser(pasynUser);
-            if(pport->pasynLockPortNotify) {
-                status = pport->pasynLockPortNotify->unlock(
-                   pport->lockPortNotifyPvt,pasynUser);
-                if(status!=asynSuccess) asynPrint(pasynUser,ASYN_TRACE_ERROR,
-                        "%s queueCallback pasynLockPortNotify:lock error %s\n",
-                         pport->portName,pasynUser->errorMessage);
-            }
-            epicsMutexUnlock(pport->synchronousLock);
-            epicsMutexMustLock(pport->asynManagerLock);
-            if (puserPvt->state==callbackCanceled)
-                epicsEventSignal(puserPvt->callbackDone);
-            puserPvt->state = callbackIdle;
-            if(puserPvt->freeAfterCallback) {
-                puserPvt->freeAfterCallback = FALSE;
-                epicsMutexMustLock(pasynBase->lock);
-                ellAdd(&pasynBase->asynUserFreeList,&puserPvt->node);
-                epicsMutexUnlock(pasynBase->lock);
-            }
         }
-        if(!pport->dpc.connected) {
-            if(!autoConnectDevice(pport,0)) {
-                epicsMutexUnlock(pport->asynManagerLock);
-                continue; /*while (1); */
+        for(pfollower = (userPvt *)ellFirst(&coalescedList); pfollower;
+        pfollower = (userPvt *)ellNext(&pfollower->node)) {
+            asynUser *pasynUserFollower = userPvtToAsynUser(pfollower);
+
+            if(!connected && pfollower->timeoutUser) {
+                pfollower->timeoutUser(pasynUserFollower);
+            } else if(callTimeoutUser) {
+                pfollower->processUser(pasynUserFollower);
+            } else {
+                pfollower->coalesceUser(pasynUserFollower,pasynUser);
             }
         }
-        while(1) {
-            int i;
-            dpCommon *pdpCommon = 0;
-            asynStatus status = asynSuccess;
-
-            callTimeoutUser = FALSE;
-            pport->queueStateChange = FALSE;
-            for(i=asynQueuePriorityHigh; i>=asynQueuePriorityLow; i--) {
-                for(puserPvt = (userPvt *)ellFirst(&pport->queueList[i]);
-                puserPvt; puserPvt = (userPvt *)ellNext(&puserPvt->node)) {
-                    pdpCommon = findDpCommon(puserPvt);
-                    assert(pdpCommon);
-
-                    if(!pdpCommon->enabled) continue;
-                    if(!pdpCommon->connected) {
-                        autoConnectDevice(pdpCommon->pport,
-                            pdpCommon->pdevice);
-                        if(pport->queueStateChange) {
-                            puserPvt = 0;
-                            break;
-                        }
-                    }
-                    if(!pdpCommon->connected && puserPvt->timeoutUser!=0) {
-                       callTimeoutUser = TRUE;
-                    }
-                    if((pport->pblockProcessHolder==NULL
-                        || pport->pblockProcessHolder==puserPvt)
-                    && (pdpCommon->pblockProcessHolder==NULL
-                        || pdpCommon->pblockProcessHolder==puserPvt)) {
-                        assert(puserPvt->isQueued);
-                        ellDelete(&pport->queueList[i],&puserPvt->node);
-                        puserPvt->isQueued = FALSE;
-                        break;
-                    }
-                }
-                if(puserPvt || pport->queueStateChange) break; /*for*/
-            }
-            if(!puserPvt) break; /*while(1)*/
-            pasynUser = userPvtToAsynUser(puserPvt);
-            pasynUser->errorMessage[0] = '\0';
-            asynPrint(pasynUser,ASYN_TRACE_FLOW,"asynManager::portThread port=%s callback\n",pport->portName);
-            puserPvt->state = callbackActive;
-            timeout = puserPvt->timeout;
-            epicsMutexUnlock(pport->asynManagerLock);
-            if(puserPvt->timer && timeout>0.0) epicsTimerCancel(puserPvt->timer);
-            epicsMutexMustLock(pport->synchronousLock);
-            if(pport->pasynLockPortNotify) {
-                status = pport->pasynLockPortNotify->lock(
-                   pport->lockPortNotifyPvt,pasynUser);
-                if(status!=asynSuccess) asynPrint(pasynUser,ASYN_TRACE_ERROR,
-                        "%s queueCallback pasynLockPortNotify:lock error %s\n",
-                         pport->portName,pasynUser->errorMessage);
+        if(pport->pasynLockPortNotify) {
+            status = pport->pasynLockPortNotify->unlock(
+               pport->lockPortNotifyPvt,pasynUser);
+            if(status!=asynSuccess) asynPrint(pasynUser,ASYN_TRACE_ERROR,
+                    "%s queueCallback pasynLockPortNotify:lock error %s\n",
+                     pport->portName,pasynUser->errorMessage);
+        }
+        epicsMutexUnlock(pport->synchronousLock);
+        epicsMutexMustLock(pport->asynManagerLock);
+        endTime = queueStatsTime();
+        serviceTime = endTime - startTime;
+        queueHistogramAdd(&pport->queueStats[i].service,serviceTime);
+        if(puserPvt->blockPortCount>0)
+            pport->pblockProcessHolder = puserPvt;
+        if(puserPvt->blockDeviceCount>0)
+            pdpCommon->pblockProcessHolder = puserPvt;
+        if(puserPvt->state==callbackCanceled)
+            epicsEventSignal(puserPvt->callbackDone);
+        puserPvt->state = callbackIdle;
+        if(puserPvt->freeAfterCallback) {
+            puserPvt->freeAfterCallback = FALSE;
+            asynUserFreeListPut(puserPvt);
+        }
+        while((pfollower = (userPvt *)ellGet(&coalescedList))) {
+            queueHistogramAdd(&pport->queueStats[i].service,serviceTime);
+            if(pfollower->blockPortCount>0)
+                pport->pblockProcessHolder = pfollower;
+            if(pfollower->blockDeviceCount>0)
+                pdpCommon->pblockProcessHolder = pfollower;
+            if(pfollower->state==callbackCanceled)
+                epicsEventSignal(pfollower->callbackDone);
+            pfollower->state = callbackIdle;
+            if(pfollower->freeAfterCallback) {
+                pfollower->freeAfterCallback = FALSE;
+                asynUserFreeListPut(pfollower);
             }
-            if(callTimeoutUser) {
-                puserPvt->timeoutUser(pasynUser);
+        }
+        if(pport->queueStateChange) break;
+    }
+    epicsMutexUnlock(pport->asynManagerLock);
+}
+
+static void portThread(port *pport)
+{
+    taskwdInsert(epicsThreadGetIdSelf(),0,0);
+    while(1) {
+        epicsEventMustWait(pport->notifyPortThread);
+        callQueuedRequests(pport);
+    }
+}
+
+/* Wakes up the thread that calls the queued requests of an ASYN_CANBLOCK port.
+ * The queued requests of ASYN_SHAREDTHREAD ports are called by a pool of shared
+ * threads, see setSharedThreads. Such a port is put on sharedReadyList, unless it
+ * is already there. If a shared thread is calling its requests the port is put
+ * back on sharedReadyList when the thread is done, so the requests queued in the
+ * meantime are not missed. A port is never called by two shared threads at once.
+ */
+static void notifyPort(port *pport)
+{
+    if(!(pport->attributes&ASYN_SHAREDTHREAD)) {
+        epicsEventSignal(pport->notifyPortThread);
+        return;
+    }
+    epicsMutexMustLock(pasynBase->sharedLock);
+    if(pport->sharedState==sharedIdle) {
+        pport->sharedState = sharedReady;
+        ellAdd(&pasynBase->sharedReadyList,&pport->sharedNode);
+        epicsEventSignal(pasynBase->sharedNotify);
+    } else if(pport->sharedState==sharedRunning) {
+        pport->sharedState = sharedRunningNotified;
+    }
+    epicsMutexUnlock(pasynBase->sharedLock);
+}
+
+/* Per thread state of a shared thread */
+typedef struct sharedThread {
+    int blockDepth; /*nesting of sharedThreadBlock*/
+}sharedThread;
+
+/* A shared thread calls the requests of the ports on sharedReadyList.
+ * A thread is extra while more threads than numSharedThreads are not blocked,
+ * see sharedThreadBlock. An extra thread exits when it has had nothing to do
+ * for SHARED_EXTRA_IDLE_TIME. */
+static void sharedPortThread(void *arg)
+{
+    sharedThread self;
+    ELLNODE *pnode;
+    port    *pport;
+    BOOL    extra;
+
+    self.blockDepth = 0;
+    epicsThreadPrivateSet(pasynBase->sharedThreadId,&self);
+    taskwdInsert(epicsThreadGetIdSelf(),0,0);
+    epicsMutexMustLock(pasynBase->sharedLock);
+    while(1) {
+        while((pnode = ellGet(&pasynBase->sharedReadyList))) {
+            pport = CONTAINER(pnode, port, sharedNode);
+            /*Wake up another shared thread for the next port*/
+            if(ellCount(&pasynBase->sharedReadyList)>0)
+                epicsEventSignal(pasynBase->sharedNotify);
+            pport->sharedState = sharedRunning;
+            epicsMutexUnlock(pasynBase->sharedLock);
+            callQueuedRequests(pport);
+            epicsMutexMustLock(pasynBase->sharedLock);
+            if(pport->sharedState==sharedRunningNotified) {
+                pport->sharedState = sharedReady;
+                ellAdd(&pasynBase->sharedReadyList,&pport->sharedNode);
             } else {
-                puserPvt->processUser(pasynUser);
-            }
-            if(pport->pasynLockPortNotify) {
-                status = pport->pasynLockPortNotify->unlock(
-                   pport->lockPortNotifyPvt,pasynUser);
-                if(status!=asynSuccess) asynPrint(pasynUser,ASYN_TRACE_ERROR,
-                        "%s queueCallback pasynLockPortNotify:lock error %s\n",
-                         pport->portName,pasynUser->errorMessage);
-            }
-            epicsMutexUnlock(pport->synchronousLock);
-            epicsMutexMustLock(pport->asynManagerLock);
-            if(puserPvt->blockPortCount>0)
-                pport->pblockProcessHolder = puserPvt;
-            if(puserPvt->blockDeviceCount>0)
-                pdpCommon->pblockProcessHolder = puserPvt;
-            if(puserPvt->state==callbackCanceled)
-                epicsEventSignal(puserPvt->callbackDone);
-            puserPvt->state = callbackIdle;
-            if(puserPvt->freeAfterCallback) {
-                puserPvt->freeAfterCallback = FALSE;
-                epicsMutexMustLock(pasynBase->lock);
-                ellAdd(&pasynBase->asynUserFreeList,&puserPvt->node);
-                epicsMutexUnlock(pasynBase->lock);
+                pport->sharedState = sharedIdle;
             }
-            if(pport->queueStateChange) break;
         }
-        epicsMutexUnlock(pport->asynManagerLock);
+        extra = (pasynBase->numSharedRunning - pasynBase->numSharedBlocked
+                 > pasynBase->numSharedThreads);
+        epicsMutexUnlock(pasynBase->sharedLock);
+        if(!extra) {
+            epicsEventMustWait(pasynBase->sharedNotify);
+            epicsMutexMustLock(pasynBase->sharedLock);
+        } else if(epicsEventWaitWithTimeout(pasynBase->sharedNotify,
+                    SHARED_EXTRA_IDLE_TIME)==epicsEventWaitOK) {
+            epicsMutexMustLock(pasynBase->sharedLock);
+        } else {
+            epicsMutexMustLock(pasynBase->sharedLock);
+            if(pasynBase->numSharedRunning - pasynBase->numSharedBlocked
+               > pasynBase->numSharedThreads) break;
+        }
+    }
+    pasynBase->numSharedRunning--;
+    epicsMutexUnlock(pasynBase->sharedLock);
+    taskwdRemove(0);
+}
+
+/*Starts a shared thread. Called with sharedLock, numSharedRunning is counted by the caller*/
+static BOOL startSharedThread(void)
+{
+    static int threadNumber = 0;
+    char name[32];
+
+    epicsSnprintf(name,sizeof(name),"asynShared%d",threadNumber);
+    if(!epicsThreadCreate(name,epicsThreadPriorityMedium,
+        epicsThreadGetStackSize(epicsThreadStackBig),
+        sharedPortThread,0)) {
+        printf("asynManager:startSharedThread epicsThreadCreate %s failed\n",name);
+        return FALSE;
+    }
+    threadNumber++;
+    return TRUE;
+}
+
+/*Called by registerPort for the first ASYN_SHAREDTHREAD port*/
+static void startSharedThreads(void)
+{
+    int  i,numThreads;
+
+    epicsMutexMustLock(pasynBase->sharedLock);
+    if(pasynBase->sharedThreadsStarted) {
+        epicsMutexUnlock(pasynBase->sharedLock);
+        return;
+    }
+    numThreads = pasynBase->numSharedThreads;
+    if(numThreads<=0) {
+#if EPICS_VERSION_INT >= VERSION_INT(3,15,0,2)
+        numThreads = DEFAULT_SHARED_THREADS_PER_CPU*epicsThreadGetCPUs();
+#endif
+        if(numThreads<MIN_SHARED_THREADS) numThreads = MIN_SHARED_THREADS;
+        pasynBase->numSharedThreads = numThreads;
     }
+    for(i=0; i<numThreads; i++) {
+        if(!startSharedThread()) break;
+    }
+    pasynBase->numSharedThreads = i;
+    pasynBase->numSharedRunning = i;
+    pasynBase->maxSharedRunning = i;
+    pasynBase->sharedThreadsStarted = TRUE;
+    epicsMutexUnlock(pasynBase->sharedLock);
+}
+
+/*Locks the port for a request, see sharedThreadBlock*/
+static void lockSynchronous(port *pport)
+{
+    if(epicsMutexTryLock(pport->synchronousLock)==epicsMutexLockOK) return;
+    sharedThreadBlock(1);
+    epicsMutexMustLock(pport->synchronousLock);
+    sharedThreadBlock(0);
 }
+
 static void queueLockPortCallback(asynUser *pasynUser)
 {
     userPvt  *puserPvt = asynUserToUserPvt(pasynUser);
@@ -954,8 +1458,12 @@ static void queueLockPortCallback(asynUser *pasynUser)
     asynPrint(pasynUser, ASYN_TRACE_FLOW,
         "%s asynManager::queueLockPortCallback waiting for mutex from queueUnlockPort\n",
         pport->portName);
+    /* The caller can hold the port for a long time, let the other ports have a
+     * shared thread meanwhile */
+    sharedThreadBlock(1);
     epicsMutexMustLock(plockPortPvt->queueLockPortMutex);
     epicsMutexUnlock(plockPortPvt->queueLockPortMutex);
+    sharedThreadBlock(0);
     asynPrint(pasynUser, ASYN_TRACE_FLOW,
         "%s asynManager::queueLockPortCallback got mutex from queueUnlockPort, signaling end event\n",
         pport->portName);
@@ -985,6 +1493,27 @@ static void queueLockPortTimeoutCallback(asynUser *pasynUser)
 };
 
 /* asynManager methods */
+static const char *queuePriorityName[asynQueuePriorityConnect+1] =
+    {"low","medium","high","connect"};
+
+static void reportQueueHistogram(FILE *fp,const char *name,
+    asynQueueHistogram *phistogram)
+{
+    int i;
+
+    fprintf(fp,"        %s histogram (us):",name);
+    for(i=0; i<ASYN_QUEUE_HISTOGRAM_BINS; i++) {
+        if(phistogram->bins[i]==0) continue;
+        if(i==0) {
+            fprintf(fp," <1:%lu",phistogram->bins[i]);
+        } else {
+            fprintf(fp," %s%lu:%lu",(i==ASYN_QUEUE_HISTOGRAM_BINS-1 ? ">=" : ""),
+                1ul<<(i-1),phistogram->bins[i]);
+        }
+    }
+    fprintf(fp,"\n");
+}
+
 static void reportPrintInterfaceList(FILE *fp,ELLLIST *plist,const char *title)
 {
     interfaceNode *pinterfaceNode = (interfaceNode *)ellFirst(plist);
@@ -999,6 +1528,22 @@ static void reportPrintInterfaceList(FILE *fp,ELLLIST *plist,const char *title)
     }
 }
 
+/* Number of queued requests of an ASYN_CANBLOCK port and its devices */
+static int countQueued(port *pport)
+{
+    device *pdevice;
+    int    i;
+    int    nQueued = ellCount(&pport->connectQueue);
+
+    for(i=asynQueuePriorityLow; i<asynQueuePriorityConnect; i++) {
+        nQueued += ellCount(&pport->dpc.queueList[i]);
+        for(pdevice = (device *)ellFirst(&pport->deviceList); pdevice;
+        pdevice = (device *)ellNext(&pdevice->node))
+            nQueued += ellCount(&pdevice->dpc.queueList[i]);
+    }
+    return nQueued;
+}
+
 /* reportPrintPort is done by separate thread so that synchronousLock
 *  and asynManagerLock can be properly reported. If report is run by same thread
 *  that has mutex then it would be reported no instead of yes
@@ -1028,8 +1573,8 @@ static void reportPrintPort(printPortArgs *pprintPortArgs)
         showDevices = 0;
         details = -details;
     }
-    for(i=asynQueuePriorityLow; i<=asynQueuePriorityConnect; i++)
-        nQueued += ellCount(&pport->queueList[i]);
+    if(pport->attributes&ASYN_CANBLOCK)
+        nQueued = countQueued(pport);
     pdpc = &pport->dpc;
     fprintf(fp,"%s multiDevice:%s canBlock:%s autoConnect:%s\n",
         pport->portName,
@@ -1053,6 +1598,31 @@ static void reportPrintPort(printPortArgs *pprintPortArgs)
             ellCount(&pport->deviceList),
             nQueued,
             (pport->pblockProcessHolder ? "Yes" : "No"));
+        if(pport->attributes&ASYN_SHAREDTHREAD) {
+            epicsMutexMustLock(pasynBase->sharedLock);
+            fprintf(fp,"    sharedThread:Yes of %d, %d running, %d blocked, max %d, %lu extra started\n",
+                pasynBase->numSharedThreads,pasynBase->numSharedRunning,
+                pasynBase->numSharedBlocked,pasynBase->maxSharedRunning,
+                pasynBase->numSharedExtra);
+            epicsMutexUnlock(pasynBase->sharedLock);
+        }
+        if(pport->numberCoalesced>0)
+            fprintf(fp,"    numberCoalesced %lu\n",pport->numberCoalesced);
+        for(i=asynQueuePriorityLow; i<=asynQueuePriorityConnect; i++) {
+            asynQueueStats *pstats = &pport->queueStats[i];
+
+            if(pstats->latency.count==0) continue;
+            fprintf(fp,"    %s priority requests %lu latency mean %.1f max %.1f "
+                "service mean %.1f max %.1f us\n",
+                queuePriorityName[i],pstats->latency.count,
+                pstats->latency.total/pstats->latency.count*1e6,pstats->latency.max*1e6,
+                (pstats->service.count ? pstats->service.total/pstats->service.count*1e6 : 0.0),
+                pstats->service.max*1e6);
+            if(details>=3) {
+                reportQueueHistogram(fp,"latency",&pstats->latency);
+                reportQueueHistogram(fp,"service",&pstats->service);
+            }
+        }
         fprintf(fp,"    asynManagerLock:%s synchronousLock:%s\n",
             ((mgrStatus==epicsMutexLockOK) ? "No" : "Yes"),
             ((syncStatus==epicsMutexLockOK) ? "No" : "Yes"));
@@ -1063,6 +1633,14 @@ static void reportPrintPort(printPortArgs *pprintPortArgs)
             ellCount(&pdpc->exceptionNotifyList));
         fprintf(fp,"    traceMask:0x%x traceIOMask:0x%x traceInfoMask:0x%x\n",
             pdpc->trace.traceMask, pdpc->trace.traceIOMask, pdpc->trace.traceInfoMask);
+        epicsMutexMustLock(pasynBase->lockTraceRing);
+        if(pport->ptraceRing) {
+            traceRing *pring = pport->ptraceRing;
+            fprintf(fp,"    traceRing size %lu messages %lu lost %lu\n",
+                (unsigned long)pring->size,(unsigned long)pring->head,
+                (unsigned long)pring->dropped);
+        }
+        epicsMutexUnlock(pasynBase->lockTraceRing);
     }
     if(details>=2) {
         reportPrintInterfaceList(fp,&pdpc->interposeInterfaceList,
@@ -1162,15 +1740,16 @@ static void report(FILE *fp,int details,const char *portName)
 
 static asynUser *createAsynUser(userCallback process, userCallback timeout)
 {
+    freeListCache *pcache;
     userPvt  *puserPvt;
     asynUser *pasynUser;
     int      nbytes;
 
     if(!pasynBase) asynInit();
-    epicsMutexMustLock(pasynBase->lock);
-    puserPvt = (userPvt *)ellFirst(&pasynBase->asynUserFreeList);
+    pcache = findFreeListCache();
+    puserPvt = (userPvt *)freeListGet(pcache ? &pcache->asynUserList : 0,
+                                      &pasynBase->asynUserFreeList);
     if(!puserPvt) {
-        epicsMutexUnlock(pasynBase->lock);
         nbytes = sizeof(userPvt) + ERROR_MESSAGE_SIZE + 1;
         puserPvt = callocMustSucceed(1,nbytes,"asynCommon:registerDriver");
         puserPvt->timer = epicsTimerQueueCreateTimer(
@@ -1180,8 +1759,6 @@ static asynUser *createAsynUser(userCallback process, userCallback timeout)
         pasynUser->errorMessage = (char *)(puserPvt +1);
         pasynUser->errorMessageSize = ERROR_MESSAGE_SIZE;
     } else {
-        ellDelete(&pasynBase->asynUserFreeList,&puserPvt->node);
-        epicsMutexUnlock(pasynBase->lock);
         pasynUser = userPvtToAsynUser(puserPvt);
     }
     puserPvt->processUser = process;
@@ -1193,6 +1770,10 @@ static asynUser *createAsynUser(userCallback process, userCallback timeout)
     assert(puserPvt->freeAfterCallback==FALSE);
     assert(puserPvt->pexceptionUser==0);
     puserPvt->isQueued = FALSE;
+    puserPvt->coalesceType = 0;
+    puserPvt->coalesceUser = 0;
+    assert(puserPvt->pcoalesceLeader==0);
+    assert(ellCount(&puserPvt->coalescedList)==0);
     pasynUser->errorMessage[0] = 0;
     pasynUser->timeout = 0.0;
     pasynUser->userPvt = 0;
@@ -1232,18 +1813,17 @@ static asynStatus freeAsynUser(asynUser *pasynUser)
         status = disconnect(pasynUser);
         if(status!=asynSuccess) return asynError;
     }
-    epicsMutexMustLock(pasynBase->lock);
     if(puserPvt->state==callbackIdle) {
-        ellAdd(&pasynBase->asynUserFreeList,&puserPvt->node);
+        asynUserFreeListPut(puserPvt);
     } else {
         puserPvt->freeAfterCallback = TRUE;
     }
-    epicsMutexUnlock(pasynBase->lock);
     return asynSuccess;
 }
 
 static void *memMalloc(size_t size)
 {
+    freeListCache *pcache;
     int ind;
     ELLLIST *pmemList;
     memNode *pmemNode;
@@ -1256,22 +1836,20 @@ static void *memMalloc(size_t size)
         return mallocMustSucceed(size,"asynManager::memMalloc");
     }
     pmemList = &pasynBase->memList[ind];
-    epicsMutexMustLock(pasynBase->lock);
-    pmemNode = (memNode *)ellFirst(pmemList);
-    if(pmemNode) {
-         ellDelete(pmemList,&pmemNode->node);
-     } else {
+    pcache = findFreeListCache();
+    pmemNode = (memNode *)freeListGet(pcache ? &pcache->memList[ind] : 0,pmemList);
+    if(!pmemNode) {
         /* Note: pmemNode->memory must be multiple of 16 in order to hold any data type */
         pmemNode = mallocMustSucceed(NODESIZE + memListSize[ind],
              "asynManager::memMalloc");
         pmemNode->memory = (char *)pmemNode + NODESIZE;
-     }
-     epicsMutexUnlock(pasynBase->lock);
-     return pmemNode->memory;
+    }
+    return pmemNode->memory;
 }
 
 static void memFree(void *pmem,size_t size)
 {
+    freeListCache *pcache;
     int ind;
     ELLLIST *pmemList;
     memNode *pmemNode;
@@ -1289,11 +1867,103 @@ static void memFree(void *pmem,size_t size)
     pmemList = &pasynBase->memList[ind];
     pmemNode = (memNode *)((char *)pmem - NODESIZE);
     assert(pmemNode->memory==pmem);
+    pcache = findFreeListCache();
+    freeListPut(pcache ? &pcache->memList[ind] : 0,pmemList,&pmemNode->node);
+}
+
+/* Returns the free list cache of this thread, or 0 if it has none */
+static freeListCache *findFreeListCache(void)
+{
+#ifdef ASYN_FREELIST_CACHE
+    freeListCache *pcache = epicsThreadPrivateGet(pasynBase->freeListCacheId);
+    int           i;
+
+    if(!pcache) {
+        pcache = callocMustSucceed(1,sizeof(freeListCache),
+            "asynManager:findFreeListCache");
+        ellInit(&pcache->asynUserList);
+        for(i=0; i<nMemList; i++) ellInit(&pcache->memList[i]);
+        if(epicsAtThreadExit(freeListCacheFlush,pcache)) {
+            free(pcache);
+            return 0;
+        }
+        epicsThreadPrivateSet(pasynBase->freeListCacheId,pcache);
+    }
+    return pcache;
+#else
+    return 0;
+#endif
+}
+
+#ifdef ASYN_FREELIST_CACHE
+/* Called when a thread with a free list cache exits */
+static void freeListCacheFlush(void *arg)
+{
+    freeListCache *pcache = (freeListCache *)arg;
+    int           i;
+
     epicsMutexMustLock(pasynBase->lock);
-    ellAdd(pmemList,&pmemNode->node);
+    ellConcat(&pasynBase->asynUserFreeList,&pcache->asynUserList);
+    for(i=0; i<nMemList; i++)
+        ellConcat(&pasynBase->memList[i],&pcache->memList[i]);
+    epicsMutexUnlock(pasynBase->lock);
+    epicsThreadPrivateSet(pasynBase->freeListCacheId,0);
+    free(pcache);
+}
+#endif
+
+/* Take a node from the cache of this thread, refilling it if it is empty.
+ * Returns 0 if the global list is also empty */
+static ELLNODE *freeListGet(ELLLIST *pcacheList,ELLLIST *pglobalList)
+{
+    ELLNODE *pnode;
+
+    if(!pcacheList) {
+        epicsMutexMustLock(pasynBase->lock);
+        pnode = ellGet(pglobalList);
+        epicsMutexUnlock(pasynBase->lock);
+        return pnode;
+    }
+    pnode = ellGet(pcacheList);
+    if(pnode) return pnode;
+    epicsMutexMustLock(pasynBase->lock);
+    while(ellCount(pcacheList)<FREELIST_CACHE_BATCH
+    && (pnode = ellGet(pglobalList))) {
+        ellAdd(pcacheList,pnode);
+    }
+    epicsMutexUnlock(pasynBase->lock);
+    return ellGet(pcacheList);
+}
+
+/* Put a node in the cache of this thread. Most recently freed nodes are
+ * reused first, and the oldest are returned to the global list when it is full */
+static void freeListPut(ELLLIST *pcacheList,ELLLIST *pglobalList,ELLNODE *pnode)
+{
+    if(!pcacheList) {
+        epicsMutexMustLock(pasynBase->lock);
+        ellAdd(pglobalList,pnode);
+        epicsMutexUnlock(pasynBase->lock);
+        return;
+    }
+    ellInsert(pcacheList,0,pnode);
+    if(ellCount(pcacheList)<=FREELIST_CACHE_MAX) return;
+    epicsMutexMustLock(pasynBase->lock);
+    while(ellCount(pcacheList)>FREELIST_CACHE_MAX-FREELIST_CACHE_BATCH) {
+        pnode = ellLast(pcacheList);
+        ellDelete(pcacheList,pnode);
+        ellAdd(pglobalList,pnode);
+    }
     epicsMutexUnlock(pasynBase->lock);
 }
 
+static void asynUserFreeListPut(userPvt *puserPvt)
+{
+    freeListCache *pcache = findFreeListCache();
+
+    freeListPut(pcache ? &pcache->asynUserList : 0,
+                &pasynBase->asynUserFreeList,&puserPvt->node);
+}
+
 static asynStatus isMultiDevice(asynUser *pasynUser,
     const char *portName,int *yesNo)
 {
@@ -1483,8 +2153,6 @@ static asynStatus queueRequest(asynUser *pasynUser,
     port     *pport = puserPvt->pport;
     device   *pdevice = puserPvt->pdevice;
     int      addr = (pdevice ? pdevice->addr : -1);
-    dpCommon *pdpCommon = findDpCommon(puserPvt);
-    BOOL     addToFront = FALSE;
     BOOL     checkPortConnect = TRUE;
 
     assert(priority>=asynQueuePriorityLow && priority<=asynQueuePriorityConnect);
@@ -1559,24 +2227,66 @@ static asynStatus queueRequest(asynUser *pasynUser,
             "timeout callback was passed to createAsynUser");
         return asynError;
     }
+    addToQueue(puserPvt,priority,timeout);
+    epicsMutexUnlock(pport->asynManagerLock);
+    notifyPort(pport);
+    return asynSuccess;
+}
+
+/*addToQueue must be called with asynManagerLock held*/
+static void addToQueue(userPvt *puserPvt,asynQueuePriority priority,double timeout)
+{
+    asynUser *pasynUser = userPvtToAsynUser(puserPvt);
+    port     *pport = puserPvt->pport;
+    device   *pdevice = puserPvt->pdevice;
+    int      addr = (pdevice ? pdevice->addr : -1);
+    dpCommon *pdpCommon = findDpCommon(puserPvt);
+    ELLLIST  *pqueueList;
+    BOOL     addToFront = FALSE;
+
+    puserPvt->queueTime = queueStatsTime();
     if(puserPvt->blockPortCount>0 || puserPvt->blockDeviceCount>0) {
         if(pport->pblockProcessHolder
         && pport->pblockProcessHolder==puserPvt) addToFront = TRUE;
         if(pdpCommon->pblockProcessHolder
         && pdpCommon->pblockProcessHolder==puserPvt) addToFront = TRUE;
     }
+    if(priority==asynQueuePriorityConnect) {
+        pqueueList = &pport->connectQueue;
+    } else {
+        pqueueList = &pdpCommon->queueList[priority];
+    }
+    if(puserPvt->coalesceUser && !addToFront && timeout<=0.0
+    && priority!=asynQueuePriorityConnect
+    && puserPvt->blockPortCount==0 && puserPvt->blockDeviceCount==0) {
+        userPvt *pleader = findCoalesceLeader(puserPvt,pqueueList);
+
+        if(pleader) {
+            asynPrint(pasynUser,ASYN_TRACE_FLOW,
+                "%s addr %d queueRequest priority %d merged with queued request\n",
+                pport->portName,addr,priority);
+            ellAdd(&pleader->coalescedList,&puserPvt->node);
+            puserPvt->pcoalesceLeader = pleader;
+            puserPvt->priority = priority;
+            puserPvt->isQueued = TRUE;
+            puserPvt->timeout = 0.0;
+            return;
+        }
+    }
     if(addToFront) {
         asynPrint(pasynUser,ASYN_TRACE_FLOW,
             "%s addr %d queueRequest priority %d from lockHolder\n",
             pport->portName,addr,priority);
-        ellInsert(&pport->queueList[priority],0,&puserPvt->node);
+        ellInsert(pqueueList,0,&puserPvt->node);
     } else {
         asynPrint(pasynUser,ASYN_TRACE_FLOW,
             "%s addr %d queueRequest priority %d not lockHolder\n",
             pport->portName,addr,priority);
         /*Add to end of list*/
-        ellAdd(&pport->queueList[priority],&puserPvt->node);
+        ellAdd(pqueueList,&puserPvt->node);
     }
+    puserPvt->priority = priority;
+    if(priority!=asynQueuePriorityConnect) readyDpCommon(pdpCommon,priority);
     pport->queueStateChange = TRUE;
     puserPvt->isQueued = TRUE;
     if(timeout<=0.0) {
@@ -1587,8 +2297,177 @@ static asynStatus queueRequest(asynUser *pasynUser,
             "%s schedule queueRequest timeout in %f seconds\n",puserPvt->pport->portName,puserPvt->timeout);
         epicsTimerStartDelay(puserPvt->timer,puserPvt->timeout);
     }
+}
+
+static asynStatus queueRequests(asynUser **ppasynUser,int nUsers,
+    asynQueuePriority priority,double timeout)
+{
+    port       *pport;
+    asynUser   *pasynUser;
+    userPvt    *puserPvt;
+    asynStatus status = asynSuccess;
+    int        i,nChecked;
+
+    if(nUsers<=0) return asynSuccess;
+    pasynUser = ppasynUser[0];
+    pport = asynUserToUserPvt(pasynUser)->pport;
+    if(!pport) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                "asynManager::queueRequests asynUser not associated with a port");
+        return asynError;
+    }
+    if(!(pport->attributes&ASYN_CANBLOCK)
+    || priority<asynQueuePriorityLow || priority>=asynQueuePriorityConnect) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                "asynManager::queueRequests port %s must be ASYN_CANBLOCK "
+                "and priority must be low, medium or high",pport->portName);
+        return asynError;
+    }
+    epicsMutexMustLock(pport->asynManagerLock);
+    if(!pport->dpc.enabled) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "port %s disabled",pport->portName);
+        epicsMutexUnlock(pport->asynManagerLock);
+        return asynDisabled;
+    }
+    if(!pport->dpc.connected) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "port %s not connected",pport->portName);
+        epicsMutexUnlock(pport->asynManagerLock);
+        return asynDisconnected;
+    }
+    /*Check them all first so that either all or none are queued.
+     *isQueued is set while checking to find an asynUser that is passed twice*/
+    for(nChecked=0; nChecked<nUsers; nChecked++) {
+        pasynUser = ppasynUser[nChecked];
+        puserPvt = asynUserToUserPvt(pasynUser);
+        if(puserPvt->pport!=pport) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                "asynManager::queueRequests asynUser not connected to port %s",
+                pport->portName);
+            status = asynError; break;
+        }
+        if(!puserPvt->processUser) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                "asynManager::queueRequests no processCallback");
+            status = asynError; break;
+        }
+        if(puserPvt->isQueued) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                "asynManager::queueRequests is already queued");
+            status = asynError; break;
+        }
+        if(timeout>0.0 && !puserPvt->timeoutUser) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                "asynManager::queueRequests timeout requested but no "
+                "timeout callback was passed to createAsynUser");
+            status = asynError; break;
+        }
+        puserPvt->isQueued = TRUE;
+    }
+    for(i=0; i<nChecked; i++) {
+        puserPvt = asynUserToUserPvt(ppasynUser[i]);
+        puserPvt->isQueued = FALSE;
+        if(status==asynSuccess) addToQueue(puserPvt,priority,timeout);
+    }
+    epicsMutexUnlock(pport->asynManagerLock);
+    if(status==asynSuccess) {
+        asynPrint(ppasynUser[0],ASYN_TRACE_FLOW,
+            "%s queueRequests %d requests priority %d\n",
+            pport->portName,nUsers,priority);
+        notifyPort(pport);
+    }
+    return status;
+}
+
+static asynStatus registerCoalesceCallback(asynUser *pasynUser,
+    const char *interfaceType,coalesceCallback callback)
+{
+    userPvt *puserPvt = asynUserToUserPvt(pasynUser);
+    port    *pport = puserPvt->pport;
+
+    if(!pport) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "asynManager::registerCoalesceCallback asynUser not connected to a port");
+        return asynError;
+    }
+    if(callback && !interfaceType) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "asynManager::registerCoalesceCallback no interfaceType");
+        return asynError;
+    }
+    epicsMutexMustLock(pport->asynManagerLock);
+    if(puserPvt->isQueued) {
+        epicsMutexUnlock(pport->asynManagerLock);
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "asynManager::registerCoalesceCallback is queued");
+        return asynError;
+    }
+    puserPvt->coalesceType = (callback ? interfaceType : 0);
+    puserPvt->coalesceUser = callback;
+    epicsMutexUnlock(pport->asynManagerLock);
+    return asynSuccess;
+}
+
+static asynStatus getQueueStats(asynUser *pasynUser,
+    asynQueuePriority priority,asynQueueStats *pstats)
+{
+    userPvt *puserPvt = asynUserToUserPvt(pasynUser);
+    port    *pport = puserPvt->pport;
+
+    if(!pport) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "asynManager::getQueueStats asynUser not connected to a port");
+        return asynError;
+    }
+    if(!(pport->attributes&ASYN_CANBLOCK)) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "asynManager::getQueueStats port %s does not have a queue",
+            pport->portName);
+        return asynError;
+    }
+    if(priority<asynQueuePriorityLow || priority>asynQueuePriorityConnect) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "asynManager::getQueueStats illegal priority %d",priority);
+        return asynError;
+    }
+    epicsMutexMustLock(pport->asynManagerLock);
+    *pstats = pport->queueStats[priority];
+    epicsMutexUnlock(pport->asynManagerLock);
+    return asynSuccess;
+}
+
+static asynStatus resetQueueStats(asynUser *pasynUser)
+{
+    userPvt *puserPvt = asynUserToUserPvt(pasynUser);
+    port    *pport = puserPvt->pport;
+
+    if(!pport) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "asynManager::resetQueueStats asynUser not connected to a port");
+        return asynError;
+    }
+    epicsMutexMustLock(pport->asynManagerLock);
+    memset(pport->queueStats,0,sizeof(pport->queueStats));
+    epicsMutexUnlock(pport->asynManagerLock);
+    return asynSuccess;
+}
+
+static asynStatus getQueueDepth(asynUser *pasynUser,int *nQueued)
+{
+    userPvt *puserPvt = asynUserToUserPvt(pasynUser);
+    port    *pport = puserPvt->pport;
+
+    if(!pport) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "asynManager::getQueueDepth asynUser not connected to a port");
+        return asynError;
+    }
+    *nQueued = 0;
+    if(!(pport->attributes&ASYN_CANBLOCK)) return asynSuccess;
+    epicsMutexMustLock(pport->asynManagerLock);
+    *nQueued = countQueued(pport);
     epicsMutexUnlock(pport->asynManagerLock);
-    epicsEventSignal(pport->notifyPortThread);
     return asynSuccess;
 }
 
@@ -1599,7 +2478,6 @@ static asynStatus cancelRequest(asynUser *pasynUser,int *wasQueued)
     device   *pdevice = puserPvt->pdevice;
     double   timeout;
     int      addr = (pdevice ? pdevice->addr : -1);
-    int      i;
     *wasQueued = 0; /*Initialize to not removed*/
     if(!pport) {
         asynPrint(pasynUser,ASYN_TRACE_ERROR,
@@ -1623,34 +2501,17 @@ static asynStatus cancelRequest(asynUser *pasynUser,int *wasQueued)
         }
         return asynSuccess;
     }
-    for(i=asynQueuePriorityConnect; i>=asynQueuePriorityLow; i--) {
-        puserPvt = (userPvt *)ellFirst(&pport->queueList[i]);
-        while(puserPvt) {
-            if(pasynUser == &puserPvt->user) {
-                ellDelete(&pport->queueList[i],&puserPvt->node);
-                *wasQueued = 1;
-                break;
-            }
-            puserPvt = (userPvt *)ellNext(&puserPvt->node);
-        }
-        if(puserPvt) break;
-    }
-    if(!puserPvt) {
-        asynPrint(pasynUser,ASYN_TRACE_ERROR,
-            "%s addr %d asynManager:cancelRequest LOGIC ERROR\n",
-            pport->portName, addr);
-        epicsMutexUnlock(pport->asynManagerLock);
-        return asynError;
-    }
+    if(ellCount(&puserPvt->coalescedList)>0) replaceCoalesceLeader(puserPvt);
+    dequeueRequest(puserPvt);
+    *wasQueued = 1;
     asynPrint(pasynUser,ASYN_TRACE_FLOW,
              "%s addr %d asynManager:cancelRequest\n",
               pport->portName,addr);
-    puserPvt->isQueued = FALSE;
     pport->queueStateChange = TRUE;
     timeout = puserPvt->timeout;
     epicsMutexUnlock(pport->asynManagerLock);
     if(puserPvt->timer && timeout>0.0) epicsTimerCancel(puserPvt->timer);
-    epicsEventSignal(pport->notifyPortThread);
+    notifyPort(pport);
     return asynSuccess;
 }
 
@@ -1730,11 +2591,12 @@ static asynStatus unblockProcessCallback(asynUser *pasynUser, int allDevices)
 
         if (pdpCommon->pblockProcessHolder==puserPvt) {
             pdpCommon->pblockProcessHolder = 0;
+            readyDpCommonAll(pdpCommon);
             wasOwner = TRUE;
         }
     }
     epicsMutexUnlock(pport->asynManagerLock);
-    if(wasOwner) epicsEventSignal(pport->notifyPortThread);
+    if(wasOwner) notifyPort(pport);
     return asynSuccess;
 }
 
@@ -1981,6 +2843,7 @@ static asynStatus registerPort(const char *portName,
     pport = callocMustSucceed(len,sizeof(char),"asynCommon:registerDriver");
     pport->portName = (char *)(pport + 1);
     strcpy(pport->portName,portName);
+    if(!(attributes&ASYN_CANBLOCK)) attributes &= ~ASYN_SHAREDTHREAD;
     pport->attributes = attributes;
     pport->asynManagerLock = epicsMutexMustCreate();
     pport->synchronousLock = epicsMutexMustCreate();
@@ -1993,7 +2856,13 @@ static asynStatus registerPort(const char *portName,
     ellInit(&pport->deviceList);
     ellInit(&pport->interfaceList);
     if((attributes&ASYN_CANBLOCK)) {
-        for(i=0; i<NUMBER_QUEUE_PRIORITIES; i++) ellInit(&pport->queueList[i]);
+        ellInit(&pport->connectQueue);
+        for(i=0; i<asynQueuePriorityConnect; i++) ellInit(&pport->readyList[i]);
+    }
+    if((attributes&ASYN_SHAREDTHREAD)) {
+        pport->sharedState = sharedIdle;
+        startSharedThreads();
+    } else if((attributes&ASYN_CANBLOCK)) {
         pport->notifyPortThread = epicsEventMustCreate(epicsEventEmpty);
         priority = priority ? priority : epicsThreadPriorityMedium;
         stackSize = stackSize ?
@@ -2222,6 +3091,60 @@ static asynStatus setAutoConnectTimeout(double timeout)
     return asynSuccess;
 }
 
+static asynStatus setSharedThreads(int numThreads)
+{
+    asynStatus status = asynSuccess;
+
+    if(!pasynBase) asynInit();
+    epicsMutexMustLock(pasynBase->sharedLock);
+    if(pasynBase->sharedThreadsStarted) {
+        printf("asynManager:setSharedThreads %d shared threads already started\n",
+            pasynBase->numSharedThreads);
+        status = asynError;
+    } else {
+        pasynBase->numSharedThreads = numThreads;
+    }
+    epicsMutexUnlock(pasynBase->sharedLock);
+    return status;
+}
+
+static asynStatus sharedThreadBlock(int yesNo)
+{
+    sharedThread *pself;
+    BOOL start = FALSE;
+
+    if(!pasynBase) return asynSuccess;
+    pself = epicsThreadPrivateGet(pasynBase->sharedThreadId);
+    if(!pself) return asynSuccess; /*Not a shared thread*/
+    if(yesNo) {
+        if(pself->blockDepth++ > 0) return asynSuccess;
+        epicsMutexMustLock(pasynBase->sharedLock);
+        pasynBase->numSharedBlocked++;
+        if(pasynBase->numSharedRunning - pasynBase->numSharedBlocked
+           < pasynBase->numSharedThreads) {
+            /*Start an extra thread so the other ports are not held up*/
+            start = startSharedThread();
+            if(start) {
+                pasynBase->numSharedRunning++;
+                pasynBase->numSharedExtra++;
+                if(pasynBase->numSharedRunning>pasynBase->maxSharedRunning)
+                    pasynBase->maxSharedRunning = pasynBase->numSharedRunning;
+            }
+        } else if(ellCount(&pasynBase->sharedReadyList)>0) {
+            /*An idle extra thread takes over*/
+            epicsEventSignal(pasynBase->sharedNotify);
+        }
+        epicsMutexUnlock(pasynBase->sharedLock);
+    } else {
+        if(pself->blockDepth<=0) return asynError;
+        if(--pself->blockDepth > 0) return asynSuccess;
+        epicsMutexMustLock(pasynBase->sharedLock);
+        pasynBase->numSharedBlocked--;
+        epicsMutexUnlock(pasynBase->sharedLock);
+    }
+    return asynSuccess;
+}
+
 static asynStatus setQueueLockPortTimeout(asynUser *pasynUser, double timeout)
 {
     userPvt    *puserPvt = asynUserToUserPvt(pasynUser);
@@ -2394,6 +3317,9 @@ static asynStatus addInterruptUser(asynUser *pasynUser,
     }
     ellAdd(&pinterruptBase->callbackList,&pinterruptNode->node);
     pinterruptNodePvt->isOnList = TRUE;
+    pinterruptBase->listVersion++;
+    if(pinterruptBase->listCallback)
+        pinterruptBase->listCallback(pinterruptBase->listCallbackPvt,pinterruptNode,1);
     epicsMutexUnlock(pport->asynManagerLock);
     return asynSuccess;
 }
@@ -2428,6 +3354,9 @@ static asynStatus removeInterruptUser(asynUser *pasynUser,
     }
     ellDelete(&pinterruptBase->callbackList,&pinterruptNode->node);
     pinterruptNodePvt->isOnList = FALSE;
+    pinterruptBase->listVersion++;
+    if(pinterruptBase->listCallback)
+        pinterruptBase->listCallback(pinterruptBase->listCallbackPvt,pinterruptNode,0);
     epicsMutexUnlock(pport->asynManagerLock);
     return asynSuccess;
 }
@@ -2469,6 +3398,36 @@ static asynStatus interruptEnd(void *pasynPvt)
     return asynSuccess;
 }
 
+static asynStatus getInterruptListVersion(void *pasynPvt,
+    unsigned long *version)
+{
+    interruptBase  *pinterruptBase = (interruptBase *)pasynPvt;
+
+    /* No lock needed: the caller is between interruptStart and interruptEnd,
+     * so addInterruptUser/removeInterruptUser can not change listVersion */
+    *version = pinterruptBase->listVersion;
+    return asynSuccess;
+}
+
+static asynStatus registerInterruptListCallback(void *pasynPvt,
+    interruptListCallback callback,void *userPvt)
+{
+    interruptBase  *pinterruptBase = (interruptBase *)pasynPvt;
+    port *pport = pinterruptBase->pport;
+
+    epicsMutexMustLock(pport->asynManagerLock);
+    if(callback && pinterruptBase->listCallback) {
+        epicsMutexUnlock(pport->asynManagerLock);
+        printf("%s asynManager:registerInterruptListCallback already registered\n",
+            pport->portName);
+        return asynError;
+    }
+    pinterruptBase->listCallback = callback;
+    pinterruptBase->listCallbackPvt = userPvt;
+    epicsMutexUnlock(pport->asynManagerLock);
+    return asynSuccess;
+}
+
 /* Time stamp functions */
 
 static void defaultTimeStampSource(void *userPvt, epicsTimeStamp *pTimeStamp)
@@ -2713,6 +3672,8 @@ static asynStatus setTraceFile(asynUser *pasynUser,FILE *fp)
     userPvt  *puserPvt = asynUserToUserPvt(pasynUser);
     tracePvt *ptracePvt  = findTracePvt(puserPvt);
 
+    /* Write queued messages to the file they were issued for */
+    traceRingDrainAll();
     epicsMutexMustLock(pasynBase->lockTrace);
     if(ptracePvt->type==traceFileFP) {
         int status;
@@ -2738,10 +3699,8 @@ static asynStatus setTraceFile(asynUser *pasynUser,FILE *fp)
     return asynSuccess;
 }
 
-static FILE *getTraceFile(asynUser *pasynUser)
+static FILE *traceFile(tracePvt *ptracePvt)
 {
-    userPvt  *puserPvt = asynUserToUserPvt(pasynUser);
-    tracePvt *ptracePvt  = findTracePvt(puserPvt);
     FILE     *fp = 0;
 
     switch(ptracePvt->type) {
@@ -2753,6 +3712,13 @@ static FILE *getTraceFile(asynUser *pasynUser)
     return fp;
 }
 
+static FILE *getTraceFile(asynUser *pasynUser)
+{
+    userPvt  *puserPvt = asynUserToUserPvt(pasynUser);
+
+    return traceFile(findTracePvt(puserPvt));
+}
+
 static asynStatus setTraceIOTruncateSize(asynUser *pasynUser,size_t size)
 {
     userPvt  *puserPvt = asynUserToUserPvt(pasynUser);
@@ -2779,35 +3745,27 @@ static size_t getTraceIOTruncateSize(asynUser *pasynUser)
     return ptracePvt->traceTruncateSize;
 }
 
-static size_t printThread(FILE *fp)
+static size_t printThread(FILE *fp, const char *threadName,
+    epicsThreadId threadId, unsigned int threadPriority)
 {
     size_t nout = 0;
-    unsigned int threadPriority = epicsThreadGetPrioritySelf();
-    epicsThreadId threadId = epicsThreadGetIdSelf();
     if(fp) {
-        nout = fprintf(fp,"[%s,%p,%u] ",epicsThreadGetNameSelf(),
+        nout = fprintf(fp,"[%s,%p,%u] ",threadName,
                        (void*)threadId,threadPriority);
     } else {
-        nout = errlogPrintf("[%s,%p,%u] ",epicsThreadGetNameSelf(),
+        nout = errlogPrintf("[%s,%p,%u] ",threadName,
                             (void*)threadId,threadPriority);
     }
     return nout;
 }
 
-static size_t printTime(FILE *fp)
+static size_t printTime(FILE *fp, epicsTimeStamp *ptime)
 {
-    epicsTimeStamp now;
     char nowText[40];
-    size_t rtn;
 
-    rtn = epicsTimeGetCurrent(&now);
-    if(rtn) {
-        printf("epicsTimeGetCurrent failed\n");
-        return 0;
-    }
     nowText[0] = 0;
     epicsTimeToStrftime(nowText,sizeof(nowText),
-         "%Y/%m/%d %H:%M:%S.%03f",&now);
+         "%Y/%m/%d %H:%M:%S.%03f",ptime);
     if(fp) {
         return fprintf(fp,"%s ",nowText);
     } else {
@@ -2815,22 +3773,14 @@ static size_t printTime(FILE *fp)
     }
 }
 
-static size_t printPort(FILE *fp, asynUser *pasynUser)
+static size_t printPort(FILE *fp, const char *portName, int addr, int reason)
 {
-    userPvt *puserPvt = asynUserToUserPvt(pasynUser);
-    port    *pport = puserPvt->pport;
-    int addr;
     size_t nout = 0;
 
-    if(!pport) {
-        return nout;
-    }
-
-    getAddr(pasynUser, &addr);
     if(fp) {
-        nout = fprintf(fp,"[%s,%d,%d] ",pport->portName, addr, pasynUser->reason);
+        nout = fprintf(fp,"[%s,%d,%d] ",portName, addr, reason);
     } else {
-        nout = errlogPrintf("[%s,%d,%d] ",pport->portName, addr, pasynUser->reason);
+        nout = errlogPrintf("[%s,%d,%d] ",portName, addr, reason);
     }
     return nout;
 }
@@ -2848,6 +3798,262 @@ static size_t printSource(FILE *fp, const char *file, int line)
     return nout;
 }
 
+/* Print the optional fields selected by traceInfoMask for the caller */
+static int printInfo(FILE *fp, asynUser *pasynUser, int traceInfoMask,
+    const char *file, int line)
+{
+    userPvt *puserPvt = asynUserToUserPvt(pasynUser);
+    int     nout = 0;
+
+    if (traceInfoMask & ASYN_TRACEINFO_TIME) {
+        epicsTimeStamp now;
+        if(epicsTimeGetCurrent(&now)) {
+            printf("epicsTimeGetCurrent failed\n");
+        } else {
+            nout += (int)printTime(fp, &now);
+        }
+    }
+    if ((traceInfoMask & ASYN_TRACEINFO_PORT) && puserPvt->pport) {
+        int addr;
+        getAddr(pasynUser, &addr);
+        nout += (int)printPort(fp, puserPvt->pport->portName, addr, pasynUser->reason);
+    }
+    if (traceInfoMask & ASYN_TRACEINFO_SOURCE) nout += (int)printSource(fp, file, line);
+    if (traceInfoMask & ASYN_TRACEINFO_THREAD)
+        nout += (int)printThread(fp, epicsThreadGetNameSelf(),
+                    epicsThreadGetIdSelf(), epicsThreadGetPrioritySelf());
+    return nout;
+}
+
+/* Print the I/O data of printIO as selected by traceIOMask. Caller holds lockTrace */
+static int printIOData(FILE *fp, tracePvt *ptracePvt, int traceIOMask,
+    size_t traceTruncateSize, const char *buffer, size_t nBytes)
+{
+    int nout = 0;
+
+    if((traceIOMask&ASYN_TRACEIO_ASCII) && (nBytes>0)) {
+       if(fp) {
+           nout += fprintf(fp,"%.*s\n",(int)nBytes,buffer);
+       } else {
+           nout += errlogPrintf("%.*s\n",(int)nBytes,buffer);
+       }
+    }
+    if(traceIOMask&ASYN_TRACEIO_ESCAPE) {
+        if(nBytes>0) {
+            if(fp) {
+                nout += epicsStrPrintEscaped(fp,buffer,nBytes);
+                nout += fprintf(fp,"\n");
+            } else {
+                nout += epicsStrSnPrintEscaped(ptracePvt->traceBuffer,
+                                               ptracePvt->traceBufferSize,
+                                               buffer,
+                                               nBytes);
+                errlogPrintf("%s\n",ptracePvt->traceBuffer);
+            }
+        }
+    }
+    if((traceIOMask&ASYN_TRACEIO_HEX) && (traceTruncateSize>0)) {
+        size_t i;
+        for(i=0; i<nBytes; i++) {
+            if(i%20 == 0) {
+                if(fp) {
+                    nout += fprintf(fp,"\n");
+                } else {
+                    nout += errlogPrintf("\n");
+                }
+            }
+            if(fp) {
+                nout += fprintf(fp,"%2.2x ",(unsigned char)buffer[i]);
+            } else {
+                nout += errlogPrintf("%2.2x ",(unsigned char)buffer[i]);
+            }
+        }
+        if(fp) {
+            nout += fprintf(fp,"\n");
+        } else {
+            nout += errlogPrintf("\n");
+        }
+    }
+    /* If the traceIOMask is 0 or traceTruncateSize <=0 we need to output a newline */
+    if((traceIOMask == 0) || (traceTruncateSize ==0)) {
+        if(fp) {
+            nout += fprintf(fp,"\n");
+        } else {
+            nout += errlogPrintf("\n");
+        }
+    }
+    return nout;
+}
+
+#ifdef ASYN_TRACE_RING
+/* Copy a trace message into the ring of the port.
+ * Returns the length of the message, 0 if the ring is full,
+ * or -1 if the port has no ring, in which case the caller prints the message.
+ * traceRingUsers tells setTraceRingSize when no caller can still use an old ring.
+ */
+static int traceRingWrite(asynUser *pasynUser, tracePvt *ptracePvt,
+    const char *buffer, size_t len, BOOL isIO,
+    const char *file, int line, const char *pformat, va_list pvar)
+{
+    userPvt     *puserPvt = asynUserToUserPvt(pasynUser);
+    port        *pport = puserPvt->pport;
+    traceRing   *pring;
+    traceRecord *precord;
+    size_t      pos, sequence, nBytes;
+    int         nout = -1;
+
+    epicsAtomicIncrIntT(&pport->traceRingUsers);
+    pring = (traceRing *)epicsAtomicGetPtrT((EpicsAtomicPtrT *)&pport->ptraceRing);
+    if(!pring) goto done;
+    pos = epicsAtomicGetSizeT(&pring->head);
+    while(1) {
+        precord = &pring->records[pos & (pring->size - 1)];
+        sequence = epicsAtomicGetSizeT(&precord->sequence);
+        if(sequence==pos) {
+            if(epicsAtomicCmpAndSwapSizeT(&pring->head,pos,pos+1)==pos) break;
+        } else if((ptrdiff_t)(sequence - pos) < 0) {
+            /* traceRingThread has not written this record yet */
+            epicsAtomicIncrSizeT(&pring->dropped);
+            nout = 0;
+            goto done;
+        }
+        pos = epicsAtomicGetSizeT(&pring->head);
+    }
+    precord->ptracePvt = ptracePvt;
+    precord->traceInfoMask = ptracePvt->traceInfoMask;
+    precord->traceIOMask = ptracePvt->traceIOMask;
+    precord->traceTruncateSize = ptracePvt->traceTruncateSize;
+    precord->isIO = isIO;
+    if(precord->traceInfoMask & ASYN_TRACEINFO_TIME)
+        epicsTimeGetCurrent(&precord->time);
+    if(precord->traceInfoMask & ASYN_TRACEINFO_PORT) {
+        getAddr(pasynUser, &precord->addr);
+        precord->reason = pasynUser->reason;
+    }
+    precord->file = file;
+    precord->line = line;
+    if(precord->traceInfoMask & ASYN_TRACEINFO_THREAD) {
+        strncpy(precord->threadName,epicsThreadGetNameSelf(),
+                TRACE_RING_THREAD_NAME_SIZE-1);
+        precord->threadName[TRACE_RING_THREAD_NAME_SIZE-1] = 0;
+        precord->threadId = epicsThreadGetIdSelf();
+        precord->threadPriority = epicsThreadGetPrioritySelf();
+    }
+    nout = epicsVsnprintf(precord->data,TRACE_RING_DATA_SIZE,pformat,pvar);
+    if(nout<0) nout = 0;
+    precord->messageTruncated = (nout >= TRACE_RING_DATA_SIZE);
+    precord->messageLength = precord->messageTruncated ? TRACE_RING_DATA_SIZE-1 : nout;
+    precord->ioLength = 0;
+    if(isIO) {
+        nBytes = (len<precord->traceTruncateSize) ? len : precord->traceTruncateSize;
+        if(nBytes > TRACE_RING_DATA_SIZE - precord->messageLength)
+            nBytes = TRACE_RING_DATA_SIZE - precord->messageLength;
+        memcpy(precord->data + precord->messageLength, buffer, nBytes);
+        precord->ioLength = nBytes;
+    }
+    epicsAtomicWriteMemoryBarrier();
+    epicsAtomicSetSizeT(&precord->sequence,pos+1);
+    /* Wake traceRingThread each time half of the ring has been used */
+    if(((pos+1) & (pring->size/2 - 1))==0) epicsEventSignal(pasynBase->traceRingEvent);
+done:
+    epicsAtomicDecrIntT(&pport->traceRingUsers);
+    return nout;
+}
+
+/* Write all records that are ready. Caller holds lockTraceRing */
+static void traceRingDrain(traceRing *pring)
+{
+    traceRecord *precord;
+    FILE        *fp, *fpFlush = 0;
+    size_t      dropped;
+
+    epicsMutexMustLock(pasynBase->lockTrace);
+    while(1) {
+        precord = &pring->records[pring->tail & (pring->size - 1)];
+        if(epicsAtomicGetSizeT(&precord->sequence) != pring->tail+1) break;
+        epicsAtomicReadMemoryBarrier();
+        fp = traceFile(precord->ptracePvt);
+        if(fpFlush && fp!=fpFlush) fflush(fpFlush);
+        fpFlush = fp;
+        if (precord->traceInfoMask & ASYN_TRACEINFO_TIME) printTime(fp, &precord->time);
+        if (precord->traceInfoMask & ASYN_TRACEINFO_PORT)
+            printPort(fp, pring->pport->portName, precord->addr, precord->reason);
+        if (precord->traceInfoMask & ASYN_TRACEINFO_SOURCE)
+            printSource(fp, precord->file, precord->line);
+        if (precord->traceInfoMask & ASYN_TRACEINFO_THREAD)
+            printThread(fp, precord->threadName, precord->threadId, precord->threadPriority);
+        if(fp) {
+            fprintf(fp,"%.*s%s",(int)precord->messageLength,precord->data,
+                precord->messageTruncated ? "...\n" : "");
+        } else {
+            errlogPrintf("%.*s%s",(int)precord->messageLength,precord->data,
+                precord->messageTruncated ? "...\n" : "");
+        }
+        if(precord->isIO) {
+            printIOData(fp, precord->ptracePvt, precord->traceIOMask,
+                precord->traceTruncateSize,
+                precord->data + precord->messageLength, precord->ioLength);
+        }
+        /* Full barrier, so the record is not reused before it has been written */
+        epicsAtomicCmpAndSwapSizeT(&precord->sequence,
+            pring->tail+1, pring->tail+pring->size);
+        pring->tail++;
+    }
+    dropped = epicsAtomicGetSizeT(&pring->dropped);
+    if(dropped != pring->droppedReported) {
+        fp = traceFile(&pring->pport->dpc.trace);
+        if(fpFlush && fp!=fpFlush) fflush(fpFlush);
+        fpFlush = fp;
+        if(fp) {
+            fprintf(fp,"%s asynTrace ring full, %lu messages lost\n",
+                pring->pport->portName,(unsigned long)(dropped - pring->droppedReported));
+        } else {
+            errlogPrintf("%s asynTrace ring full, %lu messages lost\n",
+                pring->pport->portName,(unsigned long)(dropped - pring->droppedReported));
+        }
+        pring->droppedReported = dropped;
+    }
+    if(fpFlush) fflush(fpFlush);
+    epicsMutexUnlock(pasynBase->lockTrace);
+}
+
+static void traceRingDrainAll(void)
+{
+    traceRing *pring;
+
+    if(!pasynBase) return;
+    epicsMutexMustLock(pasynBase->lockTraceRing);
+    pring = (traceRing *)ellFirst(&pasynBase->traceRingList);
+    while(pring) {
+        traceRingDrain(pring);
+        pring = (traceRing *)ellNext(&pring->node);
+    }
+    epicsMutexUnlock(pasynBase->lockTraceRing);
+}
+
+static void traceRingThread(void *arg)
+{
+    while(1) {
+        epicsEventWaitWithTimeout(pasynBase->traceRingEvent,TRACE_RING_FLUSH_PERIOD);
+        traceRingDrainAll();
+    }
+}
+
+static void traceRingExit(void *arg)
+{
+    traceRingDrainAll();
+}
+#else
+static int traceRingWrite(asynUser *pasynUser, tracePvt *ptracePvt,
+    const char *buffer, size_t len, BOOL isIO,
+    const char *file, int line, const char *pformat, va_list pvar)
+{
+    return -1;
+}
+
+static void traceRingDrainAll(void) {}
+#endif
+
 static int tracePrint(asynUser *pasynUser,int reason, const char *pformat, ...)
 {
     va_list  pvar;
@@ -2882,14 +4088,16 @@ static int traceVprintSource(asynUser *pasynUser,int reason, const char *file, i
     int      nout = 0;
     FILE     *fp;
 
-    file = asynStripPath(file);
     if(!(reason & ptracePvt->traceMask)) return 0;
+    if(puserPvt->pport && puserPvt->pport->ptraceRing) {
+        nout = traceRingWrite(pasynUser, ptracePvt, 0, 0, FALSE,
+                              file, line, pformat, pvar);
+        if(nout>=0) return nout;
+        nout = 0;
+    }
     epicsMutexMustLock(pasynBase->lockTrace);
     fp = getTraceFile(pasynUser);
-    if (ptracePvt->traceInfoMask & ASYN_TRACEINFO_TIME) nout += (int)printTime(fp);
-    if (ptracePvt->traceInfoMask & ASYN_TRACEINFO_PORT) nout += (int)printPort(fp, pasynUser);
-    if (ptracePvt->traceInfoMask & ASYN_TRACEINFO_SOURCE) nout += (int)printSource(fp, file, line);
-    if (ptracePvt->traceInfoMask & ASYN_TRACEINFO_THREAD) nout += (int)printThread(fp);
+    nout += printInfo(fp, pasynUser, ptracePvt->traceInfoMask, file, line);
     if(fp) {
         nout += vfprintf(fp,pformat,pvar);
     } else {
@@ -2944,74 +4152,93 @@ static int traceVprintIOSource(asynUser *pasynUser,int reason,
     traceIOMask = ptracePvt->traceIOMask;
     traceTruncateSize = ptracePvt->traceTruncateSize;
     if(!(reason&traceMask)) return 0;
+    if(puserPvt->pport && puserPvt->pport->ptraceRing) {
+        nout = traceRingWrite(pasynUser, ptracePvt, buffer, len, TRUE,
+                              file, line, pformat, pvar);
+        if(nout>=0) return nout;
+        nout = 0;
+    }
     epicsMutexMustLock(pasynBase->lockTrace);
     fp = getTraceFile(pasynUser);
-    if (ptracePvt->traceInfoMask & ASYN_TRACEINFO_TIME) nout += (int)printTime(fp);
-    if (ptracePvt->traceInfoMask & ASYN_TRACEINFO_PORT) nout += (int)printPort(fp, pasynUser);
-    if (ptracePvt->traceInfoMask & ASYN_TRACEINFO_SOURCE) nout += (int)printSource(fp, file, line);
-    if (ptracePvt->traceInfoMask & ASYN_TRACEINFO_THREAD) nout += (int)printThread(fp);
+    nout += printInfo(fp, pasynUser, ptracePvt->traceInfoMask, file, line);
     if(fp) {
         nout += vfprintf(fp,pformat,pvar);
     } else {
         nout += errlogVprintf(pformat,pvar);
     }
     nBytes = (len<traceTruncateSize) ? len : traceTruncateSize;
-    if((traceIOMask&ASYN_TRACEIO_ASCII) && (nBytes>0)) {
-       if(fp) {
-           nout += fprintf(fp,"%.*s\n",(int)nBytes,buffer);
-       } else {
-           nout += errlogPrintf("%.*s\n",(int)nBytes,buffer);
-       }
-    }
-    if(traceIOMask&ASYN_TRACEIO_ESCAPE) {
-        if(nBytes>0) {
-            if(fp) {
-                nout += epicsStrPrintEscaped(fp,buffer,nBytes);
-                nout += fprintf(fp,"\n");
-            } else {
-                nout += epicsStrSnPrintEscaped(ptracePvt->traceBuffer,
-                                               ptracePvt->traceBufferSize,
-                                               buffer,
-                                               nBytes);
-                errlogPrintf("%s\n",ptracePvt->traceBuffer);
-            }
-        }
-    }
-    if((traceIOMask&ASYN_TRACEIO_HEX) && (traceTruncateSize>0)) {
-        size_t i;
-        for(i=0; i<nBytes; i++) {
-            if(i%20 == 0) {
-                if(fp) {
-                    nout += fprintf(fp,"\n");
-                } else {
-                    nout += errlogPrintf("\n");
-                }
-            }
-            if(fp) {
-                nout += fprintf(fp,"%2.2x ",(unsigned char)buffer[i]);
-            } else {
-                nout += errlogPrintf("%2.2x ",(unsigned char)buffer[i]);
-            }
-        }
-        if(fp) {
-            nout += fprintf(fp,"\n");
-        } else {
-            nout += errlogPrintf("\n");
-        }
-    }
-    /* If the traceIOMask is 0 or traceTruncateSize <=0 we need to output a newline */
-    if((traceIOMask == 0) || (traceTruncateSize ==0)) {
-        if(fp) {
-            nout += fprintf(fp,"\n");
-        } else {
-            nout += errlogPrintf("\n");
-        }
-    }
+    nout += printIOData(fp, ptracePvt, traceIOMask, traceTruncateSize, buffer, nBytes);
     fflush(fp);
     epicsMutexUnlock(pasynBase->lockTrace);
     return nout;
 }
 
+static asynStatus setTraceRingSize(asynUser *pasynUser,size_t size)
+{
+    userPvt   *puserPvt = asynUserToUserPvt(pasynUser);
+    port      *pport = puserPvt->pport;
+#ifdef ASYN_TRACE_RING
+    traceRing *pring = 0;
+    traceRing *pold;
+    size_t    i;
+
+    if(!pport) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "asynManager:setTraceRingSize not connected");
+        return asynError;
+    }
+    if(size>0) {
+        pring = callocMustSucceed(1,sizeof(traceRing),"asynManager:setTraceRingSize");
+        pring->pport = pport;
+        pring->size = TRACE_RING_MIN_SIZE;
+        while(pring->size<size) pring->size <<= 1;
+        pring->records = callocMustSucceed(pring->size,sizeof(traceRecord),
+            "asynManager:setTraceRingSize");
+        for(i=0; i<pring->size; i++) pring->records[i].sequence = i;
+    }
+    epicsMutexMustLock(pasynBase->lockTraceRing);
+    if(pring && !pasynBase->traceRingThread) {
+        pasynBase->traceRingEvent = epicsEventMustCreate(epicsEventEmpty);
+        pasynBase->traceRingThread = epicsThreadMustCreate("asynTrace",
+            epicsThreadPriorityLow,
+            epicsThreadGetStackSize(epicsThreadStackMedium),
+            traceRingThread,0);
+        epicsAtExit(traceRingExit,0);
+    }
+    pold = pport->ptraceRing;
+    epicsAtomicSetPtrT((EpicsAtomicPtrT *)&pport->ptraceRing,pring);
+    if(pold) {
+        /* Wait for callers that may still be writing to the old ring */
+        while(epicsAtomicGetIntT(&pport->traceRingUsers)>0) epicsThreadSleep(0.001);
+        traceRingDrain(pold);
+        ellDelete(&pasynBase->traceRingList,&pold->node);
+        free(pold->records);
+        free(pold);
+    }
+    if(pring) ellAdd(&pasynBase->traceRingList,&pring->node);
+    epicsMutexUnlock(pasynBase->lockTraceRing);
+    return asynSuccess;
+#else
+    epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+        "asynManager:setTraceRingSize %s requires EPICS base 3.15 or later",
+        pport ? pport->portName : "");
+    return asynError;
+#endif
+}
+
+static size_t getTraceRingSize(asynUser *pasynUser)
+{
+    userPvt *puserPvt = asynUserToUserPvt(pasynUser);
+    port    *pport = puserPvt->pport;
+    size_t  size = 0;
+
+    if(!pport) return 0;
+    epicsMutexMustLock(pasynBase->lockTraceRing);
+    if(pport->ptraceRing) size = pport->ptraceRing->size;
+    epicsMutexUnlock(pasynBase->lockTraceRing);
+    return size;
+}
+
 /*
  * User-readable status code
  */
@@ -10,6 +10,9 @@
 
 #include <vector>
 #include <memory>
+#include <map>
+#include <string>
+#include <algorithm>
 
 #include <stdlib.h>
 #include <string.h>
@@ -18,8 +21,15 @@
 
 #include <epicsString.h>
 #include <epicsMutex.h>
+#include <epicsEvent.h>
 #include <epicsThread.h>
+#include <epicsTime.h>
 #include <cantProceed.h>
+#include <epicsVersion.h>
+#if EPICS_VERSION_INT >= VERSION_INT(3,15,0,0)
+    #include <epicsAtomic.h>
+    #define PARAM_SNAPSHOT
+#endif
 /* NOTE: interruptAccept is define in dbAccess.h if using EPICS IOC, else set it to 1 */
 #ifdef EPICS_LIBCOM_ONLY
     static int interruptAccept=1;
@@ -37,6 +47,55 @@
 
 static const char *driverName = "asynPortDriver";
 
+/** Copy of a scalar parameter that can be read without the driver lock,
+  * see asynPortDriver::enableParamSnapshot.
+  * This is a seqlock: the writer, which holds the driver lock, makes seq odd while it
+  * changes value, and a reader retries if seq was odd or has changed while it copied value. */
+struct paramSnapshot {
+    int seq;
+    struct {
+        asynParamType type;
+        bool defined;
+        asynStatus status;
+        int alarmStatus;
+        int alarmSeverity;
+        epicsTimeStamp timeStamp;
+        const char *name;
+        union {
+            epicsInt32   ival;
+            epicsInt64   i64val;
+            epicsFloat64 dval;
+        } data;
+    } value;
+};
+
+/** Value of a scalar parameter for the callbacks, see paramList::getCallbackValue.
+  * The callback dispatcher calls the callbacks without the driver lock, so it keeps a copy
+  * of a string value in sval and sets string to NULL. */
+struct paramCallbackValue {
+    asynParamType type;
+    asynStatus status;
+    int alarmStatus;
+    int alarmSeverity;
+    epicsUInt32 interruptMask;
+    epicsTimeStamp timeStamp;
+    union {
+        epicsInt32   ival;
+        epicsInt64   i64val;
+        epicsUInt32  uival;
+        epicsFloat64 dval;
+    } data;
+    const char *string;
+    std::string sval;
+};
+
+/** Orders parameter names ignoring case, as paramVal::nameEquals compares them */
+struct paramNameLess {
+    bool operator()(const std::string &a, const std::string &b) const {
+        return epicsStrCaseCmp(a.c_str(), b.c_str()) < 0;
+    }
+};
+
 /** Class to support parameter library (also called parameter list);
   * set and get values indexed by parameter number (pasynUser->reason)
   * and do asyn callbacks when parameters change.
@@ -68,32 +127,271 @@ public:
     asynStatus getUInt32Interrupt(int index, epicsUInt32 *mask, interruptReason reason);
     asynStatus callCallbacks(int addr);
     asynStatus callCallbacks();
+    static asynStatus callCallbacks(paramList *const *ppLists, int firstAddr, int numAddr);
     asynStatus setStatus(int index, asynStatus status);
     asynStatus getStatus(int index, asynStatus *status);
     asynStatus setAlarmStatus(int index, int alarmStatus);
     asynStatus getAlarmStatus(int index, int *alarmStatus);
     asynStatus setAlarmSeverity(int index, int alarmSeverity);
     asynStatus getAlarmSeverity(int index, int *alarmSeverity);
+    void enableSnapshot();
+    bool readSnapshot(int index, paramSnapshot *pSnapshot);
+    void valueChanged(int index);
+    asynStatus setValues(const asynParamValue *values, size_t numValues, int *badIndex);
+    asynStatus getValues(asynParamValue *values, size_t numValues, int *badIndex);
+    void getAllValues(std::vector<asynParamValue>& values);
+    void *interruptPvt(asynParamType type);
+    void getCallbackValue(int index, paramCallbackValue *pValue);
+    static void doCallbacks(asynPortDriver *pPort, ELLLIST *pclientList, int reason, int addr,
+                            const paramCallbackValue& value);
     void report(FILE *fp, int details);
 
 private:
+    void updateSnapshot(int index, const epicsTimeStamp *pTimeStamp = NULL);
     asynStatus setFlag(int index);
-    asynStatus int32Callback(int command, int addr);
-    asynStatus int64Callback(int command, int addr);
-    asynStatus uint32Callback(int command, int addr, epicsUInt32 interruptMask);
-    asynStatus float64Callback(int command, int addr);
-    asynStatus octetCallback(int command, int addr);
     void registerParameterChange(paramVal *param, int index);
 
     asynPortDriver *pasynPortDriver;
+    /** Indices of parameters changed since the last callCallbacks, each at most once */
     std::vector<unsigned> flags;
+    /** One bit per parameter, set while its index is in flags */
+    std::vector<bool> dirty;
     std::vector<paramVal*> vals;
+    /** Index of vals by parameter name, kept in step with vals by createParam */
+    std::map<std::string, int, paramNameLess> nameIndex;
+    /** Snapshot of the parameters that existed when enableSnapshot was called.
+      * It is never resized, so readers without the driver lock can use it while createParam adds parameters. */
+    paramSnapshot *snapshot;
+    int snapshotSize;
+
+    friend class callbackDispatcher;
+};
+
+/** Thread that calls the callbacks for the scalar parameters of a port, see
+  * asynPortDriver::enableCallbackDispatcher.
+  * queue() copies the changed parameters to pending with the driver locked. A parameter that is
+  * queued again before the thread has called its callbacks replaces the pending value. */
+class callbackDispatcher : public epicsThreadRunable {
+public:
+    callbackDispatcher(asynPortDriver *pPort, double maxRate);
+    ~callbackDispatcher();
+    asynStatus queue(paramList *const *ppLists, int firstAddr, int numAddr);
+    void run();
+    void report(FILE *fp);
+
+private:
+    /** Values of the queued parameters by (addr, index) */
+    typedef std::map<std::pair<int, int>, paramCallbackValue> callbackMap;
+    asynPortDriver *pPort;
+    double minPeriod;
+    epicsMutex mutex;
+    epicsEvent wakeup;
+    epicsEvent exitEvent;
+    bool exiting;
+    callbackMap pending;
+    unsigned long numQueued;
+    unsigned long numReplaced;
+    unsigned long numCalled;
+    unsigned long numBatches;
+    epicsThread thread;
+};
+
+/** Index of the clients on one asynManager interrupt list by reason and asyn address,
+  * so callbacks only visit the clients that match.
+  * asynManager calls listChanged each time a client is added to or removed from the list, which
+  * changes the clients of that reason and address only, in the order they are on the list.
+  * Several threads can do callbacks for the same list, so the index is changed and looked up with
+  * its lock held. A clientList that an interruptClients uses is not changed but replaced with a copy,
+  * and it is deleted when the last interruptClients that uses it is destroyed. */
+class interruptIndex {
+public:
+    template <typename interruptType>
+        static interruptIndex *create(asynPortDriver *pPort, void *interruptPvt);
+    ~interruptIndex();
+    void find(int reason, int addr, interruptClients &clients);
+
+private:
+    struct clientList {
+        int refs;
+        std::vector<interruptNode *> nodes;
+    };
+    typedef std::map<std::pair<int, int>, clientList *> clientMap;
+    interruptIndex(asynPortDriver *pPort, void *interruptPvt);
+    template <typename interruptType>
+        static void listChanged(void *userPvt, interruptNode *pnode, int added);
+    void update(int reason, int addr, interruptNode *pnode, bool added);
+    void release(clientList *pList);
+    asynPortDriver *pPort;
+    void *interruptPvt;
+    epicsMutex lock;
+    clientMap clients;
+
+    friend class interruptClients;
+};
+
+/** The clients on an interrupt list for one reason and asyn address, see asynPortDriver::getInterruptClients.
+  * Only valid between interruptStart and interruptEnd. */
+class interruptClients {
+public:
+    interruptClients() : pIndex(NULL), pList(NULL), pclients(NULL) {}
+    ~interruptClients() { if (pList) pIndex->release(pList); }
+    size_t size() const { return pclients ? pclients->size() : 0; }
+    interruptNode *operator[](size_t i) const { return (*pclients)[i]; }
+
+private:
+    interruptIndex *pIndex;
+    interruptIndex::clientList *pList;
+    const std::vector<interruptNode *> *pclients;
+    /** The clients of a list that has no index */
+    std::vector<interruptNode *> unindexed;
+
+    friend class interruptIndex;
+    friend class asynPortDriver;
 };
 
+interruptIndex::interruptIndex(asynPortDriver *pPort, void *interruptPvt)
+    : pPort(pPort), interruptPvt(interruptPvt)
+{}
+
+/** Creates the index of an interrupt list, which must be empty, and registers it with asynManager
+  * to be told about the clients added to and removed from the list.
+  * \param[in] pPort The asynPortDriver that owns the interrupt list.
+  * \param[in] interruptPvt The interrupt list, e.g. asynStdInterfaces.int32InterruptPvt. */
+template <typename interruptType>
+interruptIndex *interruptIndex::create(asynPortDriver *pPort, void *interruptPvt)
+{
+    interruptIndex *pIndex = new interruptIndex(pPort, interruptPvt);
+    pasynManager->registerInterruptListCallback(interruptPvt, listChanged<interruptType>, pIndex);
+    return pIndex;
+}
+
+interruptIndex::~interruptIndex()
+{
+    pasynManager->registerInterruptListCallback(this->interruptPvt, NULL, NULL);
+    for (clientMap::iterator it = this->clients.begin(); it != this->clients.end(); ++it)
+        delete it->second;
+}
+
+/** Called by asynManager with its lock of the port held, after pnode was added to or removed from the list */
+template <typename interruptType>
+void interruptIndex::listChanged(void *userPvt, interruptNode *pnode, int added)
+{
+    interruptIndex *pIndex = (interruptIndex *)userPvt;
+    interruptType *pInterrupt = (interruptType *)pnode->drvPvt;
+    int address;
+
+    pIndex->pPort->getAddress(pInterrupt->pasynUser, &address);
+    pIndex->update(pInterrupt->pasynUser->reason, address, pnode, added != 0);
+}
+
+/** Adds pnode to the end of the clients for reason and addr, or removes it */
+void interruptIndex::update(int reason, int addr, interruptNode *pnode, bool added)
+{
+    std::vector<interruptNode *>::iterator node;
+
+    this->lock.lock();
+    clientMap::iterator it = this->clients.find(std::make_pair(reason, addr));
+    if (!added) {
+        if ((it != this->clients.end()) &&
+            (std::find(it->second->nodes.begin(), it->second->nodes.end(), pnode) == it->second->nodes.end()))
+            it = this->clients.end();
+        /* The asynUser was connected to another address when it was added */
+        for (clientMap::iterator all = this->clients.begin();
+             (it == this->clients.end()) && (all != this->clients.end()); ++all) {
+            if (std::find(all->second->nodes.begin(), all->second->nodes.end(), pnode) != all->second->nodes.end())
+                it = all;
+        }
+        if (it == this->clients.end()) {
+            this->lock.unlock();
+            return;
+        }
+    } else if (it == this->clients.end()) {
+        clientList *pNew = new clientList;
+        pNew->refs = 1;
+        it = this->clients.insert(std::make_pair(std::make_pair(reason, addr), pNew)).first;
+    }
+    clientList *pList = it->second;
+    if (pList->refs > 1) {
+        /* The callbacks in progress keep the one they have */
+        pList->refs--;
+        pList = new clientList(*pList);
+        pList->refs = 1;
+        it->second = pList;
+    }
+    if (added) {
+        pList->nodes.push_back(pnode);
+    } else {
+        pList->nodes.erase(std::find(pList->nodes.begin(), pList->nodes.end(), pnode));
+        if (pList->nodes.empty()) {
+            delete pList;
+            this->clients.erase(it);
+        }
+    }
+    this->lock.unlock();
+}
+
+void interruptIndex::release(clientList *pList)
+{
+    this->lock.lock();
+    bool unused = (--pList->refs == 0);
+    this->lock.unlock();
+    if (unused) delete pList;
+}
+
+/** Sets clients to the clients for reason and addr, in the order they are on the interrupt list.
+  * Must be called between interruptStart and interruptEnd.
+  * \param[in] reason The reason (pasynUser->reason) of the clients.
+  * \param[in] addr The asyn address of the clients.
+  * \param[out] clients The matching clients. */
+void interruptIndex::find(int reason, int addr, interruptClients &clients)
+{
+    this->lock.lock();
+    clientMap::const_iterator it = this->clients.find(std::make_pair(reason, addr));
+    if (it != this->clients.end()) {
+        it->second->refs++;
+        clients.pIndex = this;
+        clients.pList = it->second;
+        clients.pclients = &it->second->nodes;
+    }
+    this->lock.unlock();
+}
+
+/** Finds the clients on an interrupt list for a reason and asyn address.
+  * Must be called between interruptStart and interruptEnd.
+  * \param[in] interruptPvt The interrupt list, e.g. asynStdInterfaces.int32InterruptPvt.
+  * \param[in] pclientList The interrupt list returned by interruptStart.
+  * \param[in] reason The reason (pasynUser->reason) of the clients.
+  * \param[in] addr The asyn address of the clients.
+  * \param[out] clients The matching clients. If the list has no index they are found by walking the list. */
+template <typename interruptType>
+void asynPortDriver::getInterruptClients(void *interruptPvt, ELLLIST *pclientList,
+                                         int reason, int addr, interruptClients &clients)
+{
+    interruptNode *pnode;
+    int address;
+
+    std::map<void *, interruptIndex *>::iterator it = this->interruptIndexes.find(interruptPvt);
+    if (it != this->interruptIndexes.end()) {
+        it->second->find(reason, addr, clients);
+        return;
+    }
+    pnode = (interruptNode *)ellFirst(pclientList);
+    while (pnode) {
+        interruptType *pInterrupt = (interruptType *)pnode->drvPvt;
+        getAddress(pInterrupt->pasynUser, &address);
+        /* If this is not a multi-device then address is -1, change to 0 */
+        if (address == -1) address = 0;
+        if ((pInterrupt->pasynUser->reason == reason) && (address == addr))
+            clients.unindexed.push_back(pnode);
+        pnode = (interruptNode *)ellNext(&pnode->node);
+    }
+    clients.pclients = &clients.unindexed;
+}
+
 /** Constructor for paramList class.
   * \param[in] pPort Pointer to asynPortDriver port for this paramList. */
 paramList::paramList(asynPortDriver *pPort)
-    : pasynPortDriver(pPort)
+    : pasynPortDriver(pPort), snapshot(NULL), snapshotSize(0)
 {}
 
 /** Destructor for paramList class; frees resources allocated in constructor */
@@ -101,16 +399,16 @@ paramList::~paramList()
 {
     for (size_t i = 0; i < this->vals.size(); i++)
         delete this->vals[i];
+    delete [] this->snapshot;
 }
 
 asynStatus paramList::setFlag(int index)
 {
-    size_t i;
-
     if (index < 0 || (size_t)index >= this->vals.size()) return asynParamBadIndex;
     /* See if we have already set the flag for this parameter */
-    for (i=0; i<flags.size(); i++) if (flags[i] == (unsigned)index) return asynSuccess;
-    /* If not found add a flag */
+    if (this->dirty[index]) return asynSuccess;
+    /* If not add a flag */
+    this->dirty[index] = true;
     this->flags.push_back((unsigned)index);
     return asynSuccess;
 }
@@ -127,11 +425,18 @@ asynStatus paramList::createParam(const char *name, asynParamType type, int *ind
 {
     //static const char *functionName = "createParam";
 
-    if (this->findParam(name, index) == asynSuccess) return asynParamAlreadyExists;
+    if (!name) return asynParamNotFound;
+    std::pair<std::map<std::string, int, paramNameLess>::iterator, bool> ins =
+        nameIndex.insert(std::make_pair(std::string(name), (int)vals.size()));
+    if (!ins.second) {
+        *index = ins.first->second;
+        return asynParamAlreadyExists;
+    }
 
     paramVal *param = new paramVal(name, type);
 
     vals.push_back(param);
+    dirty.push_back(false);
     flags.reserve(vals.size());
     *index = (int)vals.size()-1;
     return asynSuccess;
@@ -152,14 +457,15 @@ asynStatus paramList::getNumParams(int *numParams)
   * \return Returns asynParamNotFound if name is not found in the parameter list. */
 asynStatus paramList::findParam(const char *name, int *index)
 {
-    for (int i=0; i<(int)this->vals.size(); i++) {
-        if (this->vals[i]->nameEquals(name)) {
-            *index = i;
-            return asynSuccess;
-        }
+    std::map<std::string, int, paramNameLess>::const_iterator it;
+
+    if (name) it = this->nameIndex.find(name);
+    if (!name || (it == this->nameIndex.end())) {
+        *index=-1;
+        return asynParamNotFound;
     }
-    *index=-1;
-    return asynParamNotFound;
+    *index = it->second;
+    return asynSuccess;
 }
 
 void paramList::registerParameterChange(paramVal *param,int index)
@@ -179,6 +485,7 @@ asynStatus paramList::setInteger(int index, int value)
     try{
         getParameter(index)->setInteger(value);
         registerParameterChange(getParameter(index), index);
+        updateSnapshot(index);
     }
     catch (ParamValWrongType&) {
         return asynParamWrongType;
@@ -199,6 +506,7 @@ asynStatus paramList::setInteger64(int index, epicsInt64 value)
     try{
         getParameter(index)->setInteger64(value);
         registerParameterChange(getParameter(index), index);
+        updateSnapshot(index);
     }
     catch (ParamValWrongType&) {
         return asynParamWrongType;
@@ -242,6 +550,7 @@ asynStatus paramList::setDouble(int index, double value)
     {
         getParameter(index)->setDouble(value);
         registerParameterChange(getParameter(index), index);
+        updateSnapshot(index);
     }
     catch (ParamValWrongType&)
     {
@@ -422,6 +731,7 @@ asynStatus paramList::setStatus(int index, asynStatus status)
     if (index < 0 || (size_t)index >= this->vals.size()) return asynParamBadIndex;
     this->vals[index]->setStatus(status);
     registerParameterChange(getParameter(index), index);
+    updateSnapshot(index);
     return asynSuccess;
 }
 
@@ -445,6 +755,7 @@ asynStatus paramList::setAlarmStatus(int index, int alarmStatus)
     if (index < 0 || (size_t)index >= this->vals.size()) return asynParamBadIndex;
     this->vals[index]->setAlarmStatus(alarmStatus);
     registerParameterChange(getParameter(index), index);
+    updateSnapshot(index);
     return asynSuccess;
 }
 
@@ -468,9 +779,224 @@ asynStatus paramList::setAlarmSeverity(int index, int alarmSeverity)
     if (index < 0 || (size_t)index >= this->vals.size()) return asynParamBadIndex;
     this->vals[index]->setAlarmSeverity(alarmSeverity);
     registerParameterChange(getParameter(index), index);
+    updateSnapshot(index);
+    return asynSuccess;
+}
+
+/** Queues the callbacks for a parameter and updates the snapshot, after asynParamHandle::set() has changed it.
+  * \param[in] index The parameter number, which must be valid */
+void paramList::valueChanged(int index)
+{
+    setFlag(index);
+    updateSnapshot(index);
+}
+
+/** Stores a value whose type has been checked, like paramVal::setInteger() etc.
+  * \return Returns true if the value has changed. */
+template <typename epicsType>
+static bool storeValue(paramVal *pVal, epicsType value)
+{
+    epicsType &current = pVal->value<epicsType>();
+    if (pVal->isDefined() && (current == value)) return false;
+    current = value;
+    pVal->setDefined(true);
+    return true;
+}
+
+/** Sets the values of many parameters.
+  * All of the values are checked first, so none is set if one is not valid.
+  * The values are then stored, and the changed parameters are marked for callbacks, in one pass.
+  * \param[in] values Array of values; a parameter may appear more than once, the last value is kept.
+  * \param[in] numValues Number of values
+  * \param[out] badIndex The parameter number of the first value that is not valid
+  * \return Returns asynParamBadIndex if an index is not valid or asynParamWrongType if the type of a value
+  * is not the type of its parameter. */
+asynStatus paramList::setValues(const asynParamValue *values, size_t numValues, int *badIndex)
+{
+    size_t i;
+
+    for (i = 0; i < numValues; i++) {
+        int index = values[i].index;
+        *badIndex = index;
+        if (index < 0 || (size_t)index >= this->vals.size()) return asynParamBadIndex;
+        if (this->vals[index]->type != values[i].type) return asynParamWrongType;
+        if ((values[i].type != asynParamInt32) && (values[i].type != asynParamInt64) &&
+            (values[i].type != asynParamFloat64)) return asynParamWrongType;
+    }
+    for (i = 0; i < numValues; i++) {
+        int index = values[i].index;
+        paramVal *pVal = this->vals[index];
+        bool changed;
+        switch (values[i].type) {
+            case asynParamInt32:
+                changed = storeValue(pVal, values[i].value.ival);
+                break;
+            case asynParamInt64:
+                changed = storeValue(pVal, values[i].value.i64val);
+                break;
+            default:
+                changed = storeValue(pVal, values[i].value.dval);
+                break;
+        }
+        if (changed) {
+            setFlag(index);
+            updateSnapshot(index);
+        }
+    }
     return asynSuccess;
 }
 
+/** Gets the values of many parameters.
+  * \param[in,out] values Array of values; index is the parameter number, and type, value and status are set.
+  * status is the status of the parameter, or asynParamUndefined if it has no value.
+  * \param[in] numValues Number of values
+  * \param[out] badIndex The parameter number of the first value that is not valid
+  * \return Returns asynParamBadIndex if an index is not valid or asynParamWrongType if a parameter
+  * is not Int32, Int64 or Float64.  The other values are still read. */
+asynStatus paramList::getValues(asynParamValue *values, size_t numValues, int *badIndex)
+{
+    asynStatus status = asynSuccess;
+
+    for (size_t i = 0; i < numValues; i++) {
+        int index = values[i].index;
+        asynStatus valueStatus = asynSuccess;
+        if (index < 0 || (size_t)index >= this->vals.size()) {
+            valueStatus = asynParamBadIndex;
+        } else {
+            paramVal *pVal = this->vals[index];
+            bool defined = pVal->isDefined();
+            values[i].type = pVal->type;
+            values[i].status = defined ? pVal->getStatus() : asynParamUndefined;
+            switch (pVal->type) {
+                case asynParamInt32:
+                    values[i].value.ival = defined ? pVal->value<epicsInt32>() : 0;
+                    break;
+                case asynParamInt64:
+                    values[i].value.i64val = defined ? pVal->value<epicsInt64>() : 0;
+                    break;
+                case asynParamFloat64:
+                    values[i].value.dval = defined ? pVal->value<epicsFloat64>() : 0;
+                    break;
+                default:
+                    valueStatus = asynParamWrongType;
+                    break;
+            }
+        }
+        if (valueStatus != asynSuccess) {
+            values[i].status = valueStatus;
+            if (status == asynSuccess) {
+                status = valueStatus;
+                *badIndex = index;
+            }
+        }
+    }
+    return status;
+}
+
+/** Gets the values of all Int32, Int64 and Float64 parameters, in parameter number order.
+  * \param[out] values The values, with status asynParamUndefined for parameters that have no value. */
+void paramList::getAllValues(std::vector<asynParamValue>& values)
+{
+    int badIndex;
+
+    values.clear();
+    values.reserve(this->vals.size());
+    for (size_t i = 0; i < this->vals.size(); i++) {
+        asynParamType type = this->vals[i]->type;
+        if ((type == asynParamInt32) || (type == asynParamInt64) || (type == asynParamFloat64)) {
+            values.push_back(asynParamValue());
+            values.back().index = (int)i;
+        }
+    }
+    if (!values.empty()) getValues(&values[0], values.size(), &badIndex);
+}
+
+/** Creates the snapshot of the parameters in the list, if it does not already exist.
+  * Parameters created later are not in the snapshot. */
+void paramList::enableSnapshot()
+{
+    if (this->snapshot) return;
+    int numParams = (int)this->vals.size();
+    this->snapshot = new paramSnapshot[numParams]();
+    for (int i = 0; i < numParams; i++) {
+        this->snapshot[i].value.type = this->vals[i]->type;
+        this->snapshot[i].value.name = this->vals[i]->getName();
+    }
+    this->snapshotSize = numParams;
+    for (int i = 0; i < numParams; i++)
+        updateSnapshot(i);
+}
+
+/** Copies a parameter to the snapshot; called with the driver locked after it changes,
+  * and when its callbacks are done.
+  * \param[in] index The parameter number, which must be valid
+  * \param[in] pTimeStamp The timestamp of the value, or NULL for the timestamp of the port */
+void paramList::updateSnapshot(int index, const epicsTimeStamp *pTimeStamp)
+{
+#ifdef PARAM_SNAPSHOT
+    if (index >= this->snapshotSize) return;
+    paramVal *pVal = this->vals[index];
+    paramSnapshot *pSnapshot = &this->snapshot[index];
+    int seq = pSnapshot->seq;
+    epicsTimeStamp timeStamp;
+
+    if (!pTimeStamp) {
+        this->pasynPortDriver->getTimeStamp(&timeStamp);
+        pTimeStamp = &timeStamp;
+    }
+    epicsAtomicSetIntT(&pSnapshot->seq, seq + 1);
+    epicsAtomicWriteMemoryBarrier();
+    pSnapshot->value.timeStamp = *pTimeStamp;
+    pSnapshot->value.defined = pVal->isDefined();
+    pSnapshot->value.status = pVal->getStatus();
+    pSnapshot->value.alarmStatus = pVal->getAlarmStatus();
+    pSnapshot->value.alarmSeverity = pVal->getAlarmSeverity();
+    if (pSnapshot->value.defined) {
+        switch (pVal->type) {
+            case asynParamInt32:
+                pSnapshot->value.data.ival = pVal->getInteger();
+                break;
+            case asynParamInt64:
+                pSnapshot->value.data.i64val = pVal->getInteger64();
+                break;
+            case asynParamFloat64:
+                pSnapshot->value.data.dval = pVal->getDouble();
+                break;
+            default:
+                break;
+        }
+    }
+    epicsAtomicWriteMemoryBarrier();
+    epicsAtomicSetIntT(&pSnapshot->seq, seq + 2);
+#endif
+}
+
+/** Copies a parameter from the snapshot without the driver lock.
+  * \param[in] index The parameter number
+  * \param[out] pCopy Address of the copy
+  * \return Returns false if the parameter is not in the snapshot, or if it was being changed on every
+  * attempt to copy it, which can happen when the thread that changes it has been preempted. */
+bool paramList::readSnapshot(int index, paramSnapshot *pCopy)
+{
+#ifdef PARAM_SNAPSHOT
+    static const int maxAttempts = 100;
+    if (index < 0 || index >= this->snapshotSize) return false;
+    paramSnapshot *pSnapshot = &this->snapshot[index];
+
+    for (int i = 0; i < maxAttempts; i++) {
+        int seq = epicsAtomicGetIntT(&pSnapshot->seq);
+        epicsAtomicReadMemoryBarrier();
+        pCopy->value = pSnapshot->value;
+        epicsAtomicReadMemoryBarrier();
+        if (!(seq & 1) && (epicsAtomicGetIntT(&pSnapshot->seq) == seq)) {
+            pCopy->seq = seq;
+            return true;
+        }
+    }
+#endif
+    return false;
+}
+
 /** Sets the value of the UInt32Interrupt in the parameter library.
   * \param[in] index The parameter number
   * \param[in] mask The interrupt mask.
@@ -601,226 +1127,134 @@ asynStatus paramList::getName(int index, const char **value)
     return asynSuccess;
 }
 
-/** Calls the registered asyn callback functions for all clients for an integer parameter */
-asynStatus paramList::int32Callback(int command, int addr)
-{
-    ELLLIST *pclientList;
-    interruptNode *pnode;
-    asynStandardInterfaces *pInterfaces = this->pasynPortDriver->getAsynStdInterfaces();
-    epicsTimeStamp timeStamp;
-    this->pasynPortDriver->getTimeStamp(&timeStamp);
-    int address;
-    epicsInt32 value;
-    int alarmStatus=0;
-    int alarmSeverity=0;
-    asynStatus status=asynSuccess;
-
-    /* Pass int32 interrupts */
-    status = getInteger(command, &value);
-    getAlarmStatus(command, &alarmStatus);
-    getAlarmSeverity(command, &alarmSeverity);
-    if (!pInterfaces->int32InterruptPvt) return asynParamNotFound;
-    pasynManager->interruptStart(pInterfaces->int32InterruptPvt, &pclientList);
-    pnode = (interruptNode *)ellFirst(pclientList);
-    while (pnode) {
-        asynInt32Interrupt *pInterrupt = (asynInt32Interrupt *) pnode->drvPvt;
-        this->pasynPortDriver->getAddress(pInterrupt->pasynUser, &address);
-        /* If this is not a multi-device then address is -1, change to 0 */
-        if (address == -1) address = 0;
-        if ((command == pInterrupt->pasynUser->reason) &&
-            (address == addr)) {
-            /* Set the status for the callback */
-            pInterrupt->pasynUser->auxStatus = status;
-            pInterrupt->pasynUser->alarmStatus = alarmStatus;
-            pInterrupt->pasynUser->alarmSeverity = alarmSeverity;
-            /* Set the timestamp for the callback */
-            pInterrupt->pasynUser->timestamp = timeStamp;
-            pInterrupt->callback(pInterrupt->userPvt,
-                                 pInterrupt->pasynUser,
-                                 value);
-        }
-        pnode = (interruptNode *)ellNext(&pnode->node);
+/** Copies the value, status and alarms of a defined scalar parameter for the callbacks.
+  * The UInt32Digital interrupt mask is returned in pValue->interruptMask and cleared in the parameter.
+  * For a string parameter pValue->string points to the string of the parameter. */
+void paramList::getCallbackValue(int index, paramCallbackValue *pValue)
+{
+    paramVal *pVal = this->vals[index];
+
+    pValue->type = pVal->type;
+    pValue->status = pVal->getStatus();
+    pValue->alarmStatus = pVal->getAlarmStatus();
+    pValue->alarmSeverity = pVal->getAlarmSeverity();
+    pValue->interruptMask = 0;
+    pValue->string = NULL;
+    switch(pVal->type) {
+        case asynParamInt32:
+            pValue->data.ival = pVal->value<epicsInt32>();
+            break;
+        case asynParamInt64:
+            pValue->data.i64val = pVal->value<epicsInt64>();
+            break;
+        case asynParamUInt32Digital:
+            pValue->data.uival = pVal->getUInt32(0xFFFFFFFF);
+            pValue->interruptMask = pVal->uInt32CallbackMask;
+            pVal->uInt32CallbackMask = 0;
+            break;
+        case asynParamFloat64:
+            pValue->data.dval = pVal->value<epicsFloat64>();
+            break;
+        case asynParamOctet:
+            pValue->string = pVal->getString().c_str();
+            break;
+        default:
+            break;
     }
-    pasynManager->interruptEnd(pInterfaces->int32InterruptPvt);
-    return asynSuccess;
 }
 
-/** Calls the registered asyn callback functions for all clients for a 64-bit integer parameter */
-asynStatus paramList::int64Callback(int command, int addr)
+/** Sets the status, alarms and timestamp of a callback in the asynUser of the client */
+static void setCallbackStatus(asynUser *pasynUser, const paramCallbackValue& value)
 {
-    ELLLIST *pclientList;
-    interruptNode *pnode;
-    asynStandardInterfaces *pInterfaces = this->pasynPortDriver->getAsynStdInterfaces();
-    epicsTimeStamp timeStamp;
-    this->pasynPortDriver->getTimeStamp(&timeStamp);
-    int address;
-    epicsInt64 value;
-    int alarmStatus=0;
-    int alarmSeverity=0;
-    asynStatus status=asynSuccess;
-
-    /* Pass int64 interrupts */
-    status = getInteger64(command, &value);
-    getAlarmStatus(command, &alarmStatus);
-    getAlarmSeverity(command, &alarmSeverity);
-    if (!pInterfaces->int64InterruptPvt) return asynParamNotFound;
-    pasynManager->interruptStart(pInterfaces->int64InterruptPvt, &pclientList);
-    pnode = (interruptNode *)ellFirst(pclientList);
-    while (pnode) {
-        asynInt64Interrupt *pInterrupt = (asynInt64Interrupt *) pnode->drvPvt;
-        this->pasynPortDriver->getAddress(pInterrupt->pasynUser, &address);
-        /* If this is not a multi-device then address is -1, change to 0 */
-        if (address == -1) address = 0;
-        if ((command == pInterrupt->pasynUser->reason) &&
-            (address == addr)) {
-            /* Set the status for the callback */
-            pInterrupt->pasynUser->auxStatus = status;
-            pInterrupt->pasynUser->alarmStatus = alarmStatus;
-            pInterrupt->pasynUser->alarmSeverity = alarmSeverity;
-            /* Set the timestamp for the callback */
-            pInterrupt->pasynUser->timestamp = timeStamp;
-            pInterrupt->callback(pInterrupt->userPvt,
-                                 pInterrupt->pasynUser,
-                                 value);
-        }
-        pnode = (interruptNode *)ellNext(&pnode->node);
-    }
-    pasynManager->interruptEnd(pInterfaces->int64InterruptPvt);
-    return asynSuccess;
+    pasynUser->auxStatus = value.status;
+    pasynUser->alarmStatus = value.alarmStatus;
+    pasynUser->alarmSeverity = value.alarmSeverity;
+    pasynUser->timestamp = value.timeStamp;
 }
 
-/** Calls the registered asyn callback functions for all clients for an UInt32 parameter */
-asynStatus paramList::uint32Callback(int command, int addr, epicsUInt32 interruptMask)
+/** Calls the callbacks of the clients of an Int32, Int64 or Float64 parameter */
+template <typename interruptType, typename epicsType>
+static void scalarCallbacks(const interruptClients &clients, const paramCallbackValue& value,
+                            epicsType data)
 {
-    ELLLIST *pclientList;
-    interruptNode *pnode;
-    asynStandardInterfaces *pInterfaces = this->pasynPortDriver->getAsynStdInterfaces();
-    epicsTimeStamp timeStamp;
-    this->pasynPortDriver->getTimeStamp(&timeStamp);
-    int address;
-    epicsUInt32 value;
-    int alarmStatus=0;
-    int alarmSeverity=0;
-    asynStatus status=asynSuccess;
-
-    /* Pass UInt32Digital interrupts */
-    status = getUInt32(command, &value, 0xFFFFFFFF);
-    getAlarmStatus(command, &alarmStatus);
-    getAlarmSeverity(command, &alarmSeverity);
-    if (!pInterfaces->uInt32DigitalInterruptPvt) return asynParamNotFound;
-    pasynManager->interruptStart(pInterfaces->uInt32DigitalInterruptPvt, &pclientList);
-    pnode = (interruptNode *)ellFirst(pclientList);
-    while (pnode) {
-        asynUInt32DigitalInterrupt *pInterrupt = (asynUInt32DigitalInterrupt *) pnode->drvPvt;
-        this->pasynPortDriver->getAddress(pInterrupt->pasynUser, &address);
-        /* If this is not a multi-device then address is -1, change to 0 */
-        if (address == -1) address = 0;
-        if ((command == pInterrupt->pasynUser->reason) &&
-            (address == addr) &&
-            (pInterrupt->mask & interruptMask)) {
-            /* Set the status for the callback */
-            pInterrupt->pasynUser->auxStatus = status;
-            pInterrupt->pasynUser->alarmStatus = alarmStatus;
-            pInterrupt->pasynUser->alarmSeverity = alarmSeverity;
-            /* Set the timestamp for the callback */
-            pInterrupt->pasynUser->timestamp = timeStamp;
-            pInterrupt->callback(pInterrupt->userPvt,
-                                 pInterrupt->pasynUser,
-                                 pInterrupt->mask & value);
-        }
-        pnode = (interruptNode *)ellNext(&pnode->node);
+    for (size_t i = 0; i < clients.size(); i++) {
+        interruptType *pInterrupt = (interruptType *)clients[i]->drvPvt;
+        setCallbackStatus(pInterrupt->pasynUser, value);
+        pInterrupt->callback(pInterrupt->userPvt, pInterrupt->pasynUser, data);
     }
-    pasynManager->interruptEnd(pInterfaces->uInt32DigitalInterruptPvt);
-    return asynSuccess;
 }
 
-/** Calls the registered asyn callback functions for all clients for a double parameter */
-asynStatus paramList::float64Callback(int command, int addr)
-{
-    ELLLIST *pclientList;
-    interruptNode *pnode;
-    asynStandardInterfaces *pInterfaces = this->pasynPortDriver->getAsynStdInterfaces();
-    epicsTimeStamp timeStamp;
-    this->pasynPortDriver->getTimeStamp(&timeStamp);
-    int address;
-    epicsFloat64 value;
-    int alarmStatus=0;
-    int alarmSeverity=0;
-    asynStatus status=asynSuccess;
-
-    /* Pass float64 interrupts */
-    status = getDouble(command, &value);
-    getAlarmStatus(command, &alarmStatus);
-    getAlarmSeverity(command, &alarmSeverity);
-    if (!pInterfaces->float64InterruptPvt) return asynParamNotFound;
-    pasynManager->interruptStart(pInterfaces->float64InterruptPvt, &pclientList);
-    pnode = (interruptNode *)ellFirst(pclientList);
-    while (pnode) {
-        asynFloat64Interrupt *pInterrupt = (asynFloat64Interrupt *) pnode->drvPvt;
-        this->pasynPortDriver->getAddress(pInterrupt->pasynUser, &address);
-        /* If this is not a multi-device then address is -1, change to 0 */
-        if (address == -1) address = 0;
-        if ((command == pInterrupt->pasynUser->reason) &&
-            (address == addr)) {
-            /* Set the status for the callback */
-            pInterrupt->pasynUser->auxStatus = status;
-            pInterrupt->pasynUser->alarmStatus = alarmStatus;
-            pInterrupt->pasynUser->alarmSeverity = alarmSeverity;
-            /* Set the timestamp for the callback */
-            pInterrupt->pasynUser->timestamp = timeStamp;
-            pInterrupt->callback(pInterrupt->userPvt,
-                                 pInterrupt->pasynUser,
-                                 value);
+/** Calls the registered asyn callback functions for all clients for a scalar parameter.
+  * Must be called between interruptStart and interruptEnd for the interface of the parameter type.
+  * \param[in] pPort The asynPortDriver.
+  * \param[in] pclientList The interrupt list returned by interruptStart.
+  * \param[in] reason The parameter number.
+  * \param[in] addr The asyn address of the clients.
+  * \param[in] value The value from getCallbackValue, with the timestamp for the callbacks. */
+void paramList::doCallbacks(asynPortDriver *pPort, ELLLIST *pclientList, int reason, int addr,
+                            const paramCallbackValue& value)
+{
+    interruptClients clients;
+    asynStandardInterfaces *pInterfaces = pPort->getAsynStdInterfaces();
+
+    switch(value.type) {
+        case asynParamInt32:
+            pPort->getInterruptClients<asynInt32Interrupt>(
+                pInterfaces->int32InterruptPvt, pclientList, reason, addr, clients);
+            scalarCallbacks<asynInt32Interrupt>(clients, value, value.data.ival);
+            break;
+        case asynParamInt64:
+            pPort->getInterruptClients<asynInt64Interrupt>(
+                pInterfaces->int64InterruptPvt, pclientList, reason, addr, clients);
+            scalarCallbacks<asynInt64Interrupt>(clients, value, value.data.i64val);
+            break;
+        case asynParamFloat64:
+            pPort->getInterruptClients<asynFloat64Interrupt>(
+                pInterfaces->float64InterruptPvt, pclientList, reason, addr, clients);
+            scalarCallbacks<asynFloat64Interrupt>(clients, value, value.data.dval);
+            break;
+        case asynParamUInt32Digital:
+            pPort->getInterruptClients<asynUInt32DigitalInterrupt>(
+                pInterfaces->uInt32DigitalInterruptPvt, pclientList, reason, addr, clients);
+            for (size_t i = 0; i < clients.size(); i++) {
+                asynUInt32DigitalInterrupt *pInterrupt = (asynUInt32DigitalInterrupt *)clients[i]->drvPvt;
+                if (pInterrupt->mask & value.interruptMask) {
+                    setCallbackStatus(pInterrupt->pasynUser, value);
+                    pInterrupt->callback(pInterrupt->userPvt, pInterrupt->pasynUser,
+                                         pInterrupt->mask & value.data.uival);
+                }
+            }
+            break;
+        case asynParamOctet: {
+            char *string = (char *)(value.string ? value.string : value.sval.c_str());
+            pPort->getInterruptClients<asynOctetInterrupt>(
+                pInterfaces->octetInterruptPvt, pclientList, reason, addr, clients);
+            for (size_t i = 0; i < clients.size(); i++) {
+                asynOctetInterrupt *pInterrupt = (asynOctetInterrupt *)clients[i]->drvPvt;
+                setCallbackStatus(pInterrupt->pasynUser, value);
+                pInterrupt->callback(pInterrupt->userPvt, pInterrupt->pasynUser,
+                                     string, strlen(string)+1, ASYN_EOM_END);
+            }
+            break;
         }
-        pnode = (interruptNode *)ellNext(&pnode->node);
+        default:
+            break;
     }
-    pasynManager->interruptEnd(pInterfaces->float64InterruptPvt);
-    return asynSuccess;
 }
 
-/** Calls the registered asyn callback functions for all clients for a string parameter */
-asynStatus paramList::octetCallback(int command, int addr)
+/** Returns the interrupt list for the scalar parameter type, or NULL if the port does not have the interface */
+void *paramList::interruptPvt(asynParamType type)
 {
-    ELLLIST *pclientList;
-    interruptNode *pnode;
     asynStandardInterfaces *pInterfaces = this->pasynPortDriver->getAsynStdInterfaces();
-    epicsTimeStamp timeStamp;
-    this->pasynPortDriver->getTimeStamp(&timeStamp);
-    int address;
-    char *value;
-    int alarmStatus=0;
-    int alarmSeverity=0;
-    asynStatus status=asynSuccess;
 
-    /* Pass octet interrupts */
-    value = (char *)getParameter(command)->getString().c_str();
-    getStatus(command, &status);
-    getAlarmStatus(command, &alarmStatus);
-    getAlarmSeverity(command, &alarmSeverity);
-    if (!pInterfaces->octetInterruptPvt) return asynParamNotFound;
-    pasynManager->interruptStart(pInterfaces->octetInterruptPvt, &pclientList);
-    pnode = (interruptNode *)ellFirst(pclientList);
-    while (pnode) {
-        asynOctetInterrupt *pInterrupt = (asynOctetInterrupt *) pnode->drvPvt;
-        this->pasynPortDriver->getAddress(pInterrupt->pasynUser, &address);
-        /* If this is not a multi-device then address is -1, change to 0 */
-        if (address == -1) address = 0;
-        if ((command == pInterrupt->pasynUser->reason) &&
-            (address == addr)) {
-            /* Set the status for the callback */
-            pInterrupt->pasynUser->auxStatus = status;
-            pInterrupt->pasynUser->alarmStatus = alarmStatus;
-            pInterrupt->pasynUser->alarmSeverity = alarmSeverity;
-            /* Set the timestamp for the callback */
-            pInterrupt->pasynUser->timestamp = timeStamp;
-            pInterrupt->callback(pInterrupt->userPvt,
-                                 pInterrupt->pasynUser,
-                                 value, strlen(value)+1, ASYN_EOM_END);
-        }
-        pnode = (interruptNode *)ellNext(&pnode->node);
+    switch(type) {
+        case asynParamInt32:         return pInterfaces->int32InterruptPvt;
+        case asynParamInt64:         return pInterfaces->int64InterruptPvt;
+        case asynParamUInt32Digital: return pInterfaces->uInt32DigitalInterruptPvt;
+        case asynParamFloat64:       return pInterfaces->float64InterruptPvt;
+        case asynParamOctet:         return pInterfaces->octetInterruptPvt;
+        default:                     return NULL;
     }
-    pasynManager->interruptEnd(pInterfaces->octetInterruptPvt);
-    return asynSuccess;
 }
 
 /** Calls the registered asyn callback functions for all clients for any parameters that have changed
@@ -832,43 +1266,101 @@ asynStatus paramList::octetCallback(int command, int addr)
   */
 asynStatus paramList::callCallbacks(int addr)
 {
-    int index;
+    paramList *pList = this;
+
+    return callCallbacks(&pList, addr, 1);
+}
+
+/** Calls the registered asyn callback functions for the changed parameters of several parameter lists.
+  * \param[in] ppLists The parameter lists, which must belong to the same port.
+  * \param[in] firstAddr The asyn address for the callbacks of ppLists[0], ppLists[i] uses firstAddr+i.
+  * \param[in] numAddr The number of parameter lists.
+  *
+  * The changed parameters are grouped by interface.  Each interrupt list is taken once with
+  * interruptStart/interruptEnd for all of its parameters on all of the addresses, and all callbacks
+  * get the same timestamp.  Within an interface the callbacks are done in address order, and for
+  * each address in parameter index order.
+  */
+asynStatus paramList::callCallbacks(paramList *const *ppLists, int firstAddr, int numAddr)
+{
+    static const asynParamType batchTypes[] = {asynParamInt32, asynParamInt64, asynParamUInt32Digital,
+                                               asynParamFloat64, asynParamOctet};
+    static const int numBatchTypes = sizeof(batchTypes)/sizeof(batchTypes[0]);
+    std::vector<unsigned> changed;
+    /* The changed parameters of each type as (list, index), in list and then index order */
+    std::vector<std::pair<int, unsigned> > batches[numBatchTypes];
+    paramCallbackValue value;
+    ELLLIST *pclientList;
+    paramList *pList;
+    void *pvt = NULL;
+    int index, list, addr;
+    bool anyChanged;
     asynStatus status = asynSuccess;
 
-    if (!interruptAccept) return asynSuccess;
+    if (!interruptAccept || (numAddr < 1)) return asynSuccess;
+    if (ppLists[0]->pasynPortDriver->dispatcher)
+        return ppLists[0]->pasynPortDriver->dispatcher->queue(ppLists, firstAddr, numAddr);
 
+    ppLists[0]->pasynPortDriver->getTimeStamp(&value.timeStamp);
     try {
-        for (size_t i = 0; i < this->flags.size(); i++)
-        {
-            index = this->flags[i];
-            paramVal *param(getParameter(index));
-            if (!param->isDefined()) continue;
-            switch(param->type) {
-                case asynParamInt32:
-                    status = int32Callback(index, addr);
-                    break;
-                case asynParamInt64:
-                    status = int64Callback(index, addr);
-                    break;
-                case asynParamUInt32Digital:
-                    status = uint32Callback(index, addr, this->vals[index]->uInt32CallbackMask);
-                    this->vals[index]->uInt32CallbackMask = 0;
-                    break;
-                case asynParamFloat64:
-                    status = float64Callback(index, addr);
-                    break;
-                case asynParamOctet:
-                    status = octetCallback(index, addr);
-                    break;
-                default:
-                    break;
+        /* Parameters changed by the callbacks are flagged again and done in the next pass */
+        do {
+            anyChanged = false;
+            for (list = 0; list < numAddr; list++) {
+                pList = ppLists[list];
+                if (pList->flags.empty()) continue;
+                anyChanged = true;
+                changed.swap(pList->flags);
+                std::sort(changed.begin(), changed.end());
+                for (size_t i = 0; i < changed.size(); i++) {
+                    index = changed[i];
+                    paramVal *param(pList->getParameter(index));
+                    int type;
+                    /* The snapshot gets the timestamp of the callbacks, which the driver may have
+                     * updated after it set the value */
+                    pList->updateSnapshot(index, &value.timeStamp);
+                    for (type = 0; type < numBatchTypes; type++) {
+                        if (param->type == batchTypes[type]) break;
+                    }
+                    if ((type == numBatchTypes) || !param->isDefined()) {
+                        pList->dirty[index] = false;
+                        continue;
+                    }
+                    batches[type].push_back(std::make_pair(list, (unsigned)index));
+                }
+                changed.clear();
             }
-        }
+            for (int type = 0; type < numBatchTypes; type++) {
+                if (batches[type].empty()) continue;
+                pvt = ppLists[0]->interruptPvt(batchTypes[type]);
+                if (!pvt) {
+                    for (size_t i = 0; i < batches[type].size(); i++)
+                        ppLists[batches[type][i].first]->dirty[batches[type][i].second] = false;
+                    batches[type].clear();
+                    status = asynParamNotFound;
+                    continue;
+                }
+                pasynManager->interruptStart(pvt, &pclientList);
+                for (size_t i = 0; i < batches[type].size(); i++) {
+                    pList = ppLists[batches[type][i].first];
+                    addr = firstAddr + batches[type][i].first;
+                    index = batches[type][i].second;
+                    /* A parameter changed by an earlier callback in this batch is still flagged,
+                     * so its new value is sent here and it is not queued again */
+                    pList->dirty[index] = false;
+                    pList->getCallbackValue(index, &value);
+                    doCallbacks(pList->pasynPortDriver, pclientList, index, addr, value);
+                }
+                pasynManager->interruptEnd(pvt);
+                pvt = NULL;
+                batches[type].clear();
+            }
+        } while (anyChanged);
     }
     catch (ParamListInvalidIndex&) {
+        if (pvt) pasynManager->interruptEnd(pvt);
         return asynParamBadIndex;
     }
-    flags.clear();
     return status;
 }
 
@@ -938,6 +1430,137 @@ void callbackThread::run()
 
 
 
+callbackDispatcher::callbackDispatcher(asynPortDriver *pPort, double maxRate) :
+    pPort(pPort), minPeriod((maxRate > 0) ? 1./maxRate : 0.), exiting(false),
+    numQueued(0), numReplaced(0), numCalled(0), numBatches(0),
+    thread(*this, "asynPortDriverDispatcher", epicsThreadGetStackSize(epicsThreadStackMedium),
+           epicsThreadPriorityMedium)
+{
+    thread.start();
+}
+
+callbackDispatcher::~callbackDispatcher()
+{
+    mutex.lock();
+    exiting = true;
+    mutex.unlock();
+    wakeup.signal();
+    exitEvent.signal();
+    thread.exitWait();
+}
+
+/** Copies the changed scalar parameters of several parameter lists to pending; called with the driver locked.
+  * The arguments are those of paramList::callCallbacks. */
+asynStatus callbackDispatcher::queue(paramList *const *ppLists, int firstAddr, int numAddr)
+{
+    paramCallbackValue value;
+    epicsTimeStamp timeStamp;
+    std::vector<unsigned> changed;
+    paramList *pList;
+    asynStatus status = asynSuccess;
+    bool anyQueued = false;
+
+    pPort->getTimeStamp(&timeStamp);
+    mutex.lock();
+    for (int list = 0; list < numAddr; list++) {
+        pList = ppLists[list];
+        if (pList->flags.empty()) continue;
+        changed.swap(pList->flags);
+        for (size_t i = 0; i < changed.size(); i++) {
+            int index = changed[i];
+            paramVal *param = pList->vals[index];
+            pList->dirty[index] = false;
+            pList->updateSnapshot(index, &timeStamp);
+            if (!param->isDefined()) continue;
+            if (!pList->interruptPvt(param->type)) {
+                /* Not a scalar parameter, or the port does not have the interrupt */
+                if ((param->type == asynParamInt32) || (param->type == asynParamInt64) ||
+                    (param->type == asynParamUInt32Digital) || (param->type == asynParamFloat64) ||
+                    (param->type == asynParamOctet)) status = asynParamNotFound;
+                continue;
+            }
+            pList->getCallbackValue(index, &value);
+            value.timeStamp = timeStamp;
+            std::pair<callbackMap::iterator, bool> entry =
+                pending.insert(std::make_pair(std::make_pair(firstAddr + list, index), value));
+            if (!entry.second) {
+                value.interruptMask |= entry.first->second.interruptMask;
+                entry.first->second = value;
+                numReplaced++;
+            }
+            if (value.string) {
+                entry.first->second.sval = value.string;
+                entry.first->second.string = NULL;
+            }
+            numQueued++;
+            anyQueued = true;
+        }
+        changed.clear();
+    }
+    mutex.unlock();
+    if (anyQueued) wakeup.signal();
+    return status;
+}
+
+/** Calls the callbacks for the pending parameters, without the driver lock.
+  * The callbacks for each interface are done with one interruptStart/interruptEnd, in address and then
+  * parameter index order, like paramList::callCallbacks. */
+void callbackDispatcher::run()
+{
+    static const asynParamType batchTypes[] = {asynParamInt32, asynParamInt64, asynParamUInt32Digital,
+                                               asynParamFloat64, asynParamOctet};
+    static const int numBatchTypes = sizeof(batchTypes)/sizeof(batchTypes[0]);
+    callbackMap batch;
+    ELLLIST *pclientList;
+    epicsTimeStamp start, now;
+    double elapsed;
+
+    while (true) {
+        wakeup.wait();
+        epicsTimeGetCurrent(&start);
+        mutex.lock();
+        if (exiting) {
+            mutex.unlock();
+            break;
+        }
+        batch.swap(pending);
+        if (!batch.empty()) numBatches++;
+        numCalled += batch.size();
+        mutex.unlock();
+        /* Without the driver lock: the batch is a copy, the interrupt lists of the parameter types
+         * do not change after the port is created, and the interrupt client index has its own lock,
+         * see interruptIndex. Other threads can do callbacks on the same lists at the same time. */
+        for (int type = 0; type < numBatchTypes; type++) {
+            void *pvt = NULL;
+            for (callbackMap::iterator it = batch.begin(); it != batch.end(); ++it) {
+                if (it->second.type != batchTypes[type]) continue;
+                if (!pvt) {
+                    pvt = pPort->params[0]->interruptPvt(batchTypes[type]);
+                    pasynManager->interruptStart(pvt, &pclientList);
+                }
+                paramList::doCallbacks(pPort, pclientList, it->first.second, it->first.first, it->second);
+            }
+            if (pvt) pasynManager->interruptEnd(pvt);
+        }
+        batch.clear();
+        /* Parameters queued in the meantime wait for the rest of the period */
+        if (minPeriod > 0) {
+            epicsTimeGetCurrent(&now);
+            elapsed = epicsTimeDiffInSeconds(&now, &start);
+            if (elapsed < minPeriod) exitEvent.wait(minPeriod - elapsed);
+        }
+    }
+}
+
+void callbackDispatcher::report(FILE *fp)
+{
+    mutex.lock();
+    fprintf(fp, "  Callback dispatcher: max rate %g/s, %lu pending, %lu queued, %lu replaced, %lu called in %lu batches\n",
+            (minPeriod > 0) ? 1./minPeriod : 0., (unsigned long)pending.size(),
+            numQueued, numReplaced, numCalled, numBatches);
+    mutex.unlock();
+}
+
 /** Locks the driver to prevent multiple threads from accessing memory at the same time.
   * This function is called whenever asyn clients call the functions on the asyn interfaces.
   * Drivers with their own background threads must call lock() to protect conflicts with
@@ -1311,6 +1934,26 @@ asynStatus asynPortDriver::setIntegerParam(int list, int index, int value)
     return status;
 }
 
+/** Sets the value for an integer in a range of parameter lists, one value for each list.
+  * Calls setIntegerParam(list, index, values[list-firstList]) for each list.  Used with
+  * callParamCallbacksRange to update one parameter on many addresses.
+  * \param[in] firstList The first parameter list.
+  * \param[in] numLists The number of parameter lists.
+  * \param[in] index The parameter number
+  * \param[in] values Array of numLists values to set.
+  * \return Returns the first error.  The values for the other lists are still set. */
+asynStatus asynPortDriver::setIntegerParamRange(int firstList, int numLists, int index, const epicsInt32 *values)
+{
+    asynStatus status = asynSuccess;
+    asynStatus listStatus;
+
+    for (int i = 0; i < numLists; i++) {
+        listStatus = this->setIntegerParam(firstList+i, index, values[i]);
+        if (status == asynSuccess) status = listStatus;
+    }
+    return status;
+}
+
 /** Sets the value for a 64-bit integer in the parameter library.
   * Calls setInteger64Param(0, index, value) i.e. for parameter list 0.
   * \param[in] index The parameter number
@@ -1339,6 +1982,26 @@ asynStatus asynPortDriver::setInteger64Param(int list, int index, epicsInt64 val
     return status;
 }
 
+/** Sets the value for a 64-bit integer in a range of parameter lists, one value for each list.
+  * Calls setInteger64Param(list, index, values[list-firstList]) for each list.  Used with
+  * callParamCallbacksRange to update one parameter on many addresses.
+  * \param[in] firstList The first parameter list.
+  * \param[in] numLists The number of parameter lists.
+  * \param[in] index The parameter number
+  * \param[in] values Array of numLists values to set.
+  * \return Returns the first error.  The values for the other lists are still set. */
+asynStatus asynPortDriver::setInteger64ParamRange(int firstList, int numLists, int index, const epicsInt64 *values)
+{
+    asynStatus status = asynSuccess;
+    asynStatus listStatus;
+
+    for (int i = 0; i < numLists; i++) {
+        listStatus = this->setInteger64Param(firstList+i, index, values[i]);
+        if (status == asynSuccess) status = listStatus;
+    }
+    return status;
+}
+
 /** Sets the value for a UInt32Digital in the parameter library.
   * Calls setUIntDigitalParam(0, index, value, valueMask, 0) i.e. for parameter list 0.
   * \param[in] index The parameter number
@@ -1508,6 +2171,59 @@ asynStatus asynPortDriver::setDoubleParam(int list, int index, double value)
     return status;
 }
 
+/** Sets the value for a double in a range of parameter lists, one value for each list.
+  * Calls setDoubleParam(list, index, values[list-firstList]) for each list.  Used with
+  * callParamCallbacksRange to update one parameter on many addresses.
+  * \param[in] firstList The first parameter list.
+  * \param[in] numLists The number of parameter lists.
+  * \param[in] index The parameter number
+  * \param[in] values Array of numLists values to set.
+  * \return Returns the first error.  The values for the other lists are still set. */
+asynStatus asynPortDriver::setDoubleParamRange(int firstList, int numLists, int index, const double *values)
+{
+    asynStatus status = asynSuccess;
+    asynStatus listStatus;
+
+    for (int i = 0; i < numLists; i++) {
+        listStatus = this->setDoubleParam(firstList+i, index, values[i]);
+        if (status == asynSuccess) status = listStatus;
+    }
+    return status;
+}
+
+/** Sets the values of many Int32, Int64 and Float64 parameters in one call.
+  * Calls setParams(0, values) i.e. for parameter list 0.
+  * \param[in] values The parameter numbers and values. */
+asynStatus asynPortDriver::setParams(const std::vector<asynParamValue>& values)
+{
+    return this->setParams(0, values);
+}
+
+/** Sets the values of many Int32, Int64 and Float64 parameters in one call.
+  * This is equivalent to setIntegerParam(), setInteger64Param() or setDoubleParam() for each value,
+  * but the parameter list is only looked up once, and no value is set if one is not valid.
+  * A driver can build the vector once and change the values before each call.
+  * callParamCallbacks() then does the callbacks for the parameters that changed.
+  * \param[in] list The parameter list number.  Must be < maxAddr passed to asynPortDriver::asynPortDriver.
+  * \param[in] values The parameter numbers and values.
+  * \return Returns asynParamBadIndex or asynParamWrongType for the first value that is not valid. */
+asynStatus asynPortDriver::setParams(int list, const std::vector<asynParamValue>& values)
+{
+    asynStatus status;
+    int index = -1;
+    static const char *functionName = "setParams";
+
+    paramList *pList=getParamList(list);
+    if (!pList)
+        status = asynParamInvalidList;
+    else if (values.empty())
+        return asynSuccess;
+    else
+        status = pList->setValues(&values[0], values.size(), &index);
+    if (status) reportSetParamErrors(status, index, list, functionName);
+    return status;
+}
+
 /** Sets the value for a string in the parameter library.
   * Calls setStringParam(0, index, value) i.e. for parameter list 0.
   * \param[in] index The parameter number
@@ -1767,6 +2483,64 @@ asynStatus asynPortDriver::getStringParam(int list, int index, std::string& valu
     return status;
 }
 
+/** Gets the values of many Int32, Int64 and Float64 parameters in one call.
+  * Calls getParams(0, values) i.e. for parameter list 0.
+  * \param[in,out] values The parameter numbers, and the values that are read. */
+asynStatus asynPortDriver::getParams(std::vector<asynParamValue>& values)
+{
+    return this->getParams(0, values);
+}
+
+/** Gets the values of many Int32, Int64 and Float64 parameters in one call.
+  * The index of each element selects the parameter.  type, value and status are set from the parameter,
+  * where status is asynParamUndefined if it has no value.
+  * Like the other get methods it is called with the driver locked, so the values are consistent.
+  * \param[in] list The parameter list number.  Must be < maxAddr passed to asynPortDriver::asynPortDriver.
+  * \param[in,out] values The parameter numbers, and the values that are read.
+  * \return Returns asynParamBadIndex or asynParamWrongType for the first parameter that can not be read. */
+asynStatus asynPortDriver::getParams(int list, std::vector<asynParamValue>& values)
+{
+    asynStatus status;
+    int index = -1;
+    static const char *functionName = "getParams";
+
+    paramList *pList=getParamList(list);
+    if (!pList)
+        status = asynParamInvalidList;
+    else if (values.empty())
+        return asynSuccess;
+    else
+        status = pList->getValues(&values[0], values.size(), &index);
+    if (status) reportGetParamErrors(status, index, list, functionName);
+    return status;
+}
+
+/** Gets the values of all Int32, Int64 and Float64 parameters.
+  * Calls getAllParams(0, values) i.e. for parameter list 0.
+  * \param[out] values The values, in parameter number order. */
+asynStatus asynPortDriver::getAllParams(std::vector<asynParamValue>& values)
+{
+    return this->getAllParams(0, values);
+}
+
+/** Gets the values of all Int32, Int64 and Float64 parameters in a parameter list, e.g. to report
+  * or save them.  Like the other get methods it is called with the driver locked, so the values are consistent.
+  * \param[in] list The parameter list number.  Must be < maxAddr passed to asynPortDriver::asynPortDriver.
+  * \param[out] values The values, in parameter number order.  status is asynParamUndefined for
+  * parameters that have no value. */
+asynStatus asynPortDriver::getAllParams(int list, std::vector<asynParamValue>& values)
+{
+    static const char *functionName = "getAllParams";
+
+    paramList *pList=getParamList(list);
+    if (!pList) {
+        reportGetParamErrors(asynParamInvalidList, -1, list, functionName);
+        return asynParamInvalidList;
+    }
+    pList->getAllValues(values);
+    return asynSuccess;
+}
+
 /** Calls callParamCallbacks(0, 0) i.e. with both list and asyn address. */
 asynStatus asynPortDriver::callParamCallbacks()
 {
@@ -1793,6 +2567,193 @@ asynStatus asynPortDriver::callParamCallbacks(int list, int addr)
     return status;
 }
 
+/** Calls the callbacks for the changed parameters of the parameter lists firstAddr to firstAddr+numAddr-1,
+  * each with the asyn address equal to its list number.
+  * This does the same callbacks as callParamCallbacks(addr) for each of the addresses, but each
+  * interrupt list is taken once for all of the addresses, and the callbacks are done in address order.
+  * \param[in] firstAddr The first parameter list and asyn address.
+  * \param[in] numAddr The number of parameter lists and asyn addresses. */
+asynStatus asynPortDriver::callParamCallbacksRange(int firstAddr, int numAddr)
+{
+    if ((firstAddr < 0) || (numAddr < 0) || (numAddr > this->maxAddr - firstAddr))
+        return asynParamInvalidList;
+    if (numAddr == 0) return asynSuccess;
+    return paramList::callCallbacks(&this->params[firstAddr], firstAddr, numAddr);
+}
+
+/** Returns the parameter that an asynParamHandle is bound to.
+  * \param[in] list The parameter list number, which must be valid.
+  * \param[in] index The parameter number, which must be valid. */
+paramVal *asynPortDriver::getParamVal(int list, int index)
+{
+    return this->params[list]->getParameter(index);
+}
+
+/** Called by asynParamHandle::set() when it has changed the value of a parameter.
+  * \param[in] list The parameter list number.
+  * \param[in] index The parameter number. */
+void asynPortDriver::paramChanged(int list, int index)
+{
+    this->params[list]->valueChanged(index);
+}
+
+/** Enables reads of Int32, Int64 and Float64 parameters without the driver lock.
+  * Each parameter list keeps a snapshot of these parameters, which the setXXXParam methods update.
+  * The asynInt32, asynInt64 and asynFloat64 read methods then return the value from the snapshot
+  * without calling lock() and readInt32(), readInt64() or readFloat64(), so that clients reading cached
+  * values do not wait while a poller holds the lock during slow I/O.
+  * The timestamp they return is that of the port when the value was set or its callbacks were last done.
+  * A driver should only enable this if it does not reimplement these read methods,
+  * or only does so to return values from the parameter library.
+  * It should be called after createParam, normally at the end of the constructor of the driver;
+  * parameters created later are read with the lock as before.
+  * \return Returns asynError if this version of EPICS base does not support it. */
+asynStatus asynPortDriver::enableParamSnapshot()
+{
+#ifdef PARAM_SNAPSHOT
+    lock();
+    for (int addr=0; addr<this->maxAddr; addr++)
+        this->params[addr]->enableSnapshot();
+    epicsAtomicWriteMemoryBarrier();
+    epicsAtomicSetIntT(&this->paramSnapshotEnabled, 1);
+    unlock();
+    return asynSuccess;
+#else
+    asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+              "%s:enableParamSnapshot: %s requires EPICS base 3.15 or later\n",
+              driverName, portName);
+    return asynError;
+#endif
+}
+
+/** Calls the callbacks for Int32, Int64, UInt32Digital, Float64 and Octet parameters from a separate thread.
+  * callParamCallbacks() and callParamCallbacksRange() then copy the changed parameters to a queue and return
+  * without calling the callbacks, so the time the driver spends in them does not depend on the number of clients.
+  * A parameter that changes again before the thread has called its callbacks is sent once, with its latest value,
+  * status, alarms and timestamp.
+  * The thread calls the callbacks without the driver lock. The doCallbacksXXX methods for arrays,
+  * generic pointers and enums still call the callbacks in the thread of the caller.
+  * \param[in] maxRate The maximum number of times per second that the thread calls the callbacks; 0 for no limit.
+  * Parameters that change faster are sent at this rate.
+  * \return Returns asynError if the dispatcher is already enabled. */
+asynStatus asynPortDriver::enableCallbackDispatcher(double maxRate)
+{
+    lock();
+    if (this->dispatcher) {
+        unlock();
+        asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+                  "%s:enableCallbackDispatcher: %s callback dispatcher already enabled\n",
+                  driverName, portName);
+        return asynError;
+    }
+    this->dispatcher = new callbackDispatcher(this, maxRate);
+    unlock();
+    return asynSuccess;
+}
+
+/** Reads a parameter from the snapshot; called without the driver lock.
+  * Sets the timestamp, alarm status and alarm severity in pasynUser from the snapshot, like readInt32() etc.
+  * If the address is not valid pSnapshot->value.defined is false and *status is the error.
+  * \return Returns false if the value must be read with the lock. */
+bool asynPortDriver::readSnapshot(asynUser *pasynUser, asynParamType type, paramSnapshot *pSnapshot,
+                                  asynStatus *status)
+{
+#ifdef PARAM_SNAPSHOT
+    int addr;
+
+    /* Pairs with the barrier in enableParamSnapshot, so the snapshots it created are seen */
+    if (!epicsAtomicGetIntT(&this->paramSnapshotEnabled)) return false;
+    epicsAtomicReadMemoryBarrier();
+    *status = getAddress(pasynUser, &addr);
+    if (*status != asynSuccess) {
+        pSnapshot->value.defined = false;
+        return true;
+    }
+    /* Undefined values and errors are left to the read with the lock, which reports them */
+    if (!this->params[addr]->readSnapshot(pasynUser->reason, pSnapshot) ||
+        (pSnapshot->value.type != type) || !pSnapshot->value.defined) return false;
+    pasynUser->timestamp = pSnapshot->value.timeStamp;
+    pasynUser->alarmStatus = pSnapshot->value.alarmStatus;
+    pasynUser->alarmSeverity = pSnapshot->value.alarmSeverity;
+    *status = pSnapshot->value.status;
+    return true;
+#else
+    return false;
+#endif
+}
+
+/** Reads an Int32 parameter without the driver lock if enableParamSnapshot() has been called.
+  * \param[in] pasynUser pasynUser structure that encodes the reason and address.
+  * \param[out] value Address of the value to read.
+  * \param[out] status The status readInt32() would return.
+  * \return Returns false if the value must be read with readInt32(). */
+bool asynPortDriver::readParamSnapshot(asynUser *pasynUser, epicsInt32 *value, asynStatus *status)
+{
+    paramSnapshot snapshot;
+    static const char *functionName = "readInt32";
+
+    if (!readSnapshot(pasynUser, asynParamInt32, &snapshot, status)) return false;
+    if (!snapshot.value.defined) return true;
+    *value = snapshot.value.data.ival;
+    if (*status)
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                  "%s:%s: status=%d, function=%d, name=%s, value=%d",
+                  driverName, functionName, *status, pasynUser->reason, snapshot.value.name, *value);
+    else
+        asynPrint(pasynUser, ASYN_TRACEIO_DRIVER,
+              "%s:%s: function=%d, name=%s, value=%d\n",
+              driverName, functionName, pasynUser->reason, snapshot.value.name, *value);
+    return true;
+}
+
+/** Reads an Int64 parameter without the driver lock if enableParamSnapshot() has been called.
+  * \param[in] pasynUser pasynUser structure that encodes the reason and address.
+  * \param[out] value Address of the value to read.
+  * \param[out] status The status readInt64() would return.
+  * \return Returns false if the value must be read with readInt64(). */
+bool asynPortDriver::readParamSnapshot(asynUser *pasynUser, epicsInt64 *value, asynStatus *status)
+{
+    paramSnapshot snapshot;
+    static const char *functionName = "readInt64";
+
+    if (!readSnapshot(pasynUser, asynParamInt64, &snapshot, status)) return false;
+    if (!snapshot.value.defined) return true;
+    *value = snapshot.value.data.i64val;
+    if (*status)
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                  "%s:%s: status=%d, function=%d, name=%s, value=%lld",
+                  driverName, functionName, *status, pasynUser->reason, snapshot.value.name, *value);
+    else
+        asynPrint(pasynUser, ASYN_TRACEIO_DRIVER,
+              "%s:%s: function=%d, name=%s, value=%lld\n",
+              driverName, functionName, pasynUser->reason, snapshot.value.name, *value);
+    return true;
+}
+
+/** Reads a Float64 parameter without the driver lock if enableParamSnapshot() has been called.
+  * \param[in] pasynUser pasynUser structure that encodes the reason and address.
+  * \param[out] value Address of the value to read.
+  * \param[out] status The status readFloat64() would return.
+  * \return Returns false if the value must be read with readFloat64(). */
+bool asynPortDriver::readParamSnapshot(asynUser *pasynUser, epicsFloat64 *value, asynStatus *status)
+{
+    paramSnapshot snapshot;
+    static const char *functionName = "readFloat64";
+
+    if (!readSnapshot(pasynUser, asynParamFloat64, &snapshot, status)) return false;
+    if (!snapshot.value.defined) return true;
+    *value = snapshot.value.data.dval;
+    if (*status)
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                  "%s:%s: status=%d, function=%d, name=%s, value=%f",
+                  driverName, functionName, *status, pasynUser->reason, snapshot.value.name, *value);
+    else
+        asynPrint(pasynUser, ASYN_TRACEIO_DRIVER,
+              "%s:%s: function=%d, name=%s, value=%f\n",
+              driverName, functionName, pasynUser->reason, snapshot.value.name, *value);
+    return true;
+}
+
 /** Calls paramList::report(fp, details) for each parameter list that the driver supports.
   * \param[in] fp The file pointer on which report information will be written
   * \param[in] details The level of report detail desired; always report details on address 0; >=2 report all addresses */
@@ -1831,36 +2792,28 @@ asynStatus asynPortDriver::doCallbacksArray(epicsType *value, size_t nElements,
                                             int reason, int address, void *interruptPvt)
 {
     ELLLIST *pclientList;
-    interruptNode *pnode;
+    interruptClients clients;
     asynStatus status;
     int alarmStatus;
     int alarmSeverity;
     epicsTimeStamp timeStamp; getTimeStamp(&timeStamp);
-    int addr;
 
     pasynManager->interruptStart(interruptPvt, &pclientList);
-    pnode = (interruptNode *)ellFirst(pclientList);
     getParamStatus(address, reason, &status);
     getParamAlarmStatus(address, reason, &alarmStatus);
     getParamAlarmSeverity(address, reason, &alarmSeverity);
-    while (pnode) {
-        interruptType *pInterrupt = (interruptType *)pnode->drvPvt;
-        this->getAddress(pInterrupt->pasynUser, &addr);
-        /* If this is not a multi-device then address is -1, change to 0 */
-        if (addr == -1) addr = 0;
-        if ((pInterrupt->pasynUser->reason == reason) &&
-            (address == addr)) {
-            /* Set the status for the callback */
-            pInterrupt->pasynUser->auxStatus = status;
-            pInterrupt->pasynUser->alarmStatus = alarmStatus;
-            pInterrupt->pasynUser->alarmSeverity = alarmSeverity;
-            /* Set the timestamp for the callback */
-            pInterrupt->pasynUser->timestamp = timeStamp;
-            pInterrupt->callback(pInterrupt->userPvt,
-                                 pInterrupt->pasynUser,
-                                 value, nElements);
-        }
-        pnode = (interruptNode *)ellNext(&pnode->node);
+    getInterruptClients<interruptType>(interruptPvt, pclientList, reason, address, clients);
+    for (size_t i = 0; i < clients.size(); i++) {
+        interruptType *pInterrupt = (interruptType *)clients[i]->drvPvt;
+        /* Set the status for the callback */
+        pInterrupt->pasynUser->auxStatus = status;
+        pInterrupt->pasynUser->alarmStatus = alarmStatus;
+        pInterrupt->pasynUser->alarmSeverity = alarmSeverity;
+        /* Set the timestamp for the callback */
+        pInterrupt->pasynUser->timestamp = timeStamp;
+        pInterrupt->callback(pInterrupt->userPvt,
+                             pInterrupt->pasynUser,
+                             value, nElements);
     }
     pasynManager->interruptEnd(interruptPvt);
     return asynSuccess;
@@ -1946,6 +2899,7 @@ extern "C" {static asynStatus readInt32(void *drvPvt, asynUser *pasynUser,
     asynPortDriver *pPvt = (asynPortDriver *)drvPvt;
     asynStatus status;
 
+    if (pPvt->readParamSnapshot(pasynUser, value, &status)) return status;
     pPvt->lock();
     status = pPvt->readInt32(pasynUser, value);
     pPvt->unlock();
@@ -2073,6 +3027,7 @@ extern "C" {static asynStatus readInt64(void *drvPvt, asynUser *pasynUser,
     asynPortDriver *pPvt = (asynPortDriver *)drvPvt;
     asynStatus status;
 
+    if (pPvt->readParamSnapshot(pasynUser, value, &status)) return status;
     pPvt->lock();
     status = pPvt->readInt64(pasynUser, value);
     pPvt->unlock();
@@ -2424,6 +3379,7 @@ extern "C" {static asynStatus readFloat64(void *drvPvt, asynUser *pasynUser,
     asynPortDriver *pPvt = (asynPortDriver *)drvPvt;
     asynStatus status;
 
+    if (pPvt->readParamSnapshot(pasynUser, value, &status)) return status;
     pPvt->lock();
     status = pPvt->readFloat64(pasynUser, value);
     pPvt->unlock();
@@ -3149,6 +4105,55 @@ asynStatus asynPortDriver::doCallbacksFloat64Array(epicsFloat64 *value,
                                         this->asynStdInterfaces.float64ArrayInterruptPvt);
 }
 
+/** Called by driver to do the callbacks to registered clients with an array in a shared buffer.
+  * Clients that support it, such as devAsynXXXArray, keep a reference to the buffer instead of
+  * copying the data, so the driver must not modify the data after calling this method.
+  * The callbacks are done by the doCallbacksXXXArray method for type, so a derived class that
+  * overrides those methods still sees every array.
+  * \param[in] pBuffer The buffer holding the array. The caller keeps its own reference.
+  * \param[in] type The array type, asynParamInt8Array to asynParamFloat64Array.
+  * \param[in] nElements Number of elements in the array.
+  * \param[in] reason A client will be called if reason matches pasynUser->reason registered for that client.
+  * \param[in] addr A client will be called if addr matches the asyn address registered for that client. */
+asynStatus asynPortDriver::doCallbacksArrayBuffer(asynArrayBuffer *pBuffer, asynParamType type,
+                                size_t nElements, int reason, int addr)
+{
+    static const char *functionName = "doCallbacksArrayBuffer";
+    void *pData = asynArrayBufferData(pBuffer);
+    asynArrayBuffer *pPrevious;
+    asynStatus status;
+
+    pPrevious = asynArrayBufferSetPosted(pBuffer);
+    switch (type) {
+        case asynParamInt8Array:
+            status = doCallbacksInt8Array((epicsInt8 *)pData, nElements, reason, addr);
+            break;
+        case asynParamInt16Array:
+            status = doCallbacksInt16Array((epicsInt16 *)pData, nElements, reason, addr);
+            break;
+        case asynParamInt32Array:
+            status = doCallbacksInt32Array((epicsInt32 *)pData, nElements, reason, addr);
+            break;
+        case asynParamInt64Array:
+            status = doCallbacksInt64Array((epicsInt64 *)pData, nElements, reason, addr);
+            break;
+        case asynParamFloat32Array:
+            status = doCallbacksFloat32Array((epicsFloat32 *)pData, nElements, reason, addr);
+            break;
+        case asynParamFloat64Array:
+            status = doCallbacksFloat64Array((epicsFloat64 *)pData, nElements, reason, addr);
+            break;
+        default:
+            asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+                "%s:%s: port=%s invalid array type %d\n",
+                driverName, functionName, portName, type);
+            status = asynError;
+            break;
+    }
+    asynArrayBufferSetPosted(pPrevious);
+    return status;
+}
+
 /* asynGenericPointer interface methods */
 extern "C" {static asynStatus readGenericPointer(void *drvPvt, asynUser *pasynUser, void *genericPointer)
 {
@@ -3204,36 +4209,29 @@ asynStatus asynPortDriver::writeGenericPointer(asynUser *pasynUser, void *generi
 asynStatus asynPortDriver::doCallbacksGenericPointer(void *genericPointer, int reason, int address)
 {
     ELLLIST *pclientList;
-    interruptNode *pnode;
+    interruptClients clients;
     epicsTimeStamp timeStamp; getTimeStamp(&timeStamp);
     asynStatus status;
     int alarmStatus;
     int alarmSeverity;
-    int addr;
 
     getParamStatus(address, reason, &status);
     getParamAlarmStatus(address, reason, &alarmStatus);
     getParamAlarmSeverity(address, reason, &alarmSeverity);
     pasynManager->interruptStart(this->asynStdInterfaces.genericPointerInterruptPvt, &pclientList);
-    pnode = (interruptNode *)ellFirst(pclientList);
-    while (pnode) {
-        asynGenericPointerInterrupt *pInterrupt = (asynGenericPointerInterrupt *)pnode->drvPvt;
-        this->getAddress(pInterrupt->pasynUser, &addr);
-        /* If this is not a multi-device then address is -1, change to 0 */
-        if (addr == -1) addr = 0;
-        if ((pInterrupt->pasynUser->reason == reason) &&
-            (address == addr)) {
-            /* Set the status for the callback */
-            pInterrupt->pasynUser->auxStatus = status;
-            pInterrupt->pasynUser->alarmStatus = alarmStatus;
-            pInterrupt->pasynUser->alarmSeverity = alarmSeverity;
-            /* Set the timestamp for the callback */
-            pInterrupt->pasynUser->timestamp = timeStamp;
-            pInterrupt->callback(pInterrupt->userPvt,
-                                 pInterrupt->pasynUser,
-                                 genericPointer);
-        }
-        pnode = (interruptNode *)ellNext(&pnode->node);
+    this->getInterruptClients<asynGenericPointerInterrupt>(
+        this->asynStdInterfaces.genericPointerInterruptPvt, pclientList, reason, address, clients);
+    for (size_t i = 0; i < clients.size(); i++) {
+        asynGenericPointerInterrupt *pInterrupt = (asynGenericPointerInterrupt *)clients[i]->drvPvt;
+        /* Set the status for the callback */
+        pInterrupt->pasynUser->auxStatus = status;
+        pInterrupt->pasynUser->alarmStatus = alarmStatus;
+        pInterrupt->pasynUser->alarmSeverity = alarmSeverity;
+        /* Set the timestamp for the callback */
+        pInterrupt->pasynUser->timestamp = timeStamp;
+        pInterrupt->callback(pInterrupt->userPvt,
+                             pInterrupt->pasynUser,
+                             genericPointer);
     }
     pasynManager->interruptEnd(this->asynStdInterfaces.genericPointerInterruptPvt);
     return asynSuccess;
@@ -3357,23 +4355,16 @@ asynStatus asynPortDriver::writeEnum(asynUser *pasynUser, char *strings[], int v
 asynStatus asynPortDriver::doCallbacksEnum(char *strings[], int values[], int severities[], size_t nElements, int reason, int address)
 {
     ELLLIST *pclientList;
-    interruptNode *pnode;
-    int addr;
+    interruptClients clients;
 
     pasynManager->interruptStart(this->asynStdInterfaces.enumInterruptPvt, &pclientList);
-    pnode = (interruptNode *)ellFirst(pclientList);
-    while (pnode) {
-        asynEnumInterrupt *pInterrupt = (asynEnumInterrupt *)pnode->drvPvt;
-        this->getAddress(pInterrupt->pasynUser, &addr);
-        /* If this is not a multi-device then address is -1, change to 0 */
-        if (addr == -1) addr = 0;
-        if ((pInterrupt->pasynUser->reason == reason) &&
-            (address == addr)) {
-            pInterrupt->callback(pInterrupt->userPvt,
-                                 pInterrupt->pasynUser,
-                                 strings, values, severities, nElements);
-        }
-        pnode = (interruptNode *)ellNext(&pnode->node);
+    this->getInterruptClients<asynEnumInterrupt>(
+        this->asynStdInterfaces.enumInterruptPvt, pclientList, reason, address, clients);
+    for (size_t i = 0; i < clients.size(); i++) {
+        asynEnumInterrupt *pInterrupt = (asynEnumInterrupt *)clients[i]->drvPvt;
+        pInterrupt->callback(pInterrupt->userPvt,
+                             pInterrupt->pasynUser,
+                             strings, values, severities, nElements);
     }
     pasynManager->interruptEnd(this->asynStdInterfaces.enumInterruptPvt);
     return asynSuccess;
@@ -3515,6 +4506,8 @@ void asynPortDriver::report(FILE *fp, int details)
         epicsTimeStamp timeStamp; getTimeStamp(&timeStamp);
         epicsTimeToStrftime(buff, sizeof(buff), "%Y/%m/%d %H:%M:%S.%03f", &timeStamp);
         fprintf(fp, "  Timestamp: %s\n", buff);
+        if (this->paramSnapshotEnabled) fprintf(fp, "  Parameter snapshot: enabled\n");
+        if (this->dispatcher) this->dispatcher->report(fp);
         if (asynStdInterfaces.octet.pinterface) {
             fprintf(fp, "  Input EOS[%d]: ", this->inputEosLenOctet);
             epicsStrPrintEscaped(fp, this->inputEosOctet, this->inputEosLenOctet);
@@ -3806,6 +4799,8 @@ void asynPortDriver::initialize(const char *portNameIn, int maxAddrIn, int inter
 
     if (maxAddrIn < 1) maxAddrIn = 1;
     this->maxAddr = maxAddrIn;
+    this->paramSnapshotEnabled = 0;
+    this->dispatcher = NULL;
     params.resize(maxAddr);
     for (addr=0; addr<maxAddr; addr++) {
         this->params[addr] = new paramList(this);
@@ -3895,6 +4890,31 @@ void asynPortDriver::initialize(const char *portNameIn, int maxAddrIn, int inter
         throw std::runtime_error(msg);
     }
 
+    /* Create the indexes of the interrupt clients for each interface that can generate interrupts */
+    typedef interruptIndex *(*indexCreator)(asynPortDriver *pPort, void *interruptPvt);
+    struct {
+        void *interruptPvt;
+        indexCreator create;
+    } indexes[] = {
+        {pInterfaces->int32InterruptPvt,         interruptIndex::create<asynInt32Interrupt>},
+        {pInterfaces->int64InterruptPvt,         interruptIndex::create<asynInt64Interrupt>},
+        {pInterfaces->uInt32DigitalInterruptPvt, interruptIndex::create<asynUInt32DigitalInterrupt>},
+        {pInterfaces->float64InterruptPvt,       interruptIndex::create<asynFloat64Interrupt>},
+        {pInterfaces->octetInterruptPvt,         interruptIndex::create<asynOctetInterrupt>},
+        {pInterfaces->int8ArrayInterruptPvt,     interruptIndex::create<asynInt8ArrayInterrupt>},
+        {pInterfaces->int16ArrayInterruptPvt,    interruptIndex::create<asynInt16ArrayInterrupt>},
+        {pInterfaces->int32ArrayInterruptPvt,    interruptIndex::create<asynInt32ArrayInterrupt>},
+        {pInterfaces->int64ArrayInterruptPvt,    interruptIndex::create<asynInt64ArrayInterrupt>},
+        {pInterfaces->float32ArrayInterruptPvt,  interruptIndex::create<asynFloat32ArrayInterrupt>},
+        {pInterfaces->float64ArrayInterruptPvt,  interruptIndex::create<asynFloat64ArrayInterrupt>},
+        {pInterfaces->genericPointerInterruptPvt, interruptIndex::create<asynGenericPointerInterrupt>},
+        {pInterfaces->enumInterruptPvt,          interruptIndex::create<asynEnumInterrupt>}
+    };
+    for (size_t i=0; i<sizeof(indexes)/sizeof(indexes[0]); i++) {
+        if (indexes[i].interruptPvt)
+            this->interruptIndexes[indexes[i].interruptPvt] = indexes[i].create(this, indexes[i].interruptPvt);
+    }
+
     /* Connect to our device for asynTrace */
     status = pasynManager->connectDevice(this->pasynUserSelf, portName, 0);
     if (status != asynSuccess) {
@@ -3925,11 +4945,16 @@ asynStatus asynPortDriver::createParams()
 asynPortDriver::~asynPortDriver()
 {
     delete cbThread;
+    delete dispatcher;
     epicsMutexDestroy(this->mutexId);
 
     for (int addr=0; addr<this->maxAddr; addr++) {
         delete this->params[addr];
     }
+    for (std::map<void *, interruptIndex *>::iterator it = this->interruptIndexes.begin();
+         it != this->interruptIndexes.end(); ++it) {
+        delete it->second;
+    }
 
     pasynManager->freeAsynUser(this->pasynUserSelf);
     free(this->inputEosOctet);
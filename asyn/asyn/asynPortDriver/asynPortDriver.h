@@ -3,15 +3,18 @@
 
 #include <vector>
 #include <string>
+#include <map>
 
 #include <epicsTypes.h>
 #include <epicsMutex.h>
 #include <epicsThread.h>
 
 #include <asynStandardInterfaces.h>
+#include <asynArrayBuffer.h>
 #include <asynParamSet.h>
 #include <asynParamType.h>
 #include <paramErrors.h>
+#include <paramVal.h>
 
 class paramList;
 
@@ -39,6 +42,28 @@ typedef void (*userTimeStampFunction)(void *userPvt, epicsTimeStamp *pTimeStamp)
 #define asynInt64ArrayMask      0x00008000
 
 class callbackThread;
+class callbackDispatcher;
+class interruptIndex;
+class interruptClients;
+struct paramSnapshot;
+
+/** Value of an Int32, Int64 or Float64 parameter, for setParams() and getParams().
+  * The constructors set type from the type of the value. */
+struct asynParamValue {
+    asynParamValue() : index(-1), type(asynParamNotDefined), status(asynSuccess) { value.i64val = 0; }
+    asynParamValue(int idx, epicsInt32 ival)   : index(idx), type(asynParamInt32), status(asynSuccess) { value.ival = ival; }
+    asynParamValue(int idx, epicsInt64 i64val) : index(idx), type(asynParamInt64), status(asynSuccess) { value.i64val = i64val; }
+    asynParamValue(int idx, epicsFloat64 dval) : index(idx), type(asynParamFloat64), status(asynSuccess) { value.dval = dval; }
+    int index;              /**< The parameter number */
+    asynParamType type;     /**< asynParamInt32, asynParamInt64 or asynParamFloat64 */
+    asynStatus status;      /**< The status of the parameter, set by getParams() */
+    union {
+        epicsInt32   ival;
+        epicsInt64   i64val;
+        epicsFloat64 dval;
+    } value;
+};
+template <typename epicsType> class asynParamHandle;
 
 /** Base class for asyn port drivers; handles most of the bookkeeping for writing an asyn port driver
   * with standard asyn interfaces and a parameter library. */
@@ -114,6 +139,8 @@ public:
                                         size_t nElements);
     virtual asynStatus doCallbacksFloat64Array(epicsFloat64 *value,
                                         size_t nElements, int reason, int addr);
+    asynStatus doCallbacksArrayBuffer(asynArrayBuffer *pBuffer, asynParamType type,
+                                        size_t nElements, int reason, int addr);
     virtual asynStatus readGenericPointer(asynUser *pasynUser, void *pointer);
     virtual asynStatus writeGenericPointer(asynUser *pasynUser, void *pointer);
     virtual asynStatus doCallbacksGenericPointer(void *pointer, int reason, int addr);
@@ -134,6 +161,10 @@ public:
     virtual asynStatus createParam(          const char *name, asynParamType type, int *index);
     virtual asynStatus createParam(int list, const char *name, asynParamType type, int *index);
     virtual asynStatus createParams();
+    template <typename epicsType>
+        asynStatus createParam(          const char *name, asynParamHandle<epicsType> *pHandle);
+    template <typename epicsType>
+        asynStatus createParam(int list, const char *name, asynParamHandle<epicsType> *pHandle);
     virtual asynStatus getNumParams(          int *numParams);
     virtual asynStatus getNumParams(int list, int *numParams);
     virtual asynStatus findParam(          const char *name, int *index);
@@ -158,8 +189,10 @@ public:
     virtual void       reportGetParamErrors(asynStatus status, int index, int list, const char *functionName);
     virtual asynStatus setIntegerParam(          int index, int value);
     virtual asynStatus setIntegerParam(int list, int index, int value);
+    virtual asynStatus setIntegerParamRange(int firstList, int numLists, int index, const epicsInt32 *values);
     virtual asynStatus setInteger64Param(          int index, epicsInt64 value);
     virtual asynStatus setInteger64Param(int list, int index, epicsInt64 value);
+    virtual asynStatus setInteger64ParamRange(int firstList, int numLists, int index, const epicsInt64 *values);
     virtual asynStatus setUIntDigitalParam(          int index, epicsUInt32 value, epicsUInt32 valueMask);
     virtual asynStatus setUIntDigitalParam(int list, int index, epicsUInt32 value, epicsUInt32 valueMask);
     virtual asynStatus setUIntDigitalParam(          int index, epicsUInt32 value, epicsUInt32 valueMask, epicsUInt32 interruptMask);
@@ -172,6 +205,9 @@ public:
     virtual asynStatus getUInt32DigitalInterrupt(int list, int index, epicsUInt32 *mask, interruptReason reason);
     virtual asynStatus setDoubleParam(          int index, double value);
     virtual asynStatus setDoubleParam(int list, int index, double value);
+    virtual asynStatus setDoubleParamRange(int firstList, int numLists, int index, const double *values);
+    virtual asynStatus setParams(          const std::vector<asynParamValue>& values);
+    virtual asynStatus setParams(int list, const std::vector<asynParamValue>& values);
     virtual asynStatus setStringParam(          int index, const char *value);
     virtual asynStatus setStringParam(int list, int index, const char *value);
     virtual asynStatus setStringParam(          int index, const std::string& value);
@@ -188,9 +224,19 @@ public:
     virtual asynStatus getStringParam(int list, int index, int maxChars, char *value);
     virtual asynStatus getStringParam(          int index, std::string& value);
     virtual asynStatus getStringParam(int list, int index, std::string& value);
+    virtual asynStatus getParams(          std::vector<asynParamValue>& values);
+    virtual asynStatus getParams(int list, std::vector<asynParamValue>& values);
+    virtual asynStatus getAllParams(          std::vector<asynParamValue>& values);
+    virtual asynStatus getAllParams(int list, std::vector<asynParamValue>& values);
     virtual asynStatus callParamCallbacks();
     virtual asynStatus callParamCallbacks(          int addr);
     virtual asynStatus callParamCallbacks(int list, int addr);
+    virtual asynStatus callParamCallbacksRange(int firstAddr, int numAddr);
+    asynStatus enableParamSnapshot();
+    asynStatus enableCallbackDispatcher(double maxRate);
+    bool readParamSnapshot(asynUser *pasynUser, epicsInt32 *value, asynStatus *status);
+    bool readParamSnapshot(asynUser *pasynUser, epicsInt64 *value, asynStatus *status);
+    bool readParamSnapshot(asynUser *pasynUser, epicsFloat64 *value, asynStatus *status);
     virtual asynStatus updateTimeStamp();
     virtual asynStatus updateTimeStamp(epicsTimeStamp *pTimeStamp);
     virtual asynStatus getTimeStamp(epicsTimeStamp *pTimeStamp);
@@ -219,14 +265,115 @@ private:
     char *outputEosOctet;
     int outputEosLenOctet;
     callbackThread *cbThread;
+    callbackDispatcher *dispatcher;
+    std::map<void *, interruptIndex *> interruptIndexes;
+    /** Set with epicsAtomic by enableParamSnapshot, read without the lock by readSnapshot */
+    int paramSnapshotEnabled;
     template <typename epicsType, typename interruptType>
         asynStatus doCallbacksArray(epicsType *value, size_t nElements,
                                     int reason, int address, void *interruptPvt);
+    template <typename interruptType>
+        void getInterruptClients(void *interruptPvt, ELLLIST *pclientList,
+                                 int reason, int addr, interruptClients &clients);
+    bool readSnapshot(asynUser *pasynUser, asynParamType type, paramSnapshot *pSnapshot,
+                      asynStatus *status);
+    paramVal *getParamVal(int list, int index);
+    void paramChanged(int list, int index);
 
     friend class paramList;
     friend class callbackThread;
+    friend class callbackDispatcher;
+    template <typename epicsType> friend class asynParamHandle;
+};
+
+/** Parameter type for each value type of asynParamHandle */
+template <typename epicsType> struct asynParamTypeOf;
+template <> struct asynParamTypeOf<epicsInt32>   { static const asynParamType type = asynParamInt32; };
+template <> struct asynParamTypeOf<epicsInt64>   { static const asynParamType type = asynParamInt64; };
+template <> struct asynParamTypeOf<epicsFloat64> { static const asynParamType type = asynParamFloat64; };
+
+/** Handle to a parameter in one parameter list, bound by asynPortDriver::createParam.
+  * The parameter type follows from epicsType, which must be epicsInt32, epicsInt64 or epicsFloat64,
+  * so set() and get() can not be used with the wrong type and access the value directly,
+  * without looking the parameter up or checking its type on each call.
+  * Like setIntegerParam() etc. they must be called with the driver locked.
+  * index() is the parameter number for the other methods and for pasynUser->reason. */
+template <typename epicsType>
+class asynParamHandle {
+public:
+    asynParamHandle() : pPort(NULL), pVal(NULL), list_(0), index_(-1) {}
+    int index() const { return index_; }
+    int list() const { return list_; }
+
+    /** Sets the value, like setIntegerParam(list, index, value) etc.
+      * callParamCallbacks() does the callbacks if it has changed. */
+    void set(epicsType value)
+    {
+        epicsType &current = pVal->value<epicsType>();
+        if (!pVal->valueDefined || (current != value)) {
+            pVal->valueDefined = true;
+            current = value;
+            pPort->paramChanged(list_, index_);
+        }
+    }
+
+    /** Gets the value, like getIntegerParam(list, index, value) etc.
+      * \return Returns asynParamUndefined if the value has not been set, without printing an error,
+      * otherwise the status of the parameter. */
+    asynStatus get(epicsType *value) const
+    {
+        if (!pVal->valueDefined) {
+            *value = 0;
+            return asynParamUndefined;
+        }
+        *value = pVal->value<epicsType>();
+        return pVal->status_;
+    }
+
+private:
+    asynPortDriver *pPort;
+    paramVal *pVal;
+    int list_;
+    int index_;
+
+    friend class asynPortDriver;
 };
 
+/** Creates a parameter in all parameter lists and binds a handle to it in list 0.
+  * \param[in] name Parameter name
+  * \param[out] pHandle Handle to bind; the type of the parameter follows from it */
+template <typename epicsType>
+asynStatus asynPortDriver::createParam(const char *name, asynParamHandle<epicsType> *pHandle)
+{
+    int index;
+    asynStatus status = createParam(name, asynParamTypeOf<epicsType>::type, &index);
+    if (status != asynSuccess) return status;
+    /* index is the one in the last list, which differs if parameters were added to some lists only */
+    findParam(0, name, &index);
+    pHandle->pPort = this;
+    pHandle->pVal = getParamVal(0, index);
+    pHandle->list_ = 0;
+    pHandle->index_ = index;
+    return asynSuccess;
+}
+
+/** Creates a parameter in one parameter list and binds a handle to it.
+  * \param[in] list The parameter list number.  Must be < maxAddr passed to asynPortDriver::asynPortDriver.
+  * \param[in] name Parameter name
+  * \param[out] pHandle Handle to bind; the type of the parameter follows from it */
+template <typename epicsType>
+asynStatus asynPortDriver::createParam(int list, const char *name, asynParamHandle<epicsType> *pHandle)
+{
+    int index;
+    asynStatus status = createParam(list, name, asynParamTypeOf<epicsType>::type, &index);
+    if (status != asynSuccess) return status;
+    pHandle->pPort = this;
+    pHandle->pVal = getParamVal(list, index);
+    pHandle->list_ = list;
+    pHandle->index_ = index;
+    return asynSuccess;
+}
+
 class callbackThread: public epicsThreadRunable {
 public:
     callbackThread(asynPortDriver *portDriver);
@@ -9,6 +9,8 @@
 
 #include <string>
 
+template <typename epicsType> class asynParamHandle;
+
 /** Structure for storing parameter value in parameter library */
 class paramVal {
 public:
@@ -39,6 +41,8 @@ public:
     void setString(const std::string& value);
     const std::string& getString();
     void report(int id, FILE *fp, int details);
+    /** Returns the value without checking the type, for asynParamHandle */
+    template <typename epicsType> epicsType& value();
     const char* getTypeName();
     asynParamType type; /**< Parameter data type */
     static const char* typeNames[];
@@ -69,8 +73,14 @@ protected:
         epicsFloat64 *pf64;
         void         *pgp;
     } data;
+
+    template <typename epicsType> friend class asynParamHandle;
 };
 
+template <> inline epicsInt32&   paramVal::value<epicsInt32>()   { return data.ival; }
+template <> inline epicsInt64&   paramVal::value<epicsInt64>()   { return data.i64val; }
+template <> inline epicsFloat64& paramVal::value<epicsFloat64>() { return data.dval; }
+
 #endif /* cplusplus */
 
 #endif
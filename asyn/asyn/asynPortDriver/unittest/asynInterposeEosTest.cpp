@@ -0,0 +1,193 @@
+/*************************************************************************\
+* Copyright (c) 2010 UChicago Argonne LLC, as Operator of Argonne
+*     National Laboratory.
+* Distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+
+/*
+ * Input EOS processing of asynInterposeEos, with a port that returns
+ * the data in given chunks, one chunk for each read.
+ */
+
+#include <vector>
+#include <string>
+
+#include <string.h>
+
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include <asynDriver.h>
+#include <asynOctet.h>
+#include <asynInterposeEos.h>
+
+namespace {
+
+struct chunkSource {
+    std::vector<std::string> chunks;
+    size_t next;
+};
+
+chunkSource source;
+
+void chunkSourceReport(void *drvPvt, FILE *fp, int details) {}
+asynStatus chunkSourceConnect(void *drvPvt, asynUser *pasynUser)
+{
+    pasynManager->exceptionConnect(pasynUser);
+    return asynSuccess;
+}
+asynStatus chunkSourceDisconnect(void *drvPvt, asynUser *pasynUser)
+{
+    pasynManager->exceptionDisconnect(pasynUser);
+    return asynSuccess;
+}
+asynCommon chunkSourceCommon = {chunkSourceReport, chunkSourceConnect, chunkSourceDisconnect};
+
+asynStatus chunkSourceRead(void *drvPvt, asynUser *pasynUser, char *data, size_t maxchars,
+                           size_t *nbytesTransfered, int *eomReason)
+{
+    chunkSource *psource = (chunkSource *)drvPvt;
+    size_t n = 0;
+
+    if (psource->next < psource->chunks.size()) {
+        const std::string &chunk = psource->chunks[psource->next++];
+        n = chunk.size() < maxchars ? chunk.size() : maxchars;
+        memcpy(data, chunk.data(), n);
+    }
+    *nbytesTransfered = n;
+    if (eomReason) *eomReason = 0;
+    return asynSuccess;
+}
+
+asynStatus chunkSourceFlush(void *drvPvt, asynUser *pasynUser)
+{
+    return asynSuccess;
+}
+
+asynOctet *pasynOctet;
+void *octetPvt;
+asynUser *pasynUser;
+
+void setup()
+{
+    static asynOctet octet;
+    static asynInterface commonInterface, octetInterface;
+    const char *portName = "chunkSource";
+
+    octet.read = chunkSourceRead;
+    octet.flush = chunkSourceFlush;
+    commonInterface.interfaceType = asynCommonType;
+    commonInterface.pinterface = &chunkSourceCommon;
+    commonInterface.drvPvt = &source;
+    octetInterface.interfaceType = asynOctetType;
+    octetInterface.pinterface = &octet;
+    octetInterface.drvPvt = &source;
+    pasynManager->registerPort(portName, 0, 1, 0, 0);
+    pasynManager->registerInterface(portName, &commonInterface);
+    pasynManager->registerInterface(portName, &octetInterface);
+    asynInterposeEosConfig(portName, -1, 1, 0);
+    pasynUser = pasynManager->createAsynUser(0, 0);
+    pasynManager->connectDevice(pasynUser, portName, -1);
+    asynInterface *pasynInterface = pasynManager->findInterface(pasynUser, asynOctetType, 1);
+    pasynOctet = (asynOctet *)pasynInterface->pinterface;
+    octetPvt = pasynInterface->drvPvt;
+}
+
+/* Start again with new chunks and EOS */
+void load(const char *eos, const char *c1, const char *c2 = 0, const char *c3 = 0)
+{
+    pasynOctet->flush(octetPvt, pasynUser);
+    pasynOctet->setInputEos(octetPvt, pasynUser, eos, (int)strlen(eos));
+    source.chunks.clear();
+    source.next = 0;
+    source.chunks.push_back(c1);
+    if (c2) source.chunks.push_back(c2);
+    if (c3) source.chunks.push_back(c3);
+}
+
+/* Read with a buffer of maxchars, and check the characters, the count and the eomReason */
+void expectRead(size_t maxchars, const char *expect, int expectEom)
+{
+    char buffer[64];
+    size_t nRead = 12345;
+    int eomReason = -1;
+    size_t len = strlen(expect);
+
+    memset(buffer, 'X', sizeof(buffer));
+    pasynOctet->read(octetPvt, pasynUser, buffer, maxchars, &nRead, &eomReason);
+    testOk(nRead == len && memcmp(buffer, expect, len) == 0 && eomReason == expectEom &&
+           (len >= maxchars || buffer[len] == 0),
+           "read %d: nRead=%d eomReason=%d, expected %d characters eomReason=%d",
+           (int)maxchars, (int)nRead, eomReason, (int)len, expectEom);
+}
+
+void testSplitEos()
+{
+    testDiag("2 character EOS split across two driver reads");
+    load("\r\n", "abc\r", "\ndef\r\n");
+    expectRead(32, "abc", ASYN_EOM_EOS);
+    expectRead(32, "def", ASYN_EOM_EOS);
+
+    testDiag("First EOS character at the end of a driver read but not followed by the second");
+    load("\r\n", "ab\r", "x\r\n");
+    expectRead(32, "ab\rx", ASYN_EOM_EOS);
+
+    testDiag("Several EOS in one driver read, the last one split");
+    load("\r\n", "a\r\nb\r\nc\r", "\n");
+    expectRead(32, "a", ASYN_EOM_EOS);
+    expectRead(32, "b", ASYN_EOM_EOS);
+    expectRead(32, "c", ASYN_EOM_EOS);
+}
+
+void testEosAtMaxchars()
+{
+    testDiag("First EOS character is the last character that fits");
+    load("\r\n", "abc\r\nxyz\r\n");
+    expectRead(4, "abc\r", ASYN_EOM_CNT);
+    expectRead(4, "", ASYN_EOM_EOS);
+    expectRead(4, "xyz\r", ASYN_EOM_CNT);
+    expectRead(4, "", ASYN_EOM_EOS);
+
+    testDiag("First EOS character is the last character that fits, and is not followed by the second");
+    load("\r\n", "abc\rx\r\n");
+    expectRead(4, "abc\r", ASYN_EOM_CNT);
+    expectRead(4, "x", ASYN_EOM_EOS);
+
+    testDiag("First EOS character is just past maxchars");
+    load("\r\n", "abcd\r\n");
+    expectRead(4, "abcd", ASYN_EOM_CNT);
+    expectRead(4, "", ASYN_EOM_EOS);
+
+    testDiag("EOS split across driver reads after a read that filled the buffer");
+    load("\r\n", "abcd", "\r", "\nef\r\n");
+    expectRead(4, "abcd", ASYN_EOM_CNT);
+    expectRead(4, "", ASYN_EOM_EOS);
+    expectRead(4, "ef", ASYN_EOM_EOS);
+}
+
+void testOneCharacterEos()
+{
+    testDiag("1 character EOS");
+    load("\n", "abcdef\n", "gh", "\n");
+    expectRead(4, "abcd", ASYN_EOM_CNT);
+    expectRead(4, "ef", ASYN_EOM_EOS);
+    expectRead(4, "gh", ASYN_EOM_EOS);
+
+    testDiag("No EOS, the reads return what the driver has");
+    load("", "abcdef");
+    expectRead(4, "abcd", ASYN_EOM_CNT);
+    expectRead(4, "ef", 0);
+}
+
+} // namespace
+
+MAIN(asynInterposeEosTest)
+{
+    testPlan(22);
+    setup();
+    testSplitEos();
+    testEosAtMaxchars();
+    testOneCharacterEos();
+    return testDone();
+}
@@ -0,0 +1,774 @@
+/*************************************************************************\
+* Copyright (c) 2010 UChicago Argonne LLC, as Operator of Argonne
+*     National Laboratory.
+* Distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+
+/*
+ * Performance measurements for the asynPortDriver parameter library,
+ * the asynManager methods it depends on, the array element conversion
+ * used by the array device support, and the input EOS processing of
+ * asynInterposeEos.
+ *
+ * These are not run by asynRunPortDriverTests; they only report timings
+ * with testDiag and check that the operations being timed succeeded.
+ */
+
+#include <stdexcept>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <epicsStdio.h>
+#include <epicsTime.h>
+#include <epicsThread.h>
+#include <epicsEvent.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include <asynArrayConvert.h>
+#include <asynPortDriver.h>
+#include <asynPortClient.h>
+#include <asynOctet.h>
+#include <asynInterposeEos.h>
+
+// Need interrupt accept from dbAccess.h unless asyn is built with EPICS_LIBCOM_ONLY
+#ifdef EPICS_LIBCOM_ONLY
+    static int interruptAccept;
+#else
+    #include <dbAccess.h>
+#endif
+
+#ifdef __rtems__
+// no test data needed (when running individual CI tests)
+const void* epicsRtemsFSImage = 0;
+#endif
+
+namespace {
+
+/* since asyn ports are forever, store them in a global
+ * pointer so that valgrind will consider them reachable
+ */
+asynPortDriver *portInit;
+asynPortDriver *portUpdate;
+asynPortDriver *portClients;
+asynPortDriver *portRange;
+asynPortDriver *portLocked;
+asynPortDriver *portSnapshot;
+asynPortDriver *portHandle;
+asynPortDriver *portBulk;
+asynPortDriver *portDispatch[3];
+
+int numInt32Callbacks;
+
+void int32Callback(void *userPvt, asynUser *pasynUser, epicsInt32 value)
+{
+    numInt32Callbacks++;
+}
+
+double elapsed(const epicsTimeStamp& start)
+{
+    epicsTimeStamp now;
+    epicsTimeGetCurrent(&now);
+    return epicsTimeDiffInSeconds(&now, &start);
+}
+
+/* Startup cost: createParam for every parameter on every address, then the
+ * drvUserCreate lookup that record initialization does for each record. */
+void testStartup(int numParams, int maxAddr)
+{
+    epicsTimeStamp start;
+    char name[40];
+    int i, addr, index;
+    bool ok;
+
+    testDiag("Startup with %d parameters on %d addresses", numParams, maxAddr);
+
+    epicsTimeGetCurrent(&start);
+    portInit = new asynPortDriver("portInit", maxAddr,
+                                  asynDrvUserMask|asynInt32Mask,
+                                  asynInt32Mask, ASYN_MULTIDEVICE, 0, 0,
+                                  epicsThreadGetStackSize(epicsThreadStackSmall));
+    ok = true;
+    for (i=0; i<numParams; i++) {
+        epicsSnprintf(name, sizeof(name), "PARAM_%d", i);
+        if (portInit->createParam(name, asynParamInt32, &index) != asynSuccess ||
+            index != i) ok = false;
+    }
+    testOk(ok, "createParam for %d parameters", numParams);
+    testDiag("construction: %.3f s", elapsed(start));
+
+    std::vector<asynUser*> users(maxAddr);
+    for (addr=0; addr<maxAddr; addr++) {
+        users[addr] = pasynManager->createAsynUser(0, 0);
+        pasynManager->connectDevice(users[addr], "portInit", addr);
+    }
+    epicsTimeGetCurrent(&start);
+    ok = true;
+    for (addr=0; addr<maxAddr; addr++) {
+        for (i=0; i<numParams; i++) {
+            epicsSnprintf(name, sizeof(name), "PARAM_%d", i);
+            if (portInit->drvUserCreate(users[addr], name, 0, 0) != asynSuccess ||
+                users[addr]->reason != i) ok = false;
+        }
+    }
+    testOk(ok, "drvUserCreate for %d records", numParams*maxAddr);
+    testDiag("record init: %.3f s", elapsed(start));
+    for (addr=0; addr<maxAddr; addr++) {
+        pasynManager->disconnect(users[addr]);
+        pasynManager->freeAsynUser(users[addr]);
+    }
+}
+
+/* Update cycle cost: set numSet parameters, then callParamCallbacks.
+ * The time per parameter should not grow with numSet. */
+void testUpdateCycle(int numParams)
+{
+    static const int numCycles = 100;
+    epicsTimeStamp start;
+    char name[40];
+    int i, cycle, index, numSet;
+    bool ok = true;
+
+    portUpdate = new asynPortDriver("portUpdate", 1,
+                                    asynDrvUserMask|asynInt32Mask,
+                                    asynInt32Mask, 0, 0, 0,
+                                    epicsThreadGetStackSize(epicsThreadStackSmall));
+    for (i=0; i<numParams; i++) {
+        epicsSnprintf(name, sizeof(name), "PARAM_%d", i);
+        portUpdate->createParam(name, asynParamInt32, &index);
+    }
+
+    testDiag("Update cycle with %d parameters", numParams);
+    for (numSet=numParams/100; numSet<=numParams; numSet*=10) {
+        portUpdate->lock();
+        epicsTimeGetCurrent(&start);
+        for (cycle=0; cycle<numCycles; cycle++) {
+            for (i=0; i<numSet; i++) {
+                if (portUpdate->setIntegerParam(i, cycle) != asynSuccess) ok = false;
+            }
+            if (portUpdate->callParamCallbacks() != asynSuccess) ok = false;
+        }
+        double t = elapsed(start);
+        portUpdate->unlock();
+        testDiag("%6d parameters set per cycle: %.3f us/cycle, %.1f ns/parameter",
+                 numSet, t/numCycles*1e6, t/numCycles/numSet*1e9);
+    }
+    testOk(ok, "setIntegerParam and callParamCallbacks");
+}
+
+/* Callback cost with many registered clients: each client is on its own parameter,
+ * so callParamCallbacks for one parameter delivers one callback.
+ * The time per cycle should not grow with the number of clients. */
+void testClients(int maxClients)
+{
+    static const int numCycles = 10000;
+    epicsTimeStamp start;
+    char name[40];
+    int i, cycle, index, numClients, numSet;
+    bool ok = true;
+
+    portClients = new asynPortDriver("portClients", 1,
+                                     asynDrvUserMask|asynInt32Mask,
+                                     asynInt32Mask, 0, 0, 0,
+                                     epicsThreadGetStackSize(epicsThreadStackSmall));
+    for (i=0; i<maxClients; i++) {
+        epicsSnprintf(name, sizeof(name), "PARAM_%d", i);
+        portClients->createParam(name, asynParamInt32, &index);
+    }
+
+    testDiag("callParamCallbacks for one parameter with registered clients");
+    std::vector<asynInt32Client*> clients;
+    for (numClients=10; numClients<=maxClients; numClients*=10) {
+        while ((int)clients.size() < numClients) {
+            epicsSnprintf(name, sizeof(name), "PARAM_%d", (int)clients.size());
+            clients.push_back(new asynInt32Client("portClients", 0, name));
+            if (clients.back()->registerInterruptUser(int32Callback) != asynSuccess) ok = false;
+        }
+        numInt32Callbacks = 0;
+        portClients->lock();
+        epicsTimeGetCurrent(&start);
+        for (cycle=0; cycle<numCycles; cycle++) {
+            portClients->setIntegerParam(0, cycle);
+            if (portClients->callParamCallbacks() != asynSuccess) ok = false;
+        }
+        double t = elapsed(start);
+        portClients->unlock();
+        if (numInt32Callbacks != numCycles) ok = false;
+        testDiag("%6d clients: %.3f us/cycle", numClients, t/numCycles*1e6);
+    }
+    testOk(ok, "callbacks delivered to one of %d clients", maxClients);
+
+    /* Batch delivery: many parameters changed per callParamCallbacks, each with a client */
+    testDiag("callParamCallbacks for many parameters each with a client");
+    ok = true;
+    for (numSet=5; numSet<=500; numSet*=10) {
+        numInt32Callbacks = 0;
+        portClients->lock();
+        epicsTimeGetCurrent(&start);
+        for (cycle=0; cycle<numCycles/10; cycle++) {
+            for (i=0; i<numSet; i++) portClients->setIntegerParam(i, cycle);
+            if (portClients->callParamCallbacks() != asynSuccess) ok = false;
+        }
+        double t = elapsed(start);
+        portClients->unlock();
+        if (numInt32Callbacks != numSet*(numCycles/10)) ok = false;
+        testDiag("%6d parameters set per cycle: %.3f us/cycle, %.1f ns/parameter",
+                 numSet, t/(numCycles/10)*1e6, t/(numCycles/10)/numSet*1e9);
+    }
+    testOk(ok, "callbacks delivered for every parameter set");
+    for (i=0; i<(int)clients.size(); i++) delete clients[i];
+}
+
+/* One parameter updated on every address of a multi-device port, with a client on each
+ * address: callParamCallbacks for each address, compared with setting all of the values
+ * with setIntegerParamRange and doing the callbacks with one callParamCallbacksRange. */
+void testAddressRange(int maxAddr)
+{
+    static const int numCycles = 1000;
+    epicsTimeStamp start;
+    char name[40];
+    int addr, cycle, index;
+    bool ok = true;
+
+    portRange = new asynPortDriver("portRange", maxAddr,
+                                   asynDrvUserMask|asynInt32Mask,
+                                   asynInt32Mask, ASYN_MULTIDEVICE, 0, 0,
+                                   epicsThreadGetStackSize(epicsThreadStackSmall));
+    for (addr=0; addr<maxAddr; addr++) {
+        portRange->createParam(addr, "PARAM", asynParamInt32, &index);
+    }
+    std::vector<asynInt32Client*> clients;
+    for (addr=0; addr<maxAddr; addr++) {
+        clients.push_back(new asynInt32Client("portRange", addr, "PARAM"));
+        if (clients.back()->registerInterruptUser(int32Callback) != asynSuccess) ok = false;
+    }
+    std::vector<epicsInt32> values(maxAddr);
+
+    testDiag("One parameter on %d addresses", maxAddr);
+    numInt32Callbacks = 0;
+    portRange->lock();
+    epicsTimeGetCurrent(&start);
+    for (cycle=0; cycle<numCycles; cycle++) {
+        for (addr=0; addr<maxAddr; addr++) {
+            portRange->setIntegerParam(addr, index, cycle);
+            if (portRange->callParamCallbacks(addr) != asynSuccess) ok = false;
+        }
+    }
+    double t = elapsed(start);
+    portRange->unlock();
+    if (numInt32Callbacks != numCycles*maxAddr) ok = false;
+    testDiag("callParamCallbacks(addr) for each address: %.3f us/cycle", t/numCycles*1e6);
+
+    numInt32Callbacks = 0;
+    portRange->lock();
+    epicsTimeGetCurrent(&start);
+    for (cycle=0; cycle<numCycles; cycle++) {
+        for (addr=0; addr<maxAddr; addr++) values[addr] = cycle + 1;
+        portRange->setIntegerParamRange(0, maxAddr, index, &values[0]);
+        if (portRange->callParamCallbacksRange(0, maxAddr) != asynSuccess) ok = false;
+    }
+    t = elapsed(start);
+    portRange->unlock();
+    if (numInt32Callbacks != numCycles*maxAddr) ok = false;
+    testDiag("callParamCallbacksRange for all addresses: %.3f us/cycle", t/numCycles*1e6);
+    testOk(ok, "callbacks delivered for every address");
+    for (addr=0; addr<maxAddr; addr++) delete clients[addr];
+}
+
+/* Cost of a set: setIntegerParam and setDoubleParam, which look the parameter up and check
+ * its type on every call, against asynParamHandle::set, which stores the value directly.
+ * Values that change mark the parameter for callParamCallbacks, those that do not only compare. */
+void testParamHandle(int numSets)
+{
+    epicsTimeStamp start;
+    asynParamHandle<epicsInt32> int32Param;
+    asynParamHandle<epicsFloat64> float64Param;
+    epicsInt32 ival;
+    epicsFloat64 dval;
+    double t;
+    int i;
+    bool ok = true;
+
+    portHandle = new asynPortDriver("portHandle", 1,
+                                    asynDrvUserMask|asynInt32Mask|asynFloat64Mask,
+                                    asynInt32Mask|asynFloat64Mask, 0, 0, 0,
+                                    epicsThreadGetStackSize(epicsThreadStackSmall));
+    portHandle->createParam("INT32", &int32Param);
+    portHandle->createParam("FLOAT64", &float64Param);
+
+    testDiag("%d sets of one parameter, ns/set", numSets);
+    portHandle->lock();
+    epicsTimeGetCurrent(&start);
+    for (i=0; i<numSets; i++) portHandle->setIntegerParam(int32Param.index(), i);
+    t = elapsed(start);
+    epicsTimeGetCurrent(&start);
+    for (i=0; i<numSets; i++) int32Param.set(numSets - i);
+    testDiag("Int32 changing:    setIntegerParam %6.1f, handle %6.1f", t/numSets*1e9, elapsed(start)/numSets*1e9);
+    if (int32Param.get(&ival) != asynSuccess || ival != 1) ok = false;
+
+    epicsTimeGetCurrent(&start);
+    for (i=0; i<numSets; i++) portHandle->setIntegerParam(int32Param.index(), 1);
+    t = elapsed(start);
+    epicsTimeGetCurrent(&start);
+    for (i=0; i<numSets; i++) int32Param.set(1);
+    testDiag("Int32 unchanged:   setIntegerParam %6.1f, handle %6.1f", t/numSets*1e9, elapsed(start)/numSets*1e9);
+
+    epicsTimeGetCurrent(&start);
+    for (i=0; i<numSets; i++) portHandle->setDoubleParam(float64Param.index(), i);
+    t = elapsed(start);
+    epicsTimeGetCurrent(&start);
+    for (i=0; i<numSets; i++) float64Param.set(numSets - i);
+    testDiag("Float64 changing:  setDoubleParam  %6.1f, handle %6.1f", t/numSets*1e9, elapsed(start)/numSets*1e9);
+    if (portHandle->getDoubleParam(float64Param.index(), &dval) != asynSuccess || dval != 1) ok = false;
+    if (portHandle->callParamCallbacks() != asynSuccess) ok = false;
+    portHandle->unlock();
+    testOk(ok, "handles and set methods change the same values");
+}
+
+/* A status block of numParams Int32 and Float64 parameters that all change on every cycle:
+ * setIntegerParam and setDoubleParam for each parameter, against one setParams with a
+ * vector that is built once.  The callParamCallbacks that follows is timed separately,
+ * since it costs the same for both. */
+void testBulkUpdate(int numParams)
+{
+    static const int numCycles = 10000;
+    epicsTimeStamp start;
+    char name[40];
+    int i, cycle, index;
+    double t;
+    bool ok = true;
+
+    portBulk = new asynPortDriver("portBulk", 1,
+                                  asynDrvUserMask|asynInt32Mask|asynFloat64Mask,
+                                  asynInt32Mask|asynFloat64Mask, 0, 0, 0,
+                                  epicsThreadGetStackSize(epicsThreadStackSmall));
+    std::vector<asynParamValue> values;
+    for (i=0; i<numParams; i++) {
+        epicsSnprintf(name, sizeof(name), "PARAM_%d", i);
+        portBulk->createParam(name, (i%2) ? asynParamFloat64 : asynParamInt32, &index);
+        if (i%2) values.push_back(asynParamValue(index, 0.0));
+        else values.push_back(asynParamValue(index, (epicsInt32)0));
+    }
+
+    testDiag("Status block of %d parameters", numParams);
+    portBulk->lock();
+    epicsTimeGetCurrent(&start);
+    for (cycle=0; cycle<numCycles; cycle++) {
+        for (i=0; i<numParams; i++) {
+            if (i%2) portBulk->setDoubleParam(i, cycle + 0.5);
+            else portBulk->setIntegerParam(i, cycle);
+        }
+    }
+    t = elapsed(start);
+    testDiag("set*Param for each parameter: %8.3f us/cycle", t/numCycles*1e6);
+
+    epicsTimeGetCurrent(&start);
+    for (cycle=0; cycle<numCycles; cycle++) {
+        for (i=0; i<numParams; i++) {
+            if (i%2) values[i].value.dval = -cycle - 0.5;
+            else values[i].value.ival = -cycle;
+        }
+        if (portBulk->setParams(values) != asynSuccess) ok = false;
+    }
+    t = elapsed(start);
+    testDiag("setParams:                    %8.3f us/cycle", t/numCycles*1e6);
+
+    epicsTimeGetCurrent(&start);
+    for (cycle=0; cycle<numCycles; cycle++) {
+        for (i=0; i<numParams; i++) {
+            if (i%2) values[i].value.dval = cycle + 0.5;
+            else values[i].value.ival = cycle;
+        }
+        portBulk->setParams(values);
+        if (portBulk->callParamCallbacks() != asynSuccess) ok = false;
+    }
+    t = elapsed(start);
+    testDiag("setParams+callParamCallbacks: %8.3f us/cycle", t/numCycles*1e6);
+
+    std::vector<asynParamValue> read;
+    epicsTimeGetCurrent(&start);
+    for (cycle=0; cycle<numCycles; cycle++) {
+        if (portBulk->getAllParams(read) != asynSuccess) ok = false;
+    }
+    t = elapsed(start);
+    testDiag("getAllParams:                 %8.3f us/cycle", t/numCycles*1e6);
+    portBulk->unlock();
+    if ((int)read.size() != numParams || read[0].value.ival != numCycles-1) ok = false;
+    testOk(ok, "setParams and getAllParams for %d parameters", numParams);
+}
+
+/* One parameter with numClients clients, updated numCycles times with the driver locked:
+ * the time the driver spends in setIntegerParam+callParamCallbacks with the callbacks called
+ * by callParamCallbacks, and with the callback dispatcher without and with a rate limit.
+ * Each callback does some work, like the device support queuing the record. */
+volatile epicsInt32 lastDispatched;
+
+void dispatchCallback(void *userPvt, asynUser *pasynUser, epicsInt32 value)
+{
+    for (volatile int i=0; i<100; i++);
+    numInt32Callbacks++;
+    lastDispatched = value;
+}
+
+void testCallbackDispatcher(int numClients)
+{
+    static const int numCycles = 1000;
+    static const double maxRates[] = {-1., 0., 10.};
+    static const char *modes[] = {"callParamCallbacks", "dispatcher", "dispatcher at 10/s"};
+    epicsTimeStamp start;
+    char portName[40];
+    int i, mode, cycle, index;
+    double t, tDone;
+    bool ok = true;
+
+    testDiag("One parameter with %d clients, %d updates", numClients, numCycles);
+    for (mode=0; mode<3; mode++) {
+        epicsSnprintf(portName, sizeof(portName), "portDispatch%d", mode);
+        portDispatch[mode] = new asynPortDriver(portName, 1,
+                                                asynDrvUserMask|asynInt32Mask,
+                                                asynInt32Mask, 0, 0, 0,
+                                                epicsThreadGetStackSize(epicsThreadStackSmall));
+        portDispatch[mode]->createParam("PARAM", asynParamInt32, &index);
+        if ((maxRates[mode] >= 0) &&
+            (portDispatch[mode]->enableCallbackDispatcher(maxRates[mode]) != asynSuccess)) ok = false;
+        std::vector<asynInt32Client*> clients;
+        for (i=0; i<numClients; i++) {
+            clients.push_back(new asynInt32Client(portName, 0, "PARAM"));
+            if (clients.back()->registerInterruptUser(dispatchCallback) != asynSuccess) ok = false;
+        }
+        numInt32Callbacks = 0;
+        lastDispatched = -1;
+        epicsTimeGetCurrent(&start);
+        for (cycle=0; cycle<numCycles; cycle++) {
+            portDispatch[mode]->lock();
+            portDispatch[mode]->setIntegerParam(index, cycle);
+            if (portDispatch[mode]->callParamCallbacks() != asynSuccess) ok = false;
+            portDispatch[mode]->unlock();
+        }
+        t = elapsed(start);
+        while (lastDispatched != numCycles-1 && elapsed(start) < 30.) epicsThreadSleep(0.001);
+        tDone = elapsed(start);
+        if (lastDispatched != numCycles-1) ok = false;
+        testDiag("%-20s driver %8.3f us/update, all delivered after %6.3f s, %6.1f callbacks/client",
+                 modes[mode], t/numCycles*1e6, tDone, (double)numInt32Callbacks/numClients);
+        for (i=0; i<numClients; i++) delete clients[i];
+    }
+    testOk(ok, "latest value delivered to %d clients", numClients);
+}
+
+/* Reads of a cached value while a poller holds the driver lock for slow I/O,
+ * without and with enableParamSnapshot. The poller holds the lock for pollTime
+ * out of every pollTime+idleTime, then sets the value to the cycle number. */
+struct snapshotPoller {
+    asynPortDriver *port;
+    int index;
+    double pollTime, idleTime;
+    volatile bool stop;
+    epicsEventId done;
+};
+
+void snapshotPollerTask(void *arg)
+{
+    snapshotPoller *ppoller = (snapshotPoller *)arg;
+    int cycle = 0;
+
+    while (!ppoller->stop) {
+        ppoller->port->lock();
+        epicsThreadSleep(ppoller->pollTime);
+        ppoller->port->setDoubleParam(ppoller->index, ++cycle);
+        ppoller->port->callParamCallbacks();
+        ppoller->port->unlock();
+        epicsThreadSleep(ppoller->idleTime);
+    }
+    epicsEventSignal(ppoller->done);
+}
+
+void testSnapshotContention(double duration)
+{
+    static const char *portNames[] = {"portLocked", "portSnapshot"};
+    epicsTimeStamp start, readStart;
+    int i, index;
+
+    testDiag("Reads while a poller holds the lock 10 ms out of every 11 ms");
+    for (i=0; i<2; i++) {
+        asynPortDriver *port = new asynPortDriver(portNames[i], 1,
+                                                  asynDrvUserMask|asynFloat64Mask,
+                                                  0, 0, 0, 0,
+                                                  epicsThreadGetStackSize(epicsThreadStackSmall));
+        port->createParam("VALUE", asynParamFloat64, &index);
+        port->lock();
+        port->setDoubleParam(index, 0);
+        port->unlock();
+        if (i == 1) portSnapshot = port;
+        else portLocked = port;
+        bool ok = (i == 0) || (port->enableParamSnapshot() == asynSuccess);
+
+        snapshotPoller poller;
+        poller.port = port;
+        poller.index = index;
+        poller.pollTime = 0.010;
+        poller.idleTime = 0.001;
+        poller.stop = false;
+        poller.done = epicsEventMustCreate(epicsEventEmpty);
+        epicsThreadMustCreate("snapshotPoller", epicsThreadPriorityMedium,
+                              epicsThreadGetStackSize(epicsThreadStackSmall),
+                              snapshotPollerTask, &poller);
+
+        asynFloat64Client client(portNames[i], 0, "VALUE");
+        epicsFloat64 value, previous = 0;
+        double t, maxLatency = 0;
+        long numReads = 0;
+        epicsTimeGetCurrent(&start);
+        do {
+            epicsTimeGetCurrent(&readStart);
+            if (client.read(&value) != asynSuccess || value < previous) ok = false;
+            previous = value;
+            t = elapsed(readStart);
+            if (t > maxLatency) maxLatency = t;
+            numReads++;
+        } while (elapsed(start) < duration);
+        t = elapsed(start);
+        poller.stop = true;
+        epicsEventMustWait(poller.done);
+        epicsEventDestroy(poller.done);
+        testDiag("%-8s %10.0f reads/s, mean %9.3f us, max %9.3f us, %d poll cycles",
+                 i ? "snapshot" : "locked", numReads/t, t/numReads*1e6, maxLatency*1e6,
+                 (int)previous);
+        testOk(ok, "%s reads return values in the order they were set",
+               i ? "snapshot" : "locked");
+    }
+}
+
+/* Contention for the asynUser and memory freelists: every thread creates and
+ * frees a few asynUsers and small buffers, like device support and drivers do
+ * for each request. The rate per thread should not drop much with more threads. */
+struct freeListThread {
+    int numCycles;
+    bool ok;
+    epicsEventId done;
+};
+
+void freeListWorker(void *arg)
+{
+    freeListThread *pthread = (freeListThread *)arg;
+    asynUser *users[4];
+    void *mem[4];
+    int cycle, i;
+
+    for (cycle=0; cycle<pthread->numCycles; cycle++) {
+        for (i=0; i<4; i++) {
+            users[i] = pasynManager->createAsynUser(0, 0);
+            mem[i] = pasynManager->memMalloc(64);
+            if (!users[i] || !mem[i]) pthread->ok = false;
+        }
+        for (i=0; i<4; i++) {
+            pasynManager->memFree(mem[i], 64);
+            if (pasynManager->freeAsynUser(users[i]) != asynSuccess) pthread->ok = false;
+        }
+    }
+    epicsEventSignal(pthread->done);
+}
+
+void testFreeListThreads(int maxThreads)
+{
+    static const int numCycles = 100000;
+    epicsTimeStamp start;
+    int i, numThreads;
+    bool ok = true;
+
+    testDiag("createAsynUser/freeAsynUser and memMalloc/memFree from many threads");
+    for (numThreads=1; numThreads<=maxThreads; numThreads*=2) {
+        std::vector<freeListThread> threads(numThreads);
+        epicsTimeGetCurrent(&start);
+        for (i=0; i<numThreads; i++) {
+            threads[i].numCycles = numCycles;
+            threads[i].ok = true;
+            threads[i].done = epicsEventMustCreate(epicsEventEmpty);
+            epicsThreadMustCreate("freeList", epicsThreadPriorityMedium,
+                                  epicsThreadGetStackSize(epicsThreadStackSmall),
+                                  freeListWorker, &threads[i]);
+        }
+        for (i=0; i<numThreads; i++) {
+            epicsEventMustWait(threads[i].done);
+            epicsEventDestroy(threads[i].done);
+            if (!threads[i].ok) ok = false;
+        }
+        double t = elapsed(start);
+        testDiag("%3d threads: %.1f M create+free/s, %.1f ns each",
+                 numThreads, numThreads*numCycles*4/t*1e-6,
+                 t/((double)numThreads*numCycles*4)*1e9);
+    }
+    testOk(ok, "asynUsers and memory created and freed by %d threads", maxThreads);
+}
+
+/* Array element conversion: the loop over elements against the vector kernels
+ * for the conversions that device support does when FTVL differs from the driver type. */
+void testArrayConvert(size_t maxElements)
+{
+    static const struct {
+        asynArrayType srcType, dstType;
+        size_t srcSize, dstSize;
+        const char *name;
+    } pairs[] = {
+        {asynArrayInt16,   asynArrayFloat64, 2, 8, "Int16->Float64"},
+        {asynArrayUInt16,  asynArrayFloat32, 2, 4, "UInt16->Float32"},
+        {asynArrayInt32,   asynArrayFloat64, 4, 8, "Int32->Float64"},
+        {asynArrayUInt8,   asynArrayFloat64, 1, 8, "UInt8->Float64"},
+        {asynArrayFloat64, asynArrayFloat32, 8, 4, "Float64->Float32"}
+    };
+    static const size_t sizes[] = {1024, 16*1024, 256*1024, 1024*1024, 16*1024*1024};
+    epicsTimeStamp start;
+    size_t i, j, k, n;
+    bool ok = true;
+
+    testDiag("Array conversion, %s kernels, M elements/s", asynArrayConvertKernels());
+    std::vector<char> src(maxElements*8), dst1(maxElements*8), dst2(maxElements*8);
+    for (i=0; i<src.size(); i++) src[i] = (char)rand();
+    /* Keep floating point sources finite */
+    for (i=0; i<maxElements; i++) ((epicsFloat64 *)&src[0])[i] = rand()/3.0;
+    for (j=0; j<sizeof(pairs)/sizeof(pairs[0]); j++) {
+        asynArrayConvertFunc scalar = asynArrayConverterScalar(pairs[j].srcType, pairs[j].dstType);
+        asynArrayConvertFunc vector = asynArrayConverter(pairs[j].srcType, pairs[j].dstType);
+        for (k=0; k<sizeof(sizes)/sizeof(sizes[0]) && sizes[k]<=maxElements; k++) {
+            n = sizes[k];
+            int rep, numReps = (int)((1<<26)/n) + 1;
+            epicsTimeGetCurrent(&start);
+            for (rep=0; rep<numReps; rep++) scalar(&src[0], &dst1[0], n);
+            double tScalar = elapsed(start);
+            epicsTimeGetCurrent(&start);
+            for (rep=0; rep<numReps; rep++) vector(&src[0], &dst2[0], n);
+            double tVector = elapsed(start);
+            if (memcmp(&dst1[0], &dst2[0], n*pairs[j].dstSize)) ok = false;
+            testDiag("%-16s %9d elements: loop %8.1f, vector %8.1f, %.1fx",
+                     pairs[j].name, (int)n, n*numReps/tScalar*1e-6, n*numReps/tVector*1e-6,
+                     tScalar/tVector);
+        }
+    }
+    testOk(ok, "vector conversion matches the element loop");
+}
+
+/* Synchronous port that returns lineBytes of CRLF terminated lines,
+ * as many as requested for each read */
+const char lineText[] = "2024-01-01T00:00:00.000 ch01 +1.234567E+00 ch02 -7.654321E-01 OK\r\n";
+const size_t lineLength = sizeof(lineText) - 1;
+
+struct lineSource {
+    std::vector<char> block;
+    size_t position;
+    size_t remaining;
+};
+
+void lineSourceReport(void *drvPvt, FILE *fp, int details) {}
+asynStatus lineSourceConnect(void *drvPvt, asynUser *pasynUser)
+{
+    pasynManager->exceptionConnect(pasynUser);
+    return asynSuccess;
+}
+asynStatus lineSourceDisconnect(void *drvPvt, asynUser *pasynUser)
+{
+    pasynManager->exceptionDisconnect(pasynUser);
+    return asynSuccess;
+}
+asynCommon lineSourceCommon = {lineSourceReport, lineSourceConnect, lineSourceDisconnect};
+
+asynStatus lineSourceRead(void *drvPvt, asynUser *pasynUser, char *data, size_t maxchars,
+                          size_t *nbytesTransfered, int *eomReason)
+{
+    lineSource *psource = (lineSource *)drvPvt;
+    size_t n = 0;
+
+    while ((n < maxchars) && (psource->remaining > 0)) {
+        size_t chunk = psource->block.size() - psource->position;
+        if (chunk > maxchars - n) chunk = maxchars - n;
+        if (chunk > psource->remaining) chunk = psource->remaining;
+        memcpy(data + n, &psource->block[psource->position], chunk);
+        psource->position = (psource->position + chunk) % psource->block.size();
+        psource->remaining -= chunk;
+        n += chunk;
+    }
+    *nbytesTransfered = n;
+    if (eomReason) *eomReason = (n == maxchars) ? ASYN_EOM_CNT : 0;
+    return asynSuccess;
+}
+
+/* Read lineBytes of lines with asynInterposeEos looking for the CRLF */
+void testInterposeEos(size_t lineBytes)
+{
+    static lineSource source;
+    static asynOctet octet;
+    static asynInterface commonInterface, octetInterface;
+    const char *portName = "lineSource";
+    asynUser *pasynUser;
+    asynInterface *pasynInterface;
+    char buffer[256];
+    size_t nRead, total = 0;
+    int eomReason, numLines = 0, badLines = 0;
+    epicsTimeStamp start;
+
+    lineBytes -= lineBytes % lineLength;
+    source.block.resize(lineLength * 100);
+    for (size_t i = 0; i < source.block.size(); i += lineLength)
+        memcpy(&source.block[i], lineText, lineLength);
+    octet.read = lineSourceRead;
+    commonInterface.interfaceType = asynCommonType;
+    commonInterface.pinterface = &lineSourceCommon;
+    commonInterface.drvPvt = &source;
+    octetInterface.interfaceType = asynOctetType;
+    octetInterface.pinterface = &octet;
+    octetInterface.drvPvt = &source;
+    pasynManager->registerPort(portName, 0, 1, 0, 0);
+    pasynManager->registerInterface(portName, &commonInterface);
+    pasynManager->registerInterface(portName, &octetInterface);
+    asynInterposeEosConfig(portName, -1, 1, 0);
+    pasynUser = pasynManager->createAsynUser(0, 0);
+    pasynManager->connectDevice(pasynUser, portName, -1);
+    pasynInterface = pasynManager->findInterface(pasynUser, asynOctetType, 1);
+    asynOctet *pasynOctet = (asynOctet *)pasynInterface->pinterface;
+    void *octetPvt = pasynInterface->drvPvt;
+    pasynOctet->setInputEos(octetPvt, pasynUser, "\r\n", 2);
+
+    testDiag("%.0f MB of %d character lines read through asynInterposeEos", lineBytes*1e-6, (int)lineLength);
+    source.position = 0;
+    source.remaining = lineBytes;
+    epicsTimeGetCurrent(&start);
+    for (;;) {
+        pasynOctet->read(octetPvt, pasynUser, buffer, sizeof(buffer), &nRead, &eomReason);
+        if (!(eomReason & ASYN_EOM_EOS)) break;
+        total += nRead + 2;
+        numLines++;
+        if ((nRead != lineLength - 2) || memcmp(buffer, lineText, nRead)) badLines++;
+    }
+    double t = elapsed(start);
+    testDiag("%.1f MB/s, %.1f M lines/s", total/t*1e-6, numLines/t*1e-6);
+    testOk(total == lineBytes && badLines == 0 && nRead == 0,
+           "read %lu characters in %d lines, %d bad lines",
+           (unsigned long)total, numLines, badLines);
+}
+
+} // namespace
+
+MAIN(asynPortDriverPerform)
+{
+    testPlan(14);
+    interruptAccept=1;
+    try {
+        testStartup(10000, 16);
+        testUpdateCycle(10000);
+        testClients(10000);
+        testAddressRange(256);
+        testSnapshotContention(1.0);
+        testParamHandle(10000000);
+        testBulkUpdate(200);
+        testCallbackDispatcher(1000);
+        testFreeListThreads(32);
+        testArrayConvert(16*1024*1024);
+        testInterposeEos(100*1000*1000);
+    } catch(std::exception& e) {
+        testAbort("Unhandled C++ exception: %s", e.what());
+    }
+    return testDone();
+}
@@ -5,10 +5,15 @@
  \*************************************************************************/
 
 #include <stdexcept>
+#include <vector>
+#include <string>
+#include <set>
 
+#include <stdlib.h>
 #include <string.h>
 
 #include <epicsGuard.h>
+#include <epicsEvent.h>
 #include <epicsThread.h>
 #include <epicsUnitTest.h>
 #include <testMain.h>
@@ -55,6 +60,33 @@ void int32cb(void *userPvt, asynUser *pasynUser,
  * pointer so that valgrind will consider them reachable
  */
 asynPortDriver *portA;
+asynPortDriver *portArray;
+asynPortDriver *portRange;
+asynPortDriver *portIndex;
+asynPortDriver *portSnapshot;
+asynPortDriver *portHandle;
+asynPortDriver *portBulk;
+asynPortDriver *portDispatch;
+asynPortDriver *portDispatchFast;
+asynPortDriver *portSharedA;
+asynPortDriver *portSharedB;
+
+asynArrayBuffer *heldBuffer;
+int arrayFreed;
+
+void arraycb(void *userPvt, asynUser *pasynUser,
+                                       epicsInt32 *data, size_t nElements)
+{
+    // keep the posted buffer like devAsynXXXArray does
+    if (heldBuffer) asynArrayBufferRelease(heldBuffer);
+    heldBuffer = asynArrayBufferReservePosted(data);
+}
+
+void arrayFree(void *freePvt, void *pData)
+{
+    arrayFreed++;
+    free(pData);
+}
 
 void testA()
 {
@@ -89,6 +121,12 @@ void testA()
 
     testOk1(portA->createParam(0, "int32", asynParamInt32, &idx2)==asynError);
 
+    testDiag("Parameter names ignore case");
+    testOk1(portA->findParam(0, "INT32", &idx2)==asynSuccess);
+    testOk1(idx1==idx2);
+    testOk1(portA->createParam(0, "Int32", asynParamInt32, &idx2)==asynError);
+    testOk1(portA->findParam(0, NULL, &idx2)==asynParamNotFound);
+
     testOk1(portA->createParam(0, "int64", asynParamInt64, &idx1)==asynSuccess);
     testOk1(portA->createParam(0, "float64", asynParamFloat64, &idx1)==asynSuccess);
     testOk1(portA->createParam(0, "uint32", asynParamUInt32Digital, &idx1)==asynSuccess);
@@ -165,14 +203,634 @@ void testA()
     }
 }
 
+
+void testArrayBuffer()
+{
+    portArray = new asynPortDriver("portArray", 0,
+                                   asynDrvUserMask|asynInt32ArrayMask,
+                                   asynInt32ArrayMask, 0, 0, 0,
+                                   epicsThreadGetStackSize(epicsThreadStackSmall));
+    int idx;
+    epicsInt32 plain[4] = {1, 2, 3, 4};
+
+    testDiag("Array callbacks with shared buffers");
+
+    testOk1(portArray->createParam(0, "array", asynParamInt32Array, &idx)==asynSuccess);
+    asynInt32ArrayClient client("portArray", -1, "array");
+    testOk1(client.registerInterruptUser(&arraycb)==asynSuccess);
+
+    asynArrayBuffer *pBuffer = asynArrayBufferWrap(calloc(4, sizeof(epicsInt32)),
+                                                   4*sizeof(epicsInt32), arrayFree, 0);
+    testOk1(portArray->doCallbacksArrayBuffer(pBuffer, asynParamInt32Array, 4, idx, 0)==asynSuccess);
+    testOk1(heldBuffer==pBuffer);
+    asynArrayBufferRelease(pBuffer);
+    testOk1(arrayFreed==0);
+
+    // A plain array is not shared, so the client must copy it
+    testOk1(portArray->doCallbacksInt32Array(plain, 4, idx, 0)==asynSuccess);
+    testOk1(heldBuffer==NULL);
+    testOk1(arrayFreed==1);
+
+    pBuffer = asynArrayBufferAlloc(4*sizeof(epicsInt32));
+    testOk1(portArray->doCallbacksArrayBuffer(pBuffer, asynParamInt32, 4, idx, 0)==asynError);
+    testOk1(portArray->doCallbacksArrayBuffer(pBuffer, asynParamInt32Array, 4, idx, 0)==asynSuccess);
+    testOk1(heldBuffer==pBuffer);
+    asynArrayBufferRelease(pBuffer);
+    asynArrayBufferRelease(heldBuffer);
+    heldBuffer = NULL;
+    testOk1(asynArrayBufferReservePosted(plain)==NULL);
+}
+
+std::vector<int> rangeAddrs;
+std::vector<double> rangeValues;
+
+void rangecb(void *userPvt, asynUser *pasynUser, epicsFloat64 data)
+{
+    rangeAddrs.push_back((int)(size_t)userPvt);
+    rangeValues.push_back(data);
+}
+
+void testAddressRange()
+{
+    static const int numAddr = 8;
+    portRange = new asynPortDriver("portRange", numAddr,
+                                   asynDrvUserMask|asynFloat64Mask,
+                                   asynFloat64Mask, ASYN_MULTIDEVICE, 0, 0,
+                                   epicsThreadGetStackSize(epicsThreadStackSmall));
+    std::vector<asynFloat64Client*> clients;
+    double values[numAddr];
+    int idx, addr;
+    bool ok;
+
+    testDiag("Setting one parameter on a range of addresses");
+
+    for (addr=0; addr<numAddr; addr++) {
+        portRange->createParam(addr, "float64", asynParamFloat64, &idx);
+    }
+    // Register the clients in reverse order, the callbacks are still in address order
+    for (addr=numAddr-1; addr>=0; addr--) {
+        clients.push_back(new asynFloat64Client("portRange", addr, "float64"));
+        clients.back()->registerInterruptUser(&rangecb, (void *)(size_t)addr);
+    }
+    for (addr=0; addr<numAddr; addr++) values[addr] = addr*1.5;
+    {
+        Guard G(*portRange);
+        testOk1(portRange->setDoubleParamRange(2, 4, idx, &values[2])==asynSuccess);
+        testOk1(portRange->callParamCallbacksRange(0, numAddr)==asynSuccess);
+    }
+    testOk(rangeAddrs.size()==4, "callbacks only for the addresses that were set");
+    ok = rangeAddrs.size()==4;
+    for (size_t i=0; ok && i<rangeAddrs.size(); i++) {
+        ok = (rangeAddrs[i]==(int)i+2) && (rangeValues[i]==values[i+2]);
+    }
+    testOk(ok, "callbacks in address order with the value for each address");
+    {
+        Guard G(*portRange);
+        testOk1(portRange->setDoubleParamRange(6, 4, idx, values)==asynParamInvalidList);
+        testOk1(portRange->callParamCallbacksRange(6, 4)==asynParamInvalidList);
+    }
+    for (size_t i=0; i<clients.size(); i++) delete clients[i];
+}
+
+std::string indexCalls;
+
+void indexcb(void *userPvt, asynUser *pasynUser, epicsInt32 data)
+{
+    indexCalls += (char)(size_t)userPvt;
+}
+
+// The clients called for a parameter, in the order they were called
+std::string indexCallbacks(int list, int index)
+{
+    static epicsInt32 value;
+    indexCalls.clear();
+    Guard G(*portIndex);
+    portIndex->setIntegerParam(list, index, ++value);
+    portIndex->callParamCallbacks(list);
+    return indexCalls;
+}
+
+void testInterruptIndex()
+{
+    portIndex = new asynPortDriver("portIndex", 2,
+                                   asynDrvUserMask|asynInt32Mask,
+                                   asynInt32Mask, ASYN_MULTIDEVICE, 0, 0,
+                                   epicsThreadGetStackSize(epicsThreadStackSmall));
+    int idxA, idxB;
+
+    testDiag("The interrupt client index follows the clients added and removed");
+
+    for (int addr=0; addr<2; addr++) {
+        portIndex->createParam(addr, "a", asynParamInt32, &idxA);
+        portIndex->createParam(addr, "b", asynParamInt32, &idxB);
+    }
+    asynInt32Client *client1 = new asynInt32Client("portIndex", 0, "a");
+    asynInt32Client *client2 = new asynInt32Client("portIndex", 0, "a");
+    asynInt32Client *client3 = new asynInt32Client("portIndex", 1, "a");
+    asynInt32Client *client4 = new asynInt32Client("portIndex", 0, "b");
+    client1->registerInterruptUser(&indexcb, (void *)'1');
+    client2->registerInterruptUser(&indexcb, (void *)'2');
+    client3->registerInterruptUser(&indexcb, (void *)'3');
+    client4->registerInterruptUser(&indexcb, (void *)'4');
+    std::string calls = indexCallbacks(0, idxA);
+    testOk(calls=="12", "a on address 0 calls %s", calls.c_str());
+    calls = indexCallbacks(1, idxA);
+    testOk(calls=="3", "a on address 1 calls %s", calls.c_str());
+    calls = indexCallbacks(0, idxB);
+    testOk(calls=="4", "b on address 0 calls %s", calls.c_str());
+    delete client1;
+    calls = indexCallbacks(0, idxA);
+    testOk(calls=="2", "a on address 0 calls %s after client 1 is removed", calls.c_str());
+    client1 = new asynInt32Client("portIndex", 0, "a");
+    client1->registerInterruptUser(&indexcb, (void *)'1');
+    calls = indexCallbacks(0, idxA);
+    testOk(calls=="21", "a on address 0 calls %s after client 1 is added again", calls.c_str());
+    delete client2;
+    delete client3;
+    calls = indexCallbacks(0, idxA);
+    testOk(calls=="1", "a on address 0 calls %s after client 2 is removed", calls.c_str());
+    calls = indexCallbacks(1, idxA);
+    testOk(calls=="", "a on address 1 calls no client after client 3 is removed");
+    delete client1;
+    delete client4;
+}
+
+struct lockHolder {
+    asynPortDriver *port;
+    epicsEventId locked;
+    epicsEventId release;
+    epicsEventId done;
+};
+
+// Holds the driver lock like a poller doing slow I/O
+void holdLock(void *arg)
+{
+    lockHolder *pholder = (lockHolder *)arg;
+    pholder->port->lock();
+    epicsEventSignal(pholder->locked);
+    epicsEventMustWait(pholder->release);
+    pholder->port->unlock();
+    epicsEventSignal(pholder->done);
+}
+
+asynUser *snapshotUser(int reason)
+{
+    asynUser *pasynUser = pasynManager->createAsynUser(0, 0);
+    pasynManager->connectDevice(pasynUser, "portSnapshot", 0);
+    pasynUser->reason = reason;
+    return pasynUser;
+}
+
+void testParamSnapshot()
+{
+    portSnapshot = new asynPortDriver("portSnapshot", 1,
+                                      asynDrvUserMask|asynInt32Mask|asynInt64Mask|asynFloat64Mask,
+                                      0, 0, 0, 0,
+                                      epicsThreadGetStackSize(epicsThreadStackSmall));
+    int idxInt32, idxInt64, idxFloat64, idxUndefined, idxLate;
+    epicsInt32 ival;
+    epicsInt64 i64val;
+    epicsFloat64 dval;
+    asynStatus status;
+
+    testDiag("Reading parameters from the snapshot while the driver is locked");
+
+    portSnapshot->createParam("int32", asynParamInt32, &idxInt32);
+    portSnapshot->createParam("int64", asynParamInt64, &idxInt64);
+    portSnapshot->createParam("float64", asynParamFloat64, &idxFloat64);
+    portSnapshot->createParam("undefined", asynParamInt32, &idxUndefined);
+    {
+        Guard G(*portSnapshot);
+        portSnapshot->setIntegerParam(idxInt32, 1);
+        portSnapshot->setInteger64Param(idxInt64, 2);
+        portSnapshot->setDoubleParam(idxFloat64, 3.5);
+    }
+    testOk1(portSnapshot->enableParamSnapshot()==asynSuccess);
+    {
+        Guard G(*portSnapshot);
+        portSnapshot->createParam("late", asynParamInt32, &idxLate);
+        portSnapshot->setIntegerParam(idxLate, 5);
+        portSnapshot->setIntegerParam(idxInt32, 4);
+        portSnapshot->setParamStatus(idxFloat64, asynTimeout);
+        portSnapshot->setParamAlarmSeverity(idxFloat64, 2);
+    }
+
+    asynInt32Client int32Client("portSnapshot", 0, "int32");
+    asynFloat64Client float64Client("portSnapshot", 0, "float64");
+    asynInt32Client lateClient("portSnapshot", 0, "late");
+    asynInt32Client undefinedClient("portSnapshot", 0, "undefined");
+    asynUser *pasynUserInt64 = snapshotUser(idxInt64);
+    asynUser *pasynUserLate = snapshotUser(idxLate);
+    asynUser *pasynUserUndefined = snapshotUser(idxUndefined);
+    asynUser *pasynUserFloat64 = snapshotUser(idxFloat64);
+
+    lockHolder holder;
+    holder.port = portSnapshot;
+    holder.locked = epicsEventMustCreate(epicsEventEmpty);
+    holder.release = epicsEventMustCreate(epicsEventEmpty);
+    holder.done = epicsEventMustCreate(epicsEventEmpty);
+    epicsThreadMustCreate("holdLock", epicsThreadPriorityMedium,
+                          epicsThreadGetStackSize(epicsThreadStackSmall),
+                          holdLock, &holder);
+    epicsEventMustWait(holder.locked);
+    // These would wait for the lock if they did not use the snapshot
+    testOk1(int32Client.read(&ival)==asynSuccess && ival==4);
+    testOk1(portSnapshot->readParamSnapshot(pasynUserInt64, &i64val, &status) &&
+            status==asynSuccess && i64val==2);
+    testOk1(float64Client.read(&dval)==asynTimeout && dval==3.5);
+    testOk(!portSnapshot->readParamSnapshot(pasynUserLate, &ival, &status),
+           "parameter created after enableParamSnapshot is not in the snapshot");
+    testOk(!portSnapshot->readParamSnapshot(pasynUserUndefined, &ival, &status),
+           "undefined parameter is read with the lock");
+    testOk1(portSnapshot->readParamSnapshot(pasynUserFloat64, &dval, &status) &&
+            status==asynTimeout && pasynUserFloat64->alarmSeverity==2);
+    epicsEventSignal(holder.release);
+    epicsEventMustWait(holder.done);
+
+    testOk1(lateClient.read(&ival)==asynSuccess && ival==5);
+    testOk1(undefinedClient.read(&ival)==asynParamUndefined);
+
+    // The snapshot has the timestamp of the value, then the one of its callbacks
+    epicsTimeStamp setTime = {100, 0}, callbackTime = {200, 0};
+    {
+        Guard G(*portSnapshot);
+        portSnapshot->setTimeStamp(&setTime);
+        portSnapshot->setInteger64Param(idxInt64, 6);
+        portSnapshot->setTimeStamp(&callbackTime);
+    }
+    testOk1(portSnapshot->readParamSnapshot(pasynUserInt64, &i64val, &status) &&
+            i64val==6 && pasynUserInt64->timestamp.secPastEpoch==100);
+    {
+        Guard G(*portSnapshot);
+        portSnapshot->callParamCallbacks();
+    }
+    testOk1(portSnapshot->readParamSnapshot(pasynUserInt64, &i64val, &status) &&
+            i64val==6 && pasynUserInt64->timestamp.secPastEpoch==200);
+    epicsEventDestroy(holder.locked);
+    epicsEventDestroy(holder.release);
+    epicsEventDestroy(holder.done);
+    pasynManager->freeAsynUser(pasynUserInt64);
+    pasynManager->freeAsynUser(pasynUserLate);
+    pasynManager->freeAsynUser(pasynUserUndefined);
+    pasynManager->freeAsynUser(pasynUserFloat64);
+}
+
+void testParamHandle()
+{
+    portHandle = new asynPortDriver("portHandle", 2,
+                                    asynDrvUserMask|asynInt32Mask|asynInt64Mask|asynFloat64Mask,
+                                    asynInt32Mask|asynInt64Mask|asynFloat64Mask, ASYN_MULTIDEVICE, 0, 0,
+                                    epicsThreadGetStackSize(epicsThreadStackSmall));
+    asynParamHandle<epicsInt32> int32Param, int32Param1;
+    asynParamHandle<epicsInt64> int64Param;
+    asynParamHandle<epicsFloat64> float64Param;
+    epicsInt32 ival;
+    epicsInt64 i64val;
+    epicsFloat64 dval;
+    int idx;
+
+    testDiag("Typed parameter handles");
+
+    testOk1(portHandle->createParam("int32", &int32Param)==asynSuccess);
+    testOk1(portHandle->createParam(1, "int32_1", &int32Param1)==asynSuccess);
+    testOk1(portHandle->createParam("int64", &int64Param)==asynSuccess);
+    testOk1(portHandle->createParam("float64", &float64Param)==asynSuccess);
+    testOk1(portHandle->createParam("int32", &int32Param1)==asynError);
+    testOk1(portHandle->findParam("int32", &idx)==asynSuccess && idx==int32Param.index());
+    testOk1(int32Param1.list()==1);
+
+    lastint32 = 0;
+    cbcount = 0;
+    asynInt32Client client("portHandle", 0, "int32");
+    testOk1(client.registerInterruptUser(&int32cb, &client)==asynSuccess);
+    {
+        Guard G(*portHandle);
+        testOk1(int32Param.get(&ival)==asynParamUndefined);
+        int32Param.set(7);
+        int32Param1.set(8);
+        int64Param.set(9);
+        float64Param.set(1.5);
+        testOk1(int32Param.get(&ival)==asynSuccess && ival==7);
+        testOk1(portHandle->getIntegerParam(int32Param.index(), &ival)==asynSuccess && ival==7);
+        testOk1(portHandle->getIntegerParam(1, int32Param1.index(), &ival)==asynSuccess && ival==8);
+        testOk1(portHandle->getInteger64Param(int64Param.index(), &i64val)==asynSuccess && i64val==9);
+        testOk1(portHandle->getDoubleParam(float64Param.index(), &dval)==asynSuccess && dval==1.5);
+        testOk1(portHandle->callParamCallbacks()==asynSuccess);
+    }
+    testOk(cbcount==1 && lastint32==7, "callback for the value set with the handle");
+    {
+        Guard G(*portHandle);
+        // Unchanged values do not do callbacks
+        int32Param.set(7);
+        portHandle->setParamStatus(float64Param.index(), asynTimeout);
+        testOk1(float64Param.get(&dval)==asynTimeout && dval==1.5);
+        testOk1(portHandle->callParamCallbacks()==asynSuccess);
+    }
+    testOk1(cbcount==1);
+    client.write(11);
+    {
+        Guard G(*portHandle);
+        testOk(int32Param.get(&ival)==asynSuccess && ival==11, "handle sees the value written by a client");
+    }
+}
+
+void testBulkParams()
+{
+    portBulk = new asynPortDriver("portBulk", 1,
+                                  asynDrvUserMask|asynInt32Mask|asynInt64Mask|asynFloat64Mask|asynOctetMask,
+                                  asynInt32Mask|asynInt64Mask|asynFloat64Mask, 0, 0, 0,
+                                  epicsThreadGetStackSize(epicsThreadStackSmall));
+    int idxInt32, idxInt64, idxFloat64, idxString, idxUnset;
+    std::vector<asynParamValue> values, read;
+    epicsInt32 ival;
+
+    testDiag("Setting and getting many parameters in one call");
+
+    portBulk->createParam("int32", asynParamInt32, &idxInt32);
+    portBulk->createParam("int64", asynParamInt64, &idxInt64);
+    portBulk->createParam("float64", asynParamFloat64, &idxFloat64);
+    portBulk->createParam("string", asynParamOctet, &idxString);
+    portBulk->createParam("unset", asynParamInt32, &idxUnset);
+
+    lastint32 = 0;
+    cbcount = 0;
+    asynInt32Client client("portBulk", 0, "int32");
+    testOk1(client.registerInterruptUser(&int32cb, &client)==asynSuccess);
+
+    values.push_back(asynParamValue(idxInt32, (epicsInt32)3));
+    values.push_back(asynParamValue(idxInt64, (epicsInt64)4));
+    values.push_back(asynParamValue(idxFloat64, 5.5));
+    {
+        Guard G(*portBulk);
+        testOk1(portBulk->setParams(values)==asynSuccess);
+        testOk1(portBulk->callParamCallbacks()==asynSuccess);
+    }
+    testOk1(cbcount==1 && lastint32==3);
+    {
+        Guard G(*portBulk);
+        // Nothing is set if one of the values is not valid
+        values[0].value.ival = 6;
+        values.push_back(asynParamValue(idxString, (epicsInt32)7));
+        testOk1(portBulk->setParams(values)==asynParamWrongType);
+        testOk1(portBulk->getIntegerParam(idxInt32, &ival)==asynSuccess && ival==3);
+        values.back() = asynParamValue(99, (epicsInt32)7);
+        testOk1(portBulk->setParams(values)==asynParamBadIndex);
+        values.pop_back();
+        portBulk->setParamStatus(idxFloat64, asynTimeout);
+        testOk1(portBulk->setParams(values)==asynSuccess);
+        testOk1(portBulk->callParamCallbacks()==asynSuccess);
+
+        testOk1(portBulk->getAllParams(read)==asynSuccess);
+        testOk(read.size()==4, "getAllParams returns the Int32, Int64 and Float64 parameters");
+        testOk1(read[0].index==idxInt32 && read[0].type==asynParamInt32 && read[0].value.ival==6);
+        testOk1(read[1].index==idxInt64 && read[1].value.i64val==4 && read[1].status==asynSuccess);
+        testOk1(read[2].index==idxFloat64 && read[2].value.dval==5.5 && read[2].status==asynTimeout);
+        testOk1(read[3].index==idxUnset && read[3].status==asynParamUndefined);
+
+        read.clear();
+        read.push_back(asynParamValue());
+        read.back().index = idxFloat64;
+        read.push_back(asynParamValue());
+        read.back().index = idxString;
+        testOk1(portBulk->getParams(read)==asynParamWrongType);
+        testOk1(read[0].type==asynParamFloat64 && read[0].value.dval==5.5);
+        testOk1(read[1].status==asynParamWrongType);
+    }
+    testOk1(cbcount==2 && lastint32==6);
+}
+
+struct dispatchCounts {
+    epicsEventId received;
+    epicsThreadId thread;
+    size_t int32Count;
+    epicsInt32 lastInt32;
+    size_t octetCount;
+    std::string lastOctet;
+};
+
+void dispatchInt32cb(void *userPvt, asynUser *pasynUser, epicsInt32 data)
+{
+    dispatchCounts *pcounts = (dispatchCounts *)userPvt;
+    pcounts->thread = epicsThreadGetIdSelf();
+    pcounts->int32Count++;
+    pcounts->lastInt32 = data;
+    epicsEventSignal(pcounts->received);
+}
+
+void dispatchOctetcb(void *userPvt, asynUser *pasynUser, char *data, size_t numchars, int eomReason)
+{
+    dispatchCounts *pcounts = (dispatchCounts *)userPvt;
+    pcounts->octetCount++;
+    pcounts->lastOctet = data;
+    epicsEventSignal(pcounts->received);
+}
+
+void testCallbackDispatcher()
+{
+    portDispatch = new asynPortDriver("portDispatch", 1,
+                                      asynDrvUserMask|asynInt32Mask|asynOctetMask,
+                                      asynInt32Mask|asynOctetMask, 0, 0, 0,
+                                      epicsThreadGetStackSize(epicsThreadStackSmall));
+    int idxInt32, idxString;
+    dispatchCounts counts;
+
+    testDiag("Calling the callbacks from the callback dispatcher");
+
+    portDispatch->createParam("int32", asynParamInt32, &idxInt32);
+    portDispatch->createParam("string", asynParamOctet, &idxString);
+    // At most 10 batches per second, so the changes below are coalesced
+    testOk1(portDispatch->enableCallbackDispatcher(10.)==asynSuccess);
+    testOk1(portDispatch->enableCallbackDispatcher(10.)==asynError);
+
+    counts.received = epicsEventMustCreate(epicsEventEmpty);
+    counts.thread = 0;
+    counts.int32Count = 0;
+    counts.lastInt32 = 0;
+    counts.octetCount = 0;
+    asynInt32Client int32Client("portDispatch", 0, "int32");
+    asynOctetClient octetClient("portDispatch", 0, "string");
+    testOk1(int32Client.registerInterruptUser(&dispatchInt32cb, &counts)==asynSuccess);
+    testOk1(octetClient.registerInterruptUser(&dispatchOctetcb, &counts)==asynSuccess);
+
+    bool ok = true;
+    for (int i=1; i<=100; i++) {
+        Guard G(*portDispatch);
+        portDispatch->setIntegerParam(idxInt32, i);
+        portDispatch->setStringParam(idxString, (i < 100) ? "first" : "last");
+        ok = ok && (portDispatch->callParamCallbacks()==asynSuccess);
+    }
+    testOk(ok, "callParamCallbacks queues the changes");
+    while (counts.lastInt32 != 100 || counts.lastOctet != "last") {
+        if (epicsEventWaitWithTimeout(counts.received, 5.0) != epicsEventWaitOK) break;
+    }
+    testOk(counts.lastInt32==100, "latest Int32 value delivered");
+    testOk(counts.lastOctet=="last", "latest string value delivered");
+    testOk(counts.int32Count<=2 && counts.octetCount<=2,
+           "changes coalesced into %u Int32 and %u string callbacks",
+           (unsigned)counts.int32Count, (unsigned)counts.octetCount);
+    testOk(counts.thread!=0 && counts.thread!=epicsThreadGetIdSelf(), "callbacks called by the dispatcher thread");
+
+    epicsEventDestroy(counts.received);
+}
+
+struct dispatchSetter {
+    int index;
+    int numSets;
+    epicsEventId done;
+};
+
+void setParamsLoop(void *arg)
+{
+    dispatchSetter *psetter = (dispatchSetter *)arg;
+    for (int i=1; i<=psetter->numSets; i++) {
+        Guard G(*portDispatchFast);
+        portDispatchFast->setIntegerParam(psetter->index, i);
+        portDispatchFast->callParamCallbacks();
+    }
+    epicsEventSignal(psetter->done);
+}
+
+void testDispatcherClientChanges()
+{
+    portDispatchFast = new asynPortDriver("portDispatchFast", 1,
+                                          asynDrvUserMask|asynInt32Mask,
+                                          asynInt32Mask, 0, 0, 0,
+                                          epicsThreadGetStackSize(epicsThreadStackSmall));
+    dispatchCounts counts, otherCounts;
+    dispatchSetter setter;
+    int changes = 0;
+
+    testDiag("Adding and removing clients while the dispatcher calls the callbacks");
+
+    portDispatchFast->createParam("int32", asynParamInt32, &setter.index);
+    portDispatchFast->enableCallbackDispatcher(0.);
+    counts.received = epicsEventMustCreate(epicsEventEmpty);
+    counts.lastInt32 = 0;
+    otherCounts.received = epicsEventMustCreate(epicsEventEmpty);
+    asynInt32Client int32Client("portDispatchFast", 0, "int32");
+    int32Client.registerInterruptUser(&dispatchInt32cb, &counts);
+    asynUser *pasynUser = pasynManager->createAsynUser(0, 0);
+    pasynManager->connectDevice(pasynUser, "portDispatchFast", 0);
+    pasynUser->reason = setter.index;
+    asynInterface *pasynInterface = pasynManager->findInterface(pasynUser, asynInt32Type, 1);
+    asynInt32 *pasynInt32 = (asynInt32 *)pasynInterface->pinterface;
+    void *interruptPvt;
+
+    setter.numSets = 20000;
+    setter.done = epicsEventMustCreate(epicsEventEmpty);
+    epicsThreadMustCreate("setParamsLoop", epicsThreadPriorityMedium,
+                          epicsThreadGetStackSize(epicsThreadStackSmall), setParamsLoop, &setter);
+    // Each change of the interrupt list makes the dispatcher rebuild the index
+    while (epicsEventTryWait(setter.done) != epicsEventWaitOK) {
+        pasynInt32->registerInterruptUser(pasynInterface->drvPvt, pasynUser,
+                                          &dispatchInt32cb, &otherCounts, &interruptPvt);
+        pasynInt32->cancelInterruptUser(pasynInterface->drvPvt, pasynUser, interruptPvt);
+        changes++;
+    }
+    while (counts.lastInt32 != setter.numSets) {
+        if (epicsEventWaitWithTimeout(counts.received, 5.0) != epicsEventWaitOK) break;
+    }
+    testOk(counts.lastInt32==setter.numSets, "last of %d values delivered during %d client changes",
+           setter.numSets, changes);
+
+    pasynManager->freeAsynUser(pasynUser);
+    epicsEventDestroy(setter.done);
+    epicsEventDestroy(counts.received);
+    epicsEventDestroy(otherCounts.received);
+}
+
+// Memory blocks of a size that nothing else in this test uses
+const size_t threadExitBlockSize = 3000;
+const int threadExitBlocks = 4;
+
+struct threadExitWorker {
+    void *blocks[threadExitBlocks];
+    epicsEventId done;
+};
+
+void threadExitAlloc(void *arg)
+{
+    threadExitWorker *pworker = (threadExitWorker *)arg;
+    for (int i=0; i<threadExitBlocks; i++)
+        pworker->blocks[i] = pasynManager->memMalloc(threadExitBlockSize);
+    for (int i=0; i<threadExitBlocks; i++)
+        pasynManager->memFree(pworker->blocks[i], threadExitBlockSize);
+    epicsEventSignal(pworker->done);
+}
+
+void testFreeListThreadExit()
+{
+    const int numThreads = 20;
+    std::set<void *> blocks;
+    threadExitWorker worker;
+
+    testDiag("Memory freed by threads that exit is used again");
+    worker.done = epicsEventMustCreate(epicsEventEmpty);
+    for (int i=0; i<numThreads; i++) {
+        epicsThreadMustCreate("freeListExit", epicsThreadPriorityMedium,
+                              epicsThreadGetStackSize(epicsThreadStackSmall), threadExitAlloc, &worker);
+        epicsEventMustWait(worker.done);
+        // Let the thread exit
+        epicsThreadSleep(0.02);
+        blocks.insert(worker.blocks, worker.blocks + threadExitBlocks);
+    }
+    testOk(blocks.size() <= 2*threadExitBlocks, "%d threads used %d different blocks",
+           numThreads, (int)blocks.size());
+    epicsEventDestroy(worker.done);
+}
+
+void testQueueLockPortShared()
+{
+    testDiag("A port held with queueLockPort does not stop the other shared thread ports");
+    // One shared thread, so the other port only gets a thread if an extra one is started
+    testOk1(pasynManager->setSharedThreads(1)==asynSuccess);
+    portSharedA = new asynPortDriver("portSharedA", 0,
+                                     asynDrvUserMask|asynInt32Mask, 0,
+                                     ASYN_CANBLOCK|ASYN_SHAREDTHREAD, 1, 0,
+                                     epicsThreadGetStackSize(epicsThreadStackSmall));
+    portSharedB = new asynPortDriver("portSharedB", 0,
+                                     asynDrvUserMask|asynInt32Mask, asynInt32Mask,
+                                     ASYN_CANBLOCK|ASYN_SHAREDTHREAD, 1, 0,
+                                     epicsThreadGetStackSize(epicsThreadStackSmall));
+    int index;
+    portSharedB->createParam("int32", asynParamInt32, &index);
+    asynInt32Client client("portSharedB", 0, "int32", 2.0);
+
+    asynUser *pasynUser = pasynManager->createAsynUser(0, 0);
+    pasynUser->timeout = 2.0;
+    testOk1(pasynManager->connectDevice(pasynUser, "portSharedA", 0)==asynSuccess);
+    testOk1(pasynManager->queueLockPort(pasynUser)==asynSuccess);
+    epicsTimeStamp start, end;
+    epicsTimeGetCurrent(&start);
+    asynStatus status = client.write(5);
+    epicsTimeGetCurrent(&end);
+    double elapsed = epicsTimeDiffInSeconds(&end, &start);
+    testOk(status==asynSuccess && elapsed<1.0,
+           "write to portSharedB while portSharedA is locked, status %d in %.3f s",
+           (int)status, elapsed);
+    testOk1(pasynManager->queueUnlockPort(pasynUser)==asynSuccess);
+    pasynManager->disconnect(pasynUser);
+    pasynManager->freeAsynUser(pasynUser);
+}
+
 } // namespace
 
 MAIN(asynPortDriverTest)
 {
-    testPlan(54);
+    testPlan(157);
     interruptAccept=1;
     try {
         testA();
+        testArrayBuffer();
+        testAddressRange();
+        testInterruptIndex();
+        testParamSnapshot();
+        testParamHandle();
+        testBulkParams();
+        testCallbackDispatcher();
+        testDispatcherClientChanges();
+        testFreeListThreadExit();
+        testQueueLockPortShared();
     } catch(std::exception& e) {
         testAbort("Unhandled C++ exception: %s", e.what());
     }
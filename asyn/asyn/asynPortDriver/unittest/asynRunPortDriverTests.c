@@ -17,12 +17,16 @@
 #include <epicsUnitTest.h>
 
 int asynPortDriverTest(void);
+int asynInterposeEosTest(void);
+int drvAsynIPPortTest(void);
 
 void asynRunPortDriverTests(void)
 {
     testHarness();
 
     runTest(asynPortDriverTest);
+    runTest(asynInterposeEosTest);
+    runTest(drvAsynIPPortTest);
 
     /*
      * Report now in case epicsExitTest dies
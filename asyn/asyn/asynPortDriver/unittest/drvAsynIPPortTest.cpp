@@ -0,0 +1,783 @@
+/*************************************************************************\
+* Copyright (c) 2010 UChicago Argonne LLC, as Operator of Argonne
+*     National Laboratory.
+* Distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+
+/*
+ * drvAsynIPPort against servers on the loopback interface running in the
+ * same process: ports with a thread each and reactor ports talking to an
+ * echo server, reactor ports blocked in reads while another is busy,
+ * lines read through asynInterposeEos with and without a receive buffer,
+ * datagrams from a multicast sender with and without a packet ring, and
+ * drvAsynIPServerPort passing the data of its clients to interrupt users.
+ *
+ * drvAsynIPPortPerform runs the same operations with many more ports and
+ * reports how long they take.
+ */
+
+#include <vector>
+#include <string>
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <epicsStdio.h>
+#include <epicsTime.h>
+#include <epicsThread.h>
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+#include <osiSock.h>
+
+#include <asynDriver.h>
+#include <asynOctet.h>
+#include <asynOctetSyncIO.h>
+#include <asynOption.h>
+#include <drvAsynIPPort.h>
+#include <drvAsynIPServerPort.h>
+
+#if defined(__linux__) || defined(__APPLE__)
+#define HAVE_ECHO_SERVER
+#include <poll.h>
+#include <fcntl.h>
+#endif
+
+namespace {
+
+#ifdef HAVE_ECHO_SERVER
+double elapsed(const epicsTimeStamp& start)
+{
+    epicsTimeStamp now;
+    epicsTimeGetCurrent(&now);
+    return epicsTimeDiffInSeconds(&now, &start);
+}
+
+/* Echo server for any number of clients, with one thread calling poll() */
+SOCKET listenSock = INVALID_SOCKET;
+int echoPort;
+
+void echoServer(void *)
+{
+    std::vector<struct pollfd> fds(1);
+    char buf[4096];
+    fds[0].fd = listenSock;
+    fds[0].events = POLLIN;
+    for (;;) {
+        if (poll(&fds[0], fds.size(), -1) < 0) continue;
+        for (size_t i = fds.size(); i-- > 1; ) {
+            if (!(fds[i].revents & (POLLIN|POLLHUP|POLLERR))) continue;
+            int n = recv(fds[i].fd, buf, sizeof(buf), 0);
+            if ((n <= 0) || (send(fds[i].fd, buf, n, 0) != n)) {
+                epicsSocketDestroy(fds[i].fd);
+                fds.erase(fds.begin() + i);
+            }
+        }
+        if (fds[0].revents & POLLIN) {
+            struct pollfd pfd;
+            pfd.fd = epicsSocketAccept(listenSock, NULL, NULL);
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            if (pfd.fd != INVALID_SOCKET) fds.push_back(pfd);
+        }
+    }
+}
+
+/* Listen on an unused port of the loopback interface */
+SOCKET listenLoopback(int *pport)
+{
+    osiSockAddr addr;
+    osiSocklen_t addrSize = sizeof(addr.ia);
+    SOCKET sock;
+
+    osiSockAttach();
+    sock = epicsSocketCreate(AF_INET, SOCK_STREAM, 0);
+    if (sock == INVALID_SOCKET) return sock;
+    memset(&addr, 0, sizeof(addr));
+    addr.ia.sin_family = AF_INET;
+    addr.ia.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.ia.sin_port = 0;
+    if (bind(sock, &addr.sa, sizeof(addr.ia)) ||
+        listen(sock, 64) ||
+        getsockname(sock, &addr.sa, (socklen_t *)&addrSize)) {
+        epicsSocketDestroy(sock);
+        return INVALID_SOCKET;
+    }
+    *pport = ntohs(addr.ia.sin_port);
+    return sock;
+}
+
+bool startEchoServer()
+{
+    listenSock = listenLoopback(&echoPort);
+    if (listenSock == INVALID_SOCKET) return false;
+    return epicsThreadCreate("echoServer", epicsThreadPriorityMedium,
+                             epicsThreadGetStackSize(epicsThreadStackMedium),
+                             echoServer, 0) != 0;
+}
+
+/* One client per port, which queues its next transaction from the callback of the previous one */
+struct echoClient {
+    asynUser  *pasynUser;
+    asynOctet *pasynOctet;
+    void      *octetPvt;
+    int        remaining;
+    int        errors;
+};
+
+epicsMutexId doneLock;
+epicsEventId allDone;
+int numActive;
+
+void echoTransaction(asynUser *pasynUser)
+{
+    echoClient *pclient = (echoClient *)pasynUser->userPvt;
+    char buf[8];
+    size_t nWrite, nRead, got = 0;
+    int eomReason;
+
+    pasynUser->timeout = 2.0;
+    if ((pclient->pasynOctet->write(pclient->octetPvt, pasynUser, "ping\n", 5, &nWrite) != asynSuccess) ||
+        (nWrite != 5)) {
+        pclient->errors++;
+    } else {
+        while (got < 5) {
+            if (pclient->pasynOctet->read(pclient->octetPvt, pasynUser, buf + got, 5 - got,
+                                          &nRead, &eomReason) != asynSuccess) {
+                pclient->errors++;
+                break;
+            }
+            got += nRead;
+        }
+        if ((got == 5) && memcmp(buf, "ping\n", 5)) pclient->errors++;
+    }
+    if ((--pclient->remaining > 0) &&
+        (pasynManager->queueRequest(pasynUser, asynQueuePriorityMedium, 0) == asynSuccess))
+        return;
+    epicsMutexMustLock(doneLock);
+    if (--numActive == 0) epicsEventSignal(allDone);
+    epicsMutexUnlock(doneLock);
+}
+
+/* Configure a port connected to the echo server for the client, returns false on failure */
+bool connectEchoClient(echoClient *pclient, const char *portName, userCallback callback)
+{
+    char hostInfo[40];
+    asynInterface *pasynInterface;
+
+    epicsSnprintf(hostInfo, sizeof(hostInfo), "127.0.0.1:%d", echoPort);
+    if (drvAsynIPPortConfigure(portName, hostInfo, 0, 0, 1)) return false;
+    pclient->pasynUser = pasynManager->createAsynUser(callback, 0);
+    pclient->pasynUser->userPvt = pclient;
+    if ((pasynManager->connectDevice(pclient->pasynUser, portName, 0) != asynSuccess) ||
+        (pasynManager->waitConnect(pclient->pasynUser, 5.0) != asynSuccess) ||
+        !(pasynInterface = pasynManager->findInterface(pclient->pasynUser, asynOctetType, 1)))
+        return false;
+    pclient->pasynOctet = (asynOctet *)pasynInterface->pinterface;
+    pclient->octetPvt = pasynInterface->drvPvt;
+    return true;
+}
+
+/* Run numTransactions write/read transactions on each of numPorts ports at the same time */
+void testEchoPorts(const char *prefix, bool useReactor, int numPorts, int numTransactions)
+{
+    char portName[40];
+    std::vector<echoClient> clients(numPorts);
+    int i, errors = 0;
+    bool ok = true;
+
+    if (useReactor && drvAsynIPReactorConfigure(2)) {
+        testSkip(1, "reactor not supported");
+        return;
+    }
+    for (i = 0; ok && (i < numPorts); i++) {
+        epicsSnprintf(portName, sizeof(portName), "%s%d", prefix, i);
+        ok = connectEchoClient(&clients[i], portName, echoTransaction);
+        clients[i].remaining = numTransactions;
+    }
+    if (useReactor) drvAsynIPReactorConfigure(0);
+    if (!ok) {
+        testFail("%s: could not configure and connect %d ports", prefix, numPorts);
+        return;
+    }
+    numActive = numPorts;
+    for (i = 0; i < numPorts; i++)
+        pasynManager->queueRequest(clients[i].pasynUser, asynQueuePriorityMedium, 0);
+    bool done = epicsEventWaitWithTimeout(allDone, 20.0) == epicsEventWaitOK;
+    for (i = 0; i < numPorts; i++) errors += clients[i].errors;
+    testOk(done && errors == 0, "%s: %d transactions on each of %d ports, %d errors",
+           prefix, numTransactions, numPorts, errors);
+}
+
+/* A read of a reactor port, which times out because the echo server sends nothing */
+epicsMutexId stallLock;
+epicsEventId stallDone;
+int numStalled;
+int stallTimeouts;
+
+void stallRead(asynUser *pasynUser)
+{
+    echoClient *pclient = (echoClient *)pasynUser->userPvt;
+    char buf[8];
+    size_t nRead;
+    int eomReason;
+
+    pasynUser->timeout = 1.0;
+    asynStatus status = pclient->pasynOctet->read(pclient->octetPvt, pasynUser, buf, sizeof(buf),
+                                                  &nRead, &eomReason);
+    epicsMutexMustLock(stallLock);
+    if (status == asynTimeout) stallTimeouts++;
+    if (--numStalled == 0) epicsEventSignal(stallDone);
+    epicsMutexUnlock(stallLock);
+}
+
+/* Block more reactor ports in reads than there are shared threads, and check that
+ * the transactions of another reactor port finish before the reads time out */
+void testReactorStall(int numTransactions)
+{
+    int numStall = 4*epicsThreadGetCPUs() + 4;
+    char portName[40];
+    std::vector<echoClient> clients(numStall + 1);
+    epicsTimeStamp start;
+    int i;
+    bool ok = true;
+
+    if (drvAsynIPReactorConfigure(2)) {
+        testSkip(1, "reactor not supported");
+        return;
+    }
+    for (i = 0; ok && (i <= numStall); i++) {
+        epicsSnprintf(portName, sizeof(portName), "ipStall%d", i);
+        ok = connectEchoClient(&clients[i], portName, i < numStall ? stallRead : echoTransaction);
+        clients[i].remaining = numTransactions;
+    }
+    drvAsynIPReactorConfigure(0);
+    if (!ok) {
+        testFail("ipStall: could not configure and connect %d ports", numStall + 1);
+        return;
+    }
+
+    stallLock = epicsMutexMustCreate();
+    stallDone = epicsEventMustCreate(epicsEventEmpty);
+    numStalled = numStall;
+    for (i = 0; i < numStall; i++)
+        pasynManager->queueRequest(clients[i].pasynUser, asynQueuePriorityMedium, 0);
+    epicsThreadSleep(0.1);
+    numActive = 1;
+    epicsTimeGetCurrent(&start);
+    pasynManager->queueRequest(clients[numStall].pasynUser, asynQueuePriorityMedium, 0);
+    bool done = epicsEventWaitWithTimeout(allDone, 10.0) == epicsEventWaitOK;
+    double t = elapsed(start);
+    bool stalled = epicsEventWaitWithTimeout(stallDone, 10.0) == epicsEventWaitOK;
+    testOk(done && stalled && t < 0.5 && clients[numStall].errors == 0 && stallTimeouts == numStall,
+           "ipStall: %d transactions in %.3f s, %d errors, %d of %d reads timed out",
+           numTransactions, t, clients[numStall].errors, stallTimeouts, numStall);
+}
+
+/* Line server, which sends lineBytes of CRLF terminated lines to each client and closes the connection */
+SOCKET lineListenSock = INVALID_SOCKET;
+int linePort;
+const char lineText[] = "2024-01-01T00:00:00.000 ch01 +1.234567E+00 ch02 -7.654321E-01 OK\r\n";
+const size_t lineLength = sizeof(lineText) - 1;
+const size_t lineBytes = lineLength * 20000;
+
+void lineClient(void *arg)
+{
+    SOCKET sock = (SOCKET)(size_t)arg;
+    std::vector<char> block(lineLength * 100);
+    size_t sent = 0;
+
+    for (size_t i = 0; i < block.size(); i += lineLength)
+        memcpy(&block[i], lineText, lineLength);
+    while (sent < lineBytes) {
+        size_t n = lineBytes - sent < block.size() ? lineBytes - sent : block.size();
+        int thisSend = send(sock, &block[0], (int)n, 0);
+        if (thisSend <= 0) break;
+        sent += thisSend;
+    }
+    epicsSocketDestroy(sock);
+}
+
+void lineServer(void *)
+{
+    for (;;) {
+        SOCKET sock = epicsSocketAccept(lineListenSock, NULL, NULL);
+        if (sock == INVALID_SOCKET) continue;
+        epicsThreadCreate("lineClient", epicsThreadPriorityMedium,
+                          epicsThreadGetStackSize(epicsThreadStackMedium),
+                          lineClient, (void *)(size_t)sock);
+    }
+}
+
+/* Read the lines from the line server through asynInterposeEos, with a
+ * receive buffer of rxBufferSize characters in drvAsynIPPort */
+void testLineStream(int rxBufferSize)
+{
+    char portName[40], hostInfo[40], size[20];
+    char buffer[256];
+    asynUser *pasynUser;
+    size_t nRead, total = 0;
+    int eomReason, numLines = 0, badLines = 0;
+
+    epicsSnprintf(portName, sizeof(portName), "ipStream%d", rxBufferSize);
+    epicsSnprintf(hostInfo, sizeof(hostInfo), "127.0.0.1:%d", linePort);
+    epicsSnprintf(size, sizeof(size), "%d", rxBufferSize);
+    if (drvAsynIPPortConfigure(portName, hostInfo, 0, 0, 0) ||
+        pasynOctetSyncIO->connect(portName, 0, &pasynUser, NULL)) {
+        testFail("%s: could not configure port", portName);
+        return;
+    }
+    asynInterface *pasynInterface = pasynManager->findInterface(pasynUser, asynOptionType, 1);
+    asynOption *pasynOption = (asynOption *)pasynInterface->pinterface;
+    if (pasynOption->setOption(pasynInterface->drvPvt, pasynUser, "rxBufferSize", size)) {
+        testFail("%s: %s", portName, pasynUser->errorMessage);
+        return;
+    }
+    pasynOctetSyncIO->setInputEos(pasynUser, "\r\n", 2);
+    pasynManager->waitConnect(pasynUser, 5.0);
+    while (pasynOctetSyncIO->read(pasynUser, buffer, sizeof(buffer), 5.0, &nRead, &eomReason) == asynSuccess) {
+        /* The server has closed the connection */
+        if ((nRead == 0) && (eomReason & ASYN_EOM_END)) break;
+        total += nRead + 2;
+        numLines++;
+        if ((nRead != lineLength - 2) || memcmp(buffer, lineText, nRead) || !(eomReason & ASYN_EOM_EOS))
+            badLines++;
+    }
+    testOk(total == lineBytes && badLines == 0, "%s: read %lu characters in %d lines, %d bad lines",
+           portName, (unsigned long)total, numLines, badLines);
+    /* Do not reconnect to the line server */
+    pasynManager->autoConnect(pasynUser, 0);
+}
+
+/* Multicast sender, which sends numbered datagrams to the group on the loopback
+ * interface, never more than mcastWindow ahead of the reader so none are lost */
+const char mcastGroup[] = "239.255.42.99";
+const int mcastPackets = 2000;
+const int mcastPacketBytes = 64;
+const int mcastWindow = 64;
+
+struct mcastTest {
+    int            port;
+    int            numRead;
+    int            numInterrupts;
+    int            badInterrupts;
+    epicsTimeStamp lastInterrupt;
+    epicsMutexId   lock;
+    epicsEventId   readEvent;
+};
+
+void mcastSender(void *arg)
+{
+    mcastTest *ptest = (mcastTest *)arg;
+    struct in_addr ifAddr;
+    osiSockAddr addr;
+    char packet[mcastPacketBytes];
+    SOCKET sock = epicsSocketCreate(AF_INET, SOCK_DGRAM, 0);
+
+    if (sock == INVALID_SOCKET) return;
+    ifAddr.s_addr = htonl(INADDR_LOOPBACK);
+    setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, (char *)&ifAddr, sizeof(ifAddr));
+    memset(&addr, 0, sizeof(addr));
+    addr.ia.sin_family = AF_INET;
+    addr.ia.sin_addr.s_addr = inet_addr(mcastGroup);
+    addr.ia.sin_port = htons(ptest->port);
+    memset(packet, '.', sizeof(packet));
+    for (int i = 0; i < mcastPackets; i++) {
+        for (;;) {
+            epicsMutexMustLock(ptest->lock);
+            int ahead = i - ptest->numRead;
+            epicsMutexUnlock(ptest->lock);
+            if (ahead < mcastWindow) break;
+            /* The reader has stopped */
+            if (epicsEventWaitWithTimeout(ptest->readEvent, 5.0) != epicsEventWaitOK) goto done;
+        }
+        epicsSnprintf(packet, sizeof(packet), "%08d", i);
+        packet[8] = ' ';
+        sendto(sock, packet, sizeof(packet), 0, &addr.sa, sizeof(addr.ia));
+    }
+done:
+    epicsSocketDestroy(sock);
+}
+
+/* Called from the read of each datagram, with the asynUser of the interrupt user */
+void mcastInterrupt(void *userPvt, asynUser *pasynUser, char *data, size_t numchars, int eomReason)
+{
+    mcastTest *ptest = (mcastTest *)userPvt;
+    ptest->numInterrupts++;
+    if ((numchars != (size_t)mcastPacketBytes) ||
+        (epicsTimeDiffInSeconds(&pasynUser->timestamp, &ptest->lastInterrupt) < 0))
+        ptest->badInterrupts++;
+    ptest->lastInterrupt = pasynUser->timestamp;
+}
+
+/* Unused TCP or UDP port of the loopback interface */
+int unusedPort(int socketType)
+{
+    osiSockAddr addr;
+    osiSocklen_t addrSize = sizeof(addr.ia);
+    SOCKET sock = epicsSocketCreate(AF_INET, socketType, 0);
+    int port = 0;
+
+    if (sock == INVALID_SOCKET) return 0;
+    memset(&addr, 0, sizeof(addr));
+    addr.ia.sin_family = AF_INET;
+    addr.ia.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (!bind(sock, &addr.sa, sizeof(addr.ia)) &&
+        !getsockname(sock, &addr.sa, (socklen_t *)&addrSize))
+        port = ntohs(addr.ia.sin_port);
+    epicsSocketDestroy(sock);
+    return port;
+}
+
+/* Read the datagrams from the multicast sender with a packet ring of rxPackets
+ * datagrams in drvAsynIPPort. With the ring each read has the time the datagram
+ * was received, and the interrupt user gets the same time. */
+void testMulticast(int rxPackets)
+{
+    char portName[40], hostInfo[60], size[20];
+    char buffer[256];
+    asynUser *pasynUser, *pasynUserInterrupt;
+    asynInterface *pasynInterface;
+    void *registrarPvt;
+    epicsTimeStamp start;
+    mcastTest test;
+    size_t nRead;
+    int eomReason, seq, badPackets = 0, badTimes = 0;
+
+    memset(&test, 0, sizeof(test));
+    test.port = unusedPort(SOCK_DGRAM);
+    test.lock = epicsMutexMustCreate();
+    test.readEvent = epicsEventMustCreate(epicsEventEmpty);
+    epicsSnprintf(portName, sizeof(portName), "mcast%d", rxPackets);
+    epicsSnprintf(hostInfo, sizeof(hostInfo), "%s:%d udpm", mcastGroup, test.port);
+    epicsSnprintf(size, sizeof(size), "%d", rxPackets);
+    if (drvAsynIPPortConfigure(portName, hostInfo, 0, 0, 1) ||
+        pasynOctetSyncIO->connect(portName, 0, &pasynUser, NULL) ||
+        pasynManager->waitConnect(pasynUser, 5.0)) {
+        testSkip(1, "no multicast on the loopback interface");
+        return;
+    }
+    pasynInterface = pasynManager->findInterface(pasynUser, asynOptionType, 1);
+    asynOption *pasynOption = (asynOption *)pasynInterface->pinterface;
+    if (pasynOption->setOption(pasynInterface->drvPvt, pasynUser, "multicastInterface", "127.0.0.1") ||
+        pasynOption->setOption(pasynInterface->drvPvt, pasynUser, "rxPackets", size)) {
+        testFail("%s: %s", portName, pasynUser->errorMessage);
+        return;
+    }
+    pasynUserInterrupt = pasynManager->createAsynUser(0, 0);
+    pasynManager->connectDevice(pasynUserInterrupt, portName, 0);
+    pasynInterface = pasynManager->findInterface(pasynUser, asynOctetType, 1);
+    asynOctet *pasynOctet = (asynOctet *)pasynInterface->pinterface;
+    pasynOctet->registerInterruptUser(pasynInterface->drvPvt, pasynUserInterrupt, mcastInterrupt,
+                                      &test, &registrarPvt);
+    epicsThreadCreate("mcastSender", epicsThreadPriorityMedium,
+                      epicsThreadGetStackSize(epicsThreadStackMedium), mcastSender, &test);
+    epicsTimeGetCurrent(&start);
+    while ((test.numRead < mcastPackets) &&
+           (pasynOctetSyncIO->read(pasynUser, buffer, sizeof(buffer), 5.0, &nRead, &eomReason) == asynSuccess)) {
+        if ((nRead != (size_t)mcastPacketBytes) || (sscanf(buffer, "%d", &seq) != 1) || (seq != test.numRead))
+            badPackets++;
+        if ((rxPackets > 0) &&
+            ((epicsTimeDiffInSeconds(&pasynUser->timestamp, &start) < 0) ||
+             !epicsTimeEqual(&pasynUser->timestamp, &test.lastInterrupt)))
+            badTimes++;
+        epicsMutexMustLock(test.lock);
+        test.numRead++;
+        epicsMutexUnlock(test.lock);
+        epicsEventSignal(test.readEvent);
+    }
+    pasynOctet->cancelInterruptUser(pasynInterface->drvPvt, pasynUserInterrupt, registrarPvt);
+    if (test.numRead == 0) {
+        testSkip(1, "no multicast on the loopback interface");
+    } else {
+        badPackets += test.numInterrupts - test.numRead;
+        if (rxPackets > 0) badTimes += test.badInterrupts;
+        testOk(test.numRead == mcastPackets && badPackets == 0 && badTimes == 0,
+               "%s: read %d of %d datagrams, %d bad, %d bad time stamps",
+               portName, test.numRead, mcastPackets, badPackets, badTimes);
+    }
+    pasynOctetSyncIO->disconnect(pasynUser);
+}
+
+/* The port of each client of the server port echoes what the client sends.
+ * With readClients the server port reads each client when it has sent data,
+ * and the asynOctet interrupt of the client port queues the write of the echo. */
+struct serverClient {
+    asynUser  *pasynUser;
+    asynOctet *pasynOctet;
+    void      *octetPvt;
+    char       buf[256];
+    size_t     nBuf;
+    bool       queued;
+    int        numBytes;
+};
+
+std::vector<serverClient> serverClients;
+int numServerConnects;
+
+/* The interrupt and the write are both called with the client port locked */
+void serverData(void *userPvt, asynUser *, char *data, size_t numchars, int)
+{
+    serverClient *pclient = (serverClient *)userPvt;
+
+    if (numchars == 0) return;
+    if (numchars > sizeof(pclient->buf) - pclient->nBuf)
+        numchars = sizeof(pclient->buf) - pclient->nBuf;
+    memcpy(pclient->buf + pclient->nBuf, data, numchars);
+    pclient->nBuf += numchars;
+    if (!pclient->queued &&
+        (pasynManager->queueRequest(pclient->pasynUser, asynQueuePriorityMedium, 0) == asynSuccess))
+        pclient->queued = true;
+}
+
+void serverEcho(asynUser *pasynUser)
+{
+    serverClient *pclient = (serverClient *)pasynUser->userPvt;
+    size_t nWrite;
+
+    pclient->queued = false;
+    pasynUser->timeout = 5.0;
+    if (pclient->pasynOctet->write(pclient->octetPvt, pasynUser, pclient->buf, pclient->nBuf,
+                                   &nWrite) == asynSuccess)
+        pclient->numBytes += (int)nWrite;
+    pclient->nBuf = 0;
+}
+
+void serverConnection(void *, asynUser *, char *, size_t, int)
+{
+    epicsMutexMustLock(doneLock);
+    numServerConnects++;
+    epicsMutexUnlock(doneLock);
+}
+
+/* numClients non-blocking sockets in this thread calling poll(), which connect to
+ * a server port with readClients and reactor client ports, and then each send
+ * numRounds messages, waiting for the echo of one before sending the next */
+void testServerClients(int numClients, int numRounds)
+{
+    const char msg[] = "ping from client\n";
+    const int msgLength = sizeof(msg) - 1;
+    char hostInfo[40], portName[40], buf[256];
+    std::vector<struct pollfd> fds(numClients);
+    std::vector<int> pending(numClients), rounds(numClients);
+    epicsTimeStamp start;
+    osiSockAddr addr;
+    asynUser *pasynUser;
+    asynInterface *pasynInterface;
+    void *registrarPvt, *dataPvt;
+    int i, connected, remaining, errors = 0, numEchoes = 0;
+
+    if (drvAsynIPReactorConfigure(2)) {
+        testSkip(2, "reactor not supported");
+        return;
+    }
+    int port = unusedPort(SOCK_STREAM);
+    epicsSnprintf(hostInfo, sizeof(hostInfo), "127.0.0.1:%d", port);
+    int status = drvAsynIPServerPortConfigure("ipServer", hostInfo, numClients, 0, 0, 1);
+    drvAsynIPReactorConfigure(0);
+    if (status) {
+        testFail("ipServer: could not configure the server port");
+        testSkip(1, "no server port");
+        return;
+    }
+    pasynUser = pasynManager->createAsynUser(0, 0);
+    pasynManager->connectDevice(pasynUser, "ipServer", 0);
+    pasynInterface = pasynManager->findInterface(pasynUser, asynOptionType, 1);
+    if (((asynOption *)pasynInterface->pinterface)->setOption(pasynInterface->drvPvt, pasynUser,
+                                                              "readClients", "Y")) {
+        testSkip(2, "readClients not supported");
+        return;
+    }
+    serverClients.resize(numClients);
+    for (i = 0; i < numClients; i++) {
+        serverClient *pclient = &serverClients[i];
+        epicsSnprintf(portName, sizeof(portName), "ipServer:%d", i);
+        pclient->pasynUser = pasynManager->createAsynUser(serverEcho, 0);
+        pclient->pasynUser->userPvt = pclient;
+        pasynManager->connectDevice(pclient->pasynUser, portName, 0);
+        pasynInterface = pasynManager->findInterface(pclient->pasynUser, asynOctetType, 1);
+        pclient->pasynOctet = (asynOctet *)pasynInterface->pinterface;
+        pclient->octetPvt = pasynInterface->drvPvt;
+        pclient->pasynOctet->registerInterruptUser(pclient->octetPvt, pclient->pasynUser,
+                                                   serverData, pclient, &dataPvt);
+    }
+    pasynInterface = pasynManager->findInterface(pasynUser, asynOctetType, 1);
+    ((asynOctet *)pasynInterface->pinterface)->registerInterruptUser(pasynInterface->drvPvt, pasynUser,
+        serverConnection, 0, &registrarPvt);
+
+    /* Connect all the clients */
+    memset(&addr, 0, sizeof(addr));
+    addr.ia.sin_family = AF_INET;
+    addr.ia.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.ia.sin_port = htons(port);
+    epicsTimeGetCurrent(&start);
+    for (i = 0; i < numClients; i++) {
+        fds[i].fd = epicsSocketCreate(AF_INET, SOCK_STREAM, 0);
+        fds[i].events = POLLIN;
+        if ((fds[i].fd == INVALID_SOCKET) ||
+            (fcntl(fds[i].fd, F_SETFL, O_NONBLOCK) < 0) ||
+            ((connect(fds[i].fd, &addr.sa, sizeof(addr.ia)) < 0) && (errno != EINPROGRESS)))
+            errors++;
+    }
+    do {
+        epicsThreadSleep(0.01);
+        epicsMutexMustLock(doneLock);
+        connected = numServerConnects;
+        epicsMutexUnlock(doneLock);
+    } while ((connected < numClients) && (elapsed(start) < 10.0));
+    testOk(connected == numClients && errors == 0,
+           "ipServer: %d of %d clients connected, %d errors", connected, numClients, errors);
+
+    /* Each client sends numRounds messages */
+    epicsTimeGetCurrent(&start);
+    for (i = 0; i < numClients; i++) {
+        if (send(fds[i].fd, msg, msgLength, 0) != msgLength) errors++;
+        pending[i] = msgLength;
+    }
+    remaining = numClients;
+    while ((remaining > 0) && (elapsed(start) < 20.0)) {
+        if (poll(&fds[0], numClients, 1000) <= 0) continue;
+        for (i = 0; i < numClients; i++) {
+            if (!(fds[i].revents & (POLLIN|POLLHUP|POLLERR))) continue;
+            int n = recv(fds[i].fd, buf, sizeof(buf), 0);
+            if (n <= 0) {
+                errors++;
+                fds[i].events = 0;
+                remaining--;
+                continue;
+            }
+            pending[i] -= n;
+            if (pending[i] > 0) continue;
+            if (++rounds[i] == numRounds) {
+                fds[i].events = 0;
+                remaining--;
+            } else {
+                if (send(fds[i].fd, msg, msgLength, 0) != msgLength) errors++;
+                pending[i] = msgLength;
+            }
+        }
+    }
+    for (i = 0; i < numClients; i++) {
+        epicsSocketDestroy(fds[i].fd);
+        numEchoes += serverClients[i].numBytes / msgLength;
+    }
+    testOk(remaining == 0 && errors == 0 && numEchoes == numClients*numRounds,
+           "ipServer: %d echoes of %d, %d errors", numEchoes, numClients*numRounds, errors);
+}
+
+/* The messages passed to the interrupt users of a client port with an input EOS */
+std::string framedMessages;
+int numFramed;
+
+void framedData(void *, asynUser *, char *data, size_t numchars, int eomReason)
+{
+    epicsMutexMustLock(doneLock);
+    framedMessages.append(data, numchars);
+    framedMessages += (eomReason & ASYN_EOM_EOS) ? '|' : '?';
+    numFramed++;
+    epicsMutexUnlock(doneLock);
+}
+
+/* A client sends lines split across and combined in its sends, which the interrupt
+ * users of a port with the input EOS set get as one message per line */
+void testServerFraming()
+{
+    const char *sends[] = {"abc", "def\nghi\njk", "l\n"};
+    char hostInfo[40];
+    asynUser *pasynUser;
+    asynInterface *pasynInterface;
+    asynOctet *pasynOctet;
+    void *registrarPvt;
+    osiSockAddr addr;
+    epicsTimeStamp start;
+    SOCKET sock;
+    int numMessages;
+
+    int port = unusedPort(SOCK_STREAM);
+    epicsSnprintf(hostInfo, sizeof(hostInfo), "127.0.0.1:%d", port);
+    if (drvAsynIPServerPortConfigure("ipServerEos", hostInfo, 1, 0, 0, 0)) {
+        testFail("ipServerEos: could not configure the server port");
+        return;
+    }
+    pasynUser = pasynManager->createAsynUser(0, 0);
+    pasynManager->connectDevice(pasynUser, "ipServerEos", 0);
+    pasynInterface = pasynManager->findInterface(pasynUser, asynOptionType, 1);
+    if (((asynOption *)pasynInterface->pinterface)->setOption(pasynInterface->drvPvt, pasynUser,
+                                                              "readClients", "Y")) {
+        testSkip(1, "readClients not supported");
+        return;
+    }
+    pasynUser = pasynManager->createAsynUser(0, 0);
+    pasynManager->connectDevice(pasynUser, "ipServerEos:0", 0);
+    pasynInterface = pasynManager->findInterface(pasynUser, asynOctetType, 1);
+    pasynOctet = (asynOctet *)pasynInterface->pinterface;
+    pasynOctet->setInputEos(pasynInterface->drvPvt, pasynUser, "\n", 1);
+    pasynOctet->registerInterruptUser(pasynInterface->drvPvt, pasynUser,
+                                      framedData, 0, &registrarPvt);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.ia.sin_family = AF_INET;
+    addr.ia.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.ia.sin_port = htons(port);
+    sock = epicsSocketCreate(AF_INET, SOCK_STREAM, 0);
+    if ((sock == INVALID_SOCKET) || (connect(sock, &addr.sa, sizeof(addr.ia)) < 0)) {
+        testFail("ipServerEos: could not connect");
+        return;
+    }
+    for (size_t i = 0; i < sizeof(sends)/sizeof(sends[0]); i++) {
+        epicsThreadSleep(0.05);
+        send(sock, sends[i], strlen(sends[i]), 0);
+    }
+    epicsTimeGetCurrent(&start);
+    do {
+        epicsThreadSleep(0.01);
+        epicsMutexMustLock(doneLock);
+        numMessages = numFramed;
+        epicsMutexUnlock(doneLock);
+    } while ((numMessages < 3) && (elapsed(start) < 5.0));
+    epicsSocketDestroy(sock);
+    testOk(framedMessages == "abcdef|ghi|jkl|",
+           "ipServerEos: interrupt users got \"%s\"", framedMessages.c_str());
+}
+#endif
+
+} // namespace
+
+MAIN(drvAsynIPPortTest)
+{
+    testPlan(12);
+#ifdef HAVE_ECHO_SERVER
+    doneLock = epicsMutexMustCreate();
+    allDone = epicsEventMustCreate(epicsEventEmpty);
+    bool started = startEchoServer();
+    testOk(started, "echo server on 127.0.0.1:%d", echoPort);
+    testDiag("Ports with a thread each and reactor ports, a client on each queueing its next transaction");
+    testEchoPorts("ipThread", false, 4, 50);
+    testEchoPorts("ipReactor", true, 4, 50);
+    testDiag("Reactor ports blocked in reads, while another reactor port is busy");
+    testReactorStall(20);
+    lineListenSock = listenLoopback(&linePort);
+    started = (lineListenSock != INVALID_SOCKET) &&
+              epicsThreadCreate("lineServer", epicsThreadPriorityMedium,
+                                epicsThreadGetStackSize(epicsThreadStackMedium),
+                                lineServer, 0);
+    testOk(started, "line server on 127.0.0.1:%d", linePort);
+    testDiag("%d character lines read through asynInterposeEos", (int)lineLength);
+    testLineStream(0);
+    testLineStream(4096);
+    testDiag("%d datagrams of %d bytes from %s on the loopback interface",
+             mcastPackets, mcastPacketBytes, mcastGroup);
+    testMulticast(0);
+    testMulticast(32);
+    testDiag("drvAsynIPServerPort reading its clients, the client ports served by the reactor");
+    testServerClients(20, 5);
+    testDiag("drvAsynIPServerPort reading a client for the interrupt users of a port with an input EOS");
+    testServerFraming();
+#else
+    testSkip(12, "no echo server on this platform");
+#endif
+    return testDone();
+}
@@ -25,6 +25,7 @@
 #include <dbStaticLib.h>
 #include <link.h>
 #include <epicsPrint.h>
+#include <epicsStdio.h>
 #include <epicsMutex.h>
 #include <epicsThread.h>
 #include <epicsMath.h>
@@ -69,11 +70,8 @@ typedef struct devPvt{
     void              *registrarPvt;
     int               canBlock;
     epicsMutexId      devPvtLock;
-    ringBufferElement *ringBuffer;
-    int               ringHead;
-    int               ringTail;
-    int               ringSize;
-    int               ringBufferOverflows;
+    asynRingBuffer    *ringBuffer;
+    asynAggregate     *paggregate;
     ringBufferElement result;
     asynStatus        lastStatus;
     epicsFloat64      sum;
@@ -91,6 +89,7 @@ typedef struct devPvt{
     char              *userParam;
     int               addr;
     asynStatus        previousQueueRequestStatus;
+    struct asynBatch  *pbatch;
 }devPvt;
 
 static long initCommon(dbCommon *pr, DBLINK *plink,
@@ -98,6 +97,7 @@ static long initCommon(dbCommon *pr, DBLINK *plink,
 static long getIoIntInfo(int cmd, dbCommon *pr, IOSCANPVT *iopvt);
 static long createRingBuffer(dbCommon *pr);
 static void processCallbackInput(asynUser *pasynUser);
+static void coalesceCallbackInput(asynUser *pasynUser, asynUser *pasynUserRead);
 static void processCallbackOutput(asynUser *pasynUser);
 static void outputCallbackCallback(CALLBACK *pcb);
 static int  getCallbackValue(devPvt *pPvt);
@@ -174,6 +174,24 @@ static long initCommon(dbCommon *pr, DBLINK *plink,
                      pr->name, driverName, functionName,pasynUser->errorMessage);
         goto bad;
     }
+    pPvt->pbatch = asynBatchInit(pr, pasynUser);
+    /* info(asyn:AGGREGATE) only applies to the callbacks of input records. Output
+     * records ignore it, and the Average device support already averages the callbacks */
+    if (interruptCallback == interruptCallbackInput) {
+        status = asynAggregateInit(pr, &pPvt->paggregate);
+        if (status != asynSuccess) goto bad;
+    } else if (interruptCallback == interruptCallbackAverage &&
+               asynDbGetInfo(pr, "asyn:AGGREGATE")) {
+        printf("%s %s::%s asyn:AGGREGATE is not supported with Average device support\n",
+               pr->name, driverName, functionName);
+        goto bad;
+    }
+    if (processCallback == processCallbackInput) {
+        const char *coalesceString = asynDbGetInfo(pr, "asyn:COALESCE");
+        if (coalesceString && atoi(coalesceString)) {
+            pasynManager->registerCoalesceCallback(pasynUser, asynFloat64Type, coalesceCallbackInput);
+        }
+    }
     /*call drvUserCreate*/
     pasynInterface = pasynManager->findInterface(pasynUser,asynDrvUserType,1);
     if(pasynInterface && pPvt->userParam) {
@@ -246,10 +264,10 @@ static long createRingBuffer(dbCommon *pr)
     const char *sizeString;
 
     if (!pPvt->ringBuffer) {
-        pPvt->ringSize = DEFAULT_RING_BUFFER_SIZE;
+        int ringSize = DEFAULT_RING_BUFFER_SIZE;
         sizeString = asynDbGetInfo(pr, "asyn:FIFO");
-        if (sizeString) pPvt->ringSize = atoi(sizeString);
-        pPvt->ringBuffer = callocMustSucceed(pPvt->ringSize+1, sizeof *pPvt->ringBuffer, "devAsynFloat64::createRingBuffer");
+        if (sizeString) ringSize = atoi(sizeString);
+        pPvt->ringBuffer = asynRingBufferCreate(ringSize, sizeof(ringBufferElement));
     }
     return asynSuccess;
 }
@@ -327,6 +345,34 @@ static void processCallbackInput(asynUser *pasynUser)
     if(pr->pact) callbackRequestProcessCallback(&pPvt->processCallback,pr->prio,pr);
 }
 
+static void coalesceCallbackInput(asynUser *pasynUser, asynUser *pasynUserRead)
+{
+    devPvt *pPvt = (devPvt *)pasynUser->userPvt;
+    devPvt *pPvtRead = (devPvt *)pasynUserRead->userPvt;
+    dbCommon *pr = pPvt->pr;
+    static const char *functionName="coalesceCallbackInput";
+
+    /* Another record with the same reason and address did the read */
+    epicsMutexLock(pPvtRead->devPvtLock);
+    pPvt->result = pPvtRead->result;
+    epicsMutexUnlock(pPvtRead->devPvtLock);
+    if (pPvt->result.status == asynSuccess) {
+        asynPrint(pasynUser, ASYN_TRACEIO_DEVICE,
+            "%s %s::%s process value=%f read by %s\n", pr->name, driverName, functionName,
+            pPvt->result.value, pPvtRead->pr->name);
+    } else {
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+            "%s", pasynUserRead->errorMessage);
+        if (pPvt->result.status != pPvt->lastStatus) {
+            asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                "%s %s::%s process read error %s\n",
+                pr->name, driverName, functionName, pasynUser->errorMessage);
+        }
+    }
+    pPvt->lastStatus = pPvt->result.status;
+    if(pr->pact) callbackRequestProcessCallback(&pPvt->processCallback,pr->prio,pr);
+}
+
 static void processCallbackOutput(asynUser *pasynUser)
 {
     devPvt *pPvt = (devPvt *)pasynUser->userPvt;
@@ -356,7 +402,7 @@ static void interruptCallbackInput(void *drvPvt, asynUser *pasynUser,
 {
     devPvt *pPvt = (devPvt *)drvPvt;
     dbCommon *pr = pPvt->pr;
-    ringBufferElement *rp;
+    ringBufferElement element;
     static const char *functionName="interruptCallbackInput";
 
     asynPrint(pPvt->pasynUser, ASYN_TRACEIO_DEVICE,
@@ -375,27 +421,22 @@ static void interruptCallbackInput(void *drvPvt, asynUser *pasynUser,
      * Instead we just return.  There will then be nothing in the ring buffer, so the first
      * read will do a read from the driver, which should be OK. */
     if (!interruptAccept) return;
-    epicsMutexLock(pPvt->devPvtLock);
-    rp = &pPvt->ringBuffer[pPvt->ringHead];
-    rp->value = value;
-    rp->time = pasynUser->timestamp;
-    rp->status = pasynUser->auxStatus;
-    rp->alarmStatus = pasynUser->alarmStatus;
-    rp->alarmSeverity = pasynUser->alarmSeverity;
-    pPvt->ringHead = (pPvt->ringHead==pPvt->ringSize) ? 0 : pPvt->ringHead+1;
-    if (pPvt->ringHead == pPvt->ringTail) {
-        /* There was no room in the ring buffer.  In the past we just threw away
-         * the new value.  However, it is better to remove the oldest value from the
-         * ring buffer and add the new one.  That way the final value the record receives
-         * is guaranteed to be the most recent value */
-        pPvt->ringTail = (pPvt->ringTail==pPvt->ringSize) ? 0 : pPvt->ringTail+1;
-        pPvt->ringBufferOverflows++;
-    } else {
+    /* With info(asyn:AGGREGATE) only the result of each window is passed to the record,
+     * callbacks with an error status are passed as they are */
+    if (pPvt->paggregate && pasynUser->auxStatus == asynSuccess &&
+        !asynAggregateFloat64(pPvt->paggregate, &value)) return;
+    element.value = value;
+    element.time = pasynUser->timestamp;
+    element.status = pasynUser->auxStatus;
+    element.alarmStatus = pasynUser->alarmStatus;
+    element.alarmSeverity = pasynUser->alarmSeverity;
+    /* If there is no room in the ring buffer asynRingBufferPush removes the oldest value
+     * and adds the new one, so the final value the record receives is the most recent value */
+    if (!asynRingBufferPush(pPvt->ringBuffer, &element)) {
         /* We only need to request the record to process if we added a new
          * element to the ring buffer, not if we just replaced an element. */
         scanIoRequest(pPvt->ioScanPvt);
     }
-    epicsMutexUnlock(pPvt->devPvtLock);
 }
 
 static void interruptCallbackOutput(void *drvPvt, asynUser *pasynUser,
@@ -403,32 +444,28 @@ static void interruptCallbackOutput(void *drvPvt, asynUser *pasynUser,
 {
     devPvt *pPvt = (devPvt *)drvPvt;
     dbCommon *pr = pPvt->pr;
-    ringBufferElement *rp;
+    ringBufferElement element;
     static const char *functionName="interruptCallbackOutput";
 
     asynPrint(pPvt->pasynUser, ASYN_TRACEIO_DEVICE,
         "%s %s::%s new value=%f\n",
         pr->name, driverName, functionName,value);
     if (!interruptAccept) return;
+    element.value = value;
+    element.time = pasynUser->timestamp;
+    element.status = pasynUser->auxStatus;
+    element.alarmStatus = pasynUser->alarmStatus;
+    element.alarmSeverity = pasynUser->alarmSeverity;
+    /* We only need to process the record if a new element was added to the ring buffer,
+     * not if the oldest element was replaced */
+    if (asynRingBufferPush(pPvt->ringBuffer, &element)) return;
     epicsMutexLock(pPvt->devPvtLock);
-    rp = &pPvt->ringBuffer[pPvt->ringHead];
-    rp->value = value;
-    rp->time = pasynUser->timestamp;
-    rp->status = pasynUser->auxStatus;
-    rp->alarmStatus = pasynUser->alarmStatus;
-    rp->alarmSeverity = pasynUser->alarmSeverity;
-    pPvt->ringHead = (pPvt->ringHead==pPvt->ringSize) ? 0 : pPvt->ringHead+1;
-    if (pPvt->ringHead == pPvt->ringTail) {
-        pPvt->ringTail = (pPvt->ringTail==pPvt->ringSize) ? 0 : pPvt->ringTail+1;
-        pPvt->ringBufferOverflows++;
+    /* If this callback was received during asynchronous record processing
+     * we must defer calling callbackRequest until end of record processing */
+    if (pPvt->asyncProcessingActive) {
+        pPvt->numDeferredOutputCallbacks++;
     } else {
-        /* If this callback was received during asynchronous record processing
-         * we must defer calling callbackRequest until end of record processing */
-        if (pPvt->asyncProcessingActive) {
-            pPvt->numDeferredOutputCallbacks++;
-        } else {
-            callbackRequest(&pPvt->outputCallback);
-        }
+        callbackRequest(&pPvt->outputCallback);
     }
     epicsMutexUnlock(pPvt->devPvtLock);
 }
@@ -467,7 +504,7 @@ static void interruptCallbackAverage(void *drvPvt, asynUser *pasynUser,
     devPvt *pPvt = (devPvt *)drvPvt;
     dbCommon *pr = pPvt->pr;
     aiRecord *pai = (aiRecord *)pr;
-    ringBufferElement *rp;
+    ringBufferElement element;
     int numToAverage;
     static const char *functionName="interruptCallbackAverage";
 
@@ -488,24 +525,16 @@ static void interruptCallbackAverage(void *drvPvt, asynUser *pasynUser,
         numToAverage = (int)(pai->sval + 0.5);
         if (numToAverage < 1) numToAverage = 1;
         if (pPvt->numAverage >= numToAverage) {
-            rp = &pPvt->ringBuffer[pPvt->ringHead];
-            rp->value = pPvt->sum/pPvt->numAverage;
+            element.value = pPvt->sum/pPvt->numAverage;
             pPvt->numAverage = 0;
             pPvt->sum = 0.;
-            rp->time = pasynUser->timestamp;
-            rp->status = pasynUser->auxStatus;
-            rp->alarmStatus = pasynUser->alarmStatus;
-            rp->alarmSeverity = pasynUser->alarmSeverity;
-            pPvt->ringHead = (pPvt->ringHead==pPvt->ringSize) ? 0 : pPvt->ringHead+1;
-            if (pPvt->ringHead == pPvt->ringTail) {
-                /* There was no room in the ring buffer.  In the past we just threw away
-                 * the new value.  However, it is better to remove the oldest value from the
-                 * ring buffer and add the new one.  That way the final value the record receives
-                 * is guaranteed to be the most recent value */
-                pPvt->ringTail = (pPvt->ringTail==pPvt->ringSize) ? 0 : pPvt->ringTail+1;
-                pPvt->ringBufferOverflows++;
-            } /* End ring buffer full */
-            else {
+            element.time = pasynUser->timestamp;
+            element.status = pasynUser->auxStatus;
+            element.alarmStatus = pasynUser->alarmStatus;
+            element.alarmSeverity = pasynUser->alarmSeverity;
+            /* If there is no room in the ring buffer asynRingBufferPush removes the oldest value
+             * and adds the new one, so the final value the record receives is the most recent value */
+            if (!asynRingBufferPush(pPvt->ringBuffer, &element)) {
                 /* We only need to request the record to process if we added a new
                  * element to the ring buffer, not if we just replaced an element. */
                 scanIoRequest(pPvt->ioScanPvt);
@@ -522,26 +551,25 @@ static void interruptCallbackAverage(void *drvPvt, asynUser *pasynUser,
 
 static int getCallbackValue(devPvt *pPvt)
 {
-    int ret = 0;
+    ringBufferElement element;
+    size_t overflows;
     static const char *functionName="getCallbackValue";
 
-    epicsMutexLock(pPvt->devPvtLock);
-    if (pPvt->ringTail != pPvt->ringHead) {
-        if (pPvt->ringBufferOverflows > 0) {
-            asynPrint(pPvt->pasynUser, ASYN_TRACE_WARNING,
-                "%s %s::%s warning, %d ring buffer overflows\n",
-                                    pPvt->pr->name, driverName, functionName,pPvt->ringBufferOverflows);
-            pPvt->ringBufferOverflows = 0;
-        }
-        pPvt->result = pPvt->ringBuffer[pPvt->ringTail];
-        pPvt->ringTail = (pPvt->ringTail==pPvt->ringSize) ? 0 : pPvt->ringTail+1;
-        asynPrint(pPvt->pasynUser, ASYN_TRACEIO_DEVICE,
-            "%s %s::%s from ringBuffer value=%f\n",
-                                            pPvt->pr->name, driverName, functionName, pPvt->result.value);
-        ret = 1;
+    if (!pPvt->ringBuffer || !asynRingBufferPop(pPvt->ringBuffer, &element)) return 0;
+    overflows = asynRingBufferOverflows(pPvt->ringBuffer);
+    if (overflows > 0) {
+        asynPrint(pPvt->pasynUser, ASYN_TRACE_WARNING,
+            "%s %s::%s warning, %lu ring buffer overflows\n",
+            pPvt->pr->name, driverName, functionName, (unsigned long)overflows);
     }
+    /* The ring buffer does not need devPvtLock, but result does */
+    epicsMutexLock(pPvt->devPvtLock);
+    pPvt->result = element;
     epicsMutexUnlock(pPvt->devPvtLock);
-    return ret;
+    asynPrint(pPvt->pasynUser, ASYN_TRACEIO_DEVICE,
+        "%s %s::%s from ringBuffer value=%f\n",
+        pPvt->pr->name, driverName, functionName, element.value);
+    return 1;
 }
 
 static void reportQueueRequestStatus(devPvt *pPvt, asynStatus status)
@@ -563,6 +591,25 @@ static void reportQueueRequestStatus(devPvt *pPvt, asynStatus status)
     }
 }
 
+static void queueRequestFailed(asynUser *pasynUser, asynStatus status)
+{
+    devPvt *pPvt = (devPvt *)pasynUser->userPvt;
+    dbCommon *pr = pPvt->pr;
+
+    epicsMutexLock(pPvt->devPvtLock);
+    reportQueueRequestStatus(pPvt, status);
+    epicsMutexUnlock(pPvt->devPvtLock);
+    if(pr->pact) callbackRequestProcessCallback(&pPvt->processCallback,pr->prio,pr);
+}
+
+static asynStatus queueRequest(devPvt *pPvt)
+{
+    if (pPvt->pbatch)
+        return asynBatchQueueRequest(pPvt->pbatch, pPvt->pasynUser,
+                                     asynQueuePriorityLow, queueRequestFailed);
+    return pasynManager->queueRequest(pPvt->pasynUser, 0, 0);
+}
+
 
 static long initAi(aiRecord *pai)
 {
@@ -580,7 +627,7 @@ static long processAi(aiRecord *pr)
 
     if (!getCallbackValue(pPvt) && !pr->pact) {
         if(pPvt->canBlock) pr->pact = 1;
-        status = pasynManager->queueRequest(pPvt->pasynUser, 0, 0);
+        status = queueRequest(pPvt);
         if((status==asynSuccess) && pPvt->canBlock) return 0;
         if(pPvt->canBlock) pr->pact = 0;
         reportQueueRequestStatus(pPvt, status);
@@ -658,7 +705,7 @@ static long processAo(aoRecord *pr)
             pPvt->asyncProcessingActive = 1;
         }
         epicsMutexUnlock(pPvt->devPvtLock);
-        status = pasynManager->queueRequest(pPvt->pasynUser, 0, 0);
+        status = queueRequest(pPvt);
         if((status==asynSuccess) && pPvt->canBlock) return 0;
         if(pPvt->canBlock) pr->pact = 0;
         epicsMutexLock(pPvt->devPvtLock);
@@ -27,6 +27,7 @@
 #include <link.h>
 #include <cantProceed.h>
 #include <epicsPrint.h>
+#include <epicsStdio.h>
 #include <epicsMutex.h>
 #include <epicsThread.h>
 #include <cantProceed.h>
@@ -87,11 +88,8 @@ typedef struct devPvt{
     epicsInt32        deviceLow;
     epicsInt32        deviceHigh;
     epicsMutexId      devPvtLock;
-    ringBufferElement *ringBuffer;
-    int               ringHead;
-    int               ringTail;
-    int               ringSize;
-    int               ringBufferOverflows;
+    asynRingBuffer    *ringBuffer;
+    asynAggregate     *paggregate;
     ringBufferElement result;
     asynStatus        lastStatus;
     interruptCallbackInt32 interruptCallback;
@@ -115,6 +113,7 @@ typedef struct devPvt{
     int               enumValues[MAX_ENUM_STATES];
     int               enumSeverities[MAX_ENUM_STATES];
     asynStatus        previousQueueRequestStatus;
+    struct asynBatch  *pbatch;
 }devPvt;
 
 static void setEnums(char *outStrings, int *outVals, epicsEnum16 *outSeverities,
@@ -125,6 +124,7 @@ static long createRingBuffer(dbCommon *pr);
 static long convertAi(aiRecord *pai, int pass);
 static long convertAo(aoRecord *pao, int pass);
 static void processCallbackInput(asynUser *pasynUser);
+static void coalesceCallbackInput(asynUser *pasynUser, asynUser *pasynUserRead);
 static void processCallbackOutput(asynUser *pasynUser);
 static void outputCallbackCallback(CALLBACK *pcb);
 static int  getCallbackValue(devPvt *pPvt);
@@ -260,6 +260,24 @@ static long initCommon(dbCommon *pr, DBLINK *plink,
                      pr->name, driverName, functionName, pasynUser->errorMessage);
         goto bad;
     }
+    pPvt->pbatch = asynBatchInit(pr, pasynUser);
+    /* info(asyn:AGGREGATE) only applies to the callbacks of input records. Output
+     * records ignore it, and the Average device support already averages the callbacks */
+    if (interruptCallback == interruptCallbackInput) {
+        status = asynAggregateInit(pr, &pPvt->paggregate);
+        if (status != asynSuccess) goto bad;
+    } else if (interruptCallback == interruptCallbackAverage &&
+               asynDbGetInfo(pr, "asyn:AGGREGATE")) {
+        printf("%s %s::%s asyn:AGGREGATE is not supported with Average device support\n",
+               pr->name, driverName, functionName);
+        goto bad;
+    }
+    if (processCallback == processCallbackInput && !pPvt->mask) {
+        const char *coalesceString = asynDbGetInfo(pr, "asyn:COALESCE");
+        if (coalesceString && atoi(coalesceString)) {
+            pasynManager->registerCoalesceCallback(pasynUser, asynInt32Type, coalesceCallbackInput);
+        }
+    }
     /*call drvUserCreate*/
     pasynInterface = pasynManager->findInterface(pasynUser,asynDrvUserType,1);
     if(pasynInterface && pPvt->userParam) {
@@ -357,10 +375,10 @@ static long createRingBuffer(dbCommon *pr)
     const char *sizeString;
  
     if (!pPvt->ringBuffer) {
-        pPvt->ringSize = DEFAULT_RING_BUFFER_SIZE;
+        int ringSize = DEFAULT_RING_BUFFER_SIZE;
         sizeString = asynDbGetInfo(pr, "asyn:FIFO");
-        if (sizeString) pPvt->ringSize = atoi(sizeString);
-        pPvt->ringBuffer = callocMustSucceed(pPvt->ringSize+1, sizeof *pPvt->ringBuffer, "devAsynInt32::createRingBuffer");
+        if (sizeString) ringSize = atoi(sizeString);
+        pPvt->ringBuffer = asynRingBufferCreate(ringSize, sizeof(ringBufferElement));
     }
     return asynSuccess;
 }
@@ -501,6 +519,34 @@ static void processCallbackInput(asynUser *pasynUser)
     if(pr->pact) callbackRequestProcessCallback(&pPvt->processCallback,pr->prio,pr);
 }
 
+static void coalesceCallbackInput(asynUser *pasynUser, asynUser *pasynUserRead)
+{
+    devPvt *pPvt = (devPvt *)pasynUser->userPvt;
+    devPvt *pPvtRead = (devPvt *)pasynUserRead->userPvt;
+    dbCommon *pr = pPvt->pr;
+    static const char *functionName="coalesceCallbackInput";
+
+    /* Another record with the same reason and address did the read */
+    epicsMutexLock(pPvtRead->devPvtLock);
+    pPvt->result = pPvtRead->result;
+    epicsMutexUnlock(pPvtRead->devPvtLock);
+    if (pPvt->result.status == asynSuccess) {
+        asynPrint(pasynUser, ASYN_TRACEIO_DEVICE,
+            "%s %s::%s process value=%d read by %s\n", pr->name, driverName, functionName,
+            pPvt->result.value, pPvtRead->pr->name);
+    } else {
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+            "%s", pasynUserRead->errorMessage);
+        if (pPvt->result.status != pPvt->lastStatus) {
+            asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                "%s %s::%s process read error %s\n",
+                pr->name, driverName, functionName, pasynUser->errorMessage);
+        }
+    }
+    pPvt->lastStatus = pPvt->result.status;
+    if(pr->pact) callbackRequestProcessCallback(&pPvt->processCallback,pr->prio,pr);
+}
+
 static void processCallbackOutput(asynUser *pasynUser)
 {
     devPvt *pPvt = (devPvt *)pasynUser->userPvt;
@@ -531,7 +577,7 @@ static void interruptCallbackInput(void *drvPvt, asynUser *pasynUser,
 {
     devPvt *pPvt = (devPvt *)drvPvt;
     dbCommon *pr = pPvt->pr;
-    ringBufferElement *rp;
+    ringBufferElement element;
     static const char *functionName="interruptCallbackInput";
 
     if (pPvt->mask) {
@@ -554,27 +600,25 @@ static void interruptCallbackInput(void *drvPvt, asynUser *pasynUser,
      * Instead we just return.  There will then be nothing in the ring buffer, so the first
      * read will do a read from the driver, which should be OK. */
     if (!interruptAccept) return;
-    epicsMutexLock(pPvt->devPvtLock);
-    rp = &pPvt->ringBuffer[pPvt->ringHead];
-    rp->value = value;
-    rp->time = pasynUser->timestamp;
-    rp->status = pasynUser->auxStatus;
-    rp->alarmStatus = pasynUser->alarmStatus;
-    rp->alarmSeverity = pasynUser->alarmSeverity;
-    pPvt->ringHead = (pPvt->ringHead==pPvt->ringSize) ? 0 : pPvt->ringHead+1;
-    if (pPvt->ringHead == pPvt->ringTail) {
-        /* There was no room in the ring buffer.  In the past we just threw away
-         * the new value.  However, it is better to remove the oldest value from the
-         * ring buffer and add the new one.  That way the final value the record receives
-         * is guaranteed to be the most recent value */
-        pPvt->ringTail = (pPvt->ringTail==pPvt->ringSize) ? 0 : pPvt->ringTail+1;
-        pPvt->ringBufferOverflows++;
-    } else {
+    /* With info(asyn:AGGREGATE) only the result of each window is passed to the record,
+     * callbacks with an error status are passed as they are */
+    if (pPvt->paggregate && pasynUser->auxStatus == asynSuccess) {
+        epicsInt64 aggregateValue = value;
+        if (!asynAggregateInt64(pPvt->paggregate, &aggregateValue)) return;
+        value = (epicsInt32)aggregateValue;
+    }
+    element.value = value;
+    element.time = pasynUser->timestamp;
+    element.status = pasynUser->auxStatus;
+    element.alarmStatus = pasynUser->alarmStatus;
+    element.alarmSeverity = pasynUser->alarmSeverity;
+    /* If there is no room in the ring buffer asynRingBufferPush removes the oldest value
+     * and adds the new one, so the final value the record receives is the most recent value */
+    if (!asynRingBufferPush(pPvt->ringBuffer, &element)) {
         /* We only need to request the record to process if we added a new
          * element to the ring buffer, not if we just replaced an element. */
         scanIoRequest(pPvt->ioScanPvt);
     }
-    epicsMutexUnlock(pPvt->devPvtLock);
 }
 
 static void interruptCallbackOutput(void *drvPvt, asynUser *pasynUser,
@@ -582,7 +626,7 @@ static void interruptCallbackOutput(void *drvPvt, asynUser *pasynUser,
 {
     devPvt *pPvt = (devPvt *)drvPvt;
     dbCommon *pr = pPvt->pr;
-    ringBufferElement *rp;
+    ringBufferElement element;
     static const char *functionName="interruptCallbackOutput";
 
     if (pPvt->mask) {
@@ -593,25 +637,21 @@ static void interruptCallbackOutput(void *drvPvt, asynUser *pasynUser,
         "%s %s::%s new value=%d\n",
         pr->name, driverName, functionName, value);
     if (!interruptAccept) return;
+    element.value = value;
+    element.time = pasynUser->timestamp;
+    element.status = pasynUser->auxStatus;
+    element.alarmStatus = pasynUser->alarmStatus;
+    element.alarmSeverity = pasynUser->alarmSeverity;
+    /* We only need to process the record if a new element was added to the ring buffer,
+     * not if the oldest element was replaced */
+    if (asynRingBufferPush(pPvt->ringBuffer, &element)) return;
     epicsMutexLock(pPvt->devPvtLock);
-    rp = &pPvt->ringBuffer[pPvt->ringHead];
-    rp->value = value;
-    rp->time = pasynUser->timestamp;
-    rp->status = pasynUser->auxStatus;
-    rp->alarmStatus = pasynUser->alarmStatus;
-    rp->alarmSeverity = pasynUser->alarmSeverity;
-    pPvt->ringHead = (pPvt->ringHead==pPvt->ringSize) ? 0 : pPvt->ringHead+1;
-    if (pPvt->ringHead == pPvt->ringTail) {
-        pPvt->ringTail = (pPvt->ringTail==pPvt->ringSize) ? 0 : pPvt->ringTail+1;
-        pPvt->ringBufferOverflows++;
+    /* If this callback was received during asynchronous record processing
+     * we must defer calling callbackRequest until end of record processing */
+    if (pPvt->asyncProcessingActive) {
+        pPvt->numDeferredOutputCallbacks++;
     } else {
-        /* If this callback was received during asynchronous record processing
-         * we must defer calling callbackRequest until end of record processing */
-        if (pPvt->asyncProcessingActive) {
-            pPvt->numDeferredOutputCallbacks++;
-        } else {
-            callbackRequest(&pPvt->outputCallback);
-        }
+        callbackRequest(&pPvt->outputCallback);
     }
     epicsMutexUnlock(pPvt->devPvtLock);
 }
@@ -649,7 +689,7 @@ static void interruptCallbackAverage(void *drvPvt, asynUser *pasynUser,
 {
     devPvt *pPvt = (devPvt *)drvPvt;
     aiRecord *pai = (aiRecord *)pPvt->pr;
-    ringBufferElement *rp;
+    ringBufferElement element;
     int numToAverage;
     static const char *functionName="interruptCallbackAverage";
 
@@ -675,26 +715,18 @@ static void interruptCallbackAverage(void *drvPvt, asynUser *pasynUser,
         if (numToAverage < 1) numToAverage = 1;
         if (pPvt->numAverage >= numToAverage) {
             double dval;
-            rp = &pPvt->ringBuffer[pPvt->ringHead];
             dval = pPvt->sum/pPvt->numAverage;
             dval += (pPvt->sum>0.0) ? 0.5 : -0.5;
-            rp->value = (epicsInt32)dval;
+            element.value = (epicsInt32)dval;
             pPvt->numAverage = 0;
             pPvt->sum = 0.;
-            rp->time = pasynUser->timestamp;
-            rp->status = pasynUser->auxStatus;
-            rp->alarmStatus = pasynUser->alarmStatus;
-            rp->alarmSeverity = pasynUser->alarmSeverity;
-            pPvt->ringHead = (pPvt->ringHead==pPvt->ringSize) ? 0 : pPvt->ringHead+1;
-            if (pPvt->ringHead == pPvt->ringTail) {
-                /* There was no room in the ring buffer.  In the past we just threw away
-                 * the new value.  However, it is better to remove the oldest value from the
-                 * ring buffer and add the new one.  That way the final value the record receives
-                 * is guaranteed to be the most recent value */
-                pPvt->ringTail = (pPvt->ringTail==pPvt->ringSize) ? 0 : pPvt->ringTail+1;
-                pPvt->ringBufferOverflows++;
-            } /* End ring buffer full */
-            else {
+            element.time = pasynUser->timestamp;
+            element.status = pasynUser->auxStatus;
+            element.alarmStatus = pasynUser->alarmStatus;
+            element.alarmSeverity = pasynUser->alarmSeverity;
+            /* If there is no room in the ring buffer asynRingBufferPush removes the oldest value
+             * and adds the new one, so the final value the record receives is the most recent value */
+            if (!asynRingBufferPush(pPvt->ringBuffer, &element)) {
                 /* We only need to request the record to process if we added a new
                  * element to the ring buffer, not if we just replaced an element. */
                 scanIoRequest(pPvt->ioScanPvt);
@@ -767,26 +799,25 @@ static void interruptCallbackEnumBo(void *drvPvt, asynUser *pasynUser,
 
 static int getCallbackValue(devPvt *pPvt)
 {
-    int ret = 0;
+    ringBufferElement element;
+    size_t overflows;
     static const char *functionName="getCallbackValue";
 
-    epicsMutexLock(pPvt->devPvtLock);
-    if (pPvt->ringTail != pPvt->ringHead) {
-        if (pPvt->ringBufferOverflows > 0) {
-            asynPrint(pPvt->pasynUser, ASYN_TRACE_WARNING,
-                "%s %s::%s warning, %d ring buffer overflows\n",
-                pPvt->pr->name, driverName, functionName, pPvt->ringBufferOverflows);
-            pPvt->ringBufferOverflows = 0;
-        }
-        pPvt->result = pPvt->ringBuffer[pPvt->ringTail];
-        pPvt->ringTail = (pPvt->ringTail==pPvt->ringSize) ? 0 : pPvt->ringTail+1;
-        asynPrint(pPvt->pasynUser, ASYN_TRACEIO_DEVICE,
-            "%s %s::%s from ringBuffer value=%d\n",
-            pPvt->pr->name, driverName, functionName,pPvt->result.value);
-        ret = 1;
+    if (!pPvt->ringBuffer || !asynRingBufferPop(pPvt->ringBuffer, &element)) return 0;
+    overflows = asynRingBufferOverflows(pPvt->ringBuffer);
+    if (overflows > 0) {
+        asynPrint(pPvt->pasynUser, ASYN_TRACE_WARNING,
+            "%s %s::%s warning, %lu ring buffer overflows\n",
+            pPvt->pr->name, driverName, functionName, (unsigned long)overflows);
     }
+    /* The ring buffer does not need devPvtLock, but result does */
+    epicsMutexLock(pPvt->devPvtLock);
+    pPvt->result = element;
     epicsMutexUnlock(pPvt->devPvtLock);
-    return ret;
+    asynPrint(pPvt->pasynUser, ASYN_TRACEIO_DEVICE,
+        "%s %s::%s from ringBuffer value=%d\n",
+        pPvt->pr->name, driverName, functionName,element.value);
+    return 1;
 }
 
 static void reportQueueRequestStatus(devPvt *pPvt, asynStatus status)
@@ -808,6 +839,25 @@ static void reportQueueRequestStatus(devPvt *pPvt, asynStatus status)
     }
 }
 
+static void queueRequestFailed(asynUser *pasynUser, asynStatus status)
+{
+    devPvt *pPvt = (devPvt *)pasynUser->userPvt;
+    dbCommon *pr = pPvt->pr;
+
+    epicsMutexLock(pPvt->devPvtLock);
+    reportQueueRequestStatus(pPvt, status);
+    epicsMutexUnlock(pPvt->devPvtLock);
+    if(pr->pact) callbackRequestProcessCallback(&pPvt->processCallback,pr->prio,pr);
+}
+
+static asynStatus queueRequest(devPvt *pPvt)
+{
+    if (pPvt->pbatch)
+        return asynBatchQueueRequest(pPvt->pbatch, pPvt->pasynUser,
+                                     asynQueuePriorityLow, queueRequestFailed);
+    return pasynManager->queueRequest(pPvt->pasynUser, 0, 0);
+}
+
 
 static long initAi(aiRecord *pr)
 {
@@ -835,7 +885,7 @@ static long processAi(aiRecord *pr)
 
     if(!getCallbackValue(pPvt) && !pr->pact) {
         if(pPvt->canBlock) pr->pact = 1;
-        status = pasynManager->queueRequest(pPvt->pasynUser, 0, 0);
+        status = queueRequest(pPvt);
         if((status==asynSuccess) && pPvt->canBlock) return 0;
         if(pPvt->canBlock) pr->pact = 0;
         reportQueueRequestStatus(pPvt, status);
@@ -1000,7 +1050,7 @@ static long processAo(aoRecord *pr)
             pPvt->asyncProcessingActive = 1;
         }
         epicsMutexUnlock(pPvt->devPvtLock);
-        status = pasynManager->queueRequest(pPvt->pasynUser, 0, 0);
+        status = queueRequest(pPvt);
         if((status==asynSuccess) && pPvt->canBlock) return 0;
         epicsMutexLock(pPvt->devPvtLock);
         if(pPvt->canBlock) pr->pact = 0;
@@ -1044,7 +1094,7 @@ static long processLi(longinRecord *pr)
 
     if(!getCallbackValue(pPvt) && !pr->pact) {
         if(pPvt->canBlock) pr->pact = 1;
-        status = pasynManager->queueRequest(pPvt->pasynUser, 0, 0);
+        status = queueRequest(pPvt);
         if((status==asynSuccess) && pPvt->canBlock) return 0;
         if(pPvt->canBlock) pr->pact = 0;
         reportQueueRequestStatus(pPvt, status);
@@ -1104,7 +1154,7 @@ static long processLo(longoutRecord *pr)
             pPvt->asyncProcessingActive = 1;
         }
         epicsMutexUnlock(pPvt->devPvtLock);
-        status = pasynManager->queueRequest(pPvt->pasynUser, 0, 0);
+        status = queueRequest(pPvt);
         if((status==asynSuccess) && pPvt->canBlock) return 0;
         if(pPvt->canBlock) pr->pact = 0;
         epicsMutexLock(pPvt->devPvtLock);
@@ -1148,7 +1198,7 @@ static long processBi(biRecord *pr)
 
     if(!getCallbackValue(pPvt) && !pr->pact) {
         if(pPvt->canBlock) pr->pact = 1;
-        status = pasynManager->queueRequest(pPvt->pasynUser, 0, 0);
+        status = queueRequest(pPvt);
         if((status==asynSuccess) && pPvt->canBlock) return 0;
         if(pPvt->canBlock) pr->pact = 0;
         reportQueueRequestStatus(pPvt, status);
@@ -1209,7 +1259,7 @@ static long processBo(boRecord *pr)
             pPvt->asyncProcessingActive = 1;
         }
         epicsMutexUnlock(pPvt->devPvtLock);
-        status = pasynManager->queueRequest(pPvt->pasynUser, 0, 0);
+        status = queueRequest(pPvt);
         if((status==asynSuccess) && pPvt->canBlock) return 0;
         if(pPvt->canBlock) pr->pact = 0;
         epicsMutexLock(pPvt->devPvtLock);
@@ -1255,7 +1305,7 @@ static long processMbbi(mbbiRecord *pr)
 
     if(!getCallbackValue(pPvt) && !pr->pact) {
         if(pPvt->canBlock) pr->pact = 1;
-        status = pasynManager->queueRequest(pPvt->pasynUser, 0, 0);
+        status = queueRequest(pPvt);
         if((status==asynSuccess) && pPvt->canBlock) return 0;
         if(pPvt->canBlock) pr->pact = 0;
         reportQueueRequestStatus(pPvt, status);
@@ -1337,7 +1387,7 @@ static long processMbbo(mbboRecord *pr)
             pPvt->asyncProcessingActive = 1;
         }
         epicsMutexUnlock(pPvt->devPvtLock);
-        status = pasynManager->queueRequest(pPvt->pasynUser, 0, 0);
+        status = queueRequest(pPvt);
         if((status==asynSuccess) && pPvt->canBlock) return 0;
         if(pPvt->canBlock) pr->pact = 0;
         epicsMutexLock(pPvt->devPvtLock);
@@ -38,6 +38,7 @@
 #include "asynDriver.h"
 #include "asynDrvUser.h"
 #include "asynEpicsUtils.h"
+#include "devEpicsPvt.h"
 #include "asynInt32.h"
 #include "devAsynXXXTimeSeries.h"
 
@@ -83,11 +83,8 @@ typedef struct devPvt{
     int               canBlock;
     epicsMutexId      devPvtLock;
     epicsUInt32        mask;
-    ringBufferElement *ringBuffer;
-    int               ringHead;
-    int               ringTail;
-    int               ringSize;
-    int               ringBufferOverflows;
+    asynRingBuffer    *ringBuffer;
+    asynAggregate     *paggregate;
     ringBufferElement result;
     asynStatus        lastStatus;
     interruptCallbackUInt32Digital interruptCallback;
@@ -104,6 +101,7 @@ typedef struct devPvt{
     int               enumValues[MAX_ENUM_STATES];
     int               enumSeverities[MAX_ENUM_STATES];
     asynStatus        previousQueueRequestStatus;
+    struct asynBatch  *pbatch;
 }devPvt;
 
 #define NUM_BITS 16
@@ -215,6 +213,12 @@ static long initCommon(dbCommon *pr, DBLINK *plink,
                      pr->name, driverName, functionName, pasynUser->errorMessage);
         goto bad;
     }
+    pPvt->pbatch = asynBatchInit(pr, pasynUser);
+    /* info(asyn:AGGREGATE) only applies to the callbacks of input records */
+    if (interruptCallback == interruptCallbackInput) {
+        status = asynAggregateInit(pr, &pPvt->paggregate);
+        if (status != asynSuccess) goto bad;
+    }
     /*call drvUserCreate*/
     pasynInterface = pasynManager->findInterface(pasynUser,asynDrvUserType,1);
     if(pasynInterface && pPvt->userParam) {
@@ -314,10 +318,10 @@ static long createRingBuffer(dbCommon *pr)
     const char *sizeString;
 
     if (!pPvt->ringBuffer) {
-        pPvt->ringSize = DEFAULT_RING_BUFFER_SIZE;
+        int ringSize = DEFAULT_RING_BUFFER_SIZE;
         sizeString = asynDbGetInfo(pr, "asyn:FIFO");
-        if (sizeString) pPvt->ringSize = atoi(sizeString);
-        pPvt->ringBuffer = callocMustSucceed(pPvt->ringSize+1, sizeof *pPvt->ringBuffer, "devAsynUInt32Digital::createRingBuffer");
+        if (sizeString) ringSize = atoi(sizeString);
+        pPvt->ringBuffer = asynRingBufferCreate(ringSize, sizeof(ringBufferElement));
     }
     return asynSuccess;
 }
@@ -439,7 +443,7 @@ static void interruptCallbackInput(void *drvPvt, asynUser *pasynUser,
 {
     devPvt *pPvt = (devPvt *)drvPvt;
     dbCommon *pr = pPvt->pr;
-    ringBufferElement *rp;
+    ringBufferElement element;
     static const char *functionName="interruptCallbackInput";
 
     asynPrint(pPvt->pasynUser, ASYN_TRACEIO_DEVICE,
@@ -458,27 +462,25 @@ static void interruptCallbackInput(void *drvPvt, asynUser *pasynUser,
      * Instead we just return.  There will then be nothing in the ring buffer, so the first
      * read will do a read from the driver, which should be OK. */
     if (!interruptAccept) return;
-    epicsMutexLock(pPvt->devPvtLock);
-    rp = &pPvt->ringBuffer[pPvt->ringHead];
-    rp->value = value;
-    rp->time = pasynUser->timestamp;
-    rp->status = pasynUser->auxStatus;
-    rp->alarmStatus = pasynUser->alarmStatus;
-    rp->alarmSeverity = pasynUser->alarmSeverity;
-    pPvt->ringHead = (pPvt->ringHead==pPvt->ringSize) ? 0 : pPvt->ringHead+1;
-    if (pPvt->ringHead == pPvt->ringTail) {
-        /* There was no room in the ring buffer.  In the past we just threw away
-         * the new value.  However, it is better to remove the oldest value from the
-         * ring buffer and add the new one.  That way the final value the record receives
-         * is guaranteed to be the most recent value */
-        pPvt->ringTail = (pPvt->ringTail==pPvt->ringSize) ? 0 : pPvt->ringTail+1;
-        pPvt->ringBufferOverflows++;
-    } else {
+    /* With info(asyn:AGGREGATE) only the result of each window is passed to the record,
+     * callbacks with an error status are passed as they are */
+    if (pPvt->paggregate && pasynUser->auxStatus == asynSuccess) {
+        epicsInt64 aggregateValue = value;
+        if (!asynAggregateInt64(pPvt->paggregate, &aggregateValue)) return;
+        value = (epicsUInt32)aggregateValue;
+    }
+    element.value = value;
+    element.time = pasynUser->timestamp;
+    element.status = pasynUser->auxStatus;
+    element.alarmStatus = pasynUser->alarmStatus;
+    element.alarmSeverity = pasynUser->alarmSeverity;
+    /* If there is no room in the ring buffer asynRingBufferPush removes the oldest value
+     * and adds the new one, so the final value the record receives is the most recent value */
+    if (!asynRingBufferPush(pPvt->ringBuffer, &element)) {
         /* We only need to request the record to process if we added a
          * new element to the ring buffer, not if we just replaced an element. */
         scanIoRequest(pPvt->ioScanPvt);
     }
-    epicsMutexUnlock(pPvt->devPvtLock);
 }
 
 static void interruptCallbackOutput(void *drvPvt, asynUser *pasynUser,
@@ -486,32 +488,28 @@ static void interruptCallbackOutput(void *drvPvt, asynUser *pasynUser,
 {
     devPvt *pPvt = (devPvt *)drvPvt;
     dbCommon *pr = pPvt->pr;
-    ringBufferElement *rp;
+    ringBufferElement element;
     static const char *functionName="interruptCallbackOutput";
 
     asynPrint(pPvt->pasynUser, ASYN_TRACEIO_DEVICE,
         "%s %s::%s new value=%u\n",
         pr->name, driverName, functionName, value);
     if (!interruptAccept) return;
+    element.value = value;
+    element.time = pasynUser->timestamp;
+    element.status = pasynUser->auxStatus;
+    element.alarmStatus = pasynUser->alarmStatus;
+    element.alarmSeverity = pasynUser->alarmSeverity;
+    /* We only need to process the record if a new element was added to the ring buffer,
+     * not if the oldest element was replaced */
+    if (asynRingBufferPush(pPvt->ringBuffer, &element)) return;
     epicsMutexLock(pPvt->devPvtLock);
-    rp = &pPvt->ringBuffer[pPvt->ringHead];
-    rp->value = value;
-    rp->time = pasynUser->timestamp;
-    rp->status = pasynUser->auxStatus;
-    rp->alarmStatus = pasynUser->alarmStatus;
-    rp->alarmSeverity = pasynUser->alarmSeverity;
-    pPvt->ringHead = (pPvt->ringHead==pPvt->ringSize) ? 0 : pPvt->ringHead+1;
-    if (pPvt->ringHead == pPvt->ringTail) {
-        pPvt->ringTail = (pPvt->ringTail==pPvt->ringSize) ? 0 : pPvt->ringTail+1;
-        pPvt->ringBufferOverflows++;
+    /* If this callback was received during asynchronous record processing
+     * we must defer calling callbackRequest until end of record processing */
+    if (pPvt->asyncProcessingActive) {
+        pPvt->numDeferredOutputCallbacks++;
     } else {
-        /* If this callback was received during asynchronous record processing
-         * we must defer calling callbackRequest until end of record processing */
-        if (pPvt->asyncProcessingActive) {
-            pPvt->numDeferredOutputCallbacks++;
-        } else {
-            callbackRequest(&pPvt->outputCallback);
-        }
+        callbackRequest(&pPvt->outputCallback);
     }
     epicsMutexUnlock(pPvt->devPvtLock);
 }
@@ -602,26 +600,25 @@ static void interruptCallbackEnumBo(void *drvPvt, asynUser *pasynUser,
 
 static int getCallbackValue(devPvt *pPvt)
 {
-    int ret = 0;
+    ringBufferElement element;
+    size_t overflows;
     static const char *functionName="getCallbackValue";
 
-    epicsMutexLock(pPvt->devPvtLock);
-    if (pPvt->ringTail != pPvt->ringHead) {
-        if (pPvt->ringBufferOverflows > 0) {
-            asynPrint(pPvt->pasynUser, ASYN_TRACE_WARNING,
-                "%s %s::%s warning, %d ring buffer overflows\n",
-                                    pPvt->pr->name, driverName, functionName, pPvt->ringBufferOverflows);
-            pPvt->ringBufferOverflows = 0;
-        }
-        pPvt->result = pPvt->ringBuffer[pPvt->ringTail];
-        pPvt->ringTail = (pPvt->ringTail==pPvt->ringSize) ? 0 : pPvt->ringTail+1;
-        asynPrint(pPvt->pasynUser, ASYN_TRACEIO_DEVICE,
-            "%s %s::%s from ringBuffer value=%d\n",
-                                            pPvt->pr->name, driverName, functionName,pPvt->result.value);
-        ret = 1;
+    if (!pPvt->ringBuffer || !asynRingBufferPop(pPvt->ringBuffer, &element)) return 0;
+    overflows = asynRingBufferOverflows(pPvt->ringBuffer);
+    if (overflows > 0) {
+        asynPrint(pPvt->pasynUser, ASYN_TRACE_WARNING,
+            "%s %s::%s warning, %lu ring buffer overflows\n",
+            pPvt->pr->name, driverName, functionName, (unsigned long)overflows);
     }
+    /* The ring buffer does not need devPvtLock, but result does */
+    epicsMutexLock(pPvt->devPvtLock);
+    pPvt->result = element;
     epicsMutexUnlock(pPvt->devPvtLock);
-    return ret;
+    asynPrint(pPvt->pasynUser, ASYN_TRACEIO_DEVICE,
+        "%s %s::%s from ringBuffer value=%d\n",
+        pPvt->pr->name, driverName, functionName,element.value);
+    return 1;
 }
 
 static int computeShift(epicsUInt32 mask)
@@ -654,6 +651,25 @@ static void reportQueueRequestStatus(devPvt *pPvt, asynStatus status)
     }
 }
 
+static void queueRequestFailed(asynUser *pasynUser, asynStatus status)
+{
+    devPvt *pPvt = (devPvt *)pasynUser->userPvt;
+    dbCommon *pr = pPvt->pr;
+
+    epicsMutexLock(pPvt->devPvtLock);
+    reportQueueRequestStatus(pPvt, status);
+    epicsMutexUnlock(pPvt->devPvtLock);
+    if(pr->pact) callbackRequestProcessCallback(&pPvt->processCallback,pr->prio,pr);
+}
+
+static asynStatus queueRequest(devPvt *pPvt)
+{
+    if (pPvt->pbatch)
+        return asynBatchQueueRequest(pPvt->pbatch, pPvt->pasynUser,
+                                     asynQueuePriorityLow, queueRequestFailed);
+    return pasynManager->queueRequest(pPvt->pasynUser, 0, 0);
+}
+
 
 static long initBi(biRecord *pr)
 {
@@ -675,7 +691,7 @@ static long processBi(biRecord *pr)
 
     if(!getCallbackValue(pPvt) && !pr->pact) {
         if(pPvt->canBlock) pr->pact = 1;
-        status = pasynManager->queueRequest(pPvt->pasynUser, 0, 0);
+        status = queueRequest(pPvt);
         if((status==asynSuccess) && pPvt->canBlock) return 0;
         if(pPvt->canBlock) pr->pact = 0;
         reportQueueRequestStatus(pPvt, status);
@@ -738,7 +754,7 @@ static long processBo(boRecord *pr)
             pPvt->asyncProcessingActive = 1;
         }
         epicsMutexUnlock(pPvt->devPvtLock);
-        status = pasynManager->queueRequest(pPvt->pasynUser, 0, 0);
+        status = queueRequest(pPvt);
         if((status==asynSuccess) && pPvt->canBlock) return 0;
         if(pPvt->canBlock) pr->pact = 0;
         epicsMutexLock(pPvt->devPvtLock);
@@ -782,7 +798,7 @@ static long processLi(longinRecord *pr)
 
     if(!getCallbackValue(pPvt) && !pr->pact) {
         if(pPvt->canBlock) pr->pact = 1;
-        status = pasynManager->queueRequest(pPvt->pasynUser, 0, 0);
+        status = queueRequest(pPvt);
         if((status==asynSuccess) && pPvt->canBlock) return 0;
         if(pPvt->canBlock) pr->pact = 0;
         reportQueueRequestStatus(pPvt, status);
@@ -842,7 +858,7 @@ static long processLo(longoutRecord *pr)
             pPvt->asyncProcessingActive = 1;
         }
         epicsMutexUnlock(pPvt->devPvtLock);
-        status = pasynManager->queueRequest(pPvt->pasynUser, 0, 0);
+        status = queueRequest(pPvt);
         if((status==asynSuccess) && pPvt->canBlock) return 0;
         if(pPvt->canBlock) pr->pact = 0;
         epicsMutexLock(pPvt->devPvtLock);
@@ -889,7 +905,7 @@ static long processMbbi(mbbiRecord *pr)
 
     if(!getCallbackValue(pPvt) && !pr->pact) {
         if(pPvt->canBlock) pr->pact = 1;
-        status = pasynManager->queueRequest(pPvt->pasynUser, 0, 0);
+        status = queueRequest(pPvt);
         if((status==asynSuccess) && pPvt->canBlock) return 0;
         if(pPvt->canBlock) pr->pact = 0;
         reportQueueRequestStatus(pPvt, status);
@@ -970,7 +986,7 @@ static long processMbbo(mbboRecord *pr)
             pPvt->asyncProcessingActive = 1;
         }
         epicsMutexUnlock(pPvt->devPvtLock);
-        status = pasynManager->queueRequest(pPvt->pasynUser, 0, 0);
+        status = queueRequest(pPvt);
         if((status==asynSuccess) && pPvt->canBlock) return 0;
         if(pPvt->canBlock) pr->pact = 0;
         epicsMutexLock(pPvt->devPvtLock);
@@ -1018,7 +1034,7 @@ static long processMbbiDirect(mbbiDirectRecord *pr)
 
     if(!getCallbackValue(pPvt) && !pr->pact) {
         if(pPvt->canBlock) pr->pact = 1;
-        status = pasynManager->queueRequest(pPvt->pasynUser, 0, 0);
+        status = queueRequest(pPvt);
         if((status==asynSuccess) && pPvt->canBlock) return 0;
         if(pPvt->canBlock) pr->pact = 0;
         reportQueueRequestStatus(pPvt, status);
@@ -1099,7 +1115,7 @@ static long processMbboDirect(mbboDirectRecord *pr)
             pPvt->asyncProcessingActive = 1;
         }
         epicsMutexUnlock(pPvt->devPvtLock);
-        status = pasynManager->queueRequest(pPvt->pasynUser, 0, 0);
+        status = queueRequest(pPvt);
         if((status==asynSuccess) && pPvt->canBlock) return 0;
         if(pPvt->canBlock) pr->pact = 0;
         epicsMutexLock(pPvt->devPvtLock);
@@ -30,6 +30,8 @@
 
 #include <epicsExport.h>
 #include <asynDriver.h>
+#include <asynArrayBuffer.h>
+#include <asynArrayConvert.h>
 #include <asynDrvUser.h>
 #include <asynEpicsUtils.h>
 #include <asynInt8Array.h>
@@ -58,6 +60,8 @@ class devAsynXXXArray
 private:
     struct ringBufferElement {
         EPICS_TYPE          *pValue;
+        EPICS_TYPE          *pArray;   /* Copy of the data when the driver did not post a shared buffer */
+        asynArrayBuffer     *pBuffer;  /* Shared buffer that pValue points into, or NULL */
         size_t              len;
         epicsTimeStamp      time;
         asynStatus          status;
@@ -83,6 +87,9 @@ private:
     int                 ringBufferOverflows_;
     ringBufferElement   result_;
     int                 gotValue_; /* For interruptCallbackInput */
+    asynArrayBuffer     *pendingBuffer_; /* Shared buffer to copy to the record when not using ring buffer */
+    EPICS_TYPE          *pendingValue_;
+    size_t              pendingLen_;
     INTERRUPT           interruptCallback_;
     char                *portName_;
     char                *userParam_;
@@ -91,6 +98,9 @@ private:
     int                 signedType_;
     int                 unsignedType_;
     asynStatus          previousQueueRequestStatus_;
+    asynArrayConvertFunc convertIn_;     /* Driver type to FTVL when they differ, else NULL */
+    asynArrayConvertFunc convertOut_;    /* FTVL to driver type when they differ, else NULL */
+    EPICS_TYPE          *convertBuffer_; /* Driver type array for read and write when converting */
 
 public:
 
@@ -106,11 +116,17 @@ public:
         ringSize_(0),
         ringBufferOverflows_(0),
         gotValue_(0),
+        pendingBuffer_(0),
+        pendingValue_(0),
+        pendingLen_(0),
         interruptCallback_(interruptCallback),
         interfaceType_(epicsStrDup(interfaceType)),
         signedType_(signedType),
         unsignedType_(unsignedType),
-        previousQueueRequestStatus_(asynSuccess)
+        previousQueueRequestStatus_(asynSuccess),
+        convertIn_(0),
+        convertOut_(0),
+        convertBuffer_(0)
     {
         int status;
         asynInterface *pasynInterface;
@@ -118,14 +134,24 @@ public:
         static const char *functionName = "devAsynXXXArray";
 
         pRecord_->dpvt = this;
+        result_.pBuffer = 0;
         pasynUser_ = pasynManager->createAsynUser(qrCallback, 0);
         pasynUser_->userPvt = this;
         ringBufferLock_ = epicsMutexCreate();
-        /* This device support only supports signed and unsigned versions of the EPICS data type  */
+        /* The signed and unsigned versions of the EPICS data type are copied.
+         * Other numeric field types are converted to and from the EPICS data type. */
         if ((pRecord_->ftvl != this->signedType_) && (pRecord_->ftvl != this->unsignedType_)) {
-            errlogPrintf("%s::%s, %s field type must be SIGNED_TYPE or UNSIGNED_TYPE\n",
-                         driverName, functionName, pRecord_->name);
-            goto bad;
+            int recordType = ftvlToArrayType(pRecord_->ftvl);
+            int driverType = ftvlToArrayType(this->signedType_);
+            if (recordType < 0) {
+                errlogPrintf("%s::%s, %s field type must be numeric\n",
+                             driverName, functionName, pRecord_->name);
+                goto bad;
+            }
+            convertIn_ = asynArrayConverter((asynArrayType)driverType, (asynArrayType)recordType);
+            convertOut_ = asynArrayConverter((asynArrayType)recordType, (asynArrayType)driverType);
+            convertBuffer_ = (EPICS_TYPE *)callocMustSucceed(pRecord_->nelm, sizeof(EPICS_TYPE),
+                                                            "devAsynXXXArray creating conversion array");
         }
         /* Parse the link to get addr and port */
         status = pasynEpicsUtils->parseLink(pasynUser_, plink,
@@ -192,6 +218,37 @@ public:
         pRecord_->pact=1;
     }
 
+    static int ftvlToArrayType(int ftvl)
+    {
+        switch (ftvl) {
+            case menuFtypeCHAR:   return asynArrayInt8;
+            case menuFtypeUCHAR:  return asynArrayUInt8;
+            case menuFtypeSHORT:  return asynArrayInt16;
+            case menuFtypeUSHORT: return asynArrayUInt16;
+            case menuFtypeLONG:   return asynArrayInt32;
+            case menuFtypeULONG:  return asynArrayUInt32;
+#ifdef HAVE_DEVINT64
+            case menuFtypeINT64:  return asynArrayInt64;
+            case menuFtypeUINT64: return asynArrayUInt64;
+#endif
+            case menuFtypeFLOAT:  return asynArrayFloat32;
+            case menuFtypeDOUBLE: return asynArrayFloat64;
+            default:              return -1;
+        }
+    }
+
+    /* Copy driver data to the record, converting to the field type if needed */
+    void copyToRecord(const EPICS_TYPE *value, size_t len)
+    {
+        if (convertIn_) {
+            convertIn_(value, pRecord_->bptr, len);
+        } else {
+            EPICS_TYPE *pData = (EPICS_TYPE *)pRecord_->bptr;
+            int i;
+            for (i=0; i<(int)len; i++) pData[i] = value[i];
+        }
+    }
+
     long createRingBuffer()
     {
         int status;
@@ -209,17 +266,12 @@ public:
             sizeString = dbGetInfo(pdbentry, "asyn:FIFO");
             if (sizeString) ringSize_ = atoi(sizeString);
             if (ringSize_ > 0) {
-                int i;
+                /* The array for each ring buffer element is allocated in interruptCallback
+                 * the first time it is needed.  Elements that only ever hold shared buffers
+                 * posted by the driver never need one. */
                 ringBuffer_ = (ringBufferElement *) callocMustSucceed(
                                   ringSize_, sizeof(*ringBuffer_),
                                   "devAsynXXXArray::createRingBuffer creating ring buffer");
-                /* Allocate array for each ring buffer element */
-                for (i=0; i<ringSize_; i++) {
-                    ringBuffer_[i].pValue =
-                        (EPICS_TYPE *)callocMustSucceed(
-                            pRecord_->nelm, sizeof(EPICS_TYPE),
-                            "devAsynXXXArray::createRingBuffer creating ring element array");
-                }
             }
         }
         return asynSuccess;
@@ -299,7 +351,14 @@ public:
         }
         if (newInputData) {
             if (ringSize_ == 0){
-                /* Data has already been copied to the record in interruptCallback */
+                /* Data has already been copied to the record in interruptCallback,
+                 * unless the driver posted a shared buffer, which is copied here */
+                if (pendingBuffer_) {
+                    copyToRecord(pendingValue_, pendingLen_);
+                    pRecord_->nord = (epicsUInt32)pendingLen_;
+                    asynArrayBufferRelease(pendingBuffer_);
+                    pendingBuffer_ = 0;
+                }
                 gotValue_--;
                 if (gotValue_) {
                     asynPrint(pasynUser_, ASYN_TRACE_WARNING,
@@ -309,22 +368,29 @@ public:
                 }
             } else {
                 /* Copy data from ring buffer */
-                EPICS_TYPE *pData = (EPICS_TYPE *)pRecord_->bptr;
                 ringBufferElement *rp = &result_;
-                int i;
                 /* Need to copy the array with the lock because that is shared even though
-                   result_ is a copy */
+                   result_ is a copy.  A shared buffer is not modified, and result_ now holds
+                   the reference to it, so it can be copied without the lock. */
                 if (rp->status == asynSuccess) {
-                    epicsMutexLock(ringBufferLock_);
-                    for (i=0; i<(int)rp->len; i++) pData[i] = rp->pValue[i];
-                    epicsMutexUnlock(ringBufferLock_);
+                    if (rp->pBuffer) {
+                        copyToRecord(rp->pValue, rp->len);
+                    } else {
+                        epicsMutexLock(ringBufferLock_);
+                        copyToRecord(rp->pValue, rp->len);
+                        epicsMutexUnlock(ringBufferLock_);
+                    }
                     pRecord_->nord = (epicsUInt32)rp->len;
                     asynPrintIO(pasynUser_, ASYN_TRACEIO_DEVICE,
-                        (char *)pRecord_->bptr, pRecord_->nord*sizeof(EPICS_TYPE),
+                        (char *)pRecord_->bptr, pRecord_->nord*dbValueSize(pRecord_->ftvl),
                         "%s %s::%s nord=%d, pRecord_->bptr data:",
                         pRecord_->name, driverName, driverName, pRecord_->nord);
                 }
                 pRecord_->time = rp->time;
+                if (rp->pBuffer) {
+                    asynArrayBufferRelease(rp->pBuffer);
+                    rp->pBuffer = 0;
+                }
             }
         }
         pasynEpicsUtils->asynStatusToEpicsAlarm(result_.status,
@@ -346,11 +412,18 @@ public:
         size_t nread;
 
         if (isOutput_) {
+            EPICS_TYPE *pData = (EPICS_TYPE *) pRecord_->bptr;
+            if (convertOut_) {
+                convertOut_(pRecord_->bptr, convertBuffer_, pRecord_->nord);
+                pData = convertBuffer_;
+            }
             result_.status = pInterface_->write(pInterfacePvt_, pasynUser_,
-                                                (EPICS_TYPE *) pRecord_->bptr, pRecord_->nord);
+                                                pData, pRecord_->nord);
         } else {
-            result_.status = pInterface_->read(pInterfacePvt_, pasynUser_, (EPICS_TYPE *) pRecord_->bptr,
+            EPICS_TYPE *pData = convertIn_ ? convertBuffer_ : (EPICS_TYPE *) pRecord_->bptr;
+            result_.status = pInterface_->read(pInterfacePvt_, pasynUser_, pData,
                                                pRecord_->nelm, &nread);
+            if (convertIn_ && (result_.status == asynSuccess)) convertIn_(convertBuffer_, pRecord_->bptr, nread);
         }
         result_.time = pasynUser_->timestamp;
         result_.alarmStatus = (epicsAlarmCondition) pasynUser_->alarmStatus;
@@ -387,6 +460,8 @@ public:
                 ringBufferOverflows_ = 0;
             }
             result_ = ringBuffer_[ringTail_];
+            /* The reference to a shared buffer now belongs to result_ */
+            ringBuffer_[ringTail_].pBuffer = 0;
             ringTail_ = (ringTail_ == ringSize_-1) ? 0 : ringTail_ + 1;
             ret = 1;
         }
@@ -397,7 +472,8 @@ public:
     void interruptCallback(asynUser *pasynUser, EPICS_TYPE *value, size_t len)
     {
         int i;
-        EPICS_TYPE *pData = (EPICS_TYPE *)pRecord_->bptr;
+        asynArrayBuffer *pBuffer = 0;
+        asynArrayBuffer *pOldBuffer;
         static const char *functionName = "interruptCallback";
 
         asynPrintIO(pasynUser_, ASYN_TRACEIO_DEVICE,
@@ -409,13 +485,24 @@ public:
          * read will do a read from the driver, which should be OK. */
         if (!interruptAccept) return;
 
+        /* If the driver posted the array in a shared buffer keep a reference to it
+         * rather than copying it here.  It is copied to the record once, when it is processed. */
+        if (pasynUser->auxStatus == asynSuccess) pBuffer = asynArrayBufferReservePosted(value);
         if (ringSize_ == 0) {
             /* Not using a ring buffer */
             dbScanLock((dbCommon *)pRecord_);
             if (len > pRecord_->nelm) len = pRecord_->nelm;
+            pOldBuffer = 0;
             if (pasynUser->auxStatus == asynSuccess) {
-                for (i=0; i<(int)len; i++) pData[i] = value[i];
-                pRecord_->nord = (epicsUInt32)len;
+                pOldBuffer = pendingBuffer_;
+                pendingBuffer_ = pBuffer;
+                if (pBuffer) {
+                    pendingValue_ = value;
+                    pendingLen_ = len;
+                } else {
+                    copyToRecord(value, len);
+                    pRecord_->nord = (epicsUInt32)len;
+                }
             }
             pRecord_->time = pasynUser->timestamp;
             result_.status = (asynStatus) pasynUser->auxStatus;
@@ -423,6 +510,7 @@ public:
             result_.alarmSeverity = (epicsAlarmSeverity) pasynUser->alarmSeverity;
             gotValue_++;
             dbScanUnlock((dbCommon *)pRecord_);
+            if (pOldBuffer) asynArrayBufferRelease(pOldBuffer);
             if (isOutput_)
                 scanOnce((dbCommon *)pRecord_);
             else
@@ -434,7 +522,20 @@ public:
             rp = &ringBuffer_[ringHead_];
             if (len > pRecord_->nelm) len = pRecord_->nelm;
             rp->len = len;
-            for (i=0; i<(int)len; i++) rp->pValue[i] = value[i];
+            /* Drop the reference held by an element that was discarded on overflow */
+            pOldBuffer = rp->pBuffer;
+            rp->pBuffer = pBuffer;
+            if (pBuffer) {
+                rp->pValue = value;
+            } else {
+                if (!rp->pArray) {
+                    rp->pArray = (EPICS_TYPE *)callocMustSucceed(
+                        pRecord_->nelm, sizeof(EPICS_TYPE),
+                        "devAsynXXXArray::interruptCallback creating ring element array");
+                }
+                rp->pValue = rp->pArray;
+                for (i=0; i<(int)len; i++) rp->pValue[i] = value[i];
+            }
             rp->time = pasynUser->timestamp;
             rp->status = (asynStatus) pasynUser->auxStatus;
             rp->alarmStatus = (epicsAlarmCondition) pasynUser->alarmStatus;
@@ -456,6 +557,7 @@ public:
                     scanIoRequest(ioScanPvt_);
             }
             epicsMutexUnlock(ringBufferLock_);
+            if (pOldBuffer) asynArrayBufferRelease(pOldBuffer);
         }
     }
 };
@@ -23,13 +23,10 @@ typedef struct devAsynWfPvt{ \
     void            *ifacePvt; \
     void            *registrarPvt; \
     CALLBACK        callback; \
-    int             busy; \
-    epicsUInt32     nord; \
     char            *portName; \
     char            *userParam; \
-    epicsMutexId    lock; \
     int             addr; \
-    asynStatus      status; \
+    asynTimeSeries  *pseries; \
 } devAsynWfPvt; \
  \
 static long initRecord(dbCommon *pr); \
@@ -61,11 +58,11 @@ static long initRecord(dbCommon *pr) \
     asynStatus status; \
     asynUser *pasynUser; \
     asynInterface *pasynInterface; \
+    const char *preTrigger; \
  \
     pPvt = callocMustSucceed(1, sizeof(*pPvt), "devAsynXXXTimerSeries::initRecord"); \
     pr->dpvt = pPvt; \
     pPvt->pr = pr; \
-    pPvt->lock = epicsMutexCreate(); \
     pasynUser = pasynManager->createAsynUser(0, 0); \
     pasynUser->userPvt = pPvt; \
     pPvt->pasynUser = pasynUser; \
@@ -114,6 +111,20 @@ static long initRecord(dbCommon *pr) \
     } \
     pPvt->pInterface = pasynInterface->pinterface; \
     pPvt->ifacePvt = pasynInterface->drvPvt; \
+    preTrigger = asynDbGetInfo(pr, "asyn:PRETRIGGER"); \
+    pPvt->pseries = asynTimeSeriesCreate(pwf->nelm, preTrigger ? atoi(preTrigger) : 0, \
+                                         sizeof(EPICS_TYPE)); \
+    /* With pre-trigger the callbacks are registered all the time */ \
+    if (asynTimeSeriesPreTrigger(pPvt->pseries) > 0) { \
+        status = pPvt->pInterface->registerInterruptUser( \
+           pPvt->ifacePvt, pPvt->pasynUser, \
+           interruptCallback, pPvt, &pPvt->registrarPvt); \
+        if(status!=asynSuccess) { \
+            errlogPrintf("%s::initCommon, %s registerInterruptUser failed %s\n", \
+                         driverName, pr->name, pasynUser->errorMessage); \
+            goto bad; \
+        } \
+    } \
     return 0; \
 bad: \
    pr->pact=1; \
@@ -125,37 +136,25 @@ static long process(dbCommon *pr) \
 { \
     devAsynWfPvt *pPvt = (devAsynWfPvt *)pr->dpvt; \
     waveformRecord *pwf = (waveformRecord *)pr; \
+    epicsUInt32 nord = pwf->nord; \
+    int preTrigger = asynTimeSeriesPreTrigger(pPvt->pseries); \
     int busy; \
     asynStatus status; \
     epicsAlarmCondition alarmStat; \
     epicsAlarmSeverity alarmSevr; \
  \
-    epicsMutexLock(pPvt->lock); \
-    busy = pPvt->busy; \
-    switch(pwf->rarm) { \
-      case 0: \
-        break; \
-      case 1: \
-        pPvt->nord = 0; \
-        busy = 1; \
-        memset(pwf->bptr, 0, pwf->nelm*sizeof(EPICS_TYPE)); \
-        break; \
-      case 2: \
-        busy = 0; \
-        break; \
-      case 3: \
-        busy = 1; \
-        break; \
-    } \
-    if (pwf->nord != pPvt->nord) { \
-      pwf->nord = pPvt->nord; \
+    /* Swap the blocks the callbacks write to and append the values to the waveform */ \
+    busy = asynTimeSeriesProcess(pPvt->pseries, pwf->rarm, pwf->bptr, &nord); \
+    if (pwf->nord != nord) { \
+      pwf->nord = nord; \
       db_post_events(pwf, &pwf->nord, DBE_VALUE | DBE_LOG); \
     } \
     if (pwf->busy != busy) { \
       pwf->busy = busy; \
       db_post_events(pwf, &pwf->busy, DBE_VALUE | DBE_LOG); \
-      /* BUSY has changed state so either register or cancel callbacks */ \
-      if (busy) { \
+      /* BUSY has changed state so either register or cancel callbacks, \
+       * except with pre-trigger, which needs them while BUSY=0 */ \
+      if (busy && !preTrigger) { \
         status = pPvt->pInterface->registerInterruptUser( \
            pPvt->ifacePvt, pPvt->pasynUser, \
            interruptCallback, pPvt, &pPvt->registrarPvt); \
@@ -165,7 +164,7 @@ static long process(dbCommon *pr) \
                 pr->name, driverName, pPvt->pasynUser->errorMessage); \
         } \
       } \
-      else {\
+      else if (!busy && !preTrigger) {\
         status = pPvt->pInterface->cancelInterruptUser( \
            pPvt->ifacePvt, pPvt->pasynUser, pPvt->registrarPvt); \
         if(status!=asynSuccess) { \
@@ -175,16 +174,14 @@ static long process(dbCommon *pr) \
         } \
       } \
     } \
-    pPvt->busy = pwf->busy; \
     pwf->rarm = 0; \
     pwf->udf = 0; \
-    if (pPvt->status != asynSuccess) { \
-        pasynEpicsUtils->asynStatusToEpicsAlarm(pPvt->status, READ_ALARM, &alarmStat, \
+    status = asynTimeSeriesStatus(pPvt->pseries); \
+    if (status != asynSuccess) { \
+        pasynEpicsUtils->asynStatusToEpicsAlarm(status, READ_ALARM, &alarmStat, \
                                                 INVALID_ALARM, &alarmSevr); \
         recGblSetSevr(pr, alarmStat, alarmSevr); \
     } \
-    epicsMutexUnlock(pPvt->lock); \
-    pPvt->status = asynSuccess; \
     return 0; \
 }  \
  \
@@ -192,25 +189,13 @@ static void interruptCallback(void *drvPvt, asynUser *pasynUser, EPICS_TYPE valu
 { \
     devAsynWfPvt *pPvt = (devAsynWfPvt *)drvPvt; \
     waveformRecord *pwf = (waveformRecord *)pPvt->pr; \
-    EPICS_TYPE *pData = (EPICS_TYPE *)pwf->bptr; \
  \
-    epicsMutexLock(pPvt->lock); \
     asynPrint(pPvt->pasynUser, ASYN_TRACEIO_DEVICE, \
-        "%s %s::interruptCallback, value=%f, nord=%d\n", \
-        pwf->name, driverName, (double)value, pPvt->nord); \
-    /* If we are not acquiring then nothing to do */  \
-    if (pPvt->busy) { \
-      if (pPvt->nord < pwf->nelm) { \
-        pData[pPvt->nord] = value; \
-        pPvt->nord++; \
-      } \
-      else { \
-        pPvt->busy = 0; \
-        /* When acquisition completes process record */ \
+        "%s %s::interruptCallback, value=%f\n", \
+        pwf->name, driverName, (double)value); \
+    /* The value is added without locking, when acquisition completes process record */ \
+    if (asynTimeSeriesAdd(pPvt->pseries, &value, pasynUser->auxStatus)) { \
         callbackRequestProcessCallback(&pPvt->callback,pwf->prio,pwf); \
-      } \
     } \
-    if (pPvt->status == asynSuccess) pPvt->status = pasynUser->auxStatus; \
-    epicsMutexUnlock(pPvt->lock); \
 } \
 
@@ -4,9 +4,27 @@
 * found in file LICENSE that is included with this distribution.
 ***********************************************************************/
 
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
 #include <epicsAssert.h>
+#include <ellLib.h>
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+#include <epicsThread.h>
+#include <epicsStdio.h>
+#include <errlog.h>
+#include <epicsString.h>
+#include <epicsTime.h>
+#include <cantProceed.h>
 
 #include <epicsVersion.h>
+/* The lock-free callback buffers need epicsAtomic, which is not available before 3.15 */
+#if EPICS_VERSION_INT >= VERSION_INT(3,15,0,0)
+#include <epicsAtomic.h>
+#define LOCK_FREE_CALLBACKS
+#endif
 #include <dbStaticLib.h>
 #include <dbAccess.h>
 
@@ -34,3 +52,727 @@ const char* asynDbGetInfo(struct dbCommon *prec, const char *infoname)
     dbFinishEntry(&ent);
     return ret;
 }
+
+typedef struct batchEntry {
+    asynUser          *pasynUser;
+    asynQueuePriority priority;
+    asynBatchFailed   failed;
+} batchEntry;
+
+typedef struct asynBatch {
+    ELLNODE      node;
+    const char   *portName;
+    epicsMutexId lock;
+    batchEntry   *pending;   /* Requests added since the last flush */
+    int          nPending;
+    int          pendingSize;
+    batchEntry   *flushing;  /* Requests being queued by the flush thread */
+    int          flushingSize;
+    asynUser     **ppasynUser;
+    int          userSize;
+} asynBatch;
+
+/* The requests of a batch are queued at most this long after the first of them
+ * was added, so that the other records of the same scan pass can add theirs */
+#define BATCH_HOLD_TIME 0.001
+
+static ELLLIST batchList = ELLLIST_INIT;
+static epicsMutexId batchListLock;
+static epicsEventId batchFlushEvent;
+static epicsThreadOnceId batchOnce = EPICS_THREAD_ONCE_INIT;
+
+static void batchFlushThread(void *arg);
+
+static void batchInitOnce(void *arg)
+{
+    batchListLock = epicsMutexMustCreate();
+    batchFlushEvent = epicsEventMustCreate(epicsEventEmpty);
+    /* Above the scan threads, so that a busy scan thread can not hold the batches */
+    epicsThreadMustCreate("asynBatch",epicsThreadPriorityScanHigh+1,
+        epicsThreadGetStackSize(epicsThreadStackSmall),
+        batchFlushThread,NULL);
+}
+
+static void batchFlush(asynBatch *pbatch)
+{
+    batchEntry *pentry;
+    asynStatus status;
+    int        nEntries,first,last,i,size;
+
+    epicsMutexMustLock(pbatch->lock);
+    pentry = pbatch->pending;
+    pbatch->pending = pbatch->flushing;
+    pbatch->flushing = pentry;
+    size = pbatch->pendingSize;
+    pbatch->pendingSize = pbatch->flushingSize;
+    pbatch->flushingSize = size;
+    nEntries = pbatch->nPending;
+    pbatch->nPending = 0;
+    epicsMutexUnlock(pbatch->lock);
+    if(nEntries==0) return;
+    if(nEntries>pbatch->userSize) {
+        free(pbatch->ppasynUser);
+        pbatch->userSize = pbatch->flushingSize;
+        pbatch->ppasynUser = callocMustSucceed(pbatch->userSize,sizeof(asynUser *),
+            "asynBatch::flush");
+    }
+    /* Queue each run of requests with the same priority in the order they were added */
+    for(first=0; first<nEntries; first=last) {
+        for(last=first; last<nEntries
+            && pentry[last].priority==pentry[first].priority; last++) {
+            pbatch->ppasynUser[last-first] = pentry[last].pasynUser;
+        }
+        status = pasynManager->queueRequests(pbatch->ppasynUser,last-first,
+            pentry[first].priority,0.0);
+        if(status==asynSuccess) continue;
+        /* Fall back to one at a time so that only the requests that fail are reported */
+        for(i=first; i<last; i++) {
+            status = pasynManager->queueRequest(pentry[i].pasynUser,
+                pentry[i].priority,0.0);
+            if(status!=asynSuccess) pentry[i].failed(pentry[i].pasynUser,status);
+        }
+    }
+}
+
+/* One thread flushes the batches of all the ports */
+static void batchFlushThread(void *arg)
+{
+    asynBatch *pbatch;
+
+    while(1) {
+        epicsEventMustWait(batchFlushEvent);
+        epicsThreadSleep(BATCH_HOLD_TIME);
+        epicsMutexMustLock(batchListLock);
+        pbatch = (asynBatch *)ellFirst(&batchList);
+        epicsMutexUnlock(batchListLock);
+        /* Batches are never removed, so only ellNext needs the lock */
+        while(pbatch) {
+            batchFlush(pbatch);
+            epicsMutexMustLock(batchListLock);
+            pbatch = (asynBatch *)ellNext(&pbatch->node);
+            epicsMutexUnlock(batchListLock);
+        }
+    }
+}
+
+asynBatch* asynBatchInit(struct dbCommon *prec, asynUser *pasynUser)
+{
+    const char *batchString;
+    const char *portName;
+    asynBatch  *pbatch;
+    int        canBlock = 0;
+
+    batchString = asynDbGetInfo(prec, "asyn:BATCH");
+    if(!batchString || atoi(batchString)==0) return NULL;
+    if(pasynManager->canBlock(pasynUser,&canBlock)!=asynSuccess || !canBlock) return NULL;
+    if(pasynManager->getPortName(pasynUser,&portName)!=asynSuccess) return NULL;
+    epicsThreadOnce(&batchOnce,batchInitOnce,NULL);
+    epicsMutexMustLock(batchListLock);
+    for(pbatch=(asynBatch *)ellFirst(&batchList); pbatch;
+        pbatch=(asynBatch *)ellNext(&pbatch->node)) {
+        if(strcmp(pbatch->portName,portName)==0) break;
+    }
+    if(!pbatch) {
+        pbatch = callocMustSucceed(1,sizeof(asynBatch),"asynBatchInit");
+        pbatch->portName = epicsStrDup(portName);
+        pbatch->lock = epicsMutexMustCreate();
+        ellAdd(&batchList,&pbatch->node);
+    }
+    epicsMutexUnlock(batchListLock);
+    return pbatch;
+}
+
+asynStatus asynBatchQueueRequest(asynBatch *pbatch, asynUser *pasynUser,
+                                 asynQueuePriority priority, asynBatchFailed failed)
+{
+    batchEntry *pentry;
+    int        wasEmpty;
+
+    epicsMutexMustLock(pbatch->lock);
+    if(pbatch->nPending==pbatch->pendingSize) {
+        pbatch->pendingSize = pbatch->pendingSize ? 2*pbatch->pendingSize : 16;
+        pbatch->pending = realloc(pbatch->pending,pbatch->pendingSize*sizeof(batchEntry));
+        if(!pbatch->pending) cantProceed("asynBatchQueueRequest: realloc failed\n");
+    }
+    wasEmpty = (pbatch->nPending==0);
+    pentry = &pbatch->pending[pbatch->nPending++];
+    pentry->pasynUser = pasynUser;
+    pentry->priority = priority;
+    pentry->failed = failed;
+    epicsMutexUnlock(pbatch->lock);
+    if(wasEmpty) epicsEventSignal(batchFlushEvent);
+    return asynSuccess;
+}
+
+/* The ring buffer is filled by the driver callbacks, which several threads can call
+ * for one record, e.g. a driver thread and a port thread, so asynRingBufferPush takes
+ * lock. It is then the only thread that changes head. Record processing pops from
+ * tail without the lock. When the ring is full the producer removes the oldest element
+ * by also advancing tail, so tail is changed with compare and swap. An element is
+ * copied out before tail is advanced, and the copy is discarded if the producer
+ * removed that element meanwhile. The producer only writes a slot once tail has moved
+ * past it, so a copy that is kept is never torn. */
+struct asynRingBuffer {
+    size_t       capacity;    /* Number of elements, from asyn:FIFO */
+    size_t       mask;        /* Number of slots - 1, the number of slots is a power of 2 */
+    size_t       elementSize;
+    size_t       head;        /* Next position to write */
+    size_t       tail;        /* Next position to read */
+    size_t       overflows;
+    epicsMutexId lock;        /* Taken by the producer, and with LOCK_FREE_CALLBACKS only by it */
+    char         *slots;
+};
+
+#define RING_SLOT(pring,pos) ((pring)->slots + ((pos) & (pring)->mask)*(pring)->elementSize)
+
+asynRingBuffer* asynRingBufferCreate(size_t capacity, size_t elementSize)
+{
+    asynRingBuffer *pring;
+    size_t nSlots = 1;
+
+    if (capacity < 1) capacity = 1;
+    while (nSlots < capacity) nSlots *= 2;
+    pring = callocMustSucceed(1, sizeof(asynRingBuffer), "asynRingBufferCreate");
+    pring->capacity = capacity;
+    pring->mask = nSlots - 1;
+    pring->elementSize = elementSize;
+    pring->slots = callocMustSucceed(nSlots, elementSize, "asynRingBufferCreate");
+    pring->lock = epicsMutexMustCreate();
+    return pring;
+}
+
+size_t asynRingBufferCapacity(asynRingBuffer *pring)
+{
+    return pring->capacity;
+}
+
+#ifdef LOCK_FREE_CALLBACKS
+
+int asynRingBufferPush(asynRingBuffer *pring, const void *pelement)
+{
+    size_t pos, tail;
+    int overflow = 0;
+
+    epicsMutexMustLock(pring->lock);
+    pos = pring->head;
+    tail = epicsAtomicGetSizeT(&pring->tail);
+    if (pos - tail >= pring->capacity) {
+        /* There was no room in the ring buffer. Remove the oldest element so that
+         * the most recent value is always kept. If this fails the consumer has
+         * just taken the oldest element, so there is now room. */
+        if (epicsAtomicCmpAndSwapSizeT(&pring->tail, tail, tail+1) == tail) {
+            epicsAtomicIncrSizeT(&pring->overflows);
+            overflow = 1;
+        }
+    }
+    memcpy(RING_SLOT(pring, pos), pelement, pring->elementSize);
+    epicsAtomicWriteMemoryBarrier();
+    epicsAtomicSetSizeT(&pring->head, pos+1);
+    epicsMutexUnlock(pring->lock);
+    return overflow;
+}
+
+int asynRingBufferPop(asynRingBuffer *pring, void *pelement)
+{
+    size_t tail;
+
+    for (;;) {
+        tail = epicsAtomicGetSizeT(&pring->tail);
+        if (tail == epicsAtomicGetSizeT(&pring->head)) return 0;
+        epicsAtomicReadMemoryBarrier();
+        if (pelement) memcpy(pelement, RING_SLOT(pring, tail), pring->elementSize);
+        if (epicsAtomicCmpAndSwapSizeT(&pring->tail, tail, tail+1) == tail) return 1;
+        /* The producer removed this element because the ring was full */
+    }
+}
+
+size_t asynRingBufferOverflows(asynRingBuffer *pring)
+{
+    size_t overflows = epicsAtomicGetSizeT(&pring->overflows);
+
+    /* Only subtract what was read, so overflows counted meanwhile are kept */
+    if (overflows) epicsAtomicSubSizeT(&pring->overflows, overflows);
+    return overflows;
+}
+
+#else /* LOCK_FREE_CALLBACKS */
+
+int asynRingBufferPush(asynRingBuffer *pring, const void *pelement)
+{
+    int overflow = 0;
+
+    epicsMutexMustLock(pring->lock);
+    if (pring->head - pring->tail == pring->capacity) {
+        pring->tail++;
+        pring->overflows++;
+        overflow = 1;
+    }
+    memcpy(RING_SLOT(pring, pring->head), pelement, pring->elementSize);
+    pring->head++;
+    epicsMutexUnlock(pring->lock);
+    return overflow;
+}
+
+int asynRingBufferPop(asynRingBuffer *pring, void *pelement)
+{
+    epicsMutexMustLock(pring->lock);
+    if (pring->tail == pring->head) {
+        epicsMutexUnlock(pring->lock);
+        return 0;
+    }
+    if (pelement) memcpy(pelement, RING_SLOT(pring, pring->tail), pring->elementSize);
+    pring->tail++;
+    epicsMutexUnlock(pring->lock);
+    return 1;
+}
+
+size_t asynRingBufferOverflows(asynRingBuffer *pring)
+{
+    size_t overflows;
+
+    epicsMutexMustLock(pring->lock);
+    overflows = pring->overflows;
+    pring->overflows = 0;
+    epicsMutexUnlock(pring->lock);
+    return overflows;
+}
+
+#endif /* LOCK_FREE_CALLBACKS */
+
+/* Aggregation of I/O Intr callback values, selected with info tags */
+typedef enum {
+    aggregateDecimate,
+    aggregateMin,
+    aggregateMax,
+    aggregateMean,
+    aggregateRMS
+} aggregateMode;
+
+static const char *aggregateModeNames[] = {"DECIMATE", "MIN", "MAX", "MEAN", "RMS"};
+
+struct asynAggregate {
+    epicsMutexId   lock;      /* Several threads can call back for one record */
+    aggregateMode  mode;
+    int            n;         /* Values per result, 0 if period is used */
+    double         period;    /* Seconds per result, 0 if n is used */
+    int            count;     /* Values in the current window */
+    epicsTimeStamp start;     /* Time of the first value in the current window */
+    double         sum;       /* Sum of the values for MEAN, of their squares for RMS */
+    double         dvalue;    /* Current value for DECIMATE, MIN and MAX */
+    epicsInt64     ivalue;
+};
+
+asynStatus asynAggregateInit(struct dbCommon *prec, asynAggregate **ppagg)
+{
+    const char    *modeString, *nString, *periodString;
+    char          *end;
+    asynAggregate *pagg;
+    int           mode;
+    long          n = 0;
+    double        period = 0.;
+
+    *ppagg = NULL;
+    modeString = asynDbGetInfo(prec, "asyn:AGGREGATE");
+    if (!modeString) return asynSuccess;
+    for (mode=aggregateDecimate; mode<=aggregateRMS; mode++) {
+        if (epicsStrCaseCmp(modeString, aggregateModeNames[mode]) == 0) break;
+    }
+    if (mode > aggregateRMS) {
+        errlogPrintf("%s asyn:AGGREGATE \"%s\" is not DECIMATE, MIN, MAX, MEAN or RMS\n",
+                     prec->name, modeString);
+        return asynError;
+    }
+    nString = asynDbGetInfo(prec, "asyn:AGGREGATE_N");
+    if (nString) {
+        n = strtol(nString, &end, 0);
+        if (end == nString || *end || n < 1) {
+            errlogPrintf("%s asyn:AGGREGATE_N \"%s\" is not a positive integer\n",
+                         prec->name, nString);
+            return asynError;
+        }
+    }
+    periodString = asynDbGetInfo(prec, "asyn:AGGREGATE_PERIOD");
+    if (periodString) {
+        period = strtod(periodString, &end);
+        if (end == periodString || *end || !(period > 0.)) {
+            errlogPrintf("%s asyn:AGGREGATE_PERIOD \"%s\" is not a positive number of seconds\n",
+                         prec->name, periodString);
+            return asynError;
+        }
+    }
+    if (!nString && !periodString) {
+        errlogPrintf("%s asyn:AGGREGATE needs asyn:AGGREGATE_N or asyn:AGGREGATE_PERIOD\n",
+                     prec->name);
+        return asynError;
+    }
+    pagg = callocMustSucceed(1, sizeof(asynAggregate), "asynAggregateInit");
+    pagg->lock = epicsMutexMustCreate();
+    pagg->mode = (aggregateMode)mode;
+    /* asyn:AGGREGATE_N takes precedence if both are given */
+    if (n >= 1) pagg->n = (int)n;
+    else pagg->period = period;
+    *ppagg = pagg;
+    return asynSuccess;
+}
+
+/* Adds value to the sums, and returns 1 if the window is now complete.
+ * Called with pagg->lock held. */
+static int aggregateAdd(asynAggregate *pagg, double value)
+{
+    epicsTimeStamp now;
+
+    if (pagg->count++ == 0) {
+        pagg->sum = 0.;
+        if (pagg->period > 0.) epicsTimeGetCurrent(&pagg->start);
+    }
+    if (pagg->mode == aggregateMean) pagg->sum += value;
+    else if (pagg->mode == aggregateRMS) pagg->sum += value*value;
+    if (pagg->n > 0) return pagg->count >= pagg->n;
+    epicsTimeGetCurrent(&now);
+    return epicsTimeDiffInSeconds(&now, &pagg->start) >= pagg->period;
+}
+
+/* Returns the MEAN or RMS of the window that is complete */
+static double aggregateResult(asynAggregate *pagg)
+{
+    double result = pagg->sum/pagg->count;
+
+    if (pagg->mode == aggregateRMS) result = sqrt(result);
+    pagg->count = 0;
+    return result;
+}
+
+int asynAggregateInt64(asynAggregate *pagg, epicsInt64 *pvalue)
+{
+    epicsInt64 value = *pvalue;
+    int first;
+    double result;
+
+    epicsMutexMustLock(pagg->lock);
+    first = (pagg->count == 0);
+    switch (pagg->mode) {
+    case aggregateDecimate:
+        pagg->ivalue = value;
+        break;
+    case aggregateMin:
+        if (first || value < pagg->ivalue) pagg->ivalue = value;
+        break;
+    case aggregateMax:
+        if (first || value > pagg->ivalue) pagg->ivalue = value;
+        break;
+    default:
+        break;
+    }
+    if (!aggregateAdd(pagg, (double)value)) {
+        epicsMutexUnlock(pagg->lock);
+        return 0;
+    }
+    if (pagg->mode == aggregateMean || pagg->mode == aggregateRMS) {
+        result = aggregateResult(pagg);
+        result += (result>0.0) ? 0.5 : -0.5;
+        *pvalue = (epicsInt64)result;
+    } else {
+        pagg->count = 0;
+        *pvalue = pagg->ivalue;
+    }
+    epicsMutexUnlock(pagg->lock);
+    return 1;
+}
+
+int asynAggregateFloat64(asynAggregate *pagg, epicsFloat64 *pvalue)
+{
+    epicsFloat64 value = *pvalue;
+    int first;
+
+    epicsMutexMustLock(pagg->lock);
+    first = (pagg->count == 0);
+    switch (pagg->mode) {
+    case aggregateDecimate:
+        pagg->dvalue = value;
+        break;
+    case aggregateMin:
+        if (first || value < pagg->dvalue) pagg->dvalue = value;
+        break;
+    case aggregateMax:
+        if (first || value > pagg->dvalue) pagg->dvalue = value;
+        break;
+    default:
+        break;
+    }
+    if (!aggregateAdd(pagg, value)) {
+        epicsMutexUnlock(pagg->lock);
+        return 0;
+    }
+    if (pagg->mode == aggregateMean || pagg->mode == aggregateRMS) {
+        *pvalue = aggregateResult(pagg);
+    } else {
+        pagg->count = 0;
+        *pvalue = pagg->dvalue;
+    }
+    epicsMutexUnlock(pagg->lock);
+    return 1;
+}
+
+/* Time series of callback values for asynXXXTimeSeries device support.
+ * The state word holds the number of values in the active block, which of the two
+ * blocks that is, whether acquisition is armed, and whether processing of the record
+ * has been requested. The driver callbacks, which several threads can call, add values
+ * with addLock held, so one callback at a time adds a value. It writes a value past the
+ * count and then advances the count with compare and swap, which fails if the record
+ * has swapped the blocks meanwhile. The record swaps the
+ * blocks with compare and swap, and then copies the values of the block it retired,
+ * which the callback no longer writes to. While acquisition is not armed the values
+ * go to a circular buffer of preTrigger+1 values, so that the last preTrigger of them
+ * can be copied without the one the callback may be writing. */
+#define TS_COUNT_BITS (sizeof(size_t)*8 - 3)
+#define TS_COUNT      (((size_t)1 << TS_COUNT_BITS) - 1)
+#define TS_REQUESTED  ((size_t)1 << TS_COUNT_BITS)
+#define TS_ARMED      ((size_t)1 << (TS_COUNT_BITS+1))
+#define TS_INDEX      ((size_t)1 << (TS_COUNT_BITS+2))
+
+struct asynTimeSeries {
+    size_t       nelm;
+    size_t       preTrigger;
+    size_t       elementSize;
+    size_t       state;
+    size_t       remaining;   /* Number of values that still fit in the waveform */
+    int          status;      /* First error status of the callbacks */
+    epicsMutexId addLock;     /* Taken by asynTimeSeriesAdd only */
+#ifndef LOCK_FREE_CALLBACKS
+    epicsMutexId lock;
+#endif
+    char         *blocks[2];  /* nelm values each */
+    char         *pre;        /* preTrigger+1 values */
+};
+
+#define TS_BLOCK(pts,state) ((pts)->blocks[((state) & TS_INDEX) ? 1 : 0])
+
+#ifdef LOCK_FREE_CALLBACKS
+
+#define tsGet(pts,ptarget) epicsAtomicGetSizeT(ptarget)
+#define tsCmpAndSwap(pts,ptarget,oldVal,newVal) epicsAtomicCmpAndSwapSizeT(ptarget,oldVal,newVal)
+#define tsGetStatus(pts) epicsAtomicGetIntT(&(pts)->status)
+#define tsCmpAndSwapStatus(pts,oldVal,newVal) epicsAtomicCmpAndSwapIntT(&(pts)->status,oldVal,newVal)
+#define tsWriteMemoryBarrier() epicsAtomicWriteMemoryBarrier()
+#define tsReadMemoryBarrier() epicsAtomicReadMemoryBarrier()
+
+#else /* LOCK_FREE_CALLBACKS */
+
+static size_t tsGet(asynTimeSeries *pts, size_t *ptarget)
+{
+    size_t value;
+
+    epicsMutexMustLock(pts->lock);
+    value = *ptarget;
+    epicsMutexUnlock(pts->lock);
+    return value;
+}
+
+static size_t tsCmpAndSwap(asynTimeSeries *pts, size_t *ptarget, size_t oldVal, size_t newVal)
+{
+    size_t value;
+
+    epicsMutexMustLock(pts->lock);
+    value = *ptarget;
+    if (value == oldVal) *ptarget = newVal;
+    epicsMutexUnlock(pts->lock);
+    return value;
+}
+
+static int tsGetStatus(asynTimeSeries *pts)
+{
+    int status;
+
+    epicsMutexMustLock(pts->lock);
+    status = pts->status;
+    epicsMutexUnlock(pts->lock);
+    return status;
+}
+
+static int tsCmpAndSwapStatus(asynTimeSeries *pts, int oldVal, int newVal)
+{
+    int status;
+
+    epicsMutexMustLock(pts->lock);
+    status = pts->status;
+    if (status == oldVal) pts->status = newVal;
+    epicsMutexUnlock(pts->lock);
+    return status;
+}
+
+#define tsWriteMemoryBarrier()
+#define tsReadMemoryBarrier()
+
+#endif /* LOCK_FREE_CALLBACKS */
+
+static void tsSetRemaining(asynTimeSeries *pts, size_t remaining)
+{
+    /* Compare and swap always succeeds here, it is used as it is a full memory barrier */
+    tsCmpAndSwap(pts, &pts->remaining, tsGet(pts, &pts->remaining), remaining);
+}
+
+/* Copies the n values before position count of a circular buffer of size values */
+static void tsCopyLast(asynTimeSeries *pts, char *pdst, const char *psrc,
+                       size_t count, size_t size, size_t n)
+{
+    size_t first, n1;
+
+    if (n == 0) return;
+    first = (count - n) % size;
+    n1 = size - first;
+    if (n1 > n) n1 = n;
+    memcpy(pdst, psrc + first*pts->elementSize, n1*pts->elementSize);
+    if (n > n1) memcpy(pdst + n1*pts->elementSize, psrc, (n-n1)*pts->elementSize);
+}
+
+asynTimeSeries* asynTimeSeriesCreate(size_t nelm, int preTrigger, size_t elementSize)
+{
+    asynTimeSeries *pts;
+
+    if (nelm < 1) nelm = 1;
+    if (preTrigger < 0) preTrigger = 0;
+    if ((size_t)preTrigger >= nelm) preTrigger = (int)(nelm - 1);
+    pts = callocMustSucceed(1, sizeof(asynTimeSeries), "asynTimeSeriesCreate");
+    pts->nelm = nelm;
+    pts->preTrigger = preTrigger;
+    pts->elementSize = elementSize;
+    pts->remaining = nelm;
+    pts->blocks[0] = callocMustSucceed(nelm, elementSize, "asynTimeSeriesCreate");
+    pts->blocks[1] = callocMustSucceed(nelm, elementSize, "asynTimeSeriesCreate");
+    if (preTrigger > 0)
+        pts->pre = callocMustSucceed(preTrigger+1, elementSize, "asynTimeSeriesCreate");
+    pts->addLock = epicsMutexMustCreate();
+#ifndef LOCK_FREE_CALLBACKS
+    pts->lock = epicsMutexMustCreate();
+#endif
+    return pts;
+}
+
+int asynTimeSeriesPreTrigger(asynTimeSeries *pts)
+{
+    return (int)pts->preTrigger;
+}
+
+/* asynTimeSeriesAdd with addLock held */
+static int tsAdd(asynTimeSeries *pts, const void *pvalue, asynStatus status)
+{
+    size_t state, count, next;
+    size_t period = pts->preTrigger + 1;
+    char *pslot;
+
+    if (status != asynSuccess) tsCmpAndSwapStatus(pts, asynSuccess, status);
+    for (;;) {
+        state = tsGet(pts, &pts->state);
+        count = state & TS_COUNT;
+        next = state + 1;
+        if (state & TS_ARMED) {
+            if (count >= tsGet(pts, &pts->remaining)) {
+                /* The waveform is full, processing was requested when it filled,
+                 * unless the record has swapped the blocks and reduced remaining */
+                tsReadMemoryBarrier();
+                if (tsGet(pts, &pts->state) == state) return 0;
+                continue;
+            }
+            pslot = TS_BLOCK(pts, state) + count*pts->elementSize;
+        } else if (pts->preTrigger > 0) {
+            pslot = pts->pre + (count % period)*pts->elementSize;
+            /* Once the buffer is full keep the count between period and 2*period */
+            if (count + 1 == 2*period) next -= period;
+        } else {
+            return 0;
+        }
+        memcpy(pslot, pvalue, pts->elementSize);
+        tsWriteMemoryBarrier();
+        if (tsCmpAndSwap(pts, &pts->state, state, next) == state) break;
+        /* The record swapped the blocks, so add the value to the new one */
+    }
+    if ((state & (TS_ARMED | TS_REQUESTED)) != TS_ARMED) return 0;
+    if (count + 1 < tsGet(pts, &pts->remaining)) return 0;
+    /* The waveform is now full. If this fails the record is being processed. */
+    return tsCmpAndSwap(pts, &pts->state, next, next | TS_REQUESTED) == next;
+}
+
+int asynTimeSeriesAdd(asynTimeSeries *pts, const void *pvalue, asynStatus status)
+{
+    int full;
+
+    epicsMutexMustLock(pts->addLock);
+    full = tsAdd(pts, pvalue, status);
+    epicsMutexUnlock(pts->addLock);
+    return full;
+}
+
+int asynTimeSeriesProcess(asynTimeSeries *pts, int rarm, void *pdata, epicsUInt32 *pnord)
+{
+    size_t state, next, count, n;
+    size_t nord = *pnord;
+    size_t elementSize = pts->elementSize;
+    char *pwf = (char *)pdata;
+    int armed, clear = 0;
+
+    state = tsGet(pts, &pts->state);
+    armed = (state & TS_ARMED) != 0;
+    switch (rarm) {
+    case 1:
+        memset(pwf, 0, pts->nelm*elementSize);
+        nord = 0;
+        armed = 1;
+        clear = 1;
+        break;
+    case 2:
+        armed = 0;
+        break;
+    case 3:
+        armed = 1;
+        break;
+    default:
+        break;
+    }
+    if (nord >= pts->nelm) armed = 0;
+    for (;;) {
+        /* While acquisition is not armed the callbacks only fill the pre-trigger buffer */
+        if (!armed && !(state & TS_ARMED)) break;
+        if (armed) tsSetRemaining(pts, pts->nelm - nord);
+        next = armed ? (TS_ARMED | (~state & TS_INDEX)) : 0;
+        if (tsCmpAndSwap(pts, &pts->state, state, next) != state) {
+            /* A value was added meanwhile */
+            state = tsGet(pts, &pts->state);
+            continue;
+        }
+        count = state & TS_COUNT;
+        if (clear) {
+            /* RARM=1, the waveform starts with the last preTrigger values */
+            n = (count < pts->preTrigger) ? count : pts->preTrigger;
+            if (state & TS_ARMED) tsCopyLast(pts, pwf, TS_BLOCK(pts, state), count, pts->nelm, n);
+            else tsCopyLast(pts, pwf, pts->pre, count, pts->preTrigger + 1, n);
+            clear = 0;
+        } else if (state & TS_ARMED) {
+            n = (count < pts->nelm - nord) ? count : pts->nelm - nord;
+            memcpy(pwf + nord*elementSize, TS_BLOCK(pts, state), n*elementSize);
+        } else {
+            n = 0;
+        }
+        nord += n;
+        if (!armed) break;
+        if (nord >= pts->nelm) {
+            /* The waveform is full, so disarm */
+            armed = 0;
+            state = tsGet(pts, &pts->state);
+            continue;
+        }
+        tsSetRemaining(pts, pts->nelm - nord);
+        state = tsGet(pts, &pts->state);
+        /* Values added before remaining was reduced may already fill the waveform */
+        if ((state & TS_COUNT) < pts->nelm - nord) break;
+    }
+    *pnord = (epicsUInt32)nord;
+    return armed;
+}
+
+asynStatus asynTimeSeriesStatus(asynTimeSeries *pts)
+{
+    int status = tsGetStatus(pts);
+
+    if (status != asynSuccess) tsCmpAndSwapStatus(pts, status, asynSuccess);
+    return (asynStatus)status;
+}
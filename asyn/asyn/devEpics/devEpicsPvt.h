@@ -7,14 +7,98 @@
 #ifndef DEVEPICSPVT_H
 #define DEVEPICSPVT_H
 
+#include <stddef.h>
+#include <asynDriver.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 struct dbCommon;
+struct asynBatch;
 
 const char* asynDbGetInfo(struct dbCommon *prec, const char *infoname);
 
+/* Batching of queueRequest for records with info(asyn:BATCH,"1").
+ * asynBatchInit returns NULL if the record does not ask for batching or the
+ * port cannot block, in which case pasynManager->queueRequest should be used.
+ * asynBatchQueueRequest adds the request to the batch for the port, which is
+ * queued with pasynManager->queueRequests by the flush thread shared by all
+ * ports, at most about 1 ms after the first request of the batch was added.
+ * If the request can not be queued the flush thread calls failed, with
+ * pasynUser->errorMessage describing the error. */
+typedef void (*asynBatchFailed)(asynUser *pasynUser, asynStatus status);
+
+struct asynBatch* asynBatchInit(struct dbCommon *prec, asynUser *pasynUser);
+asynStatus asynBatchQueueRequest(struct asynBatch *pbatch, asynUser *pasynUser,
+                                 asynQueuePriority priority, asynBatchFailed failed);
+
+/* Ring buffer of callback values for records with SCAN=I/O Intr.
+ * It holds capacity elements of elementSize bytes, normally the value of
+ * info(asyn:FIFO). asynRingBufferPush can be called by several threads. On
+ * EPICS 3.15 and later asynRingBufferPop does not take a lock, so record
+ * processing never waits for a callback.
+ * asynRingBufferPush removes the oldest element if the ring is full, so the
+ * most recent value is always kept, and returns 1 in that case.
+ * asynRingBufferPop returns 0 if the ring is empty. pelement may be NULL to
+ * discard the element.
+ * asynRingBufferOverflows returns the number of elements removed by
+ * asynRingBufferPush since it was last called. */
+typedef struct asynRingBuffer asynRingBuffer;
+
+asynRingBuffer* asynRingBufferCreate(size_t capacity, size_t elementSize);
+size_t asynRingBufferCapacity(asynRingBuffer *pring);
+int asynRingBufferPush(asynRingBuffer *pring, const void *pelement);
+int asynRingBufferPop(asynRingBuffer *pring, void *pelement);
+size_t asynRingBufferOverflows(asynRingBuffer *pring);
+
+/* Aggregation of the callback values of an input record with SCAN=I/O Intr, so
+ * that a high rate parameter processes the record at a lower rate. Selected with
+ *   info(asyn:AGGREGATE, "DECIMATE", "MIN", "MAX", "MEAN" or "RMS")
+ *   info(asyn:AGGREGATE_N, "100")        one result for every 100 callbacks, or
+ *   info(asyn:AGGREGATE_PERIOD, "0.1")   one result for every 0.1 second window
+ * asynAggregateInit sets *ppagg to NULL if the record does not ask for aggregation.
+ * It returns asynError, and reports with errlogPrintf, if the tags are not valid,
+ * and the record then fails init_record.
+ * asynAggregateInt64 and asynAggregateFloat64 add *pvalue to the current window.
+ * They return 0 if the window is not complete, and the callback value should be
+ * dropped. Otherwise they replace *pvalue with the result and return 1.
+ * The window of asyn:AGGREGATE_PERIOD ends with the first callback after the
+ * period, so a parameter that stops changing does not produce a result.
+ * Callbacks with an error status are not added to the window, the device
+ * support passes them to the record as they are. Several threads can call
+ * asynAggregateInt64 and asynAggregateFloat64 for one record, they take a lock.
+ * Only the device support of input records that use the I/O Intr callbacks calls
+ * asynAggregateInit, so the tags are ignored on output records. */
+typedef struct asynAggregate asynAggregate;
+
+asynStatus asynAggregateInit(struct dbCommon *prec, asynAggregate **ppagg);
+int asynAggregateInt64(asynAggregate *pagg, epicsInt64 *pvalue);
+int asynAggregateFloat64(asynAggregate *pagg, epicsFloat64 *pvalue);
+
+/* Acquisition of a time series of callback values into a waveform record, for
+ * asynXXXTimeSeries device support. The callbacks add values to one of two blocks
+ * of nelm values. asynTimeSeriesAdd can be called by several threads, it takes a
+ * lock that asynTimeSeriesProcess does not take on EPICS 3.15 and later. When the
+ * record processes asynTimeSeriesProcess swaps the blocks and appends the values of
+ * the retired block to the waveform, so the callbacks never wait for the record.
+ * With preTrigger > 0, normally from info(asyn:PRETRIGGER), the last preTrigger
+ * values are also kept while acquisition is not armed, and RARM=1 starts the
+ * waveform with them. preTrigger is limited to nelm-1.
+ * asynTimeSeriesAdd returns 1 when the waveform has become full, in which case
+ * the record should be processed.
+ * asynTimeSeriesProcess handles rarm as the waveform RARM field, updates *pnord
+ * and returns 1 if acquisition is armed, i.e. the new value of BUSY.
+ * asynTimeSeriesStatus returns the first error status passed to asynTimeSeriesAdd
+ * since it was last called. */
+typedef struct asynTimeSeries asynTimeSeries;
+
+asynTimeSeries* asynTimeSeriesCreate(size_t nelm, int preTrigger, size_t elementSize);
+int asynTimeSeriesPreTrigger(asynTimeSeries *pts);
+int asynTimeSeriesAdd(asynTimeSeries *pts, const void *pvalue, asynStatus status);
+int asynTimeSeriesProcess(asynTimeSeries *pts, int rarm, void *pdata, epicsUInt32 *pnord);
+asynStatus asynTimeSeriesStatus(asynTimeSeries *pts);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -34,6 +34,10 @@
  * the code as of version 1.29 should be used as the starting point.
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+# define _GNU_SOURCE    /* for recvmmsg() */
+#endif
+
 #include <string.h>
 #include <ctype.h>
 #include <stdio.h>
@@ -45,6 +49,7 @@
 #include <errlog.h>
 #include <iocsh.h>
 #include <epicsAssert.h>
+#include <epicsEvent.h>
 #include <epicsExit.h>
 #include <epicsStdio.h>
 #include <epicsString.h>
@@ -85,6 +90,24 @@
 # endif
 #endif
 
+/* readv() fills the caller's buffer and the receive buffer with one system call */
+#if !defined(_WIN32) && !defined(vxWorks) && !defined(__rtems__)
+# define USE_READV
+# include <sys/uio.h>
+#endif
+
+/* recvmmsg() fills the packet ring of a UDP socket with one system call */
+#if defined(__linux__)
+# define USE_RECVMMSG
+#endif
+
+/* The reactor mode, see drvAsynIPReactorConfigure, uses epoll */
+#if defined(__linux__) && EPICS_VERSION_INT >= VERSION_INT(3,15,0,0)
+# define USE_EPOLL
+# include <sys/epoll.h>
+# include <epicsAtomic.h>
+#endif
+
 /* If SO_REUSEPORT is not defined then use SO_REUSEADDR instead.
    It is not defined on RTEMS, Windows and older Linux versions. */
 #ifndef SO_REUSEPORT
@@ -99,6 +122,36 @@
 
 #define ISCOM_UNKNOWN (-1)
 
+/* Default size of the receive buffer of a TCP connection, see the rxBufferSize option */
+#define DEFAULT_RX_BUFFER_SIZE 4096
+
+/* Default packet ring of a multicast UDP port, see the rxPackets and rxPacketSize options */
+#define DEFAULT_RX_PACKETS 32
+#define DEFAULT_RX_PACKET_SIZE 9000
+
+/* Maximum number of events returned by one epoll_wait() of a reactor thread */
+#define REACTOR_MAX_EVENTS 64
+
+/* Time a reactor port waits before it lets asynManager start another shared thread */
+#define REACTOR_BLOCK_GRACE 0.001
+
+/*
+ * A datagram in the packet ring of a UDP socket
+ */
+typedef struct ipPacket {
+    char              *data;
+    size_t             len;
+    epicsTimeStamp     time;        /* Time the datagram was received by the kernel */
+    osiSockAddr        from;
+#ifdef USE_RECVMMSG
+    struct iovec       iov;
+    union {
+        struct cmsghdr hdr;
+        char           buf[CMSG_SPACE(sizeof(struct timespec))];
+    }                  control;
+#endif
+} ipPacket;
+
 /*
  * This structure holds the hardware-specific information for a single
  * asyn link.  There is one for each IP socket.
@@ -115,6 +168,25 @@ typedef struct {
     SOCKET             fd;
     unsigned long      nRead;
     unsigned long      nWritten;
+    char              *rxBuf;       /* Characters received on a SOCK_STREAM but not read yet */
+    size_t             rxBufSize;
+    size_t             rxHead;      /* Next character in rxBuf */
+    size_t             rxCount;     /* Number of characters in rxBuf from rxHead */
+    unsigned long      numRecvCalls;
+    unsigned long      numSendCalls;
+    unsigned long      numPollCalls;
+    unsigned long      numBufferedReads;
+    ipPacket          *rxRing;      /* Datagrams received on a SOCK_DGRAM but not read yet */
+    size_t             rxRingSize;  /* Number of packets in rxRing */
+    size_t             rxPacketSize;
+    size_t             rxRingHead;  /* Next packet in rxRing */
+    size_t             rxRingCount; /* Number of packets in rxRing from rxRingHead */
+#ifdef USE_RECVMMSG
+    struct mmsghdr    *rxMsgs;      /* One for each packet in rxRing */
+#endif
+    unsigned long      numPackets;
+    unsigned long      numTruncated;
+    struct in_addr     mcastIf;     /* Interface for the multicast group, INADDR_ANY for the default */
     union {
       osiSockAddr        oa;
 #if defined(HAS_AF_UNIX)
@@ -127,12 +199,35 @@ typedef struct {
     asynInterface      common;
     asynInterface      option;
     asynInterface      octet;
+    struct ipReactor  *preactor;    /* Reactor serving the socket, or NULL */
+    int                inReactor;   /* fd is registered with preactor */
+    int                ioCount;     /* Incremented by the reactor for each event on fd */
+    epicsEventId       ioEvent;     /* Signalled by the reactor for each event on fd */
 } ttyController_t;
 
+/*
+ * In reactor mode the TCP sockets are registered with one of a few threads
+ * waiting in epoll_wait(), which wake up the port reading or writing the socket.
+ * The port then does not need a thread of its own, and is registered with
+ * ASYN_SHAREDTHREAD, so the number of threads does not grow with the number of devices.
+ */
+typedef struct ipReactor {
+    int                index;
+    int                epfd;
+    unsigned long      numWakeups;
+    unsigned long      numEvents;
+} ipReactor;
+
+static ipReactor *reactors;
+static int numReactors;
+static int nextReactor;
+static int reactorEnabled;
+
 #define FLAG_BROADCAST                  0x1
 #define FLAG_CONNECT_PER_TRANSACTION    0x2
 #define FLAG_SHUTDOWN                   0x4
 #define FLAG_SO_REUSEPORT               0x8
+#define FLAG_MULTICAST                  0x10
 #define FLAG_NEED_LOOKUP                0x100
 #define FLAG_DONE_LOOKUP                0x200
 
@@ -199,6 +294,356 @@ static int setNonBlock(SOCKET fd, int nonBlockFlag)
     return 0;
 }
 
+/*
+ * recv() for a SOCK_STREAM.
+ * With a receive buffer, which must be empty, the characters that do not fit
+ * into data are kept in the buffer for the following reads.
+ */
+static int
+recvStream(ttyController_t *tty, char *data, size_t maxchars)
+{
+    int thisRead;
+
+    if (!tty->rxBuf && (tty->rxBufSize > 0))
+        tty->rxBuf = mallocMustSucceed(tty->rxBufSize, "drvAsynIPPort::recvStream");
+    tty->numRecvCalls++;
+    if (!tty->rxBuf)
+        return recv(tty->fd, data, (int)maxchars, 0);
+#ifdef USE_READV
+    {
+        struct iovec iov[2];
+        iov[0].iov_base = data;
+        iov[0].iov_len = maxchars;
+        iov[1].iov_base = tty->rxBuf;
+        iov[1].iov_len = tty->rxBufSize;
+        thisRead = (int)readv(tty->fd, iov, 2);
+        if (thisRead > (int)maxchars) {
+            tty->rxHead = 0;
+            tty->rxCount = thisRead - maxchars;
+            thisRead = (int)maxchars;
+        }
+    }
+#else
+    if (maxchars >= tty->rxBufSize)
+        return recv(tty->fd, data, (int)maxchars, 0);
+    thisRead = recv(tty->fd, tty->rxBuf, (int)tty->rxBufSize, 0);
+    if (thisRead > (int)maxchars) {
+        tty->rxHead = maxchars;
+        tty->rxCount = thisRead - maxchars;
+        thisRead = (int)maxchars;
+    }
+    if (thisRead > 0)
+        memcpy(data, tty->rxBuf, thisRead);
+#endif
+    return thisRead;
+}
+
+/*
+ * Free the packet ring, for example to change its size
+ */
+static void
+freeRing(ttyController_t *tty)
+{
+    if (tty->rxRing)
+        free(tty->rxRing[0].data);
+    free(tty->rxRing);
+    tty->rxRing = NULL;
+    tty->rxRingCount = 0;
+#ifdef USE_RECVMMSG
+    free(tty->rxMsgs);
+    tty->rxMsgs = NULL;
+#endif
+}
+
+/*
+ * Allocate the packet ring, rxRingSize packets of up to rxPacketSize characters
+ */
+static void
+allocRing(ttyController_t *tty)
+{
+    char *data;
+    size_t i;
+
+    tty->rxRing = (ipPacket *)callocMustSucceed(tty->rxRingSize, sizeof(ipPacket),
+                                                "drvAsynIPPort::allocRing");
+    data = (char *)mallocMustSucceed(tty->rxRingSize * tty->rxPacketSize,
+                                     "drvAsynIPPort::allocRing");
+#ifdef USE_RECVMMSG
+    tty->rxMsgs = (struct mmsghdr *)callocMustSucceed(tty->rxRingSize, sizeof(struct mmsghdr),
+                                                      "drvAsynIPPort::allocRing");
+#endif
+    for (i = 0; i < tty->rxRingSize; i++) {
+        ipPacket *pkt = &tty->rxRing[i];
+        pkt->data = data + i * tty->rxPacketSize;
+#ifdef USE_RECVMMSG
+        pkt->iov.iov_base = pkt->data;
+        pkt->iov.iov_len = tty->rxPacketSize;
+        tty->rxMsgs[i].msg_hdr.msg_name = &pkt->from.sa;
+        tty->rxMsgs[i].msg_hdr.msg_iov = &pkt->iov;
+        tty->rxMsgs[i].msg_hdr.msg_iovlen = 1;
+        tty->rxMsgs[i].msg_hdr.msg_control = pkt->control.buf;
+#endif
+    }
+}
+
+/*
+ * Receive the datagrams waiting on a SOCK_DGRAM into the empty packet ring.
+ * With recvmmsg() this is one system call for up to rxRingSize datagrams.
+ * Returns the number of datagrams received, or -1 like recvfrom().
+ */
+static int
+recvPackets(ttyController_t *tty)
+{
+    ipPacket *pkt;
+    epicsTimeStamp now;
+    int i, n;
+
+    if (!tty->rxRing)
+        allocRing(tty);
+    tty->rxRingHead = 0;
+    tty->numRecvCalls++;
+#ifdef USE_RECVMMSG
+    for (i = 0; i < (int)tty->rxRingSize; i++) {
+        struct msghdr *msg = &tty->rxMsgs[i].msg_hdr;
+        msg->msg_namelen = sizeof(tty->rxRing[i].from.ia);
+        msg->msg_controllen = sizeof(tty->rxRing[i].control);
+        msg->msg_flags = 0;
+    }
+    n = recvmmsg(tty->fd, tty->rxMsgs, (unsigned int)tty->rxRingSize, MSG_DONTWAIT, NULL);
+    if (n <= 0)
+        return -1;
+    epicsTimeGetCurrent(&now);
+    for (i = 0; i < n; i++) {
+        struct msghdr *msg = &tty->rxMsgs[i].msg_hdr;
+        struct cmsghdr *cmsg;
+        pkt = &tty->rxRing[i];
+        pkt->len = tty->rxMsgs[i].msg_len;
+        pkt->time = now;
+        if (msg->msg_flags & MSG_TRUNC)
+            tty->numTruncated++;
+        for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+#ifdef SO_TIMESTAMPNS
+            if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_TIMESTAMPNS))
+                epicsTimeFromTimespec(&pkt->time, (struct timespec *)CMSG_DATA(cmsg));
+#endif
+        }
+    }
+#else
+    for (n = 0; n < (int)tty->rxRingSize; n++) {
+        unsigned int addrlen;
+        pkt = &tty->rxRing[n];
+        addrlen = sizeof(pkt->from.ia);
+        i = recvfrom(tty->fd, pkt->data, (int)tty->rxPacketSize, 0, &pkt->from.sa, &addrlen);
+        if (i < 0)
+            break;
+        pkt->len = i;
+        epicsTimeGetCurrent(&now);
+        pkt->time = now;
+#ifndef USE_POLL
+        /* The socket blocks, so only the first recvfrom() is known to return */
+        n++;
+        break;
+#endif
+    }
+    if (n == 0)
+        return -1;
+#endif
+    tty->rxRingCount = n;
+    tty->numPackets += n;
+    return n;
+}
+
+/*
+ * Copy the next datagram from the packet ring into data, and set the time
+ * stamp of pasynUser to the time it was received.
+ * Like recvfrom() the characters that do not fit into data are discarded.
+ */
+static int
+readPacket(ttyController_t *tty, asynUser *pasynUser, char *data, size_t maxchars)
+{
+    ipPacket *pkt = &tty->rxRing[tty->rxRingHead++];
+    int thisRead = (int)(pkt->len < maxchars ? pkt->len : maxchars);
+
+    tty->rxRingCount--;
+    memcpy(data, pkt->data, thisRead);
+    pasynUser->timestamp = pkt->time;
+    pasynManager->setTimeStamp(pasynUser, &pkt->time);
+    if (pasynTrace->getTraceMask(pasynUser) & ASYN_TRACEIO_DRIVER) {
+        char inetBuff[32];
+        ipAddrToDottedIP(&pkt->from.ia, inetBuff, sizeof(inetBuff));
+        asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, data, thisRead,
+                  "%s (from %s) read %d\n",
+                  tty->IPDeviceName, inetBuff, thisRead);
+    }
+    tty->nRead += (unsigned long)thisRead;
+    return thisRead;
+}
+
+/*
+ * Join the multicast group of a "udpm" port on the interface mcastIf,
+ * which is also used to send to the group
+ */
+static int
+joinGroup(ttyController_t *tty, SOCKET fd)
+{
+    struct ip_mreq mreq;
+
+    mreq.imr_multiaddr = tty->farAddr.oa.ia.sin_addr;
+    mreq.imr_interface = tty->mcastIf;
+    if (setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, (void *)&tty->mcastIf, sizeof tty->mcastIf) < 0)
+        return -1;
+    return setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, (void *)&mreq, sizeof mreq);
+}
+
+static void
+leaveGroup(ttyController_t *tty, SOCKET fd)
+{
+    struct ip_mreq mreq;
+
+    mreq.imr_multiaddr = tty->farAddr.oa.ia.sin_addr;
+    mreq.imr_interface = tty->mcastIf;
+    setsockopt(fd, IPPROTO_IP, IP_DROP_MEMBERSHIP, (void *)&mreq, sizeof mreq);
+}
+
+#ifdef USE_EPOLL
+/*
+ * Reactor thread
+ * The sockets are registered edge triggered, so each event is only reported once
+ * and the port must read or write until EWOULDBLOCK before it waits again.
+ */
+static void
+reactorThread(void *arg)
+{
+    ipReactor *preactor = (ipReactor *)arg;
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+    int i, n;
+
+    for (;;) {
+        n = epoll_wait(preactor->epfd, events, REACTOR_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            errlogPrintf("drvAsynIPPort reactor %d: epoll_wait() failed: %s\n",
+                         preactor->index, strerror(errno));
+            return;
+        }
+        preactor->numWakeups++;
+        preactor->numEvents += n;
+        for (i = 0; i < n; i++) {
+            ttyController_t *tty = (ttyController_t *)events[i].data.ptr;
+            epicsAtomicIncrIntT(&tty->ioCount);
+            epicsEventSignal(tty->ioEvent);
+        }
+    }
+}
+
+static int
+reactorAdd(ttyController_t *tty, SOCKET fd)
+{
+    struct epoll_event event;
+
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = tty;
+    if (epoll_ctl(tty->preactor->epfd, EPOLL_CTL_ADD, fd, &event) < 0)
+        return -1;
+    tty->inReactor = 1;
+    return 0;
+}
+
+static void
+reactorRemove(ttyController_t *tty)
+{
+    struct epoll_event event;
+
+    if (!tty->inReactor) return;
+    epoll_ctl(tty->preactor->epfd, EPOLL_CTL_DEL, tty->fd, &event);
+    tty->inReactor = 0;
+}
+
+/*
+ * Wait until the reactor reports an event on the socket after ioCount was read.
+ * Waits forever if timeout < 0.
+ * Returns 0 if there was an event, -1 on timeout.
+ * A wait longer than REACTOR_BLOCK_GRACE is reported to asynManager, so that
+ * the other ports on the shared threads are not held up meanwhile.
+ */
+static int
+reactorWait(ttyController_t *tty, int ioCount, double timeout)
+{
+    epicsTimeStamp startTime, now;
+    double remaining = timeout;
+    int blocked = 0;
+    int status = 0;
+
+    if (timeout > 0)
+        epicsTimeGetCurrent(&startTime);
+    while (epicsAtomicGetIntT(&tty->ioCount) == ioCount) {
+        if (timeout >= 0 && remaining <= 0) {
+            status = -1;
+            break;
+        }
+        if (!blocked) {
+            double grace = REACTOR_BLOCK_GRACE;
+
+            if ((timeout >= 0) && (remaining < grace))
+                grace = remaining;
+            epicsEventWaitWithTimeout(tty->ioEvent, grace);
+            if (epicsAtomicGetIntT(&tty->ioCount) != ioCount)
+                break;
+            pasynManager->sharedThreadBlock(1);
+            blocked = 1;
+        }
+        else if (timeout < 0) {
+            epicsEventMustWait(tty->ioEvent);
+            continue;
+        }
+        else {
+            epicsEventWaitWithTimeout(tty->ioEvent, remaining);
+        }
+        if (timeout >= 0) {
+            epicsTimeGetCurrent(&now);
+            remaining = timeout - epicsTimeDiffInSeconds(&now, &startTime);
+        }
+    }
+    if (blocked)
+        pasynManager->sharedThreadBlock(0);
+    return status;
+}
+
+/*
+ * recv() for a socket served by a reactor.
+ * Replaces the poll() before recv(): the socket is read first, and only if
+ * there is nothing to read the port waits for the reactor.
+ * Returns the same as recv(), with errno EWOULDBLOCK on timeout.
+ */
+static int
+reactorRecv(ttyController_t *tty, char *data, size_t maxchars, double timeout)
+{
+    epicsTimeStamp startTime, now;
+    double remaining = timeout;
+    int ioCount;
+    int thisRead;
+    int timedOut = 0;
+
+    if (timeout > 0)
+        epicsTimeGetCurrent(&startTime);
+    for (;;) {
+        ioCount = epicsAtomicGetIntT(&tty->ioCount);
+        thisRead = recvStream(tty, data, maxchars);
+        if ((thisRead >= 0) || timedOut ||
+            ((SOCKERRNO != SOCK_EWOULDBLOCK) && (SOCKERRNO != SOCK_EINTR)))
+            return thisRead;
+        if (timeout > 0) {
+            epicsTimeGetCurrent(&now);
+            remaining = timeout - epicsTimeDiffInSeconds(&now, &startTime);
+            if (remaining < 0) remaining = 0;
+        }
+        /* After a timeout recv() is called once more, so errno is set by it */
+        if (reactorWait(tty, ioCount, remaining) < 0)
+            timedOut = 1;
+    }
+}
+#endif
+
 /*
  * Close a connection
  */
@@ -207,7 +652,12 @@ closeConnection(asynUser *pasynUser,ttyController_t *tty,const char *why)
 {
     asynPrint(pasynUser, ASYN_TRACE_FLOW,
               "Closing %s connection (fd %d): %s\n", tty->IPDeviceName, tty->fd, why);
+    tty->rxCount = 0;
+    tty->rxRingCount = 0;
     if (tty->fd != INVALID_SOCKET) {
+#ifdef USE_EPOLL
+        reactorRemove(tty);
+#endif
         epicsSocketDestroy(tty->fd);
         tty->fd = INVALID_SOCKET;
     }
@@ -235,6 +685,23 @@ asynCommonReport(void *drvPvt, FILE *fp, int details)
         fprintf(fp, "                    fd: %d\n", (int)tty->fd);
         fprintf(fp, "    Characters written: %lu\n", tty->nWritten);
         fprintf(fp, "       Characters read: %lu\n", tty->nRead);
+        fprintf(fp, "        Receive buffer: %lu bytes, %lu characters held\n",
+                (unsigned long)tty->rxBufSize, (unsigned long)tty->rxCount);
+        fprintf(fp, "          System calls: %lu recv, %lu send, %lu poll\n",
+                tty->numRecvCalls, tty->numSendCalls, tty->numPollCalls);
+        fprintf(fp, "     Reads from buffer: %lu\n", tty->numBufferedReads);
+        if (tty->socketType == SOCK_DGRAM) {
+            fprintf(fp, "           Packet ring: %lu packets of %lu bytes, %lu held\n",
+                    (unsigned long)tty->rxRingSize, (unsigned long)tty->rxPacketSize,
+                    (unsigned long)tty->rxRingCount);
+            fprintf(fp, "      Packets received: %lu, %lu truncated\n",
+                    tty->numPackets, tty->numTruncated);
+        }
+        if (tty->preactor) {
+            fprintf(fp, "               Reactor: %d, %lu events in %lu wakeups\n",
+                    tty->preactor->index, tty->preactor->numEvents, tty->preactor->numWakeups);
+            fprintf(fp, "         Socket events: %d\n", tty->ioCount);
+        }
     }
 }
 
@@ -256,6 +723,9 @@ cleanup (void *arg)
     if (tty->fd != INVALID_SOCKET) {
         asynPrint(tty->pasynUser, ASYN_TRACE_FLOW, "%s: shutting down socket\n", tty->portName);
         tty->flags |= FLAG_SHUTDOWN; /* prevent reconnect */
+#ifdef USE_EPOLL
+        reactorRemove(tty);
+#endif
         epicsSocketDestroy(tty->fd);
         tty->fd = INVALID_SOCKET;
         /* If this delay is not present then the sockets are not always really closed cleanly */
@@ -385,6 +855,17 @@ static int parseHostInfo(ttyController_t *tty, const char* hostInfo)
             tty->flags |= FLAG_BROADCAST;
             tty->flags |= FLAG_SO_REUSEPORT;
         }
+        else if (epicsStrCaseCmp(protocol, "udpm") == 0) {
+            tty->socketType = SOCK_DGRAM;
+            tty->flags |= FLAG_MULTICAST;
+            tty->flags |= FLAG_SO_REUSEPORT;
+            /* Receive the datagrams sent to the group port, unless localPort is given */
+            if (localPort < 0) {
+                tty->localAddr.ia.sin_family = AF_INET;
+                tty->localAddr.ia.sin_port = htons(port);
+                tty->localAddrSize = sizeof(tty->localAddr.ia);
+            }
+        }
         else {
             printf("%s: Unknown protocol \"%s\".\n", functionName, protocol);
             return -1;
@@ -491,6 +972,13 @@ connectIt(void *drvPvt, asynUser *pasynUser)
             tty->flags &= ~FLAG_NEED_LOOKUP;
             tty->flags |=  FLAG_DONE_LOOKUP;
         }
+        if ((tty->flags & FLAG_MULTICAST)
+         && !IN_MULTICAST(ntohl(tty->farAddr.oa.ia.sin_addr.s_addr))) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                        "\"%s\" is not a multicast address", tty->IPHostName);
+            epicsSocketDestroy(fd);
+            return asynError;
+        }
 
         /*
          * Bind to the local IP address if it was specified.
@@ -505,13 +993,29 @@ connectIt(void *drvPvt, asynUser *pasynUser)
             }
         }
 
+        /*
+         * Join the multicast group if so requested
+         */
+        if ((tty->flags & FLAG_MULTICAST) && (joinGroup(tty, fd) < 0)) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                          "Can't join %s multicast group: %s",
+                          tty->IPDeviceName, strerror(SOCKERRNO));
+            epicsSocketDestroy(fd);
+            return asynError;
+        }
+
         /*
          * Connect to the remote host
          * If the connect fails, arrange for another DNS lookup in case the
          * problem is just that the device has DHCP'd itself an new number.
          */
         if (tty->socketType != SOCK_DGRAM) {
-            if (connect(fd, &tty->farAddr.oa.sa, (int)tty->farAddrSize) < 0) {
+            int connectStatus;
+
+            pasynManager->sharedThreadBlock(1);
+            connectStatus = connect(fd, &tty->farAddr.oa.sa, (int)tty->farAddrSize);
+            pasynManager->sharedThreadBlock(0);
+            if (connectStatus < 0) {
                 epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
                               "Can't connect to %s: %s",
                               tty->IPDeviceName, strerror(SOCKERRNO));
@@ -541,6 +1045,21 @@ connectIt(void *drvPvt, asynUser *pasynUser)
         return asynError;
     }
 #endif
+#if defined(USE_RECVMMSG) && defined(SO_TIMESTAMPNS)
+    /* The time each datagram was received is returned by recvmmsg() */
+    i = 1;
+    if (tty->socketType == SOCK_DGRAM)
+        setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, (void *)&i, sizeof i);
+#endif
+#ifdef USE_EPOLL
+    if (tty->preactor && (tty->socketType == SOCK_STREAM) && (reactorAdd(tty, fd) < 0)) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                      "Can't add %s to reactor: %s",
+                      tty->IPDeviceName, strerror(errno));
+        epicsSocketDestroy(fd);
+        return asynError;
+    }
+#endif
 
     asynPrint(pasynUser, ASYN_TRACE_FLOW,
                           "Opened connection OK to %s\n", tty->IPDeviceName);
@@ -588,6 +1107,9 @@ static asynStatus writeIt(void *drvPvt, asynUser *pasynUser,
     epicsTimeStamp startTime;
     epicsTimeStamp endTime;
     int haveStartTime;
+#ifdef USE_EPOLL
+    int ioCount = 0;
+#endif
 
     assert(tty);
     asynPrint(pasynUser, ASYN_TRACE_FLOW,
@@ -631,19 +1153,26 @@ static asynStatus writeIt(void *drvPvt, asynUser *pasynUser,
     haveStartTime = 0;
     for (;;) {
 #ifdef USE_POLL
-        int pollstatus;
+        int pollstatus = 1;
         struct pollfd pollfd;
-        pollfd.fd = tty->fd;
-        pollfd.events = POLLOUT;
-        epicsTimeGetCurrent(&startTime);
-        while ((pollstatus = poll(&pollfd, 1, writePollmsec)) < 0) {
-            if (errno != EINTR) {
-                epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                                          "%s poll() failed: %s", tty->IPDeviceName, strerror(errno));
-                return asynError;
+#ifdef USE_EPOLL
+        /* With a reactor send() is tried first, see below */
+        if (!tty->inReactor)
+#endif
+        {
+            pollfd.fd = tty->fd;
+            pollfd.events = POLLOUT;
+            epicsTimeGetCurrent(&startTime);
+            tty->numPollCalls++;
+            while ((pollstatus = poll(&pollfd, 1, writePollmsec)) < 0) {
+                if (errno != EINTR) {
+                    epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                              "%s poll() failed: %s", tty->IPDeviceName, strerror(errno));
+                    return asynError;
+                }
+                epicsTimeGetCurrent(&endTime);
+                if (epicsTimeDiffInSeconds(&endTime, &startTime)*1000 > writePollmsec) break;
             }
-            epicsTimeGetCurrent(&endTime);
-            if (epicsTimeDiffInSeconds(&endTime, &startTime)*1000 > writePollmsec) break;
         }
         if (pollstatus == 0) {
             epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
@@ -652,6 +1181,11 @@ static asynStatus writeIt(void *drvPvt, asynUser *pasynUser,
         }
 #endif
         for (;;) {
+#ifdef USE_EPOLL
+            if (tty->inReactor)
+                ioCount = epicsAtomicGetIntT(&tty->ioCount);
+#endif
+            tty->numSendCalls++;
             if (tty->socketType == SOCK_DGRAM) {
                 thisWrite = sendto(tty->fd, (char *)data, (int)numchars, 0, &tty->farAddr.oa.sa, (int)tty->farAddrSize);
             } else {
@@ -672,6 +1206,11 @@ static asynStatus writeIt(void *drvPvt, asynUser *pasynUser,
                         break;
                     }
                 }
+#ifdef USE_EPOLL
+                if (tty->inReactor)
+                    reactorWait(tty, ioCount, SEND_RETRY_DELAY);
+                else
+#endif
                 epicsThreadSleep(SEND_RETRY_DELAY);
             } else break;
         }
@@ -738,6 +1277,32 @@ static asynStatus readIt(void *drvPvt, asynUser *pasynUser,
                   "%s maxchars %d. Why <=0?",tty->IPDeviceName,(int)maxchars);
         return asynError;
     }
+    if (tty->rxCount > 0) {
+        /* Characters received by a previous read, no system call needed */
+        thisRead = (int)(tty->rxCount < maxchars ? tty->rxCount : maxchars);
+        memcpy(data, tty->rxBuf + tty->rxHead, thisRead);
+        tty->rxHead += thisRead;
+        tty->rxCount -= thisRead;
+        tty->numBufferedReads++;
+        asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, data, thisRead,
+                    "%s read %d\n", tty->IPDeviceName, thisRead);
+        tty->nRead += (unsigned long)thisRead;
+        *nbytesTransfered = thisRead;
+        if (thisRead < (int) maxchars)
+            data[thisRead] = 0;
+        if (gotEom) *gotEom = (thisRead < (int) maxchars) ? 0 : ASYN_EOM_CNT;
+        return asynSuccess;
+    }
+    if (tty->rxRingCount > 0) {
+        /* Datagrams received by a previous read, no system call needed */
+        thisRead = readPacket(tty, pasynUser, data, maxchars);
+        tty->numBufferedReads++;
+        *nbytesTransfered = thisRead;
+        if (thisRead < (int) maxchars)
+            data[thisRead] = 0;
+        if (gotEom) *gotEom = (thisRead < (int) maxchars) ? 0 : ASYN_EOM_CNT;
+        return asynSuccess;
+    }
     readPollmsec = (int) (pasynUser->timeout * 1000.0);
     if (readPollmsec == 0) readPollmsec = 1;
     if (readPollmsec < 0) readPollmsec = -1;
@@ -756,11 +1321,16 @@ static asynStatus readIt(void *drvPvt, asynUser *pasynUser,
 #endif
     if (gotEom) *gotEom = 0;
 #ifdef USE_POLL
+#ifdef USE_EPOLL
+    /* With a reactor recv() is tried first, see reactorRecv() */
+    if (!tty->inReactor)
+#endif
     {
         struct pollfd pollfd;
         pollfd.fd = tty->fd;
         pollfd.events = POLLIN;
         epicsTimeGetCurrent(&startTime);
+        tty->numPollCalls++;
         while (poll(&pollfd, 1, readPollmsec) < 0) {
             if (errno != EINTR) {
                 epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
@@ -772,10 +1342,15 @@ static asynStatus readIt(void *drvPvt, asynUser *pasynUser,
         }
     }
 #endif
-    if (tty->socketType == SOCK_DGRAM) {
+    if ((tty->socketType == SOCK_DGRAM) && (tty->rxRingSize > 0)) {
+        thisRead = recvPackets(tty);
+        if (thisRead > 0)
+            thisRead = readPacket(tty, pasynUser, data, maxchars);
+    } else if (tty->socketType == SOCK_DGRAM) {
         /* We use recvfrom() for SOCK_DRAM so we can print the source address with ASYN_TRACEIO_DRIVER */
         osiSockAddr oa;
         unsigned int addrlen = sizeof(oa.ia);
+        tty->numRecvCalls++;
         thisRead = recvfrom(tty->fd, data, (int)maxchars, 0, &oa.sa, &addrlen);
         if (thisRead >= 0) {
             if (pasynTrace->getTraceMask(pasynUser) & ASYN_TRACEIO_DRIVER) {
@@ -788,7 +1363,12 @@ static asynStatus readIt(void *drvPvt, asynUser *pasynUser,
             tty->nRead += (unsigned long)thisRead;
         }
     } else {
-        thisRead = recv(tty->fd, data, (int)maxchars, 0);
+#ifdef USE_EPOLL
+        if (tty->inReactor)
+            thisRead = reactorRecv(tty, data, maxchars, readPollmsec / 1000.0);
+        else
+#endif
+        thisRead = recvStream(tty, data, maxchars);
         if (thisRead >= 0) {
             asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, data, thisRead,
                         "%s read %d\n", tty->IPDeviceName, thisRead);
@@ -843,6 +1423,12 @@ flushIt(void *drvPvt,asynUser *pasynUser)
 
     assert(tty);
     asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s flush\n", tty->IPDeviceName);
+    numTotal = (int)tty->rxCount;
+    tty->rxCount = 0;
+    while (tty->rxRingCount > 0) {
+        numTotal += (int)tty->rxRing[tty->rxRingHead++].len;
+        tty->rxRingCount--;
+    }
     if (tty->fd != INVALID_SOCKET) {
         /*
          * Toss characters until there are none left
@@ -851,6 +1437,7 @@ flushIt(void *drvPvt,asynUser *pasynUser)
         setNonBlock(tty->fd, 1);
 #endif
         while (1) {
+            tty->numRecvCalls++;
             numRecv = recv(tty->fd, cbuf, sizeof cbuf, 0);
             if (numRecv <= 0) break;
             numTotal += numRecv;
@@ -877,6 +1464,8 @@ ttyCleanup(ttyController_t *tty)
         free(tty->portName);
         free(tty->IPDeviceName);
         free(tty->IPHostName);
+        free(tty->rxBuf);
+        freeRing(tty);
         free(tty);
     }
 }
@@ -899,6 +1488,26 @@ getOption(void *drvPvt, asynUser *pasynUser,
     else if (epicsStrCaseCmp(key, "hostInfo") == 0) {
         l = epicsSnprintf(val, valSize, "%s", tty->IPDeviceName);
     }
+    else if (epicsStrCaseCmp(key, "rxBufferSize") == 0) {
+        l = epicsSnprintf(val, valSize, "%lu", (unsigned long)tty->rxBufSize);
+    }
+    else if (epicsStrCaseCmp(key, "rxPackets") == 0) {
+        l = epicsSnprintf(val, valSize, "%lu", (unsigned long)tty->rxRingSize);
+    }
+    else if (epicsStrCaseCmp(key, "rxPacketSize") == 0) {
+        l = epicsSnprintf(val, valSize, "%lu", (unsigned long)tty->rxPacketSize);
+    }
+    else if (epicsStrCaseCmp(key, "multicastInterface") == 0) {
+        struct sockaddr_in ia;
+        char inetBuff[32];
+        inetBuff[0] = '\0';
+        if (tty->mcastIf.s_addr != htonl(INADDR_ANY)) {
+            ia.sin_addr = tty->mcastIf;
+            ia.sin_port = 0;
+            ipAddrToDottedIP(&ia, inetBuff, sizeof(inetBuff));
+        }
+        l = epicsSnprintf(val, valSize, "%s", inetBuff);
+    }
     else {
         epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
                                                 "Unsupported key \"%s\"", key);
@@ -938,6 +1547,67 @@ setOption(void *drvPvt, asynUser *pasynUser, const char *key, const char *val)
         int status = parseHostInfo(tty, val);
         if (status) return asynError;
     }
+    else if (epicsStrCaseCmp(key, "rxBufferSize") == 0) {
+        int size;
+        if ((sscanf(val, "%d", &size) != 1) || (size < 0)) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                    "Invalid rxBufferSize value.");
+            return asynError;
+        }
+        if (tty->rxCount > 0) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                          "%s receive buffer holds %lu characters, read or flush them first",
+                          tty->IPDeviceName, (unsigned long)tty->rxCount);
+            return asynError;
+        }
+        free(tty->rxBuf);
+        tty->rxBuf = NULL;
+        tty->rxBufSize = size;
+    }
+    else if ((epicsStrCaseCmp(key, "rxPackets") == 0) ||
+             (epicsStrCaseCmp(key, "rxPacketSize") == 0)) {
+        int size;
+        int isPackets = (epicsStrCaseCmp(key, "rxPackets") == 0);
+        if ((sscanf(val, "%d", &size) != 1) || (size < (isPackets ? 0 : 1))) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                    "Invalid %s value.", key);
+            return asynError;
+        }
+        if (tty->rxRingCount > 0) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                          "%s packet ring holds %lu packets, read or flush them first",
+                          tty->IPDeviceName, (unsigned long)tty->rxRingCount);
+            return asynError;
+        }
+        freeRing(tty);
+        if (isPackets)
+            tty->rxRingSize = size;
+        else
+            tty->rxPacketSize = size;
+    }
+    else if (epicsStrCaseCmp(key, "multicastInterface") == 0) {
+        struct in_addr ifAddr;
+        if ((val[0] == '\0') || (strcmp(val, "0.0.0.0") == 0)) {
+            ifAddr.s_addr = htonl(INADDR_ANY);
+        }
+        else if (hostToIPAddr(val, &ifAddr) < 0) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                    "Invalid multicastInterface value.");
+            return asynError;
+        }
+        if ((tty->flags & FLAG_MULTICAST) && (tty->fd != INVALID_SOCKET)) {
+            /* Join the group again on the new interface */
+            leaveGroup(tty, tty->fd);
+            tty->mcastIf = ifAddr;
+            if (joinGroup(tty, tty->fd) < 0) {
+                epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                              "Can't join %s multicast group: %s",
+                              tty->IPDeviceName, strerror(SOCKERRNO));
+                return asynError;
+            }
+        }
+        tty->mcastIf = ifAddr;
+    }
     else if (epicsStrCaseCmp(key, "") != 0) {
         epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
                                                 "Unsupported key \"%s\"", key);
@@ -1005,6 +1675,9 @@ drvAsynIPPortConfigure(const char *portName,
     tty->portName = epicsStrDup(portName);
     tty->fd = INVALID_SOCKET;
     tty->isCom =  ISCOM_UNKNOWN;
+    tty->rxBufSize = DEFAULT_RX_BUFFER_SIZE;
+    tty->rxPacketSize = DEFAULT_RX_PACKET_SIZE;
+    tty->mcastIf.s_addr = htonl(INADDR_ANY);
 
     /*
      * Create socket from hostInfo
@@ -1014,6 +1687,16 @@ drvAsynIPPortConfigure(const char *portName,
         ttyCleanup(tty);
         return -1;
     }
+    if (tty->flags & FLAG_MULTICAST)
+        tty->rxRingSize = DEFAULT_RX_PACKETS;
+
+    /*
+     * TCP sockets are served by a reactor if drvAsynIPReactorConfigure was called
+     */
+    if (reactorEnabled && (tty->socketType == SOCK_STREAM)) {
+        tty->preactor = &reactors[nextReactor++ % numReactors];
+        tty->ioEvent = epicsEventMustCreate(epicsEventEmpty);
+    }
 
     /*
      *  Link with higher level routines
@@ -1026,7 +1709,7 @@ drvAsynIPPortConfigure(const char *portName,
     tty->option.pinterface  = (void *)&asynOptionMethods;
     tty->option.drvPvt = tty;
     if (pasynManager->registerPort(tty->portName,
-                                   ASYN_CANBLOCK,
+                                   ASYN_CANBLOCK | (tty->preactor ? ASYN_SHAREDTHREAD : 0),
                                    !noAutoConnect,
                                    priority,
                                    0) != asynSuccess) {
@@ -1079,6 +1762,65 @@ drvAsynIPPortConfigure(const char *portName,
     return 0;
 }
 
+/*
+ * Serve the TCP sockets of the ports configured after this with numThreads
+ * reactor threads, and call their queued requests from the shared threads of
+ * asynManager. numThreads 0 configures the following ports without a reactor.
+ */
+ASYN_API int
+drvAsynIPReactorConfigure(int numThreads)
+{
+#ifdef USE_EPOLL
+    int i;
+    char threadName[20];
+
+    if (numThreads <= 0) {
+        reactorEnabled = 0;
+        return 0;
+    }
+    if (reactors) {
+        if (numThreads != numReactors)
+            printf("drvAsynIPReactorConfigure: using the %d reactor threads already started\n",
+                   numReactors);
+        reactorEnabled = 1;
+        return 0;
+    }
+    if (osiSockAttach() == 0) {
+        printf("drvAsynIPReactorConfigure: osiSockAttach failed\n");
+        return -1;
+    }
+    reactors = (ipReactor *)callocMustSucceed(numThreads, sizeof(ipReactor),
+                                              "drvAsynIPReactorConfigure");
+    for (i = 0; i < numThreads; i++) {
+        reactors[i].index = i;
+        reactors[i].epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (reactors[i].epfd < 0) {
+            printf("drvAsynIPReactorConfigure: epoll_create1() failed: %s\n", strerror(errno));
+            break;
+        }
+        epicsSnprintf(threadName, sizeof(threadName), "ipReactor%d", i);
+        if (!epicsThreadCreate(threadName, epicsThreadPriorityHigh,
+                               epicsThreadGetStackSize(epicsThreadStackSmall),
+                               reactorThread, &reactors[i])) {
+            printf("drvAsynIPReactorConfigure: Can't create thread %s\n", threadName);
+            close(reactors[i].epfd);
+            break;
+        }
+    }
+    if (i == 0) {
+        free(reactors);
+        reactors = NULL;
+        return -1;
+    }
+    numReactors = i;
+    reactorEnabled = 1;
+    return 0;
+#else
+    printf("drvAsynIPReactorConfigure: not supported on this platform\n");
+    return -1;
+#endif
+}
+
 /*
  * IOC shell command registration
  */
@@ -1099,6 +1841,16 @@ static void drvAsynIPPortConfigureCallFunc(const iocshArgBuf *args)
                            args[3].ival, args[4].ival);
 }
 
+static const iocshArg drvAsynIPReactorConfigureArg0 = { "number of threads",iocshArgInt};
+static const iocshArg *drvAsynIPReactorConfigureArgs[] = {
+    &drvAsynIPReactorConfigureArg0};
+static const iocshFuncDef drvAsynIPReactorConfigureFuncDef =
+                      {"drvAsynIPReactorConfigure",1,drvAsynIPReactorConfigureArgs};
+static void drvAsynIPReactorConfigureCallFunc(const iocshArgBuf *args)
+{
+    drvAsynIPReactorConfigure(args[0].ival);
+}
+
 /*
  * This routine is called before multitasking has started, so there's
  * no race condition in the test/set of firstTime.
@@ -1109,6 +1861,7 @@ drvAsynIPPortRegisterCommands(void)
     static int firstTime = 1;
     if (firstTime) {
         iocshRegister(&drvAsynIPPortConfigureFuncDef,drvAsynIPPortConfigureCallFunc);
+        iocshRegister(&drvAsynIPReactorConfigureFuncDef,drvAsynIPReactorConfigureCallFunc);
         firstTime = 0;
     }
 }
@@ -24,6 +24,7 @@ ASYN_API int drvAsynIPPortConfigure(const char *portName,
                                           unsigned int priority,
                                           int noAutoConnect,
                                           int userFlags);
+ASYN_API int drvAsynIPReactorConfigure(int numThreads);
 
 #ifdef __cplusplus
 }
@@ -37,22 +37,53 @@
 #include "asynDriver.h"
 #include "asynInt32.h"
 #include "asynOctet.h"
+#include "asynOption.h"
 #include "asynCommonSyncIO.h"
 #include "asynInterposeEos.h"
 #include "drvAsynIPServerPort.h"
 #include "drvAsynIPPort.h"
 
+/* The readClients option waits for the clients with epoll */
+#if defined(__linux__)
+# define USE_EPOLL
+# include <sys/epoll.h>
+# include <poll.h>
+#endif
+
+/* The accept rate is measured over this many connections */
+#define ACCEPT_RATE_SAMPLES 64
+
+/* Maximum number of events returned by one epoll_wait() of the client reader */
+#define CLIENT_MAX_EVENTS 64
+
+/* Size of each read of a client with the readClients option */
+#define CLIENT_READ_SIZE 1024
+
+/* Longest message passed to the interrupt users with the readClients option */
+#define CLIENT_MESSAGE_SIZE 1024
+
 /* This structure holds the information for an IP port created by the listener */
 typedef struct {
     char               *portName;
     int                fd;
     asynUser          *pasynUser;
+    int                index;
+    struct ttyController *tty;
+    asynUser          *pasynUserRead;   /* Queued when the client has sent data */
+    asynOctet         *pasynOctet;
+    void              *octetPvt;
+    void              *interruptPvt;
+    asynOctet         *pasynOctetEos;   /* Top of the port, for the input EOS */
+    void              *octetEosPvt;
+    char              *message;         /* Characters received since the last input EOS */
+    size_t             messageLength;
+    unsigned long      numReads;
 } portList_t;
 
 /*
  * This structure holds the hardware-specific information for a single IP listener port.
  */
-typedef struct {
+typedef struct ttyController {
     asynUser          *pasynUser;
     unsigned int       portNumber;
     char              *portName;
@@ -67,6 +98,7 @@ typedef struct {
     asynInterface      common;
     asynInterface      int32;
     asynInterface      octet;
+    asynInterface      option;
     void               *octetCallbackPvt;
     portList_t         *portList;
     char               *IPDeviceName;
@@ -78,6 +110,14 @@ typedef struct {
     char               *UDPbuffer;
     int                UDPbufferSize;
     int                UDPbufferPos;
+    int                nextClient;          /* Where to start looking for a free port */
+    unsigned long      numAccepts;
+    unsigned long      numRejects;          /* Connections closed because all ports were in use */
+    epicsTimeStamp     acceptTimes[ACCEPT_RATE_SAMPLES];  /* Times of the last accepts */
+    double             peakAcceptRate;
+    int                readClients;     /* Read the clients when they send data, see readClients option */
+    int                epfd;            /* epoll of the clients for readClients */
+    unsigned long      numClientEvents;
 } ttyController_t;
 
 #define THEORETICAL_UDP_MAX_SIZE 65507
@@ -161,6 +201,161 @@ static void closeConnection(asynUser *pasynUser, ttyController_t *tty)
     }
 }
 
+/*
+ * Connections accepted per second over the last ACCEPT_RATE_SAMPLES connections
+ */
+static double acceptRate(ttyController_t *tty)
+{
+    unsigned long n = tty->numAccepts < ACCEPT_RATE_SAMPLES ? tty->numAccepts : ACCEPT_RATE_SAMPLES;
+    double span;
+
+    if (n < 2) return 0;
+    span = epicsTimeDiffInSeconds(&tty->acceptTimes[(tty->numAccepts - 1) % ACCEPT_RATE_SAMPLES],
+                                  &tty->acceptTimes[(tty->numAccepts - n) % ACCEPT_RATE_SAMPLES]);
+    return span > 0 ? (n - 1) / span : 0;
+}
+
+#ifdef USE_EPOLL
+/*
+ * Wait for the next data from a client.
+ * EPOLLONESHOT keeps the client out of the epoll until its read has run.
+ */
+static int armClient(ttyController_t *tty, portList_t *pl, int op)
+{
+    struct epoll_event ev;
+
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    ev.data.u32 = pl->index;
+    if ((epoll_ctl(tty->epfd, op, pl->fd, &ev) < 0) && (errno == EEXIST))
+        return epoll_ctl(tty->epfd, EPOLL_CTL_MOD, pl->fd, &ev);
+    return 0;
+}
+
+/*
+ * Pass the characters a client has sent to the asynOctet interrupt users of the
+ * client port, framed by the input EOS as if they were read through asynInterposeEos.
+ */
+static void clientMessage(asynUser *pasynUser, portList_t *pl, int eomReason)
+{
+    size_t length = pl->messageLength;
+
+    pl->message[length] = 0;
+    pl->messageLength = 0;
+    pasynOctetBase->callInterruptUsers(pasynUser, pl->interruptPvt,
+                                       pl->message, &length, &eomReason);
+}
+
+static void clientData(asynUser *pasynUser, portList_t *pl,
+                       const char *data, size_t numchars, const char *eos, int eosLen)
+{
+    while (numchars > 0) {
+        size_t room = CLIENT_MESSAGE_SIZE - pl->messageLength;
+        size_t n = numchars < room ? numchars : room;
+        const char *pend = memchr(data, eos[eosLen-1], n);
+
+        if (pend)
+            n = pend - data + 1;
+        memcpy(pl->message + pl->messageLength, data, n);
+        pl->messageLength += n;
+        data += n;
+        numchars -= n;
+        if (pend && (pl->messageLength >= (size_t)eosLen) &&
+            (memcmp(pl->message + pl->messageLength - eosLen, eos, eosLen) == 0)) {
+            pl->messageLength -= eosLen;
+            clientMessage(pasynUser, pl, ASYN_EOM_EOS);
+        } else if (pl->messageLength == CLIENT_MESSAGE_SIZE) {
+            clientMessage(pasynUser, pl, ASYN_EOM_CNT);
+        }
+    }
+}
+
+/*
+ * Read what a client has sent, queued by clientReader.
+ * The data goes to the asynOctet interrupt users of the client port, as with asynOctetBase.
+ * If the port has an input EOS they get one message at a time, otherwise the data as it was read.
+ */
+static void clientRead(asynUser *pasynUser)
+{
+    portList_t *pl = (portList_t *)pasynUser->userPvt;
+    char buffer[CLIENT_READ_SIZE];
+    char eos[2];
+    int eosLen = 0;
+    size_t nRead;
+    int eomReason;
+    int connected;
+    asynStatus status;
+    struct pollfd pollfd;
+
+    pl->numReads++;
+    if (pl->pasynOctetEos->getInputEos(pl->octetEosPvt, pasynUser,
+                                       eos, sizeof(eos), &eosLen) != asynSuccess)
+        eosLen = 0;
+    pollfd.fd = pl->fd;
+    pollfd.events = POLLIN;
+    do {
+        status = pl->pasynOctet->read(pl->octetPvt, pasynUser,
+                                      buffer, sizeof(buffer), &nRead, &eomReason);
+        if ((status == asynSuccess) && (nRead > 0)) {
+            if (eosLen > 0)
+                clientData(pasynUser, pl, buffer, nRead, eos, eosLen);
+            else
+                pasynOctetBase->callInterruptUsers(pasynUser, pl->interruptPvt,
+                                                   buffer, &nRead, &eomReason);
+        }
+        /* The driver keeps nothing back, see rxBufferSize in drvAsynIPServerPortConfigure,
+         * so the socket tells if there is more to read without waiting for it */
+    } while ((status == asynSuccess) && (nRead == sizeof(buffer)) &&
+             (poll(&pollfd, 1, 0) > 0));
+    pasynManager->isConnected(pl->pasynUser, &connected);
+    if (!connected) {
+        /* The rest of the last message */
+        if (pl->messageLength > 0)
+            clientMessage(pasynUser, pl, ASYN_EOM_END);
+        return;
+    }
+    /* The port is locked, so the listener can't give it a new connection before we rearm */
+    if (armClient(pl->tty, pl, EPOLL_CTL_MOD) < 0) {
+        asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                "drvAsynIPServerPort: %s can't wait for client: %s\n",
+                pl->portName, strerror(errno));
+    }
+}
+
+/*
+ * This is the thread that waits for data from all the clients when readClients is set.
+ * The reads are queued to the client ports, so they run on the port threads.
+ */
+static void clientReader(void *drvPvt)
+{
+    ttyController_t *tty = (ttyController_t *) drvPvt;
+    struct epoll_event events[CLIENT_MAX_EVENTS];
+    portList_t *pl;
+    asynStatus status;
+    int n, i;
+
+    while (1) {
+        n = epoll_wait(tty->epfd, events, CLIENT_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            asynPrint(tty->pasynUser, ASYN_TRACE_ERROR,
+                    "drvAsynIPServerPort: %s epoll_wait failed: %s\n",
+                    tty->portName, strerror(errno));
+            break;
+        }
+        for (i = 0; i < n; i++) {
+            tty->numClientEvents++;
+            pl = &tty->portList[events[i].data.u32];
+            status = pasynManager->queueRequest(pl->pasynUserRead, asynQueuePriorityLow, 0.0);
+            if (status != asynSuccess) {
+                asynPrint(tty->pasynUser, ASYN_TRACE_FLOW,
+                        "drvAsynIPServerPort: %s can't queue read: %s\n",
+                        pl->portName, pl->pasynUserRead->errorMessage);
+            }
+        }
+    }
+}
+#endif
+
 /*
  * Read from the UDP port
  */
@@ -250,6 +445,87 @@ static asynStatus writeIt(void *drvPvt, asynUser *pasynUser,
         const char *data, size_t numchars, size_t *nbytesTransfered) {
     return asynError;
 }
+
+/*
+ * asynOption methods
+ */
+static asynStatus
+getOption(void *drvPvt, asynUser *pasynUser,
+                              const char *key, char *val, int valSize)
+{
+    ttyController_t *tty = (ttyController_t *)drvPvt;
+    int l;
+
+    val[0] = '\0';
+    assert(tty);
+    if (epicsStrCaseCmp(key, "readClients") == 0) {
+        l = epicsSnprintf(val, valSize, "%c", tty->readClients ? 'Y' : 'N');
+    }
+    else {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                "Unsupported key \"%s\"", key);
+        return asynError;
+    }
+    if (l >= valSize) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                            "Value buffer for key '%s' is too small.", key);
+        return asynError;
+    }
+    return asynSuccess;
+}
+
+static asynStatus
+setOption(void *drvPvt, asynUser *pasynUser, const char *key, const char *val)
+{
+    ttyController_t *tty = (ttyController_t *)drvPvt;
+
+    assert(tty);
+    asynPrint(pasynUser, ASYN_TRACE_FLOW,
+                    "%s setOption key %s val %s\n", tty->portName, key, val);
+
+    if (epicsStrCaseCmp(key, "readClients") == 0) {
+        if (epicsStrCaseCmp(val, "N") == 0) {
+            tty->readClients = 0;
+            return asynSuccess;
+        }
+        if (epicsStrCaseCmp(val, "Y") != 0) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                    "Invalid readClients value.");
+            return asynError;
+        }
+#ifdef USE_EPOLL
+        if (tty->socketType == SOCK_DGRAM) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                    "readClients is only for TCP servers.");
+            return asynError;
+        }
+        if (tty->epfd < 0) {
+            if ((tty->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+                epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                              "Can't create epoll: %s", strerror(errno));
+                return asynError;
+            }
+            epicsThreadCreate("clientReader",
+                    epicsThreadPriorityHigh,
+                    epicsThreadGetStackSize(epicsThreadStackSmall),
+                    (EPICSTHREADFUNC) clientReader, tty);
+        }
+        tty->readClients = 1;
+#else
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                "readClients is not supported on this platform.");
+        return asynError;
+#endif
+    }
+    else if (epicsStrCaseCmp(key, "") != 0) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                "Unsupported key \"%s\"", key);
+        return asynError;
+    }
+    return asynSuccess;
+}
+static const struct asynOption asynOptionMethods = { setOption, getOption };
+
 /*Beginning of asynCommon methods*/
 
 /*
@@ -260,6 +536,8 @@ static void report(void *drvPvt, FILE *fp, int details)
     ttyController_t *tty = (ttyController_t *)drvPvt;
     portList_t *pl;
     int connected;
+    int nQueued;
+    int numConnected = 0, totalQueued = 0, maxQueued = 0;
     int i;
 
     assert(tty);
@@ -269,11 +547,27 @@ static void report(void *drvPvt, FILE *fp, int details)
     if (details >= 1) {
         fprintf(fp, "            fd: %d\n", tty->fd);
         fprintf(fp, "  Max. clients: %d\n", tty->maxClients);
+        if (tty->socketType != SOCK_DGRAM) {
+            fprintf(fp, "       Accepts: %lu, %lu rejected\n", tty->numAccepts, tty->numRejects);
+            fprintf(fp, "   Accept rate: %.1f/s over the last %d, peak %.1f/s\n",
+                    acceptRate(tty), ACCEPT_RATE_SAMPLES, tty->peakAcceptRate);
+        }
         for (i=0; i<tty->maxClients; i++) {
             pl = &tty->portList[i];
+            if (!pl->pasynUser) continue;
             pasynManager->isConnected(pl->pasynUser, &connected);
-            fprintf(fp, "    Client %d name:%s fd: %d connected:%d\n", i, pl->portName, pl->fd, connected);
+            pasynManager->getQueueDepth(pl->pasynUser, &nQueued);
+            numConnected += connected;
+            totalQueued += nQueued;
+            if (nQueued > maxQueued) maxQueued = nQueued;
+            if (details >= 2)
+                fprintf(fp, "    Client %d name:%s fd: %d connected:%d queued:%d reads:%lu\n",
+                        i, pl->portName, pl->fd, connected, nQueued, pl->numReads);
         }
+        fprintf(fp, "     Connected: %d\n", numConnected);
+        fprintf(fp, "Queued requests: %d, max. %d for one client\n", totalQueued, maxQueued);
+        if (tty->readClients)
+            fprintf(fp, "  Read clients: Y, %lu epoll events\n", tty->numClientEvents);
     }
 }
 
@@ -295,6 +589,7 @@ static void connectionListener(void *drvPvt)
     int i;
     portList_t *pl, *p;
     int connected;
+    double rate;
 
     /*
      * Sanity check
@@ -339,18 +634,28 @@ static void connectionListener(void *drvPvt)
                         tty->fd, strerror(errno));
                 continue;
             }
-            /* Search for a port which is disconnected */
+            epicsTimeGetCurrent(&tty->acceptTimes[tty->numAccepts % ACCEPT_RATE_SAMPLES]);
+            tty->numAccepts++;
+            rate = acceptRate(tty);
+            if ((tty->numAccepts >= ACCEPT_RATE_SAMPLES) && (rate > tty->peakAcceptRate))
+                tty->peakAcceptRate = rate;
+            /* Search for a port which is disconnected, starting after the last one used,
+             * so that with many clients the search does not step over all the ports in use */
             pl = NULL;
-            for (i = 0, p = &tty->portList[0]; i < tty->maxClients; i++, p++) {
+            for (i = 0; i < tty->maxClients; i++) {
+                p = &tty->portList[(tty->nextClient + i) % tty->maxClients];
+                if (!p->pasynUser) continue;
                 pasynManager->isConnected(p->pasynUser, &connected);
                 if (!connected) {
                     pl = p;
+                    tty->nextClient = (tty->nextClient + i + 1) % tty->maxClients;
                     break;
                 }
             }
             if (pl == NULL) {
                 asynPrint(pasynUser, ASYN_TRACE_ERROR,
                     "drvAsynIPServerPort: %s: too many clients\n", tty->portName);
+                tty->numRejects++;
                 epicsSocketDestroy(clientFd);
                 continue;
             }
@@ -381,6 +686,15 @@ static void connectionListener(void *drvPvt)
                 pnode = (interruptNode *) ellNext(&pnode->node);
             }
             pasynManager->interruptEnd(tty->octetCallbackPvt);
+#ifdef USE_EPOLL
+            /* Only now, so that the callbacks could register for the data from the client */
+            pl->messageLength = 0;
+            if (tty->readClients && pl->pasynUserRead && (armClient(tty, pl, EPOLL_CTL_ADD) < 0)) {
+                asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                        "drvAsynIPServerPort: %s can't wait for client: %s\n",
+                        pl->portName, strerror(errno));
+            }
+#endif
         }
     }
 }
@@ -574,6 +888,7 @@ int drvAsynIPServerPortConfigure(const char *portName,
     tty->UDPbuffer = NULL;
     tty->UDPbufferSize = 0;
     tty->UDPbufferPos = 0;
+    tty->epfd = -1;
     /*
      * Parse configuration parameters
      */
@@ -622,6 +937,9 @@ int drvAsynIPServerPortConfigure(const char *portName,
     tty->common.interfaceType = asynCommonType;
     tty->common.pinterface = &drvAsynIPServerPortCommon;
     tty->common.drvPvt = tty;
+    tty->option.interfaceType = asynOptionType;
+    tty->option.pinterface = (void *)&asynOptionMethods;
+    tty->option.drvPvt = tty;
     if (pasynManager->registerPort(tty->portName,
             ASYN_CANBLOCK,
             !noAutoConnect,
@@ -637,6 +955,12 @@ int drvAsynIPServerPortConfigure(const char *portName,
         ttyCleanup(tty);
         return -1;
     }
+    status = pasynManager->registerInterface(tty->portName, &tty->option);
+    if (status != asynSuccess) {
+        printf("drvAsynIPServerPortConfigure: Can't register option.\n");
+        ttyCleanup(tty);
+        return -1;
+    }
     if (tty->socketType != SOCK_DGRAM) {
         tty->int32.interfaceType = asynInt32Type;
         tty->int32.pinterface = &drvAsynIPServerPortInt32;
@@ -685,6 +1009,8 @@ int drvAsynIPServerPortConfigure(const char *portName,
         pl = &tty->portList[i];
         pl->portName = callocMustSucceed(1, len, "drvAsynIPServerPortConfigure");
         pl->fd = INVALID_SOCKET;
+        pl->index = i;
+        pl->tty = tty;
         epicsSnprintf(pl->portName, len, "%s:%d", tty->portName, i);
         /* Must create port with noAutoConnect, we manually connect with the file descriptor */
         status = drvAsynIPPortConfigure(pl->portName,
@@ -705,6 +1031,36 @@ int drvAsynIPServerPortConfigure(const char *portName,
                     pl->portName, pl->pasynUser->errorMessage);
             continue;
         }
+#ifdef USE_EPOLL
+        /* For readClients, reads the driver without the EOS interpose, which would pass
+         * the characters to the interrupt users as they are read, and frames them itself.
+         * The driver's receive buffer is not needed, clientRead reads all there is. */
+        if (tty->socketType != SOCK_DGRAM) {
+            asynUser *pasynUserRead = pasynManager->createAsynUser(clientRead, 0);
+            asynInterface *pasynInterface, *pasynInterfaceEos, *pasynInterfaceOption;
+            pasynUserRead->userPvt = pl;
+            pasynUserRead->timeout = 0;
+            if ((pasynManager->connectDevice(pasynUserRead, pl->portName, -1) != asynSuccess) ||
+                ((pasynInterface = pasynManager->findInterface(pasynUserRead, asynOctetType, 0)) == NULL) ||
+                ((pasynInterfaceEos = pasynManager->findInterface(pasynUserRead, asynOctetType, 1)) == NULL) ||
+                ((pasynInterfaceOption = pasynManager->findInterface(pasynUserRead, asynOptionType, 1)) == NULL) ||
+                (((asynOption *)pasynInterfaceOption->pinterface)->setOption(pasynInterfaceOption->drvPvt,
+                                                        pasynUserRead, "rxBufferSize", "0") != asynSuccess) ||
+                (pasynManager->getInterruptPvt(pasynUserRead, asynOctetType, &pl->interruptPvt) != asynSuccess)) {
+                asynPrint(tty->pasynUser, ASYN_TRACE_ERROR,
+                        "drvAsynIPServerPort: %s can't connect reader %s\n",
+                        pl->portName, pasynUserRead->errorMessage);
+                pasynManager->freeAsynUser(pasynUserRead);
+                continue;
+            }
+            pl->pasynOctet = (asynOctet *)pasynInterface->pinterface;
+            pl->octetPvt = pasynInterface->drvPvt;
+            pl->pasynOctetEos = (asynOctet *)pasynInterfaceEos->pinterface;
+            pl->octetEosPvt = pasynInterfaceEos->drvPvt;
+            pl->message = mallocMustSucceed(CLIENT_MESSAGE_SIZE + 1, "drvAsynIPServerPortConfigure");
+            pl->pasynUserRead = pasynUserRead;
+        }
+#endif
     }
 
     /* Start a thread listening on this port */
@@ -48,6 +48,9 @@ static asynStatus initialize(const char *portName,
            int interruptProcess);
 static void callInterruptUsers(asynUser *pasynUser,void *pasynPvt,
     char *data,size_t *nbytesTransfered,int *eomReason);
+static void interruptUsers(asynUser *pasynUser,void *pasynPvt,
+    char *data,size_t *nbytesTransfered,int *eomReason,
+    const epicsTimeStamp *ptime);
 
 static asynOctetBase octetBase = {initialize,callInterruptUsers};
 asynOctetBase *pasynOctetBase = &octetBase;
@@ -175,6 +178,14 @@ static asynStatus initialize(const char *portName,
 
 static void callInterruptUsers(asynUser *pasynUser,void *pasynPvt,
     char *data,size_t *nbytesTransfered,int *eomReason)
+{
+    interruptUsers(pasynUser,pasynPvt,data,nbytesTransfered,eomReason,0);
+}
+
+/* ptime is the time the driver received the data, or NULL if it did not set one */
+static void interruptUsers(asynUser *pasynUser,void *pasynPvt,
+    char *data,size_t *nbytesTransfered,int *eomReason,
+    const epicsTimeStamp *ptime)
 {
     asynStatus         status;
     ELLLIST            *plist;
@@ -202,6 +213,7 @@ static void callInterruptUsers(asynUser *pasynUser,void *pasynPvt,
     while (pnode) {
         pinterrupt = pnode->drvPvt;
         if(addr==pinterrupt->addr) {
+            if(ptime) pinterrupt->pasynUser->timestamp = *ptime;
             pinterrupt->callback(
                 pinterrupt->userPvt,pinterrupt->pasynUser,
                 data,*nbytesTransfered,*eomReason);
@@ -227,13 +239,25 @@ static asynStatus readIt(void *drvPvt, asynUser *pasynUser,
     octetPvt   *poctetPvt = (octetPvt *)drvPvt;
     asynOctet  *pasynOctet = poctetPvt->pasynOctet;
     asynStatus status;
-
+    epicsTimeStamp callerTime = pasynUser->timestamp;
+    int        driverTime;
+
+    /* A driver that knows when the data was received, like drvAsynIPPort with
+     * a packet ring, sets pasynUser->timestamp. Clear it first to tell. */
+    if(poctetPvt->interruptProcess) {
+        pasynUser->timestamp.secPastEpoch = 0;
+        pasynUser->timestamp.nsec = 0;
+    }
     status = pasynOctet->read(poctetPvt->drvPvt,pasynUser,
                                  data,maxchars,nbytesTransfered,eomReason);
+    if(!poctetPvt->interruptProcess) return status;
+    driverTime = pasynUser->timestamp.secPastEpoch!=0
+              || pasynUser->timestamp.nsec!=0;
+    if(!driverTime) pasynUser->timestamp = callerTime;
     if(status!=asynSuccess) return status;
-    if(poctetPvt->interruptProcess)
-        callInterruptUsers(pasynUser,poctetPvt->pasynPvt,
-            data,nbytesTransfered,eomReason);
+    interruptUsers(pasynUser,poctetPvt->pasynPvt,
+        data,nbytesTransfered,eomReason,
+        driverTime ? &pasynUser->timestamp : 0);
     return status;
 }
 
@@ -194,32 +194,61 @@ static asynStatus readIt(void *ppvt,asynUser *pasynUser,
     }
     for (;;) {
         if ((peosPvt->inBufTail != peosPvt->inBufHead)) {
-            char c = *data++ = peosPvt->inBuf[peosPvt->inBufTail++];
-            nRead++;
-            if (peosPvt->eosInLen > 0) {
-                if (c == peosPvt->eosIn[peosPvt->eosInMatch]) {
-                    if (++peosPvt->eosInMatch == peosPvt->eosInLen) {
-                        peosPvt->eosInMatch = 0;
-                        nRead -= peosPvt->eosInLen;
-                        data -= peosPvt->eosInLen;
-                        *(data+1) = 0;
-                        eom |= ASYN_EOM_EOS;
-                        break;
-                    }
-                } else {
-                    /*
-                     * Resynchronize the search.  Since the driver
-                     * allows a maximum two-character EOS it doesn't
-                     * have to worry about cases like:
-                     *    End-of-string is "eeef"
-                     *    Input stream so far is "eeeeeeeee"
-                     */
-                    if (c == peosPvt->eosIn[0]) {
-                        peosPvt->eosInMatch = 1;
-                    } else {
-                        peosPvt->eosInMatch = 0;
+            /*
+             * Find the first character of the EOS with memchr, then copy
+             * everything before the EOS with one memcpy.
+             */
+            const char *in = peosPvt->inBuf + peosPvt->inBufTail;
+            const char *end, *p;
+            size_t n = peosPvt->inBufHead - peosPvt->inBufTail;
+            size_t len, used;
+            int found = 0;
+
+            if (n > maxchars - nRead) n = maxchars - nRead;
+            end = in + n;
+            len = used = n;
+            if ((peosPvt->eosInLen == 2) && (peosPvt->eosInMatch == 1)) {
+                /* The previous input ended with the first character of the EOS */
+                peosPvt->eosInMatch = 0;
+                if (in[0] == peosPvt->eosIn[1]) {
+                    peosPvt->inBufTail++;
+                    if (nRead > 0) {
+                        nRead--;
+                        data--;
                     }
+                    eom |= ASYN_EOM_EOS;
+                    break;
+                }
+            }
+            p = in;
+            while ((peosPvt->eosInLen > 0) && (p < end) &&
+                   ((p = memchr(p, peosPvt->eosIn[0], end - p)) != NULL)) {
+                if (peosPvt->eosInLen == 1) {
+                    len = p - in;
+                    used = len + 1;
+                    found = 1;
+                    break;
+                }
+                if (p + 1 == end) {
+                    /* Might be the EOS, depending on the next character */
+                    peosPvt->eosInMatch = 1;
+                    break;
+                }
+                if (p[1] == peosPvt->eosIn[1]) {
+                    len = p - in;
+                    used = len + 2;
+                    found = 1;
+                    break;
                 }
+                p++;
+            }
+            memcpy(data, in, len);
+            data += len;
+            nRead += len;
+            peosPvt->inBufTail += (unsigned int)used;
+            if (found) {
+                eom |= ASYN_EOM_EOS;
+                break;
             }
             if (nRead >= maxchars)  {
                 eom = ASYN_EOM_CNT;
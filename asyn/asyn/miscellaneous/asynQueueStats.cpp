@@ -0,0 +1,297 @@
+/*
+ * asynQueueStats.cpp
+ *
+ * Asyn driver that inherits from the asynPortDriver class to make the queue
+ * statistics that asynManager keeps for another port available to records.
+ * The asyn address selects the queue priority: 0=low, 1=medium, 2=high, 3=connect.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include <epicsTypes.h>
+#include <epicsThread.h>
+#include <iocsh.h>
+
+#include <asynPortDriver.h>
+
+#include <epicsExport.h>
+
+static const char *driverName="asynQueueStats";
+
+/* These are the drvInfo strings that are used to identify the parameters.
+ * They are used by asyn clients, including standard asyn device support */
+#define P_RequestsString        "QUEUE_REQUESTS"        /* asynFloat64,      r/o */
+#define P_LatencyMeanString     "QUEUE_LATENCY_MEAN"    /* asynFloat64,      r/o */
+#define P_LatencyMaxString      "QUEUE_LATENCY_MAX"     /* asynFloat64,      r/o */
+#define P_ServiceMeanString     "QUEUE_SERVICE_MEAN"    /* asynFloat64,      r/o */
+#define P_ServiceMaxString      "QUEUE_SERVICE_MAX"     /* asynFloat64,      r/o */
+#define P_LatencyHistString     "QUEUE_LATENCY_HIST"    /* asynInt32Array,   r/o */
+#define P_ServiceHistString     "QUEUE_SERVICE_HIST"    /* asynInt32Array,   r/o */
+#define P_HistEdgesString       "QUEUE_HIST_EDGES"      /* asynFloat64Array, r/o */
+#define P_ResetString           "QUEUE_STATS_RESET"     /* asynInt32,        w   */
+
+#define NUM_PRIORITIES (asynQueuePriorityConnect+1)
+
+class asynQueueStatsDriver : public asynPortDriver {
+public:
+    asynQueueStatsDriver(const char *portName, const char *targetPortName, double pollPeriod);
+
+    /* These are the methods that we override from asynPortDriver */
+    virtual asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value);
+    virtual asynStatus readInt32Array(asynUser *pasynUser, epicsInt32 *value,
+                                      size_t nElements, size_t *nIn);
+    virtual asynStatus readFloat64Array(asynUser *pasynUser, epicsFloat64 *value,
+                                        size_t nElements, size_t *nIn);
+
+    /* These are the methods that are new to this class */
+    void pollTask(void);
+
+protected:
+    /** Values used for pasynUser->reason, and indexes into the parameter library. */
+    int P_Requests;
+    int P_LatencyMean;
+    int P_LatencyMax;
+    int P_ServiceMean;
+    int P_ServiceMax;
+    int P_LatencyHist;
+    int P_ServiceHist;
+    int P_HistEdges;
+    int P_Reset;
+
+private:
+    void update(void);
+    static void histogramToArray(const asynQueueHistogram *phistogram, epicsInt32 *array);
+    asynUser *pasynUserTarget_;
+    double pollPeriod_;
+    epicsInt32 latencyHist_[NUM_PRIORITIES][ASYN_QUEUE_HISTOGRAM_BINS];
+    epicsInt32 serviceHist_[NUM_PRIORITIES][ASYN_QUEUE_HISTOGRAM_BINS];
+    epicsFloat64 histEdges_[ASYN_QUEUE_HISTOGRAM_BINS];
+};
+
+static void pollTaskC(void *drvPvt)
+{
+    asynQueueStatsDriver *pPvt = (asynQueueStatsDriver *)drvPvt;
+    pPvt->pollTask();
+}
+
+/** Constructor for the asynQueueStatsDriver class.
+  * Calls constructor for the asynPortDriver base class.
+  * \param[in] portName The name of the asyn port driver to be created.
+  * \param[in] targetPortName The name of the ASYN_CANBLOCK port whose queue statistics are reported.
+  * \param[in] pollPeriod The time in seconds between reading the statistics. */
+asynQueueStatsDriver::asynQueueStatsDriver(const char *portName, const char *targetPortName,
+                                           double pollPeriod)
+   : asynPortDriver(portName,
+                    NUM_PRIORITIES, /* maxAddr */
+                    asynInt32Mask | asynFloat64Mask | asynInt32ArrayMask | asynFloat64ArrayMask | asynDrvUserMask, /* Interface mask */
+                    asynFloat64Mask | asynInt32ArrayMask,                   /* Interrupt mask */
+                    ASYN_MULTIDEVICE, /* asynFlags.  This driver does not block and it is multi-device */
+                    1, /* Autoconnect */
+                    0, /* Default priority */
+                    0), /* Default stack size*/
+     pollPeriod_(pollPeriod)
+{
+    asynStatus status;
+    asynQueueStats stats;
+    const char *functionName = "asynQueueStatsDriver";
+    int i;
+
+    memset(latencyHist_, 0, sizeof(latencyHist_));
+    memset(serviceHist_, 0, sizeof(serviceHist_));
+    histEdges_[0] = 0.;
+    for (i=1; i<ASYN_QUEUE_HISTOGRAM_BINS; i++) histEdges_[i] = (1ul<<(i-1))*1e-6;
+
+    createParam(P_RequestsString,       asynParamFloat64,       &P_Requests);
+    createParam(P_LatencyMeanString,    asynParamFloat64,       &P_LatencyMean);
+    createParam(P_LatencyMaxString,     asynParamFloat64,       &P_LatencyMax);
+    createParam(P_ServiceMeanString,    asynParamFloat64,       &P_ServiceMean);
+    createParam(P_ServiceMaxString,     asynParamFloat64,       &P_ServiceMax);
+    createParam(P_LatencyHistString,    asynParamInt32Array,    &P_LatencyHist);
+    createParam(P_ServiceHistString,    asynParamInt32Array,    &P_ServiceHist);
+    createParam(P_HistEdgesString,      asynParamFloat64Array,  &P_HistEdges);
+    createParam(P_ResetString,          asynParamInt32,         &P_Reset);
+
+    if (pollPeriod_ <= 0.) pollPeriod_ = 1.0;
+    pasynUserTarget_ = pasynManager->createAsynUser(0, 0);
+    status = pasynManager->connectDevice(pasynUserTarget_, targetPortName, -1);
+    if (status == asynSuccess) {
+        status = pasynManager->getQueueStats(pasynUserTarget_, asynQueuePriorityLow, &stats);
+    }
+    if (status) {
+        printf("%s::%s: port %s %s\n", driverName, functionName,
+               targetPortName, pasynUserTarget_->errorMessage);
+        return;
+    }
+    update();
+
+    /* Create the thread that reads the statistics in the background */
+    status = (asynStatus)(epicsThreadCreate("asynQueueStatsTask",
+                          epicsThreadPriorityLow,
+                          epicsThreadGetStackSize(epicsThreadStackMedium),
+                          (EPICSTHREADFUNC)::pollTaskC,
+                          this) == NULL);
+    if (status) {
+        printf("%s::%s: epicsThreadCreate failure\n", driverName, functionName);
+        return;
+    }
+}
+
+/** Converts the histogram counts to epicsInt32, limiting them to the largest epicsInt32 */
+void asynQueueStatsDriver::histogramToArray(const asynQueueHistogram *phistogram, epicsInt32 *array)
+{
+    int i;
+
+    for (i=0; i<ASYN_QUEUE_HISTOGRAM_BINS; i++) {
+        array[i] = (phistogram->bins[i] > 0x7fffffff) ? 0x7fffffff : (epicsInt32)phistogram->bins[i];
+    }
+}
+
+/** Reads the statistics for each priority and does callbacks for them.
+  * Must be called with the lock held. */
+void asynQueueStatsDriver::update(void)
+{
+    asynQueueStats stats;
+    int priority;
+
+    for (priority=0; priority<NUM_PRIORITIES; priority++) {
+        if (pasynManager->getQueueStats(pasynUserTarget_, (asynQueuePriority)priority, &stats)) continue;
+        setDoubleParam(priority, P_Requests,    (double)stats.latency.count);
+        setDoubleParam(priority, P_LatencyMean, stats.latency.count ? stats.latency.total/stats.latency.count : 0.);
+        setDoubleParam(priority, P_LatencyMax,  stats.latency.max);
+        setDoubleParam(priority, P_ServiceMean, stats.service.count ? stats.service.total/stats.service.count : 0.);
+        setDoubleParam(priority, P_ServiceMax,  stats.service.max);
+        callParamCallbacks(priority);
+        histogramToArray(&stats.latency, latencyHist_[priority]);
+        histogramToArray(&stats.service, serviceHist_[priority]);
+        doCallbacksInt32Array(latencyHist_[priority], ASYN_QUEUE_HISTOGRAM_BINS, P_LatencyHist, priority);
+        doCallbacksInt32Array(serviceHist_[priority], ASYN_QUEUE_HISTOGRAM_BINS, P_ServiceHist, priority);
+    }
+}
+
+/** Task that runs as a separate thread and reads the statistics every pollPeriod seconds. */
+void asynQueueStatsDriver::pollTask(void)
+{
+    lock();
+    while (1) {
+        unlock();
+        epicsThreadSleep(pollPeriod_);
+        lock();
+        update();
+    }
+}
+
+/** Called when asyn clients call pasynInt32->write().
+  * Writing QUEUE_STATS_RESET resets the statistics for all priorities.
+  * \param[in] pasynUser pasynUser structure that encodes the reason and address.
+  * \param[in] value Value to write. */
+asynStatus asynQueueStatsDriver::writeInt32(asynUser *pasynUser, epicsInt32 value)
+{
+    int function = pasynUser->reason;
+    asynStatus status = asynSuccess;
+    const char *functionName = "writeInt32";
+
+    if (function == P_Reset) {
+        if (value) {
+            status = pasynManager->resetQueueStats(pasynUserTarget_);
+            if (status == asynSuccess) update();
+        }
+    } else {
+        status = asynPortDriver::writeInt32(pasynUser, value);
+    }
+    if (status)
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                  "%s:%s: status=%d, function=%d, value=%d",
+                  driverName, functionName, status, function, value);
+    else
+        asynPrint(pasynUser, ASYN_TRACEIO_DRIVER,
+              "%s:%s: function=%d, value=%d\n",
+              driverName, functionName, function, value);
+    return status;
+}
+
+/** Called when asyn clients call pasynInt32Array->read().
+  * Returns the latency or service time histogram for the priority selected by the address.
+  * \param[in] pasynUser pasynUser structure that encodes the reason and address.
+  * \param[in] value Pointer to the array to read.
+  * \param[in] nElements Number of elements to read.
+  * \param[out] nIn Number of elements actually read. */
+asynStatus asynQueueStatsDriver::readInt32Array(asynUser *pasynUser, epicsInt32 *value,
+                                                size_t nElements, size_t *nIn)
+{
+    int function = pasynUser->reason;
+    int addr;
+    size_t nCopy = ASYN_QUEUE_HISTOGRAM_BINS;
+
+    getAddress(pasynUser, &addr);
+    if ((addr < 0) || (addr >= NUM_PRIORITIES)) addr = 0;
+    if (nElements < nCopy) nCopy = nElements;
+    if (function == P_LatencyHist) {
+        memcpy(value, latencyHist_[addr], nCopy*sizeof(epicsInt32));
+    } else if (function == P_ServiceHist) {
+        memcpy(value, serviceHist_[addr], nCopy*sizeof(epicsInt32));
+    } else {
+        return asynPortDriver::readInt32Array(pasynUser, value, nElements, nIn);
+    }
+    *nIn = nCopy;
+    return asynSuccess;
+}
+
+/** Called when asyn clients call pasynFloat64Array->read().
+  * Returns the lower edge of each histogram bin in seconds.
+  * \param[in] pasynUser pasynUser structure that encodes the reason and address.
+  * \param[in] value Pointer to the array to read.
+  * \param[in] nElements Number of elements to read.
+  * \param[out] nIn Number of elements actually read. */
+asynStatus asynQueueStatsDriver::readFloat64Array(asynUser *pasynUser, epicsFloat64 *value,
+                                                  size_t nElements, size_t *nIn)
+{
+    int function = pasynUser->reason;
+    size_t nCopy = ASYN_QUEUE_HISTOGRAM_BINS;
+
+    if (function != P_HistEdges) {
+        return asynPortDriver::readFloat64Array(pasynUser, value, nElements, nIn);
+    }
+    if (nElements < nCopy) nCopy = nElements;
+    memcpy(value, histEdges_, nCopy*sizeof(epicsFloat64));
+    *nIn = nCopy;
+    return asynSuccess;
+}
+
+/* Configuration routine.  Called directly, or from the iocsh function below */
+
+extern "C" {
+
+/** EPICS iocsh callable function to call constructor for the asynQueueStatsDriver class.
+  * \param[in] portName The name of the asyn port driver to be created.
+  * \param[in] targetPortName The name of the ASYN_CANBLOCK port whose queue statistics are reported.
+  * \param[in] pollPeriod The time in seconds between reading the statistics. */
+int asynQueueStatsConfigure(const char *portName, const char *targetPortName, double pollPeriod)
+{
+    new asynQueueStatsDriver(portName, targetPortName, pollPeriod);
+    return asynSuccess;
+}
+
+
+/* EPICS iocsh shell commands */
+
+static const iocshArg initArg0 = { "portName",iocshArgString};
+static const iocshArg initArg1 = { "target port name",iocshArgString};
+static const iocshArg initArg2 = { "poll period",iocshArgDouble};
+static const iocshArg * const initArgs[] = {&initArg0,
+                                            &initArg1,
+                                            &initArg2};
+static const iocshFuncDef initFuncDef = {"asynQueueStatsConfigure",3,initArgs};
+static void initCallFunc(const iocshArgBuf *args)
+{
+    asynQueueStatsConfigure(args[0].sval, args[1].sval, args[2].dval);
+}
+
+void asynQueueStatsRegister(void)
+{
+    iocshRegister(&initFuncDef,initCallFunc);
+}
+
+epicsExportRegistrar(asynQueueStatsRegister);
+
+}
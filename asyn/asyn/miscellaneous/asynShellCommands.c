@@ -948,6 +948,38 @@ static void asynSetTraceIOTruncateSizeCall(const iocshArgBuf * args) {
     asynSetTraceIOTruncateSize(portName,addr,size);
 }
 
+static const iocshArg asynSetTraceRingSizeArg0 = {"portName", iocshArgString};
+static const iocshArg asynSetTraceRingSizeArg1 = {"size", iocshArgInt};
+static const iocshArg *const asynSetTraceRingSizeArgs[] = {
+    &asynSetTraceRingSizeArg0,&asynSetTraceRingSizeArg1};
+static const iocshFuncDef asynSetTraceRingSizeDef =
+    {"asynSetTraceRingSize", 2, asynSetTraceRingSizeArgs};
+ASYN_API int
+ asynSetTraceRingSize(const char *portName,int size)
+{
+    asynUser *pasynUser;
+    asynStatus status;
+
+    pasynUser = pasynManager->createAsynUser(0,0);
+    status = pasynManager->connectDevice(pasynUser,portName,-1);
+    if(status!=asynSuccess) {
+        printf("%s\n",pasynUser->errorMessage);
+        pasynManager->freeAsynUser(pasynUser);
+        return -1;
+    }
+    status = pasynTrace->setTraceRingSize(pasynUser,(size<0) ? 0 : size);
+    if(status!=asynSuccess) {
+        printf("%s\n",pasynUser->errorMessage);
+    }
+    pasynManager->freeAsynUser(pasynUser);
+    return 0;
+}
+static void asynSetTraceRingSizeCall(const iocshArgBuf * args) {
+    const char *portName = args[0].sval;
+    int size = args[1].ival;
+    asynSetTraceRingSize(portName,size);
+}
+
 static const iocshArg asynEnableArg0 = {"portName", iocshArgString};
 static const iocshArg asynEnableArg1 = {"addr", iocshArgInt};
 static const iocshArg asynEnableArg2 = {"yesNo", iocshArgInt};
@@ -1169,6 +1201,16 @@ static void asynSetAutoConnectTimeoutCall(const iocshArgBuf * args) {
     pasynManager->setAutoConnectTimeout(timeout);
 }
 
+static const iocshArg asynSetSharedThreadsArg0 = {"numThreads", iocshArgInt};
+static const iocshArg *const asynSetSharedThreadsArgs[] = {
+    &asynSetSharedThreadsArg0};
+static const iocshFuncDef asynSetSharedThreadsDef =
+    {"asynSetSharedThreads", 1, asynSetSharedThreadsArgs};
+static void asynSetSharedThreadsCall(const iocshArgBuf * args) {
+    int numThreads = args[0].ival;
+    pasynManager->setSharedThreads(numThreads);
+}
+
 static const iocshArg asynRegisterTimeStampSourceArg0 = { "portName",iocshArgString};
 static const iocshArg asynRegisterTimeStampSourceArg1 = { "functionName",iocshArgString};
 static const iocshArg * const asynRegisterTimeStampSourceArgs[] = {
@@ -1328,6 +1370,7 @@ static void asynRegister(void)
     iocshRegister(&asynSetTraceInfoMaskDef,asynSetTraceInfoMaskCall);
     iocshRegister(&asynSetTraceFileDef,asynSetTraceFileCall);
     iocshRegister(&asynSetTraceIOTruncateSizeDef,asynSetTraceIOTruncateSizeCall);
+    iocshRegister(&asynSetTraceRingSizeDef,asynSetTraceRingSizeCall);
     iocshRegister(&asynEnableDef,asynEnableCall);
     iocshRegister(&asynAutoConnectDef,asynAutoConnectCall);
     iocshRegister(&asynSetQueueLockPortTimeoutDef,asynSetQueueLockPortTimeoutCall);
@@ -1343,6 +1386,7 @@ static void asynRegister(void)
     iocshRegister(&asynOctetGetOutputEosDef,asynOctetGetOutputEosCall);
     iocshRegister(&asynWaitConnectDef,asynWaitConnectCall);
     iocshRegister(&asynSetAutoConnectTimeoutDef,asynSetAutoConnectTimeoutCall);
+    iocshRegister(&asynSetSharedThreadsDef,asynSetSharedThreadsCall);
     iocshRegister(&asynRegisterTimeStampSourceDef, asynRegisterTimeStampSourceCall);
     iocshRegister(&asynUnregisterTimeStampSourceDef, asynUnregisterTimeStampSourceCall);
     iocshRegister(&asynSetMinTimerPeriodDef, asynSetMinTimerPeriodCall);
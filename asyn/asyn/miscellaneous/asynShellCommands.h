@@ -34,6 +34,8 @@ ASYN_API int
  asynSetTraceFile(const char *portName,int addr,const char *filename);
 ASYN_API int
  asynSetTraceIOTruncateSize(const char *portName,int addr,int size);
+ASYN_API int
+ asynSetTraceRingSize(const char *portName,int size);
 ASYN_API int
  asynAutoConnect(const char *portName,int addr,int yesNo);
 ASYN_API int
@@ -0,0 +1,11 @@
+#!/bin/sh
+# Measures the rate of scalar callbacks into device support.
+# The array callbacks are turned off and each burst is done without delay.
+# Usage: doBenchmark.sh [burstLength]
+caput testARB:A1:ArrayCallbacks 0
+caput testARB:A1:BurstDelay 0
+caput testARB:A1:BurstLength ${1:-100000}
+caput testARB:A1:Run 1
+sleep 5
+caput testARB:A1:Run 0
+caget testARB:A1:BurstLength_RBV testARB:A1:BurstTime_RBV testARB:A1:CallbackRate_RBV testARB:A1:ScalarReceived
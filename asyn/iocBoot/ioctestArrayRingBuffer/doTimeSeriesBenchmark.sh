@@ -0,0 +1,16 @@
+#!/bin/sh
+# Measures the rate of scalar callbacks acquired by asynInt32TimeSeries.
+# ScalarTimeSeries is armed and then filled by bursts without delay. It is complete
+# when NORD is 100000 and BUSY is 0. The values are the counter in the burst, so with
+# the default burst length the waveform is 0,1,2,... if no values were lost.
+# Usage: doTimeSeriesBenchmark.sh [burstLength]
+caput testARB:A1:ArrayCallbacks 0
+caput testARB:A1:BurstDelay 0
+caput testARB:A1:BurstLength ${1:-100000}
+caput testARB:A1:ScalarTimeSeries.RARM 1
+caput testARB:A1:Run 1
+sleep 5
+caput testARB:A1:Run 0
+caget testARB:A1:BurstLength_RBV testARB:A1:BurstTime_RBV testARB:A1:CallbackRate_RBV
+caget testARB:A1:ScalarTimeSeries.NORD testARB:A1:ScalarTimeSeries.BUSY
+caget -# 5 testARB:A1:ScalarTimeSeries
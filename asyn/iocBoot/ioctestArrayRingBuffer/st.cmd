@@ -6,7 +6,7 @@ testArrayRingBuffer_registerRecordDeviceDriver(pdbbase)
 
 testArrayRingBufferConfigure("testARB", 100)
 
-dbLoadRecords("../../db/testArrayRingBuffer.db","P=testARB:,R=A1:,PORT=testARB,ADDR=0,TIMEOUT=1,NELM=100,RING_SIZE=10")
+dbLoadRecords("../../db/testArrayRingBuffer.db","P=testARB:,R=A1:,PORT=testARB,ADDR=0,TIMEOUT=1,NELM=100,RING_SIZE=10,TS_NELM=100000,PRETRIGGER=100")
 dbLoadRecords("../../db/asynRecord.db","P=testARB:,R=asyn1,PORT=testARB,ADDR=0,OMAX=80,IMAX=80")
 #asynSetTraceMask("testARB",0,0x21)
 #asynSetTraceMask("testARB",0,0xFF)
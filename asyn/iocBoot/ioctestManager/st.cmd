@@ -11,6 +11,8 @@ testManagerDriverInit("canBlockMulti",1,0,1)
 #testManagerDriverInit("cantBlockMulti",0,1,1)
 #testManagerDriverInit("canBlockSingle",1,1,0)
 #testManagerDriverInit("canBlockMulti",1,1,1)
+# for testManagerStress, a multiDevice port with 256 devices
+#testManagerDriverInit("stressMulti",1,0,1,256)
 
 #asynSetTraceMask("cantBlockSingle",0,0xff)
 #asynSetTraceMask("canBlockSingle",-1,0xff)
@@ -18,3 +20,5 @@ testManagerDriverInit("canBlockMulti",1,0,1)
 
 dbLoadRecords("../../db/asynRecord.db","P=asyn,R=Record,PORT=cantBlockSingle,ADDR=0,OMAX=0,IMAX=0")
 iocInit()
+# queue throughput with 256 addresses, 16 requests each, 128 of them disabled
+#testManagerStress("stressMulti",256,16,128,"")
@@ -14,6 +14,7 @@
 #include <epicsTypes.h>
 #include <epicsThread.h>
 #include <epicsEvent.h>
+#include <epicsTime.h>
 #include <iocsh.h>
 
 #include <asynPortDriver.h>
@@ -32,6 +33,9 @@ static const char *driverName="testArrayRingBuffer";
 #define P_BurstDelayString         "BURST_DELAY"         /* asynFloat64,  r/w */
 #define P_ScalarDataString         "SCALAR_DATA"         /* asynInt32,    r/w */
 #define P_ArrayDataString          "ARRAY_DATA"          /* asynInt32Array,  r/w */
+#define P_ArrayCallbacksString     "ARRAY_CALLBACKS"     /* asynInt32,    r/w */
+#define P_BurstTimeString          "BURST_TIME"          /* asynFloat64,  r/o */
+#define P_CallbackRateString       "CALLBACK_RATE"       /* asynFloat64,  r/o */
 
 class testArrayRingBuffer : public asynPortDriver {
 public:
@@ -55,6 +59,9 @@ protected:
     int P_BurstDelay;
     int P_ScalarData;
     int P_ArrayData;
+    int P_ArrayCallbacks;
+    int P_BurstTime;
+    int P_CallbackRate;
 
 private:
     /* Our data */
@@ -100,10 +107,14 @@ testArrayRingBuffer::testArrayRingBuffer(const char *portName, int maxArrayLengt
     createParam(P_BurstDelayString,         asynParamFloat64,       &P_BurstDelay);
     createParam(P_ScalarDataString,         asynParamInt32,         &P_ScalarData);
     createParam(P_ArrayDataString,          asynParamInt32Array,    &P_ArrayData);
+    createParam(P_ArrayCallbacksString,     asynParamInt32,         &P_ArrayCallbacks);
+    createParam(P_BurstTimeString,          asynParamFloat64,       &P_BurstTime);
+    createParam(P_CallbackRateString,       asynParamFloat64,       &P_CallbackRate);
 
     /* Set the initial values of some parameters */
     setIntegerParam(P_MaxArrayLength,    maxArrayLength);
     setIntegerParam(P_ArrayLength,       maxArrayLength);
+    setIntegerParam(P_ArrayCallbacks,    1);
 
     /* Create the thread that does the array callbacks in the background */
     status = (asynStatus)(epicsThreadCreate("testArrayRingBufferTask",
@@ -120,7 +131,11 @@ testArrayRingBuffer::testArrayRingBuffer(const char *portName, int maxArrayLengt
 
 
 /** Array generation ask that runs as a separate thread.  When the P_RunStop parameter is set to 1
-  * it periodically generates a burst of arrays. */
+  * it periodically generates a burst of arrays.
+  * The time taken by each burst and the resulting number of callbacks per second are put
+  * in P_BurstTime and P_CallbackRate, to measure the cost of the callbacks into device support.
+  * Setting P_ArrayCallbacks to 0 does only the scalar callbacks, which measures the ring
+  * buffer of the scalar records. */
 void testArrayRingBuffer::arrayGenTask(void)
 {
     double loopDelay;
@@ -130,6 +145,9 @@ void testArrayRingBuffer::arrayGenTask(void)
     double burstDelay;
     epicsInt32 maxArrayLength;
     epicsInt32 arrayLength;
+    epicsInt32 arrayCallbacks;
+    epicsTimeStamp startTime, endTime;
+    double burstTime;
 
     lock();
     /* Loop forever */
@@ -153,16 +171,25 @@ void testArrayRingBuffer::arrayGenTask(void)
             setIntegerParam(P_ArrayLength, arrayLength);
         }
         getIntegerParam(P_BurstLength, &burstLength);
+        getIntegerParam(P_ArrayCallbacks, &arrayCallbacks);
+        epicsTimeGetCurrent(&startTime);
         for (i=0; i<burstLength; i++) {
-            for (j=0; j<arrayLength; j++) {
-                pData_[j] = i;
-            }
             setIntegerParam(P_ScalarData, i);
             callParamCallbacks();
-            doCallbacksInt32Array(pData_, arrayLength, P_ArrayData, 0);
+            if (arrayCallbacks) {
+                for (j=0; j<arrayLength; j++) {
+                    pData_[j] = i;
+                }
+                doCallbacksInt32Array(pData_, arrayLength, P_ArrayData, 0);
+            }
             if (burstDelay > 0.0)
                 epicsThreadSleep(burstDelay);
         }
+        epicsTimeGetCurrent(&endTime);
+        burstTime = epicsTimeDiffInSeconds(&endTime, &startTime);
+        setDoubleParam(P_BurstTime, burstTime);
+        setDoubleParam(P_CallbackRate, (burstTime > 0.0) ? burstLength/burstTime : 0.0);
+        callParamCallbacks();
     }
 }
 
@@ -20,6 +20,7 @@
 #include <epicsMutex.h>
 #include <epicsEvent.h>
 #include <epicsStdio.h>
+#include <epicsTime.h>
 #include <epicsAssert.h>
 #include <asynDriver.h>
 #include <asynOctet.h>
@@ -455,6 +456,124 @@ static void testManager(const char *port,int addr,FILE *file)
     }
 }
 
+typedef struct stressInfo {
+    epicsEventId gateStarted;
+    epicsEventId gate;
+    epicsEventId done;
+    int          nLeft;
+}stressInfo;
+
+/* All callbacks are called by the port thread, so nLeft needs no lock */
+static void stressCallback(asynUser *pasynUser)
+{
+    stressInfo *pstressInfo = (stressInfo *)pasynUser->userPvt;
+
+    if(--pstressInfo->nLeft==0) epicsEventSignal(pstressInfo->done);
+}
+
+static void stressGateCallback(asynUser *pasynUser)
+{
+    stressInfo *pstressInfo = (stressInfo *)pasynUser->userPvt;
+
+    epicsEventSignal(pstressInfo->gateStarted);
+    epicsEventMustWait(pstressInfo->gate);
+}
+
+/* Queue nPerAddr requests for each of nAddr addresses while the port thread
+ * is held by a gate request, then time how long the port thread takes to
+ * call them all. The requests for the first nDisabled addresses are queued
+ * first and those devices are disabled, so the port thread must pass over
+ * them. They are called after the devices are enabled again.
+ */
+static void testManagerStress(const char *port,int nAddr,int nPerAddr,
+    int nDisabled,FILE *file)
+{
+    stressInfo info;
+    asynUser   **ppasynUser;
+    asynUser   *pasynUserGate;
+    asynStatus status;
+    epicsTimeStamp start,end;
+    double     seconds;
+    int        nUsers,nEnabled,yesNo;
+    int        addr,i;
+
+    if(nAddr<=0 || nPerAddr<=0) {
+        fprintf(file,"nAddr and nPerAddr must be > 0\n");
+        return;
+    }
+    if(nDisabled<0 || nDisabled>nAddr) nDisabled = 0;
+    nUsers = nAddr*nPerAddr;
+    nEnabled = (nAddr-nDisabled)*nPerAddr;
+    info.gateStarted = epicsEventMustCreate(epicsEventEmpty);
+    info.gate = epicsEventMustCreate(epicsEventEmpty);
+    info.done = epicsEventMustCreate(epicsEventEmpty);
+    info.nLeft = nEnabled;
+    pasynUserGate = pasynManager->createAsynUser(stressGateCallback,0);
+    pasynUserGate->userPvt = &info;
+    status = pasynManager->connectDevice(pasynUserGate,port,-1);
+    if(status!=asynSuccess) {
+        fprintf(file,"connectDevice failed %s\n",pasynUserGate->errorMessage);
+        pasynManager->freeAsynUser(pasynUserGate);
+        return;
+    }
+    pasynManager->canBlock(pasynUserGate,&yesNo);
+    if(!yesNo) {
+        fprintf(file,"port %s can not block so no stress test\n",port);
+        pasynManager->freeAsynUser(pasynUserGate);
+        return;
+    }
+    ppasynUser = callocMustSucceed(nUsers,sizeof(asynUser *),"testManagerStress");
+    for(i=0; i<nUsers; i++) {
+        addr = i/nPerAddr;
+        ppasynUser[i] = pasynManager->createAsynUser(stressCallback,0);
+        ppasynUser[i]->userPvt = &info;
+        status = pasynManager->connectDevice(ppasynUser[i],port,addr);
+        if(status!=asynSuccess) {
+            fprintf(file,"connectDevice addr %d failed %s\n",
+                addr,ppasynUser[i]->errorMessage);
+            return;
+        }
+    }
+    status = pasynManager->queueRequest(pasynUserGate,asynQueuePriorityHigh,0.0);
+    if(status!=asynSuccess) {
+        fprintf(file,"queueRequest failed %s\n",pasynUserGate->errorMessage);
+        return;
+    }
+    epicsEventMustWait(info.gateStarted);
+    for(addr=0; addr<nDisabled; addr++)
+        pasynManager->enable(ppasynUser[addr*nPerAddr],0);
+    for(i=0; i<nUsers; i++) {
+        status = pasynManager->queueRequest(ppasynUser[i],asynQueuePriorityLow,0.0);
+        if(status!=asynSuccess) {
+            fprintf(file,"queueRequest failed %s\n",ppasynUser[i]->errorMessage);
+            return;
+        }
+    }
+    epicsTimeGetCurrent(&start);
+    epicsEventSignal(info.gate);
+    epicsEventMustWait(info.done);
+    epicsTimeGetCurrent(&end);
+    seconds = epicsTimeDiffInSeconds(&end,&start);
+    fprintf(file,"port %s %d addresses %d requests per address %d disabled\n",
+        port,nAddr,nPerAddr,nDisabled);
+    fprintf(file,"    %d requests in %f seconds, %.0f requests/second\n",
+        nEnabled,seconds,(seconds>0.0) ? nEnabled/seconds : 0.0);
+    if(nDisabled>0) {
+        info.nLeft = nUsers - nEnabled;
+        for(addr=0; addr<nDisabled; addr++)
+            pasynManager->enable(ppasynUser[addr*nPerAddr],1);
+        epicsEventMustWait(info.done);
+        fprintf(file,"    %d requests for disabled addresses called after enable\n",
+            nUsers - nEnabled);
+    }
+    for(i=0; i<nUsers; i++) pasynManager->freeAsynUser(ppasynUser[i]);
+    free(ppasynUser);
+    pasynManager->freeAsynUser(pasynUserGate);
+    epicsEventDestroy(info.gateStarted);
+    epicsEventDestroy(info.gate);
+    epicsEventDestroy(info.done);
+}
+
 static const iocshArg testManagerArg0 = {"port", iocshArgString};
 static const iocshArg testManagerArg1 = {"addr", iocshArgInt};
 static const iocshArg testManagerArg2 = {"reportFile", iocshArgString};
@@ -503,6 +622,31 @@ static void testManagerAllPortsCall(const iocshArgBuf * args)
     if(file!=stdout) fclose(file);
 }
 
+static const iocshArg testManagerStressArg0 = {"port", iocshArgString};
+static const iocshArg testManagerStressArg1 = {"nAddr", iocshArgInt};
+static const iocshArg testManagerStressArg2 = {"nPerAddr", iocshArgInt};
+static const iocshArg testManagerStressArg3 = {"nDisabled", iocshArgInt};
+static const iocshArg testManagerStressArg4 = {"reportFile", iocshArgString};
+static const iocshArg *const testManagerStressArgs[] = {
+    &testManagerStressArg0,&testManagerStressArg1,&testManagerStressArg2,
+    &testManagerStressArg3,&testManagerStressArg4};
+static const iocshFuncDef testManagerStressDef = {"testManagerStress", 5, testManagerStressArgs};
+static void testManagerStressCall(const iocshArgBuf * args)
+{
+    char *filename = args[4].sval;
+    FILE *file = stdout;
+
+    if(filename && strlen(filename)>0) {
+        file = fopen(filename,"w");
+        if(!file) {
+            printf("could not open %s %s\n",filename,strerror(errno));
+            return;
+        }
+    }
+    testManagerStress(args[0].sval,args[1].ival,args[2].ival,args[3].ival,file);
+    if(file!=stdout) fclose(file);
+}
+
 static void testManagerRegister(void)
 {
     static int firstTime = 1;
@@ -510,5 +654,6 @@ static void testManagerRegister(void)
     firstTime = 0;
     iocshRegister(&testManagerDef,testManagerCall);
     iocshRegister(&testManagerAllPortsDef,testManagerAllPortsCall);
+    iocshRegister(&testManagerStressDef,testManagerStressCall);
 }
 epicsExportRegistrar(testManagerRegister);
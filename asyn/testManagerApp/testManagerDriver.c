@@ -30,7 +30,8 @@
 #define NUM_DEVICES 2
 
 typedef struct testManagerPvt {
-    int           deviceConnected[NUM_DEVICES];
+    int           *deviceConnected;
+    int           numDevices;
     const char    *portName;
     int           connected;
     int           multiDevice;
@@ -39,7 +40,7 @@ typedef struct testManagerPvt {
 
 /* init routine */
 static int testManagerDriverInit(const char *dn, int canBlock,
-    int noAutoConnect,int multiDevice);
+    int noAutoConnect,int multiDevice,int numDevices);
 
 /* asynCommon methods */
 static void report(void *drvPvt,FILE *fp,int details);
@@ -48,7 +49,7 @@ static asynStatus disconnect(void *drvPvt,asynUser *pasynUser);
 static asynCommon asyn = { report, connect, disconnect };
 
 static int testManagerDriverInit(const char *dn, int canBlock,
-    int noAutoConnect,int multiDevice)
+    int noAutoConnect,int multiDevice,int numDevices)
 {
     testManagerPvt    *ptestManagerPvt;
     char       *portName;
@@ -56,9 +57,13 @@ static int testManagerDriverInit(const char *dn, int canBlock,
     size_t     nbytes;
     int        attributes;
 
-    nbytes = sizeof(testManagerPvt) + strlen(dn) + 1;
+    /* numDevices is only given for tests that need many devices, e.g. testManagerStress */
+    if(numDevices<=0) numDevices = NUM_DEVICES;
+    nbytes = sizeof(testManagerPvt) + numDevices*sizeof(int) + strlen(dn) + 1;
     ptestManagerPvt = callocMustSucceed(nbytes,sizeof(char),"testManagerDriverInit");
-    portName = (char *)(ptestManagerPvt + 1);
+    ptestManagerPvt->deviceConnected = (int *)(ptestManagerPvt + 1);
+    ptestManagerPvt->numDevices = numDevices;
+    portName = (char *)(ptestManagerPvt->deviceConnected + numDevices);
     strcpy(portName,dn);
     ptestManagerPvt->portName = portName;
     ptestManagerPvt->multiDevice = multiDevice;
@@ -91,7 +96,7 @@ static void report(void *drvPvt,FILE *fp,int details)
         "multiDevice:%s connected:%s\n",
         (ptestManagerPvt->multiDevice ? "Yes" : "No"),
         (ptestManagerPvt->connected ? "Yes" : "No"));
-    n = (ptestManagerPvt->multiDevice) ? NUM_DEVICES : 1;
+    n = (ptestManagerPvt->multiDevice) ? ptestManagerPvt->numDevices : 1;
     for(i=0;i<n;i++) {
        fprintf(fp,"        device %d connected:%s\n",
             i,
@@ -132,7 +137,7 @@ static asynStatus connect(void *drvPvt,asynUser *pasynUser)
         pasynManager->exceptionConnect(pasynUser);
         return asynSuccess;
     }
-    if(addr>=NUM_DEVICES) {
+    if(addr>=ptestManagerPvt->numDevices) {
         asynPrint(pasynUser,ASYN_TRACE_ERROR,
             "%s testManagerDriver:connect illegal addr %d\n",ptestManagerPvt->portName,addr);
         return asynError;
@@ -181,7 +186,7 @@ static asynStatus disconnect(void *drvPvt,asynUser *pasynUser)
         pasynManager->exceptionDisconnect(pasynUser);
         return asynSuccess;
     }
-    if(addr>=NUM_DEVICES) {
+    if(addr>=ptestManagerPvt->numDevices) {
         asynPrint(pasynUser,ASYN_TRACE_ERROR,
             "%s testManagerDriver:disconnect illegal addr %d\n",ptestManagerPvt->portName,addr);
         return asynError;
@@ -202,14 +207,17 @@ static const iocshArg testManagerDriverInitArg0 = { "portName", iocshArgString }
 static const iocshArg testManagerDriverInitArg1 = { "canBlock", iocshArgInt };
 static const iocshArg testManagerDriverInitArg2 = { "disable auto-connect", iocshArgInt };
 static const iocshArg testManagerDriverInitArg3 = { "multiDevice", iocshArgInt };
+static const iocshArg testManagerDriverInitArg4 = { "numDevices", iocshArgInt };
 static const iocshArg *testManagerDriverInitArgs[] = {
     &testManagerDriverInitArg0,&testManagerDriverInitArg1,
-    &testManagerDriverInitArg2,&testManagerDriverInitArg3};
+    &testManagerDriverInitArg2,&testManagerDriverInitArg3,
+    &testManagerDriverInitArg4};
 static const iocshFuncDef testManagerDriverInitFuncDef = {
-    "testManagerDriverInit", 4, testManagerDriverInitArgs};
+    "testManagerDriverInit", 5, testManagerDriverInitArgs};
 static void testManagerDriverInitCallFunc(const iocshArgBuf *args)
 {
-    testManagerDriverInit(args[0].sval,args[1].ival,args[2].ival,args[3].ival);
+    testManagerDriverInit(args[0].sval,args[1].ival,args[2].ival,args[3].ival,
+        args[4].ival);
 }
 
 static void testManagerDriverRegister(void)